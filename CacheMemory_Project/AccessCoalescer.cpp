@@ -0,0 +1,104 @@
+/**
+ *  @file       AccessCoalescer.cpp
+ *  @brief      CAccessCoalescer class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <limits>
+
+#include "VirtualAddress.h"
+#include "AccessCoalescer.h"
+
+CAccessCoalescer::CAccessCoalescer ( ) noexcept
+{
+    Init ( );
+};
+
+void CAccessCoalescer::Init (void) noexcept
+{
+    m_qwHead     = 0;
+    m_qwTail     = 0;
+    m_qwAccesses = 0;
+    m_qwRecords  = 0;
+    for (size_t i = 0; i < req::g_4WAY_CACHE_SETS; i++)
+    {
+        m_rgOpen[i]      = g_NO_RECORD;
+        m_rgLastBlock[i] = g_NO_RECORD;
+    }
+}
+
+bool CAccessCoalescer::Append (const TRACE_RECORD& record, std::vector<TRACE_RECORD>& vecOut)
+{
+    const QWORD qwBlock = record.qwAddress & ~static_cast<QWORD>(req::g_CACHE_BLOCK_SIZE - 1);
+
+    // an address wider than a pointer is passed on unmapped, for the replay
+    // to refuse
+    const void* pAddress = nullptr;
+    CVirtualAddress::FromTraceAddress (record.qwAddress, pAddress);
+
+    CVirtualAddress vAddress (pAddress);
+    const DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+    const bool      bMapped = dwIndex < req::g_4WAY_CACHE_SETS;
+
+    m_qwAccesses += 1 + static_cast<QWORD>(record.dwRepeat);
+
+    if ( bMapped && (m_rgLastBlock[dwIndex] == qwBlock) && (m_rgOpen[dwIndex] != g_NO_RECORD) )
+    {
+        DWORD& dwRepeat = m_rgWindow[m_rgOpen[dwIndex] % g_COALESCE_WINDOW].dwRepeat;
+        if ( record.dwRepeat < std::numeric_limits<DWORD>::max() - dwRepeat )
+        {
+            dwRepeat += 1 + record.dwRepeat;
+            return true;
+        }
+    }
+
+    // a new record, closing the set's previous run
+    if ( bMapped && (m_rgOpen[dwIndex] != g_NO_RECORD) )
+        m_rgClosed[m_rgOpen[dwIndex] % g_COALESCE_WINDOW] = true;
+
+    if ( m_qwTail - m_qwHead == g_COALESCE_WINDOW )
+        Release (vecOut);
+
+    const size_t nSlot = static_cast<size_t>(m_qwTail % g_COALESCE_WINDOW);
+    m_rgWindow[nSlot]              = record;
+    m_rgWindow[nSlot].dwDependency = 0;
+    m_rgClosed[nSlot]              = !bMapped;
+    if ( bMapped )
+    {
+        m_rgOpen[dwIndex]      = m_qwTail;
+        m_rgLastBlock[dwIndex] = qwBlock;
+    }
+    m_qwTail++;
+    m_qwRecords++;
+
+    // pass on every closed record at the head
+    while ( (m_qwHead < m_qwTail) && m_rgClosed[m_qwHead % g_COALESCE_WINDOW] )
+        Release (vecOut);
+
+    return false;
+}
+
+void CAccessCoalescer::Flush (std::vector<TRACE_RECORD>& vecOut)
+{
+    while ( m_qwHead < m_qwTail )
+        Release (vecOut);
+}
+
+void CAccessCoalescer::Release (std::vector<TRACE_RECORD>& vecOut)
+{
+    const size_t nSlot = static_cast<size_t>(m_qwHead % g_COALESCE_WINDOW);
+
+    // releasing an open record closes its run; the set's last block is kept
+    for (auto& it : m_rgOpen)
+    {
+        if ( it == m_qwHead )
+            it = g_NO_RECORD;
+    }
+
+    vecOut.push_back (m_rgWindow[nSlot]);
+    m_qwHead++;
+}
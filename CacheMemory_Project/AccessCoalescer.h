@@ -0,0 +1,120 @@
+/**
+ *  @file       AccessCoalescer.h
+ *  @brief      CAccessCoalescer class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_ACCESS_COALESCER_H__)
+#define _ACCESS_COALESCER_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#if !defined(_CACHE_TRACE_H__)
+    #include "CacheTrace.h"
+#endif
+
+/// events held back waiting for more accesses to fold in
+constexpr size_t g_COALESCE_WINDOW = 64;
+
+/**
+ *  Folds accesses that are certain to hit into counted trace records, so a
+ *  replay decodes and searches a set once per run instead of once per access.
+ *
+ *  An access to the block last accessed in its set is a hit under every
+ *  replacement policy the simulator implements: the block was resident
+ *  after that access, and only an access to the same set can evict it.
+ *  Such an access is folded into the record of that earlier access, whose
+ *  dwRepeat counts it.  A run of accesses to one cache block, eight
+ *  consecutive ints in a 32 byte line, thus becomes a single record.
+ *
+ *  Sets are simulated independently, so records of different sets may be
+ *  reordered without changing any outcome.  The coalescer holds up to
+ *  g_COALESCE_WINDOW records back in order of their first access, letting
+ *  accesses to other sets pass while a run is still open, and releases the
+ *  oldest once a later access to its set closes it or the window is full.
+ *  Within a set the order of records is kept, which is all FIFO needs and
+ *  all the next-use order of Belady's OPT depends on.
+ *
+ *  A record keeps the timestamp of its first access.  Record distances
+ *  change, so dependency hints are dropped.  The timing of a coalesced
+ *  trace is therefore lost, and CBeladySimulator refuses to feed one to a
+ *  timing model (-replay).  Addresses that decode to no set are passed
+ *  through unchanged.
+ *
+ *  This is a trace stage.  A live CCacheManager has its own same block
+ *  fast path in GetCacheData, which still reports every access.
+ *
+ *  All of this assumes the trace has the cache to itself.  When traces
+ *  share a cache (CSharedCache) the repeats are replayed one by one, but
+ *  the reordering across sets still changes how the traces interleave, so
+ *  shared results differ slightly from those of the original traces.
+ */
+class CAccessCoalescer
+{
+    /// no record of the set is open
+    static constexpr QWORD g_NO_RECORD = ~static_cast<QWORD>(0);
+
+    TRACE_RECORD    m_rgWindow[g_COALESCE_WINDOW];
+    bool            m_rgClosed[g_COALESCE_WINDOW];
+    QWORD           m_qwHead;                       ///< sequence number of the oldest record held
+    QWORD           m_qwTail;                       ///< sequence number of the next record
+    QWORD           m_rgOpen[req::g_4WAY_CACHE_SETS];       ///< open record of every set
+    QWORD           m_rgLastBlock[req::g_4WAY_CACHE_SETS];  ///< block last accessed in every set
+    QWORD           m_qwAccesses;
+    QWORD           m_qwRecords;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CAccessCoalescer ( ) noexcept;
+
+/**
+    Discards any record held back and forgets every set's last block
+ */
+    void Init (void) noexcept;
+
+/**
+    Adds an access, or a record that already carries repeats
+
+    @param [in]  record         access to add
+    @param [out] vecOut         records released, appended to
+
+    @retval true      if the access was folded into an earlier record
+    @retval false     if it started a record of its own
+ */
+    bool Append (const TRACE_RECORD& record, std::vector<TRACE_RECORD>& vecOut);
+
+/**
+    Releases every record held back, closing all runs
+
+    @param [out] vecOut         records released, appended to
+ */
+    void Flush  (std::vector<TRACE_RECORD>& vecOut);
+
+/**
+    Returns the number of accesses added, repeats included
+ */
+    constexpr QWORD get_Accesses (void) const noexcept
+    { return m_qwAccesses; };
+
+/**
+    Returns the number of records released or held back
+ */
+    constexpr QWORD get_Records  (void) const noexcept
+    { return m_qwRecords; };
+
+private:
+
+    void Release (std::vector<TRACE_RECORD>& vecOut);
+};
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ *  @file       AddressRegistry.cpp
+ *  @brief      CAddressRegistry class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "VirtualAddress.h"
+#include "CacheSet.h"
+#include "AddressRegistry.h"
+
+CAddressRegistry::CAddressRegistry ( )
+    : m_vecRanges    ( ),
+      m_vecNames     (1, "<unregistered>"),
+      m_vecStats     (1, OBJECT_STATS ( )),
+      m_mapEvictions ( )
+{
+};
+
+DWORD CAddressRegistry::Register (const char* szName, const void* pBase, size_t cbLen)
+{
+    DWORD_PTR dwBase = reinterpret_cast<DWORD_PTR>(pBase);
+    DWORD_PTR dwEnd  = dwBase + cbLen;
+
+    if ( (szName == nullptr) || (cbLen == 0) || (dwEnd < dwBase) )
+        return g_UNREGISTERED_OBJECT;
+
+    // first range that starts at or after the new one
+    auto it = std::lower_bound (m_vecRanges.begin(), m_vecRanges.end(), dwBase,
+                                [](const CRange& r, DWORD_PTR dw) { return r.dwBase < dw; });
+
+    if ( ((it != m_vecRanges.end()) && (it->dwBase < dwEnd)) ||
+         ((it != m_vecRanges.begin()) && ((it - 1)->dwEnd > dwBase)) )
+        return g_UNREGISTERED_OBJECT;
+
+    DWORD dwObject = static_cast<DWORD>(m_vecNames.size());
+    m_vecRanges.insert (it, CRange { dwBase, dwEnd, dwObject });
+    m_vecNames.push_back (szName);
+    m_vecStats.push_back (OBJECT_STATS ( ));
+
+    return dwObject;
+}
+
+DWORD CAddressRegistry::Lookup (DWORD_PTR dwAddress) const noexcept
+{
+    // last range that starts at or before the address
+    auto it = std::upper_bound (m_vecRanges.begin(), m_vecRanges.end(), dwAddress,
+                                [](DWORD_PTR dw, const CRange& r) { return dw < r.dwBase; });
+
+    if ( (it != m_vecRanges.begin()) && (dwAddress < (it - 1)->dwEnd) )
+        return (it - 1)->dwObject;
+
+    return g_UNREGISTERED_OBJECT;
+}
+
+QWORD CAddressRegistry::get_Evictions (DWORD dwEvictor, DWORD dwVictim, DWORD_PTR dwIndex) const
+{
+    auto it = m_mapEvictions.find (CEvictionKey { dwEvictor, dwVictim, dwIndex });
+    return (it != m_mapEvictions.end()) ? it->second : 0;
+}
+
+void CAddressRegistry::OnCacheAccess (const void* pAddress, DWORD_PTR /* dwIndex */, bool bHit)
+{
+    OBJECT_STATS& stats = m_vecStats[Lookup (reinterpret_cast<DWORD_PTR>(pAddress))];
+    if ( bHit )
+        stats.qwHits++;
+    else
+        stats.qwMisses++;
+}
+
+void CAddressRegistry::OnCacheFill (const void* pAddress, DWORD_PTR dwIndex,
+                                    DWORD_PTR dwEvictedTag)
+{
+    if ( dwEvictedTag == NO_EVICTION )
+        return;
+
+    DWORD dwEvictor = Lookup (reinterpret_cast<DWORD_PTR>(pAddress));
+    // only the tag of the evicted block is left, not the address it was
+    // loaded for, so attribute it by the address of its first byte
+    DWORD dwVictim  = Lookup (CVirtualAddress::EncodeAddress (dwEvictedTag, dwIndex));
+
+    m_vecStats[dwEvictor].qwEvictionsCaused++;
+    m_vecStats[dwVictim].qwEvictionsSuffered++;
+    m_mapEvictions[CEvictionKey { dwEvictor, dwVictim, dwIndex }]++;
+}
+
+std::ostream& CAddressRegistry::Report (std::ostream& os) const
+{
+    os << std::dec << std::setfill (' ');
+    os << "Object attribution" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    os << std::left  << std::setw(16) << "Object" << std::right
+       << std::setw(10) << "Hits"
+       << std::setw(10) << "Misses"
+       << std::setw(10) << "Evicts"
+       << std::setw(10) << "Evicted" << std::endl;
+
+    for (size_t i = 0; i < m_vecNames.size(); i++)
+    {
+        const OBJECT_STATS& stats = m_vecStats[i];
+        if ( (i == g_UNREGISTERED_OBJECT) &&
+             !(stats.qwHits || stats.qwMisses || stats.qwEvictionsCaused || stats.qwEvictionsSuffered) )
+            continue;
+
+        os << std::left  << std::setw(16) << m_vecNames[i] << std::right
+           << std::setw(10) << stats.qwHits
+           << std::setw(10) << stats.qwMisses
+           << std::setw(10) << stats.qwEvictionsCaused
+           << std::setw(10) << stats.qwEvictionsSuffered << std::endl;
+    }
+
+    os << std::endl;
+    os << "Eviction matrix (evictor -> victim)" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    for (const auto& it : m_mapEvictions)
+    {
+        os << "   " << m_vecNames[it.first.dwEvictor] << " evicted "
+           << m_vecNames[it.first.dwVictim] << " in set " << it.first.dwIndex
+           << ": " << it.second << std::endl;
+    }
+
+    return os;
+}
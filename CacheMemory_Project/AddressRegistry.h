@@ -0,0 +1,157 @@
+/**
+ *  @file       AddressRegistry.h
+ *  @brief      CAddressRegistry class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_ADDRESS_REGISTRY_H__)
+#define _ADDRESS_REGISTRY_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _MAP_
+    #include <map>
+#endif
+
+#ifndef _STRING_
+    #include <string>
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#if !defined(_CACHE_OBSERVER_H__)
+    #include "CacheObserver.h"
+#endif
+
+/// object id of accesses that do not fall within any registered range
+constexpr DWORD g_UNREGISTERED_OBJECT = 0;
+
+/**
+ *  Per object attribution counters
+ */
+struct OBJECT_STATS
+{
+    QWORD   qwHits;             ///< cache hits on the object
+    QWORD   qwMisses;           ///< cache misses on the object
+    QWORD   qwEvictionsCaused;  ///< blocks evicted by loads of the object
+    QWORD   qwEvictionsSuffered;///< blocks of the object evicted by any load
+};
+
+/**
+ *  Registry of named address ranges (arrays, heap objects, mapped regions)
+ *  that attributes every cache hit, miss and eviction to an object.
+ *
+ *  Ranges are kept sorted by base address, so attributing an address is a
+ *  binary search.  As a cache observer, the registry also records which
+ *  object evicted which, per cache set, e.g. "A evicted B in set 2", which
+ *  shows the data structures that conflict with one another and are the
+ *  candidates for padding or splitting.
+ */
+class CAddressRegistry : public ICacheObserver
+{
+    struct CRange
+    {
+        DWORD_PTR   dwBase;
+        DWORD_PTR   dwEnd;      ///< one past the last byte
+        DWORD       dwObject;
+    };
+
+    /// eviction matrix key: evicting object, evicted object, cache set
+    struct CEvictionKey
+    {
+        DWORD       dwEvictor;
+        DWORD       dwVictim;
+        DWORD_PTR   dwIndex;
+
+        bool operator < (const CEvictionKey& rhs) const noexcept
+        {
+            if ( dwEvictor != rhs.dwEvictor ) return dwEvictor < rhs.dwEvictor;
+            if ( dwVictim  != rhs.dwVictim )  return dwVictim  < rhs.dwVictim;
+            return dwIndex < rhs.dwIndex;
+        };
+    };
+
+    std::vector<CRange>             m_vecRanges;    ///< sorted by dwBase
+    std::vector<std::string>        m_vecNames;     ///< indexed by object id
+    std::vector<OBJECT_STATS>       m_vecStats;     ///< indexed by object id
+    std::map<CEvictionKey, QWORD>   m_mapEvictions;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CAddressRegistry ( );
+
+/**
+    Registers a named address range
+
+    @param [in] szName          name used in reports
+    @param [in] pBase           first byte of the range
+    @param [in] cbLen           count of bytes (cb) in the range
+
+    @retval object id (> 0)             on success
+    @retval g_UNREGISTERED_OBJECT       if the range is empty or overlaps
+                                        a range already registered
+ */
+    DWORD Register (const char* szName, const void* pBase, size_t cbLen);
+
+/**
+    Finds the object an address belongs to
+
+    @param [in] dwAddress       address to attribute
+
+    @retval object id                   if the address is registered
+    @retval g_UNREGISTERED_OBJECT       otherwise
+ */
+    DWORD Lookup (DWORD_PTR dwAddress) const noexcept;
+
+/**
+    Returns the name of an object
+ */
+    const std::string& get_Name  (DWORD dwObject) const
+    { return m_vecNames[dwObject]; };
+
+/**
+    Returns the attribution counters of an object
+ */
+    const OBJECT_STATS& get_Stats (DWORD dwObject) const
+    { return m_vecStats[dwObject]; };
+
+/**
+    Returns how often dwEvictor evicted a block of dwVictim in set dwIndex
+ */
+    QWORD get_Evictions (DWORD dwEvictor, DWORD dwVictim, DWORD_PTR dwIndex) const;
+
+/**
+    Writes the per object counters and the eviction matrix
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os) const;
+
+/**
+    Counts a hit or miss against the object holding the address
+ */
+    virtual void OnCacheAccess (const void* pAddress, DWORD_PTR dwIndex, bool bHit) override;
+
+/**
+    Counts an eviction caused by the object holding the loaded address and
+    suffered by the object holding the first byte of the evicted block;
+    fills into an empty way are ignored
+ */
+    virtual void OnCacheFill   (const void* pAddress, DWORD_PTR dwIndex,
+                                DWORD_PTR dwEvictedTag) override;
+
+private:
+
+    CAddressRegistry (const CAddressRegistry& rhs) = delete;
+    CAddressRegistry& operator = (const CAddressRegistry& rhs) = delete;
+};
+
+#endif
@@ -0,0 +1,277 @@
+/**
+ *  @file       AssociativeCache.cpp
+ *  @brief      CAssociativeSet and CAssociativeCache class implementations
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <iomanip>
+
+#include "AssociativeCache.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// CAssociativeSet
+
+CAssociativeSet::CAssociativeSet ( ) noexcept
+    : m_vecWays    ( ),
+      m_vecTable   ( ),
+      m_nTableMask (0),
+      m_nFilled    (0),
+      m_dwNewest   (g_ASSOC_NO_WAY),
+      m_dwOldest   (g_ASSOC_NO_WAY),
+      m_ePolicy    (REPLACE_FIFO)
+{
+};
+
+bool CAssociativeSet::Init (size_t nWays, REPLACEMENT_POLICY ePolicy /* = REPLACE_FIFO */,
+                            size_t nHashThreshold /* = g_ASSOC_HASH_THRESHOLD */)
+{
+    if ( (nWays == 0) || (nWays > g_ASSOC_MAX_WAYS) ||
+         ((ePolicy != REPLACE_FIFO) && (ePolicy != REPLACE_LRU)) )
+        return false;
+
+    m_vecWays.assign (nWays, CWay { 0, g_ASSOC_NO_WAY, g_ASSOC_NO_WAY });
+    m_nFilled  = 0;
+    m_dwNewest = g_ASSOC_NO_WAY;
+    m_dwOldest = g_ASSOC_NO_WAY;
+    m_ePolicy  = ePolicy;
+
+    m_nTableMask = 0;
+    m_vecTable.clear ( );
+    if ( nWays > nHashThreshold )
+    {
+        // at least twice the ways, keeping the probe runs short
+        size_t nSlots = 1;
+        while ( nSlots < 2 * nWays )
+            nSlots <<= 1;
+        m_vecTable.assign (nSlots, g_ASSOC_NO_WAY);
+        m_nTableMask = nSlots - 1;
+    }
+    return true;
+}
+
+DWORD CAssociativeSet::FindWay (QWORD qwTag) const noexcept
+{
+    if ( m_nTableMask == 0 )
+    {
+        for (size_t i = 0; i < m_nFilled; i++)
+        {
+            if ( m_vecWays[i].qwTag == qwTag )
+                return static_cast<DWORD>(i);
+        }
+        return g_ASSOC_NO_WAY;
+    }
+
+    for (size_t nSlot = HashSlot (qwTag); ; nSlot = (nSlot + 1) & m_nTableMask)
+    {
+        DWORD dwWay = m_vecTable[nSlot];
+        if ( (dwWay == g_ASSOC_NO_WAY) || (m_vecWays[dwWay].qwTag == qwTag) )
+            return dwWay;
+    }
+}
+
+void CAssociativeSet::Unlink (DWORD dwWay) noexcept
+{
+    CWay& way = m_vecWays[dwWay];
+
+    if ( way.dwNewer != g_ASSOC_NO_WAY )
+        m_vecWays[way.dwNewer].dwOlder = way.dwOlder;
+    else
+        m_dwNewest = way.dwOlder;
+
+    if ( way.dwOlder != g_ASSOC_NO_WAY )
+        m_vecWays[way.dwOlder].dwNewer = way.dwNewer;
+    else
+        m_dwOldest = way.dwNewer;
+
+    way.dwNewer = g_ASSOC_NO_WAY;
+    way.dwOlder = g_ASSOC_NO_WAY;
+}
+
+void CAssociativeSet::LinkNewest (DWORD dwWay) noexcept
+{
+    CWay& way = m_vecWays[dwWay];
+
+    way.dwNewer = g_ASSOC_NO_WAY;
+    way.dwOlder = m_dwNewest;
+    if ( m_dwNewest != g_ASSOC_NO_WAY )
+        m_vecWays[m_dwNewest].dwNewer = dwWay;
+    else
+        m_dwOldest = dwWay;
+    m_dwNewest = dwWay;
+}
+
+void CAssociativeSet::HashInsert (DWORD dwWay) noexcept
+{
+    size_t nSlot = HashSlot (m_vecWays[dwWay].qwTag);
+    while ( m_vecTable[nSlot] != g_ASSOC_NO_WAY )
+        nSlot = (nSlot + 1) & m_nTableMask;
+    m_vecTable[nSlot] = dwWay;
+}
+
+/**
+    @note Backward shift deletion: every entry after the hole in the same
+    probe run that would still be found from its home slot through the hole
+    is moved into it, so lookups never need to skip deleted entries.
+*/
+void CAssociativeSet::HashRemove (DWORD dwWay) noexcept
+{
+    size_t nHole = HashSlot (m_vecWays[dwWay].qwTag);
+    while ( m_vecTable[nHole] != dwWay )
+        nHole = (nHole + 1) & m_nTableMask;
+
+    for (size_t nSlot = (nHole + 1) & m_nTableMask; m_vecTable[nSlot] != g_ASSOC_NO_WAY;
+         nSlot = (nSlot + 1) & m_nTableMask)
+    {
+        size_t nHome = HashSlot (m_vecWays[m_vecTable[nSlot]].qwTag);
+        // move the entry unless its home lies cyclically in (nHole, nSlot]
+        if ( ((nSlot - nHome) & m_nTableMask) >= ((nSlot - nHole) & m_nTableMask) )
+        {
+            m_vecTable[nHole] = m_vecTable[nSlot];
+            nHole = nSlot;
+        }
+    }
+    m_vecTable[nHole] = g_ASSOC_NO_WAY;
+}
+
+bool CAssociativeSet::AccessCacheTag (QWORD qwTag) noexcept
+{
+    DWORD dwWay = FindWay (qwTag);
+    if ( dwWay == g_ASSOC_NO_WAY )
+        return false;
+
+    if ( (m_ePolicy == REPLACE_LRU) && (dwWay != m_dwNewest) )
+    {
+        Unlink (dwWay);
+        LinkNewest (dwWay);
+    }
+    return true;
+}
+
+bool CAssociativeSet::LoadCacheTag (QWORD qwTag, QWORD* pqwEvictedTag /* = nullptr */) noexcept
+{
+    // every Tag value is possible (a 1 byte block of a 1 set cache keeps the
+    // whole address), so an eviction is reported apart from the Tag
+    DWORD dwWay;
+    bool  bEvicted = false;
+    if ( m_nFilled < m_vecWays.size() )
+    {
+        dwWay = static_cast<DWORD>(m_nFilled++);
+    }
+    else
+    {
+        bEvicted = true;
+        dwWay    = m_dwOldest;
+        if ( pqwEvictedTag )
+            *pqwEvictedTag = m_vecWays[dwWay].qwTag;
+        if ( m_nTableMask != 0 )
+            HashRemove (dwWay);
+        Unlink (dwWay);
+    }
+
+    m_vecWays[dwWay].qwTag = qwTag;
+    if ( m_nTableMask != 0 )
+        HashInsert (dwWay);
+    LinkNewest (dwWay);
+    return bEvicted;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CAssociativeCache
+
+CAssociativeCache::CAssociativeCache ( ) noexcept
+    : m_rgSets       ( ),
+      m_nSets        (0),
+      m_dwOffsetBits (0),
+      m_dwIndexBits  (0),
+      m_qwHits       (0),
+      m_qwMisses     (0),
+      m_qwEvictions  (0)
+{
+};
+
+bool CAssociativeCache::Init (size_t nSets, size_t nWays, size_t cbBlock /* = req::g_CACHE_BLOCK_SIZE */,
+                              REPLACEMENT_POLICY ePolicy /* = REPLACE_FIFO */,
+                              size_t nHashThreshold /* = g_ASSOC_HASH_THRESHOLD */)
+{
+    if ( (nSets == 0) || ((nSets & (nSets - 1)) != 0) ||
+         (cbBlock == 0) || ((cbBlock & (cbBlock - 1)) != 0) )
+        return false;
+
+    m_rgSets.reset (new CAssociativeSet[nSets]);
+    m_nSets = nSets;
+    for (size_t i = 0; i < nSets; i++)
+    {
+        if ( !m_rgSets[i].Init (nWays, ePolicy, nHashThreshold) )
+        {
+            m_rgSets.reset ( );
+            m_nSets = 0;
+            return false;
+        }
+    }
+
+    m_dwOffsetBits = 0;
+    while ( (static_cast<size_t>(1) << m_dwOffsetBits) < cbBlock )
+        m_dwOffsetBits++;
+    m_dwIndexBits = 0;
+    while ( (static_cast<size_t>(1) << m_dwIndexBits) < nSets )
+        m_dwIndexBits++;
+
+    m_qwHits      = 0;
+    m_qwMisses    = 0;
+    m_qwEvictions = 0;
+    return true;
+}
+
+bool CAssociativeCache::Access (QWORD qwAddress) noexcept
+{
+    if ( (qwAddress == 0) || (m_nSets == 0) )
+        return false;
+
+    const QWORD     qwBlock = qwAddress >> m_dwOffsetBits;
+    const size_t    nIndex  = static_cast<size_t>(qwBlock & (m_nSets - 1));
+    const QWORD     qwTag   = qwBlock >> m_dwIndexBits;
+
+    CAssociativeSet& cacheSet = m_rgSets[nIndex];
+    if ( cacheSet.AccessCacheTag (qwTag) )
+    {
+        m_qwHits++;
+        return true;
+    }
+
+    m_qwMisses++;
+    if ( cacheSet.LoadCacheTag (qwTag) )
+        m_qwEvictions++;
+    return false;
+}
+
+std::ostream& CAssociativeCache::Report (std::ostream& os) const
+{
+    const QWORD qwAccesses = m_qwHits + m_qwMisses;
+    const bool  bValid     = m_nSets > 0;
+
+    os << std::dec << std::setfill (' ');
+    os << "Associative cache" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    if ( bValid )
+    {
+        os << "Geometry:          " << m_nSets << " sets x " << m_rgSets[0].get_Ways ( ) << " ways x "
+           << (static_cast<size_t>(1) << m_dwOffsetBits) << " bytes" << std::endl;
+        os << "Policy:            " << ((m_rgSets[0].get_Policy ( ) == REPLACE_LRU) ? "LRU" : "FIFO")
+           << (m_rgSets[0].is_Hashed ( ) ? ", hashed lookup" : ", linear lookup") << std::endl;
+    }
+    os << "Cache Misses:      " << m_qwMisses    << std::endl;
+    os << "Cache Hits:        " << m_qwHits      << std::endl;
+    os << "Evictions:         " << m_qwEvictions << std::endl;
+    if ( qwAccesses )
+    {
+        os << "Miss Rate:         " << std::fixed << std::setprecision(4)
+           << 100.0 * m_qwMisses / qwAccesses << "%" << std::endl;
+        os.unsetf (std::ios::floatfield);
+    }
+
+    return os;
+}
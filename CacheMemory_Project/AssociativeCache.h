@@ -0,0 +1,222 @@
+/**
+ *  @file       AssociativeCache.h
+ *  @brief      CAssociativeSet and CAssociativeCache class interfaces
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_ASSOCIATIVE_CACHE_H__)
+#define _ASSOCIATIVE_CACHE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _MEMORY_
+    #include <memory>
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+#if !defined(_CACHE_SET_H__)
+    #include "CacheSet.h"
+#endif
+
+/// sets with more ways than this look their Tags up in a hash table
+constexpr size_t g_ASSOC_HASH_THRESHOLD = 32;
+/// most ways a set may have
+constexpr size_t g_ASSOC_MAX_WAYS       = 1024 * 1024;
+/// end of a replacement list, or an empty hash slot
+constexpr DWORD  g_ASSOC_NO_WAY         = 0xFFFFFFFF;
+
+/**
+ *  Tag-only cache set whose associativity is chosen at run time, from a
+ *  handful of ways up to a fully associative buffer of a million entries.
+ *
+ *  The replacement order is an intrusive doubly linked list threaded
+ *  through the ways, newest (or most recently used) first: a fill links a
+ *  way at the head and evicts the tail, and under REPLACE_LRU a hit moves
+ *  its way back to the head, all in constant time.
+ *
+ *  Up to nHashThreshold ways the Tags are simply compared one after
+ *  another, as CCacheSet does.  Above it an open addressing hash table
+ *  (linear probing, at most half full) maps every resident Tag to its way,
+ *  so a lookup costs a probe or two whatever the associativity; an evicted
+ *  Tag is removed by shifting its probe run back, leaving no tombstones.
+ *
+ *  Tags are QWORDs whatever the pointer size, as the traces it replays
+ *  hold 64 bit addresses even for a 32 bit build.
+ */
+class CAssociativeSet
+{
+    struct CWay
+    {
+        QWORD       qwTag;
+        DWORD       dwNewer;        ///< towards the head of the list
+        DWORD       dwOlder;        ///< towards the tail of the list
+    };
+
+    std::vector<CWay>   m_vecWays;
+    std::vector<DWORD>  m_vecTable;     ///< way holding each Tag, empty below the threshold
+    size_t              m_nTableMask;
+    size_t              m_nFilled;      ///< ways holding a Tag, filled in order
+    DWORD               m_dwNewest;
+    DWORD               m_dwOldest;
+    REPLACEMENT_POLICY  m_ePolicy;
+
+public:
+/**
+ *  Default Constructor, Init must be called before use
+ */
+    CAssociativeSet ( ) noexcept;
+
+/**
+    Allocates the ways, all of them empty
+
+    @param [in] nWays           associativity, 1 to g_ASSOC_MAX_WAYS
+    @param [in] ePolicy         REPLACE_FIFO or REPLACE_LRU
+    @param [in] nHashThreshold  most ways still searched linearly
+
+    @retval true      on success
+    @retval false     on an invalid way count or policy
+ */
+    bool Init (size_t nWays, REPLACEMENT_POLICY ePolicy = REPLACE_FIFO,
+               size_t nHashThreshold = g_ASSOC_HASH_THRESHOLD);
+
+/**
+    Looks up a Tag, under REPLACE_LRU making its way the most recently used
+
+    @param [in] qwTag           Tag associated with the cache block
+
+    @retval true      on cache hit
+    @retval false     on cache miss
+ */
+    bool AccessCacheTag (QWORD qwTag) noexcept;
+
+/**
+    Associates a way with qwTag, evicting the oldest (FIFO) or least
+    recently used (LRU) Tag once every way is filled
+
+    @param [in]  qwTag          Tag to load, not currently resident
+    @param [out] pqwEvictedTag  optional, receives the Tag that was replaced,
+                                left unchanged if the way was empty
+
+    @retval true      if a Tag was evicted
+    @retval false     if an empty way was filled
+ */
+    bool LoadCacheTag   (QWORD qwTag, QWORD* pqwEvictedTag = nullptr) noexcept;
+
+    size_t get_Ways (void) const noexcept
+    { return m_vecWays.size(); };
+
+    constexpr REPLACEMENT_POLICY get_Policy (void) const noexcept
+    { return m_ePolicy; };
+
+    constexpr bool is_Hashed (void) const noexcept
+    { return m_nTableMask != 0; };
+
+private:
+
+    DWORD FindWay    (QWORD qwTag) const noexcept;
+    void  Unlink     (DWORD dwWay) noexcept;
+    void  LinkNewest (DWORD dwWay) noexcept;
+    void  HashInsert (DWORD dwWay) noexcept;
+    void  HashRemove (DWORD dwWay) noexcept;
+
+    size_t HashSlot  (QWORD qwTag) const noexcept
+    { return static_cast<size_t>((qwTag * 0x9E3779B97F4A7C15ull) >> 32) & m_nTableMask; };
+
+    CAssociativeSet (const CAssociativeSet& rhs) = delete;
+    CAssociativeSet& operator = (const CAssociativeSet& rhs) = delete;
+};
+
+/**
+ *  Tag-only cache of any geometry built from CAssociativeSet, for replaying
+ *  traces through structures far larger or more associative than the 4-way
+ *  cache of the assignment: a fully associative TLB is a single set, a
+ *  shadow cache for sizing studies one with thousands of ways.
+ *
+ *  Addresses are decoded from the geometry given to Init; address 0 is
+ *  skipped, as CVirtualAddress does not decode it.
+ */
+class CAssociativeCache
+{
+    std::unique_ptr<CAssociativeSet[]>  m_rgSets;
+    size_t                              m_nSets;
+    DWORD                               m_dwOffsetBits;
+    DWORD                               m_dwIndexBits;
+    QWORD                               m_qwHits;
+    QWORD                               m_qwMisses;
+    QWORD                               m_qwEvictions;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CAssociativeCache ( ) noexcept;
+
+/**
+    Allocates an empty cache
+
+    @param [in] nSets           number of sets, a power of 2
+    @param [in] nWays           ways per set, 1 to g_ASSOC_MAX_WAYS
+    @param [in] cbBlock         block size in bytes, a power of 2
+    @param [in] ePolicy         REPLACE_FIFO or REPLACE_LRU
+    @param [in] nHashThreshold  most ways still searched linearly
+
+    @retval true      on success
+    @retval false     on an invalid geometry or policy
+ */
+    bool Init (size_t nSets, size_t nWays, size_t cbBlock = req::g_CACHE_BLOCK_SIZE,
+               REPLACEMENT_POLICY ePolicy = REPLACE_FIFO,
+               size_t nHashThreshold = g_ASSOC_HASH_THRESHOLD);
+
+/**
+    Accesses an address, filling its block on a miss
+
+    @param [in] qwAddress       memory address accessed
+
+    @retval true      on a hit
+    @retval false     on a miss, or for address 0
+ */
+    bool Access (QWORD qwAddress) noexcept;
+
+/**
+    Records accesses certain to hit, such as the repeats folded into a
+    coalesced trace record
+
+    @param [in] qwHits          number of hits
+ */
+    void AddHits (QWORD qwHits) noexcept
+    { m_qwHits += qwHits; };
+
+    constexpr QWORD get_CacheHits   (void) const noexcept
+    { return m_qwHits; };
+
+    constexpr QWORD get_CacheMisses (void) const noexcept
+    { return m_qwMisses; };
+
+    constexpr QWORD get_Evictions   (void) const noexcept
+    { return m_qwEvictions; };
+
+/**
+    Writes the geometry and the outcome of the accesses
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os) const;
+
+private:
+
+    CAssociativeCache (const CAssociativeCache& rhs) = delete;
+    CAssociativeCache& operator = (const CAssociativeCache& rhs) = delete;
+};
+
+#endif
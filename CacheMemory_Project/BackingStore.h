@@ -0,0 +1,51 @@
+/**
+ *  @file       BackingStore.h
+ *  @brief      IBackingStore interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_BACKING_STORE_H__)
+#define _BACKING_STORE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+/**
+ *  Memory behind a CCacheManager, which fills cache blocks from it and
+ *  writes data through to it, see CCacheManager::set_BackingStore
+ */
+class IBackingStore
+{
+public:
+    virtual ~IBackingStore ( )
+    { };
+
+ /**
+    Reads a range of memory
+
+    @param [in]  qwAddress      address of the first byte
+    @param [out] pBuffer        receives cbLen bytes
+    @param [in]  cbLen          count of bytes (cb) to read
+
+    @retval true      on success
+    @retval false     on error
+ */
+    virtual bool Read  (QWORD qwAddress, void* pBuffer, size_t cbLen) = 0;
+
+ /**
+    Writes a range of memory
+
+    @param [in] qwAddress       address of the first byte
+    @param [in] pData           cbLen bytes to write
+    @param [in] cbLen           count of bytes (cb) to write
+
+    @retval true      on success
+    @retval false     on error
+ */
+    virtual bool Write (QWORD qwAddress, const void* pData, size_t cbLen) = 0;
+};
+
+#endif
@@ -0,0 +1,238 @@
+/**
+ *  @file       BeladySimulator.cpp
+ *  @brief      CBeladySimulator class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <memory.h>
+#include <algorithm>
+#include <unordered_map>
+
+#include "VirtualAddress.h"
+#include "CacheTrace.h"
+#include "CacheTiming.h"
+#include "BeladySimulator.h"
+
+/// smallest chunk processed, regardless of the memory budget
+constexpr size_t g_OPT_MIN_CHUNK = 1024;
+/// approximate cost of a last-use table entry (key, position, node and bucket)
+constexpr size_t g_OPT_LAST_USE_ENTRY = 48;
+
+static size_t ChunkRecords (size_t cbBudget) noexcept
+{
+    return std::max (g_OPT_MIN_CHUNK, cbBudget / (sizeof(TRACE_RECORD) + sizeof(DWORD)));
+}
+
+/// lookahead window, the table holds up to twice as many entries between purges
+static QWORD LookaheadRecords (size_t cbBudget) noexcept
+{
+    return std::min<QWORD> (g_NEXT_USE_FAR,
+                            std::max (g_OPT_MIN_CHUNK, cbBudget / (2 * g_OPT_LAST_USE_ENTRY)));
+}
+
+static void InitNextUseHeader (NEXT_USE_HEADER& hdr, QWORD qwRecords) noexcept
+{
+    memset (&hdr, 0, sizeof(hdr));
+
+    hdr.dwMagic     = g_NEXT_USE_MAGIC;
+    hdr.dwVersion   = g_NEXT_USE_VERSION;
+    hdr.cbHeader    = sizeof(NEXT_USE_HEADER);
+    hdr.dwBlockSize = req::g_CACHE_BLOCK_SIZE;
+    hdr.qwRecords   = qwRecords;
+}
+
+/**
+    @note The trace is walked from the last chunk to the first, and within a
+    chunk from the last record to the first, while a table maps every block
+    seen so far to the position of its most recent (i.e. next, in program
+    order) access.  Each chunk of distances is written at its own offset, so
+    the side file ends up in forward order.
+
+    Distances of a lookahead window or more are saturated, so a block whose
+    last use lies that far ahead can be dropped from the table: whenever it
+    reaches twice the window, the entries beyond the window are purged.  At
+    most a window's worth of blocks survive a purge, so the table stays
+    within the memory budget whatever the footprint of the trace.
+*/
+bool CBeladySimulator::BuildNextUse (const TCHAR* szTrace, const TCHAR* szNextUse,
+                                     size_t cbBudget /* = g_OPT_MEMORY_BUDGET */)
+{
+    CCacheTraceReader trace;
+    if ( (szNextUse == nullptr) || !trace.Open (szTrace) )
+        return false;
+
+    std::ofstream ofs (szNextUse, std::ios::out | std::ios::binary | std::ios::trunc);
+    if ( !ofs.is_open() )
+        return false;
+
+    const QWORD qwRecords = trace.get_Records ( );
+    const QWORD qwMask    = ~static_cast<QWORD>(req::g_CACHE_BLOCK_SIZE - 1);
+    const size_t nChunk   = ChunkRecords (cbBudget);
+    const QWORD qwWindow  = LookaheadRecords (cbBudget);
+
+    NEXT_USE_HEADER hdr;
+    InitNextUseHeader (hdr, qwRecords);
+    ofs.write (reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+
+    std::unordered_map<QWORD, QWORD> mapLastUse;   // block address -> position
+    std::vector<TRACE_RECORD>        vecRecords;
+    std::vector<DWORD>               vecDistance;
+
+    QWORD qwEnd = qwRecords;
+    while ( qwEnd > 0 )
+    {
+        size_t nCount  = static_cast<size_t>(std::min<QWORD> (nChunk, qwEnd));
+        QWORD  qwFirst = qwEnd - nCount;
+
+        if ( !trace.Read (qwFirst, nCount, vecRecords) )
+            return false;
+
+        vecDistance.resize (nCount);
+        for (size_t i = nCount; i-- > 0; )
+        {
+            QWORD qwPosition = qwFirst + i;
+            QWORD qwBlock    = vecRecords[i].qwAddress & qwMask;
+
+            auto it = mapLastUse.find (qwBlock);
+            if ( it == mapLastUse.end() )
+            {
+                // never reused, or not within the window if purged
+                vecDistance[i] = (qwPosition + qwWindow < qwRecords) ? g_NEXT_USE_FAR : 0;
+                mapLastUse.emplace (qwBlock, qwPosition);
+            }
+            else
+            {
+                QWORD qwDistance = it->second - qwPosition;
+                vecDistance[i]   = (qwDistance < qwWindow) ? static_cast<DWORD>(qwDistance)
+                                                           : g_NEXT_USE_FAR;
+                it->second       = qwPosition;
+            }
+
+            if ( mapLastUse.size() >= 2 * qwWindow )
+            {
+                for (auto itPurge = mapLastUse.begin(); itPurge != mapLastUse.end(); )
+                {
+                    if ( itPurge->second - qwPosition >= qwWindow )
+                        itPurge = mapLastUse.erase (itPurge);
+                    else
+                        ++itPurge;
+                }
+            }
+        }
+
+        ofs.seekp (static_cast<std::streamoff>(sizeof(NEXT_USE_HEADER) + qwFirst * sizeof(DWORD)));
+        ofs.write (reinterpret_cast<const char*>(vecDistance.data()), nCount * sizeof(DWORD));
+        if ( ofs.fail() )
+            return false;
+
+        qwEnd = qwFirst;
+    }
+
+    return true;
+}
+
+bool CBeladySimulator::Run (const TCHAR* szTrace, const TCHAR* szNextUse, REPLACEMENT_POLICY ePolicy,
+                            size_t cbBudget /* = g_OPT_MEMORY_BUDGET */)
+{
+    m_qwCacheHits   = 0;
+    m_qwCacheMisses = 0;
+
+    CCacheTraceReader trace;
+    if ( !trace.Open (szTrace) )
+        return false;
+
+    const QWORD qwRecords = trace.get_Records ( );
+
+    std::ifstream ifsNextUse;
+    if ( ePolicy == REPLACE_OPT )
+    {
+        if ( szNextUse == nullptr )
+            return false;
+
+        ifsNextUse.open (szNextUse, std::ios::in | std::ios::binary);
+
+        NEXT_USE_HEADER hdr;
+        NEXT_USE_HEADER hdrExpected;
+        InitNextUseHeader (hdrExpected, qwRecords);
+
+        ifsNextUse.read (reinterpret_cast<char*>(&hdr), sizeof(hdr));
+        if ( ifsNextUse.fail() || (memcmp (&hdr, &hdrExpected, sizeof(hdr)) != 0) )
+            return false;
+    }
+
+    CCacheSet rgCacheSets[req::g_4WAY_CACHE_SETS];
+    for (auto& it : rgCacheSets)
+    {
+        it.Init ( );
+        if ( !it.set_Policy (ePolicy) )
+            return false;
+    }
+
+    const size_t nChunk = ChunkRecords (cbBudget);
+
+    std::vector<TRACE_RECORD> vecRecords;
+    std::vector<DWORD>        vecDistance;
+
+    for (QWORD qwFirst = 0; qwFirst < qwRecords; )
+    {
+        size_t nCount = static_cast<size_t>(std::min<QWORD> (nChunk, qwRecords - qwFirst));
+
+        if ( !trace.Read (qwFirst, nCount, vecRecords) )
+            return false;
+
+        if ( ePolicy == REPLACE_OPT )
+        {
+            vecDistance.resize (nCount);
+            ifsNextUse.read (reinterpret_cast<char*>(vecDistance.data()), nCount * sizeof(DWORD));
+            if ( ifsNextUse.fail() )
+                return false;
+        }
+
+        for (size_t i = 0; i < nCount; i++)
+        {
+            // folded accesses kept neither their timestamps nor their dependencies
+            if ( m_pTiming && (vecRecords[i].dwRepeat != 0) )
+                return false;
+
+            const void* pAddress;
+            if ( !CVirtualAddress::FromTraceAddress (vecRecords[i].qwAddress, pAddress) )
+                return false;
+
+            CVirtualAddress vAddress (pAddress);
+            DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+            if ( dwIndex >= _countof(rgCacheSets) )
+                continue;
+
+            QWORD qwNextUse = NEVER_REUSED;
+            if ( (ePolicy == REPLACE_OPT) && (vecDistance[i] != 0) )
+                qwNextUse = qwFirst + i + vecDistance[i];
+
+            DWORD_PTR  dwTag    = vAddress.DecodeTag ( );
+            CCacheSet& cacheSet = rgCacheSets[dwIndex];
+
+            bool bHit = cacheSet.AccessCacheTag (dwTag, qwNextUse);
+            if ( bHit )
+                m_qwCacheHits++;
+            else
+            {
+                m_qwCacheMisses++;
+                cacheSet.LoadCacheTag (dwTag, qwNextUse);
+            }
+
+            // accesses folded into the record hit the block just used
+            m_qwCacheHits += vecRecords[i].dwRepeat;
+
+            if ( m_pTiming )
+                m_pTiming->Issue (vecRecords[i].qwAddress, bHit,
+                                  vecRecords[i].qwTimestamp, vecRecords[i].dwDependency);
+        }
+
+        qwFirst += nCount;
+    }
+
+    return true;
+}
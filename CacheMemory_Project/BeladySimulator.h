@@ -0,0 +1,153 @@
+/**
+ *  @file       BeladySimulator.h
+ *  @brief      CBeladySimulator class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_BELADY_SIMULATOR_H__)
+#define _BELADY_SIMULATOR_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#if !defined(_CACHE_SET_H__)
+    #include "CacheSet.h"
+#endif
+
+class CCacheTimingModel;
+
+/*
+    Next-use side file, written by the backward pass over a trace.
+
+    | NEXT_USE_HEADER | DWORD | DWORD | ...
+
+    One DWORD per trace record, holding the distance (in records) to the
+    next access of the same cache block: 0 if the block is never accessed
+    again, saturated at g_NEXT_USE_FAR for reuses as far away as the
+    lookahead window of the backward pass or further (blocks never reused
+    may be saturated too, unless they are in the last window of the trace).
+    Saturated blocks are still evicted before any block reused sooner, only
+    their order among themselves is approximate.
+
+    Repeats folded into a record by CAccessCoalescer need no entry of their
+    own: they hit, and the next use of the block after them is the next
+    record of the same block, since records of a set keep their order.
+*/
+
+/// 'ACNU' - Associative Cache Next Use
+constexpr DWORD g_NEXT_USE_MAGIC   = 0x554E4341;
+/// bumped whenever the layout of the next-use file changes
+constexpr DWORD g_NEXT_USE_VERSION = 1;
+/// saturated next-use distance
+constexpr DWORD g_NEXT_USE_FAR     = 0xFFFFFFFF;
+
+/// default memory budget for the trace and next-use chunks (in bytes)
+constexpr size_t g_OPT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+/**
+ *  Next-use file header
+ */
+struct NEXT_USE_HEADER
+{
+    DWORD   dwMagic;            ///< g_NEXT_USE_MAGIC
+    DWORD   dwVersion;          ///< g_NEXT_USE_VERSION
+    DWORD   cbHeader;           ///< sizeof(NEXT_USE_HEADER)
+    DWORD   dwBlockSize;        ///< block size the distances were computed for
+    QWORD   qwRecords;          ///< number of distances following the header
+};
+
+/**
+ *  Replays an address trace through the 4-way set associative cache, using
+ *  either the FIFO policy or Belady's optimal (OPT) replacement, so the
+ *  miss count of a realizable policy can be compared to the ideal one.
+ *
+ *  OPT needs the next use of every access, computed by a backward pass over
+ *  the trace (BuildNextUse) into a side file that the forward replay (Run)
+ *  then streams alongside the trace.  Both passes work in chunks sized by a
+ *  memory budget, so traces of billions of accesses can be processed; the
+ *  last-use table of the backward pass only looks a window of records
+ *  ahead, sized by the same budget, so it does not grow with the number of
+ *  distinct blocks touched either.
+ */
+class CBeladySimulator
+{
+    QWORD   m_qwCacheHits;
+    QWORD   m_qwCacheMisses;
+
+    CCacheTimingModel* m_pTiming;   ///< optional, fed with every replayed access
+
+public:
+/**
+ *  Default Constructor
+ */
+    CBeladySimulator ( ) noexcept
+        : m_qwCacheHits   (0),
+          m_qwCacheMisses (0),
+          m_pTiming       (nullptr)
+    { };
+
+/**
+    Attaches a timing model that receives every replayed access together
+    with the timestamp and dependency hint of its trace record, or detaches
+    the current one when passed nullptr.  A coalesced trace cannot be timed,
+    as its folded accesses have no timestamps or dependencies of their own,
+    so Run fails on the first record carrying repeats.
+
+    @param [in] pTiming         timing model to attach (not owned)
+ */
+    void set_TimingModel (CCacheTimingModel* pTiming) noexcept
+    { m_pTiming = pTiming; };
+
+/**
+    Backward pass: computes the next-use distance of every access in a trace
+
+    @param [in] szTrace         trace written by CCacheTraceWriter
+    @param [in] szNextUse       name of the next-use file to create
+    @param [in] cbBudget        memory budget for the chunk buffers and, as
+                                much again, for the last-use table (in bytes)
+
+    @retval true      on success
+    @retval false     on error
+ */
+    static bool BuildNextUse (const TCHAR* szTrace, const TCHAR* szNextUse,
+                              size_t cbBudget = g_OPT_MEMORY_BUDGET);
+
+/**
+    Forward pass: replays a trace and counts hits and misses
+
+    @param [in] szTrace         trace written by CCacheTraceWriter
+    @param [in] szNextUse       next-use file written by BuildNextUse for the
+                                same trace, only needed for REPLACE_OPT
+    @param [in] ePolicy         replacement policy to simulate, REPLACE_FIFO
+                                or REPLACE_OPT
+    @param [in] cbBudget        memory budget for the chunk buffers (in bytes)
+
+    @retval true      on success
+    @retval false     on error, on an address wider than a pointer, or on
+                      a coalesced record while a timing model is attached
+ */
+    bool Run (const TCHAR* szTrace, const TCHAR* szNextUse, REPLACEMENT_POLICY ePolicy,
+              size_t cbBudget = g_OPT_MEMORY_BUDGET);
+
+ /**
+    Returns the number of cache hits of the last Run
+ */
+    constexpr QWORD get_CacheHits   (void) const noexcept
+    { return m_qwCacheHits; };
+
+ /**
+    Returns the number of cache misses of the last Run
+ */
+    constexpr QWORD get_CacheMisses (void) const noexcept
+    { return m_qwCacheMisses; };
+
+private:
+
+    CBeladySimulator (const CBeladySimulator& rhs) = delete;
+    CBeladySimulator& operator = (const CBeladySimulator& rhs) = delete;
+};
+
+#endif
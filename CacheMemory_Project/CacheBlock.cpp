@@ -12,7 +12,8 @@
 
 
 CCacheBlock::CCacheBlock ( ) noexcept
-    : m_dwTag (0)
+    : m_dwTag (0),
+      m_bValid (false)
 {  // intentionally marking the memory block with fixed value
    // for testing and debugging purposes (yeah, like M$)
     memset (m_rgBlock, 'FE',  sizeof(m_rgBlock) );
@@ -43,9 +44,38 @@ bool CCacheBlock::LoadCacheBlock (DWORD_PTR dwTag, const BYTE* pData,
         if ( cbLen <= sizeof(m_rgBlock) )
         {
             memcpy (m_rgBlock, pData, cbLen);
-            m_dwTag = dwTag;
-            bReturn = true;
+            m_dwTag  = dwTag;
+            m_bValid = true;
+            bReturn  = true;
         }
     }
     return bReturn;
 }
+
+bool CCacheBlock::UpdateCacheData (size_t cbOffset, const void* pData, size_t cbLen) noexcept
+{
+    bool bReturn = false;
+    if ( (pData != nullptr) && (cbOffset <= sizeof(m_rgBlock)) && 
+         (cbLen <= sizeof(m_rgBlock) - cbOffset) )
+    {
+        memcpy (&m_rgBlock[cbOffset], pData, cbLen);
+        bReturn = true;
+    }
+    return bReturn;
+}
+
+void CCacheBlock::SaveState (CACHE_BLOCK_STATE& state) const noexcept
+{
+    state.qwTag      = m_dwTag;
+    state.dwFlags    = m_bValid ? g_BLOCK_FLAG_VALID : 0;
+    state.dwReserved = 0;
+    memcpy (state.rgBlock, m_rgBlock, sizeof(state.rgBlock));
+}
+
+void CCacheBlock::RestoreState (const CACHE_BLOCK_STATE& state) noexcept
+{
+    // CCacheSet::IsValidState refuses a Tag wider than a pointer
+    m_dwTag  = static_cast<DWORD_PTR>(state.qwTag);
+    m_bValid = (state.dwFlags & g_BLOCK_FLAG_VALID) != 0;
+    memcpy (m_rgBlock, state.rgBlock, sizeof(m_rgBlock));
+}
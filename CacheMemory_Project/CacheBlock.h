@@ -6,10 +6,17 @@
  *
  */
 
+#if !defined(_CACHE_BLOCK_H__)
+#define _CACHE_BLOCK_H__
+
 #if !defined(_COMMON_DEF_H__)
     #include "CommonDef.h"
 #endif
 
+#if !defined(_CACHE_CHECKPOINT_H__)
+    #include "CacheCheckpoint.h"
+#endif
+
 
 
 
@@ -20,6 +27,7 @@
 class CCacheBlock
 {
     DWORD_PTR     m_dwTag; ///< Tag identifier associated with cache date block
+    bool          m_bValid; ///< true once the block has been loaded with data
     BYTE          m_rgBlock[req::g_CACHE_BLOCK_SIZE]; ///< actual cache data block
 
 public:
@@ -46,6 +54,15 @@ public:
     constexpr DWORD_PTR get_Tag (void) const noexcept
     { return m_dwTag; };
 
+ /**
+    Indicates whether the cache block holds valid data
+
+    @retval true     block has been loaded and its Tag is meaningful
+    @retval false    block has never been loaded
+ */
+    constexpr bool is_Valid (void) const noexcept
+    { return m_bValid; };
+
  /**
     Attempts to retrieve data from the underlying cache block based on offset
     
@@ -71,6 +88,42 @@ public:
     bool LoadCacheBlock (DWORD_PTR dwTag, const BYTE* pData, 
                          size_t cbLen = req::g_CACHE_BLOCK_SIZE) noexcept;
 
+ /**
+    Associates the cache block with dwTag without loading any data, used when
+    replaying an address trace whose addresses are not backed by memory
+
+    @param [in] dwTag       value containing Tag to associate with this cache block
+ */
+    void LoadCacheTag (DWORD_PTR dwTag) noexcept
+    { m_dwTag = dwTag; m_bValid = true; };
+
+ /**
+    Overwrites part of the cache block with new data (write-through update)
+
+    @param [in] cbOffset    count of byte (cb) offset into cache block
+    @param [in] pData       pointer to the data being written
+    @param [in] cbLen       count of bytes (cb) of data length
+
+    @retval true    on success
+    @retval false   if the update does not fit within the cache block
+ */
+    bool UpdateCacheData (size_t cbOffset, const void* pData, size_t cbLen) noexcept;
+
+ /**
+    Copies the complete state of the cache block into a checkpoint record
+
+    @param [out] state      checkpoint record to fill
+ */
+    void SaveState    (CACHE_BLOCK_STATE& state) const noexcept;
+
+ /**
+    Restores the complete state of the cache block from a checkpoint record
+
+    @param [in] state       checkpoint record previously filled by SaveState,
+                            its Tag checked by CCacheSet::IsValidState
+ */
+    void RestoreState (const CACHE_BLOCK_STATE& state) noexcept;
+
 private:
 
     CCacheBlock(const CCacheBlock& rhs) = delete;
@@ -79,3 +132,4 @@ private:
 
 };
 
+#endif
@@ -0,0 +1,76 @@
+/**
+ *  @file       CacheCheckpoint.h
+ *  @brief      Binary layout of a cache-state checkpoint (snapshot) file
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CACHE_CHECKPOINT_H__)
+#define _CACHE_CHECKPOINT_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+/*
+    A checkpoint captures the complete state of a CCacheManager so that a
+    "warmed" cache can be restored and measured many times without replaying
+    the warm-up accesses.  The file is laid out as a fixed header followed by
+    one CACHE_SET_STATE record per cache set:
+
+    | CACHE_CHECKPOINT_HEADER | CACHE_SET_STATE[0] | ... | CACHE_SET_STATE[n-1] |
+
+    All records are fixed size, so a restore is nothing more than reading the
+    header and the set records, validating them and copying each set record
+    back into place.  The geometry of the cache is stored in the header and must
+    match the geometry of the program restoring the checkpoint.
+*/
+
+/// 'ACCP' - Associative Cache CheckPoint
+constexpr DWORD g_CHECKPOINT_MAGIC   = 0x50434341;
+/// bumped whenever the layout of any of the records below changes
+constexpr DWORD g_CHECKPOINT_VERSION = 1;
+
+/// CACHE_BLOCK_STATE::dwFlags - block contains valid data
+constexpr DWORD g_BLOCK_FLAG_VALID   = 0x00000001;
+
+/**
+ *  Saved state of a single CCacheBlock
+ */
+struct CACHE_BLOCK_STATE
+{
+    QWORD   qwTag;                               ///< Tag identifier
+    DWORD   dwFlags;                             ///< g_BLOCK_FLAG_xxx bits
+    DWORD   dwReserved;                          ///< padding, always zero
+    BYTE    rgBlock[req::g_CACHE_BLOCK_SIZE];    ///< cache data block
+};
+
+/**
+ *  Saved state of a single CCacheSet, including its replacement state
+ */
+struct CACHE_SET_STATE
+{
+    /// FIFO replacement order, block indices from oldest to newest
+    BYTE                rgFifoOrder[req::g_4WAY_BLOCKS_PER_SET];
+    CACHE_BLOCK_STATE   rgBlock[req::g_4WAY_BLOCKS_PER_SET];
+};
+
+/**
+ *  Checkpoint file header
+ */
+struct CACHE_CHECKPOINT_HEADER
+{
+    DWORD   dwMagic;            ///< g_CHECKPOINT_MAGIC
+    DWORD   dwVersion;          ///< g_CHECKPOINT_VERSION
+    DWORD   cbHeader;           ///< sizeof(CACHE_CHECKPOINT_HEADER)
+    DWORD   cbSetState;         ///< sizeof(CACHE_SET_STATE)
+    DWORD   dwNumSets;          ///< number of CACHE_SET_STATE records that follow
+    DWORD   dwBlocksPerSet;     ///< associativity
+    DWORD   dwBlockSize;        ///< block size in bytes
+    DWORD   dwReserved;         ///< padding, always zero
+    QWORD   qwCacheHits;        ///< statistics at the time of the checkpoint
+    QWORD   qwCacheMisses;      ///< statistics at the time of the checkpoint
+};
+
+#endif
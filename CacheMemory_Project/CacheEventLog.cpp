@@ -0,0 +1,308 @@
+/**
+ *  @file       CacheEventLog.cpp
+ *  @brief      CCacheEventLog and CCacheEventReader class implementations
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <memory.h>
+
+#include "CacheSet.h"
+#include "CacheEventLog.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Column encoding helpers
+
+/// appends an unsigned LEB128 variable length integer
+static void AppendVarint (std::vector<BYTE>& vecOut, QWORD qwValue)
+{
+    while ( qwValue >= 0x80 )
+    {
+        vecOut.push_back (static_cast<BYTE>(qwValue | 0x80));
+        qwValue >>= 7;
+    }
+    vecOut.push_back (static_cast<BYTE>(qwValue));
+}
+
+/// reads an unsigned LEB128 variable length integer, false if truncated
+static bool ReadVarint (const BYTE*& p, const BYTE* pEnd, QWORD& qwValue) noexcept
+{
+    qwValue = 0;
+    for (int iShift = 0; (p < pEnd) && (iShift < 64); iShift += 7)
+    {
+        BYTE b = *p++;
+        qwValue |= static_cast<QWORD>(b & 0x7F) << iShift;
+        if ( (b & 0x80) == 0 )
+            return true;
+    }
+    return false;
+}
+
+/// run-length encodes a column as (value, run length) varint pairs
+template <typename T>
+static void AppendRle (std::vector<BYTE>& vecOut, const std::vector<T>& vecColumn)
+{
+    size_t i = 0;
+    while ( i < vecColumn.size() )
+    {
+        size_t nRun = 1;
+        while ( (i + nRun < vecColumn.size()) && (vecColumn[i + nRun] == vecColumn[i]) )
+            nRun++;
+
+        AppendVarint (vecOut, static_cast<QWORD>(vecColumn[i]));
+        AppendVarint (vecOut, nRun);
+        i += nRun;
+    }
+}
+
+/// decodes exactly nCount values of a run-length encoded column
+static bool ReadRle (const BYTE* p, const BYTE* pEnd, size_t nCount, std::vector<QWORD>& vecColumn)
+{
+    vecColumn.clear ( );
+    while ( vecColumn.size() < nCount )
+    {
+        QWORD qwValue, qwRun;
+        if ( !ReadVarint (p, pEnd, qwValue) || !ReadVarint (p, pEnd, qwRun) ||
+             (qwRun == 0) || (qwRun > nCount - vecColumn.size()) )
+            return false;
+
+        vecColumn.insert (vecColumn.end(), static_cast<size_t>(qwRun), qwValue);
+    }
+    return p == pEnd;
+}
+
+static QWORD ZigZag   (QWORD qwDelta) noexcept
+{ return (qwDelta << 1) ^ static_cast<QWORD>(static_cast<__int64>(qwDelta) >> 63); }
+
+static QWORD UnZigZag (QWORD qwValue) noexcept
+{ return (qwValue >> 1) ^ (0 - (qwValue & 1)); }
+
+static void InitEventLogHeader (EVENT_LOG_HEADER& hdr, DWORD dwEventsPerBlock) noexcept
+{
+    memset (&hdr, 0, sizeof(hdr));
+
+    hdr.dwMagic          = g_EVENT_LOG_MAGIC;
+    hdr.dwVersion        = g_EVENT_LOG_VERSION;
+    hdr.cbHeader         = sizeof(EVENT_LOG_HEADER);
+    hdr.dwNumSets        = req::g_4WAY_CACHE_SETS;
+    hdr.dwBlocksPerSet   = req::g_4WAY_BLOCKS_PER_SET;
+    hdr.dwBlockSize      = req::g_CACHE_BLOCK_SIZE;
+    hdr.dwEventsPerBlock = dwEventsPerBlock;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CCacheEventLog
+
+CCacheEventLog::CCacheEventLog ( )
+    : m_ofs              ( ),
+      m_dwEventsPerBlock (g_EVENTS_PER_BLOCK),
+      m_vecHitBitmap     ( ),
+      m_vecSets          ( ),
+      m_vecEvicted       ( ),
+      m_bFillPending     (false),
+      m_qwEvents         (0),
+      m_vecEncoded       ( )
+{
+};
+
+CCacheEventLog::~CCacheEventLog ( )
+{
+    Close ( );
+};
+
+bool CCacheEventLog::Open (const TCHAR* szFileName, DWORD dwEventsPerBlock /* = g_EVENTS_PER_BLOCK */)
+{
+    Close ( );
+
+    if ( (szFileName == nullptr) || (dwEventsPerBlock == 0) )
+        return false;
+
+    m_ofs.open (szFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    if ( !m_ofs.is_open() )
+        return false;
+
+    m_dwEventsPerBlock = dwEventsPerBlock;
+    m_vecHitBitmap.assign ((dwEventsPerBlock + 7) / 8, 0);
+    m_vecSets.clear ( );
+    m_vecSets.reserve (dwEventsPerBlock);
+    m_vecEvicted.clear ( );
+    m_vecEvicted.reserve (dwEventsPerBlock);
+    m_bFillPending = false;
+    m_qwEvents     = 0;
+
+    EVENT_LOG_HEADER hdr;
+    InitEventLogHeader (hdr, dwEventsPerBlock);
+    m_ofs.write (reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+
+    return !m_ofs.fail();
+}
+
+void CCacheEventLog::Close (void)
+{
+    if ( m_ofs.is_open() )
+    {
+        FlushBlock ( );
+        m_ofs.close ( );
+    }
+}
+
+void CCacheEventLog::OnCacheAccess (const void* /* pAddress */, DWORD_PTR dwIndex, bool bHit)
+{
+    if ( !m_ofs.is_open() )
+        return;
+
+    if ( m_vecSets.size() >= m_dwEventsPerBlock )
+        FlushBlock ( );
+
+    size_t iEvent = m_vecSets.size();
+    if ( bHit )
+        m_vecHitBitmap[iEvent >> 3] |= static_cast<BYTE>(1 << (iEvent & 7));
+    else
+        m_vecEvicted.push_back (g_NO_EVICTED_TAG);
+
+    m_vecSets.push_back (static_cast<DWORD>(dwIndex));
+    m_bFillPending = !bHit;
+    m_qwEvents++;
+}
+
+void CCacheEventLog::OnCacheFill (const void* /* pAddress */, DWORD_PTR dwIndex,
+                                  DWORD_PTR dwEvictedTag)
+{
+    // only a fill that directly follows the miss on the same set belongs to it
+    if ( m_bFillPending && !m_vecSets.empty() && (m_vecSets.back() == dwIndex) )
+    {
+        if ( dwEvictedTag != NO_EVICTION )
+            m_vecEvicted.back() = dwEvictedTag;
+    }
+    m_bFillPending = false;
+}
+
+void CCacheEventLog::FlushBlock (void)
+{
+    if ( m_vecSets.empty() )
+        return;
+
+    EVENT_BLOCK_HEADER blk;
+    memset (&blk, 0, sizeof(blk));
+    blk.dwEvents    = static_cast<DWORD>(m_vecSets.size());
+    blk.dwMisses    = static_cast<DWORD>(m_vecEvicted.size());
+    blk.cbHitBitmap = (blk.dwEvents + 7) / 8;
+
+    m_vecEncoded.clear ( );
+    AppendRle (m_vecEncoded, m_vecSets);
+    blk.cbSetColumn = static_cast<DWORD>(m_vecEncoded.size());
+
+    // replace the evicted Tags by their delta encoding, in place
+    QWORD qwPrevEvicted = 0;
+    for (auto& it : m_vecEvicted)
+    {
+        if ( it == g_NO_EVICTED_TAG )
+            it = 0;
+        else
+        {
+            QWORD qwTag = it;
+            it = ZigZag (qwTag - qwPrevEvicted) + 1;
+            qwPrevEvicted = qwTag;
+        }
+    }
+    AppendRle (m_vecEncoded, m_vecEvicted);
+    blk.cbEvictColumn = static_cast<DWORD>(m_vecEncoded.size()) - blk.cbSetColumn;
+
+    m_ofs.write (reinterpret_cast<const char*>(&blk), sizeof(blk));
+    m_ofs.write (reinterpret_cast<const char*>(m_vecHitBitmap.data()), blk.cbHitBitmap);
+    m_ofs.write (reinterpret_cast<const char*>(m_vecEncoded.data()), m_vecEncoded.size());
+
+    memset (m_vecHitBitmap.data(), 0, m_vecHitBitmap.size());
+    m_vecSets.clear ( );
+    m_vecEvicted.clear ( );
+    m_bFillPending = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CCacheEventReader
+
+CCacheEventReader::CCacheEventReader ( )
+    : m_ifs           ( ),
+      m_hdr           ( ),
+      m_vecPayload    ( )
+{
+};
+
+bool CCacheEventReader::Open (const TCHAR* szFileName)
+{
+    if ( szFileName == nullptr )
+        return false;
+
+    m_ifs.open (szFileName, std::ios::in | std::ios::binary);
+    if ( !m_ifs.is_open() )
+        return false;
+
+    m_ifs.read (reinterpret_cast<char*>(&m_hdr), sizeof(m_hdr));
+
+    return !m_ifs.fail() &&
+           (m_hdr.dwMagic   == g_EVENT_LOG_MAGIC)   &&
+           (m_hdr.dwVersion == g_EVENT_LOG_VERSION) &&
+           (m_hdr.cbHeader  == sizeof(EVENT_LOG_HEADER)) &&
+           (m_hdr.dwEventsPerBlock > 0);
+}
+
+bool CCacheEventReader::ReadBlock (std::vector<CACHE_EVENT>& vecEvents)
+{
+    vecEvents.clear ( );
+
+    EVENT_BLOCK_HEADER blk;
+    m_ifs.read (reinterpret_cast<char*>(&blk), sizeof(blk));
+    if ( m_ifs.fail() )
+        return false;
+
+    if ( (blk.dwEvents == 0) || (blk.dwEvents > m_hdr.dwEventsPerBlock) ||
+         (blk.dwMisses > blk.dwEvents) || (blk.cbHitBitmap != (blk.dwEvents + 7) / 8) )
+        return false;
+
+    size_t cbPayload = static_cast<size_t>(blk.cbHitBitmap) + blk.cbSetColumn + blk.cbEvictColumn;
+    m_vecPayload.resize (cbPayload);
+    m_ifs.read (reinterpret_cast<char*>(m_vecPayload.data()), cbPayload);
+    if ( m_ifs.fail() )
+        return false;
+
+    const BYTE* pBitmap = m_vecPayload.data();
+    const BYTE* pSets   = pBitmap + blk.cbHitBitmap;
+    const BYTE* pEvict  = pSets   + blk.cbSetColumn;
+
+    std::vector<QWORD> vecSets;
+    std::vector<QWORD> vecEvict;
+    if ( !ReadRle (pSets,  pEvict, blk.dwEvents, vecSets) ||
+         !ReadRle (pEvict, pEvict + blk.cbEvictColumn, blk.dwMisses, vecEvict) )
+        return false;
+
+    vecEvents.resize (blk.dwEvents);
+
+    QWORD  qwPrevEvicted = 0;
+    size_t iMiss         = 0;
+    for (size_t i = 0; i < blk.dwEvents; i++)
+    {
+        CACHE_EVENT& ev = vecEvents[i];
+        ev.dwIndex      = static_cast<DWORD>(vecSets[i]);
+        ev.bHit         = (pBitmap[i >> 3] & (1 << (i & 7))) != 0;
+        ev.bEvicted     = false;
+        ev.qwEvictedTag = 0;
+
+        if ( !ev.bHit )
+        {
+            if ( iMiss >= vecEvict.size() )
+                return false;
+
+            QWORD qwValue = vecEvict[iMiss++];
+            if ( qwValue != 0 )
+            {
+                qwPrevEvicted  += UnZigZag (qwValue - 1);
+                ev.bEvicted     = true;
+                ev.qwEvictedTag = qwPrevEvicted;
+            }
+        }
+    }
+    return iMiss == vecEvict.size();
+}
@@ -0,0 +1,200 @@
+/**
+ *  @file       CacheEventLog.h
+ *  @brief      CCacheEventLog and CCacheEventReader class interfaces
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CACHE_EVENT_LOG_H__)
+#define _CACHE_EVENT_LOG_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#if !defined(_CACHE_OBSERVER_H__)
+    #include "CacheObserver.h"
+#endif
+
+/*
+    Compact, columnar per-access event stream.
+
+    The stream records, for every cache access, whether it hit, which set it
+    mapped to and, for misses, which Tag (if any) was evicted by the block
+    load that followed.  Events are grouped into blocks of up to
+    EventsPerBlock accesses, each stored column by column:
+
+    | EVENT_LOG_HEADER | EVENT_BLOCK_HEADER | hit bitmap | set column | evict column | EVENT_BLOCK_HEADER | ...
+
+    - hit bitmap    one bit per event, bit set on a hit
+    - set column    set index of every event
+    - evict column  one value per miss: 0 if nothing was evicted, otherwise
+                    the zig-zag encoded difference to the previously evicted
+                    Tag plus one
+
+    Both columns are run-length encoded as (value, run length) pairs of
+    LEB128 variable length integers, which keeps the common cases (long runs
+    in one set, streaming evictions of consecutive Tags) down to a few bytes.
+*/
+
+/// 'ACEL' - Associative Cache Event Log
+constexpr DWORD g_EVENT_LOG_MAGIC   = 0x4C454341;
+/// bumped whenever the layout of the event log changes
+constexpr DWORD g_EVENT_LOG_VERSION = 1;
+/// default number of events per block
+constexpr DWORD g_EVENTS_PER_BLOCK  = 4096;
+
+/// evicted Tag placeholder for misses that did not evict a valid block
+constexpr QWORD g_NO_EVICTED_TAG    = ~0ULL;
+
+/**
+ *  Event log file header
+ */
+struct EVENT_LOG_HEADER
+{
+    DWORD   dwMagic;            ///< g_EVENT_LOG_MAGIC
+    DWORD   dwVersion;          ///< g_EVENT_LOG_VERSION
+    DWORD   cbHeader;           ///< sizeof(EVENT_LOG_HEADER)
+    DWORD   dwNumSets;          ///< number of cache sets
+    DWORD   dwBlocksPerSet;     ///< associativity
+    DWORD   dwBlockSize;        ///< block size in bytes
+    DWORD   dwEventsPerBlock;   ///< maximum events per event block
+    DWORD   dwReserved;         ///< padding, always zero
+};
+
+/**
+ *  Event block header, followed by the three column payloads
+ */
+struct EVENT_BLOCK_HEADER
+{
+    DWORD   dwEvents;           ///< number of events in the block
+    DWORD   dwMisses;           ///< number of misses (values in the evict column)
+    DWORD   cbHitBitmap;        ///< size of the hit bitmap in bytes
+    DWORD   cbSetColumn;        ///< size of the encoded set column in bytes
+    DWORD   cbEvictColumn;      ///< size of the encoded evict column in bytes
+    DWORD   dwReserved;         ///< padding, always zero
+};
+
+/**
+ *  A single decoded event
+ */
+struct CACHE_EVENT
+{
+    DWORD   dwIndex;            ///< cache set accessed
+    bool    bHit;               ///< true on a cache hit
+    bool    bEvicted;           ///< true if a miss evicted a valid block
+    QWORD   qwEvictedTag;       ///< Tag of the evicted block, if bEvicted
+};
+
+/**
+ *  Cache observer writing the columnar event stream
+ */
+class CCacheEventLog : public ICacheObserver
+{
+    std::ofstream       m_ofs;
+    DWORD               m_dwEventsPerBlock;
+
+    std::vector<BYTE>   m_vecHitBitmap;     ///< hit bits of the current block
+    std::vector<DWORD>  m_vecSets;          ///< set index per event
+    std::vector<QWORD>  m_vecEvicted;       ///< evicted Tag per miss, g_NO_EVICTED_TAG if none
+    bool                m_bFillPending;     ///< last event was a miss awaiting its fill
+    QWORD               m_qwEvents;         ///< total events written
+
+    std::vector<BYTE>   m_vecEncoded;       ///< scratch encoding buffer
+
+public:
+/**
+ *  Default Constructor
+ */
+    CCacheEventLog ( );
+
+    virtual ~CCacheEventLog ( );
+
+/**
+    Creates the event log file
+
+    @param [in] szFileName          name of the event log file
+    @param [in] dwEventsPerBlock    events per columnar block
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool Open  (const TCHAR* szFileName, DWORD dwEventsPerBlock = g_EVENTS_PER_BLOCK);
+
+/**
+    Writes any buffered events and closes the event log file
+ */
+    void Close (void);
+
+/**
+    Returns the total number of events recorded
+ */
+    constexpr QWORD get_Events (void) const noexcept
+    { return m_qwEvents; };
+
+    virtual void OnCacheAccess (const void* pAddress, DWORD_PTR dwIndex, bool bHit) override;
+
+    virtual void OnCacheFill   (const void* pAddress, DWORD_PTR dwIndex,
+                                DWORD_PTR dwEvictedTag) override;
+
+private:
+
+    void FlushBlock (void);
+
+    CCacheEventLog (const CCacheEventLog& rhs) = delete;
+    CCacheEventLog& operator = (const CCacheEventLog& rhs) = delete;
+};
+
+/**
+ *  Sequential reader of an event log written by CCacheEventLog
+ */
+class CCacheEventReader
+{
+    std::ifstream       m_ifs;
+    EVENT_LOG_HEADER    m_hdr;
+    std::vector<BYTE>   m_vecPayload;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CCacheEventReader ( );
+
+/**
+    Opens an event log and validates its header
+
+    @param [in] szFileName      name of the event log file
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool Open (const TCHAR* szFileName);
+
+/**
+    Returns the event log header, valid after a successful Open
+ */
+    const EVENT_LOG_HEADER& get_Header (void) const noexcept
+    { return m_hdr; };
+
+/**
+    Reads and decodes the next event block
+
+    @param [out] vecEvents      decoded events of the block
+
+    @retval true      if a block was read
+    @retval false     at the end of the log or on a malformed block
+ */
+    bool ReadBlock (std::vector<CACHE_EVENT>& vecEvents);
+
+private:
+
+    CCacheEventReader (const CCacheEventReader& rhs) = delete;
+    CCacheEventReader& operator = (const CCacheEventReader& rhs) = delete;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ *  @file       CacheHeatmap.cpp
+ *  @brief      CCacheHeatmap class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <string>
+#include <algorithm>
+
+#include "CacheEventLog.h"
+#include "CacheHeatmap.h"
+
+/// minimum width of the PGM images, each set is stretched to fill it
+constexpr DWORD g_MIN_IMAGE_WIDTH = 256;
+
+CCacheHeatmap::CCacheHeatmap ( )
+    : m_dwNumSets      (0),
+      m_dwBlocksPerSet (0),
+      m_vecMisses      ( ),
+      m_vecOccupancy   ( ),
+      m_nWindows       (0)
+{
+};
+
+bool CCacheHeatmap::Build (const TCHAR* szEventLog, QWORD qwWindow)
+{
+    CCacheEventReader reader;
+    if ( (qwWindow == 0) || !reader.Open (szEventLog) )
+        return false;
+
+    m_dwNumSets      = reader.get_Header().dwNumSets;
+    m_dwBlocksPerSet = reader.get_Header().dwBlocksPerSet;
+    m_vecMisses.clear ( );
+    m_vecOccupancy.clear ( );
+    m_nWindows = 0;
+
+    if ( m_dwNumSets == 0 )
+        return false;
+
+    std::vector<DWORD>       vecOccupancy (m_dwNumSets, 0);
+    std::vector<CACHE_EVENT> vecEvents;
+    QWORD                    qwEvent = 0;
+
+    while ( reader.ReadBlock (vecEvents) )
+    {
+        for (const auto& ev : vecEvents)
+        {
+            if ( ev.dwIndex >= m_dwNumSets )
+                return false;
+
+            if ( (qwEvent % qwWindow) == 0 )
+            {   // start a new row, occupancy carries over from the previous one
+                m_nWindows++;
+                m_vecMisses.resize (m_nWindows * m_dwNumSets, 0);
+                m_vecOccupancy.insert (m_vecOccupancy.end(), vecOccupancy.begin(), vecOccupancy.end());
+            }
+
+            if ( !ev.bHit )
+            {
+                m_vecMisses[(m_nWindows - 1) * m_dwNumSets + ev.dwIndex]++;
+
+                // a miss that evicted nothing filled an empty block
+                if ( !ev.bEvicted && (vecOccupancy[ev.dwIndex] < m_dwBlocksPerSet) )
+                    vecOccupancy[ev.dwIndex]++;
+
+                m_vecOccupancy[(m_nWindows - 1) * m_dwNumSets + ev.dwIndex] = vecOccupancy[ev.dwIndex];
+            }
+            qwEvent++;
+        }
+    }
+
+    return m_nWindows > 0;
+}
+
+bool CCacheHeatmap::Write (const TCHAR* szPrefix) const
+{
+    return (szPrefix != nullptr) && (m_nWindows > 0) &&
+           WriteMatrix (szPrefix, _T("_misses"),    m_vecMisses) &&
+           WriteMatrix (szPrefix, _T("_occupancy"), m_vecOccupancy);
+}
+
+bool CCacheHeatmap::WriteMatrix (const TCHAR* szPrefix, const TCHAR* szSuffix,
+                                 const std::vector<DWORD>& vecMatrix) const
+{
+    std::basic_string<TCHAR> strBase (szPrefix);
+    strBase += szSuffix;
+
+    // CSV: one row per time window, one column per set
+    std::ofstream ofsCsv ((strBase + _T(".csv")).c_str());
+    if ( !ofsCsv.is_open() )
+        return false;
+
+    ofsCsv << "window";
+    for (DWORD s = 0; s < m_dwNumSets; s++)
+        ofsCsv << ",set" << s;
+    ofsCsv << std::endl;
+
+    for (size_t w = 0; w < m_nWindows; w++)
+    {
+        ofsCsv << w;
+        for (DWORD s = 0; s < m_dwNumSets; s++)
+            ofsCsv << ',' << vecMatrix[w * m_dwNumSets + s];
+        ofsCsv << std::endl;
+    }
+    ofsCsv.close ( );
+
+    // PGM: white is the hottest cell of the whole matrix
+    DWORD dwMax   = std::max<DWORD> (1, *std::max_element (vecMatrix.begin(), vecMatrix.end()));
+    DWORD dwScale = std::max<DWORD> (1, (g_MIN_IMAGE_WIDTH + m_dwNumSets - 1) / m_dwNumSets);
+    DWORD dwWidth = m_dwNumSets * dwScale;
+
+    std::ofstream ofsPgm ((strBase + _T(".pgm")).c_str(), std::ios::out | std::ios::binary);
+    if ( !ofsPgm.is_open() )
+        return false;
+
+    ofsPgm << "P5\n" << dwWidth << ' ' << m_nWindows << "\n255\n";
+
+    std::vector<BYTE> vecRow (dwWidth);
+    for (size_t w = 0; w < m_nWindows; w++)
+    {
+        for (DWORD s = 0; s < m_dwNumSets; s++)
+        {
+            BYTE bPixel = static_cast<BYTE>((static_cast<QWORD>(vecMatrix[w * m_dwNumSets + s]) * 255) / dwMax);
+            std::fill (vecRow.begin() + s * dwScale, vecRow.begin() + (s + 1) * dwScale, bPixel);
+        }
+        ofsPgm.write (reinterpret_cast<const char*>(vecRow.data()), vecRow.size());
+    }
+
+    return !ofsPgm.fail();
+}
@@ -0,0 +1,84 @@
+/**
+ *  @file       CacheHeatmap.h
+ *  @brief      CCacheHeatmap class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CACHE_HEATMAP_H__)
+#define _CACHE_HEATMAP_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+/**
+ *  Turns an event log written by CCacheEventLog into time x set heatmaps.
+ *
+ *  Time is divided into windows of a fixed number of accesses; each window
+ *  becomes one row and each cache set one column.  Two heatmaps are built:
+ *
+ *  - misses        number of misses in the set during the window
+ *  - occupancy     number of valid blocks in the set at the end of the window
+ *
+ *  Each heatmap is written both as a CSV matrix (exact values) and as a
+ *  binary PGM grayscale image (scaled to the maximum value), named
+ *  \<prefix\>_misses.csv, \<prefix\>_misses.pgm, \<prefix\>_occupancy.csv and
+ *  \<prefix\>_occupancy.pgm.
+ */
+class CCacheHeatmap
+{
+    DWORD                   m_dwNumSets;
+    DWORD                   m_dwBlocksPerSet;
+    std::vector<DWORD>      m_vecMisses;        ///< row-major window x set
+    std::vector<DWORD>      m_vecOccupancy;     ///< row-major window x set
+    size_t                  m_nWindows;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CCacheHeatmap ( );
+
+/**
+    Reads an event log and accumulates the heatmaps
+
+    @param [in] szEventLog          name of the event log file
+    @param [in] qwWindow            number of accesses per heatmap row
+
+    @retval true      on success
+    @retval false     on error or malformed event log
+ */
+    bool Build (const TCHAR* szEventLog, QWORD qwWindow);
+
+/**
+    Writes the heatmaps built by Build as CSV and PGM files
+
+    @param [in] szPrefix            path and file name prefix of the output files
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool Write (const TCHAR* szPrefix) const;
+
+/**
+    Returns the number of time windows (heatmap rows)
+ */
+    constexpr size_t get_Windows (void) const noexcept
+    { return m_nWindows; };
+
+private:
+
+    bool WriteMatrix (const TCHAR* szPrefix, const TCHAR* szSuffix,
+                      const std::vector<DWORD>& vecMatrix) const;
+
+    CCacheHeatmap (const CCacheHeatmap& rhs) = delete;
+    CCacheHeatmap& operator = (const CCacheHeatmap& rhs) = delete;
+};
+
+#endif
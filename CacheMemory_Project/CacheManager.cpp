@@ -7,8 +7,10 @@
  */
 #include "stdafx.h"
 
+#include <memory.h>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 
 #include "VirtualAddress.h"
 #include "CacheManager.h"
@@ -17,13 +19,28 @@ void CCacheManager::Init(void)
 {
     for (auto& it : m_rgCacheSets)
         it.Init();
+
+    m_pLastBlock = nullptr;
 }
 
 bool CCacheManager::GetCacheData (const void* pAddress, DWORD& dwData) noexcept
 {
     bool bReturn = false;
+    const DWORD_PTR dwAddress = reinterpret_cast<DWORD_PTR>(pAddress);
+    const DWORD_PTR dwBlock   = dwAddress & ~static_cast<DWORD_PTR>(req::g_CACHE_BLOCK_SIZE - 1);
+
+    if ( pAddress && m_pLastBlock && (dwBlock == m_dwLastBlock) )
+    {
+        // same block as the last hit or fill, so no decode and no search
+        bReturn = m_pLastBlock->GetCacheData (dwAddress - dwBlock, dwData);
+#ifdef _DEBUG
+        std::cout << "  Same block as the last access, Cache Set [" << m_dwLastIndex << "]" << std::endl;
+#endif
+        if ( m_pObserver )
+            m_pObserver->OnCacheAccess (pAddress, m_dwLastIndex, bReturn);
+    }
     // we need to decode pAddress and see if it maps to what we have in cache
-    if ( pAddress )
+    else if ( pAddress )
     {
         CVirtualAddress vAddress (pAddress);
         DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
@@ -49,9 +66,23 @@ bool CCacheManager::GetCacheData (const void* pAddress, DWORD& dwData) noexcept
    incurring the complexity of a fully associative memory.
 */
             bReturn = m_rgCacheSets[dwIndex].GetCacheData (dwTag, dwOffset, dwData);
+            if ( bReturn )
+            {
+                m_pLastBlock  = m_rgCacheSets[dwIndex].get_LastBlock ( );
+                m_dwLastBlock = dwBlock;
+                m_dwLastIndex = dwIndex;
+            }
+
+            if ( m_pObserver )
+                m_pObserver->OnCacheAccess (pAddress, dwIndex, bReturn);
         }
     }
 
+    if ( bReturn )
+        m_qwCacheHits++;
+    else
+        m_qwCacheMisses++;
+
     return bReturn;
 }
 
@@ -65,11 +96,206 @@ bool CCacheManager::LoadCachePage (const void* pAddress) noexcept
         DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
         if ( (dwIndex < _countof(m_rgCacheSets) ) && (dwIndex != DECODE_ERROR) )
         {
-            bReturn = m_rgCacheSets[dwIndex].LoadCacheBlock(vAddress.DecodeTag( ), 
-                                                            pAddress);
+            DWORD_PTR dwEvictedTag = NO_EVICTION;
+            if ( m_pBackingStore )
+                bReturn = FillFromBackingStore (reinterpret_cast<DWORD_PTR>(pAddress),
+                                                vAddress.DecodeTag ( ), dwIndex, &dwEvictedTag);
+            else
+                bReturn = m_rgCacheSets[dwIndex].LoadCacheBlock(vAddress.DecodeTag( ), 
+                                                                pAddress, &dwEvictedTag);
+
+            // the fill may have evicted the last block, it is the last block now
+            m_pLastBlock  = bReturn ? m_rgCacheSets[dwIndex].get_LastBlock ( ) : nullptr;
+            m_dwLastBlock = reinterpret_cast<DWORD_PTR>(pAddress) & ~static_cast<DWORD_PTR>(req::g_CACHE_BLOCK_SIZE - 1);
+            m_dwLastIndex = dwIndex;
+
+            if ( bReturn && m_pObserver )
+                m_pObserver->OnCacheFill (pAddress, dwIndex, dwEvictedTag);
+        }
+    }
+    return bReturn;
+}
+
+bool CCacheManager::UpdateCacheData (const void* pAddress, const void* pData, size_t cbLen) noexcept
+{
+    bool bReturn = false;
+
+    if ( pAddress && pData )
+    {
+        if ( m_pBackingStore )
+            m_pBackingStore->Write (reinterpret_cast<DWORD_PTR>(pAddress), pData, cbLen);
+
+        CVirtualAddress vAddress (pAddress);
+        DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+        if ( (dwIndex < _countof(m_rgCacheSets) ) && (dwIndex != DECODE_ERROR) )
+        {
+            bReturn = m_rgCacheSets[dwIndex].UpdateCacheData (vAddress.DecodeTag ( ),
+                                                              vAddress.DecodeOffset ( ),
+                                                              pData, cbLen);
         }
     }
     return bReturn;
 }
 
+bool CCacheManager::GetCacheData (QWORD qwAddress, DWORD& dwData) noexcept
+{
+    const void* pAddress;
+    if ( CVirtualAddress::FromTraceAddress (qwAddress, pAddress) )
+        return GetCacheData (pAddress, dwData);
+
+    bool bReturn = false;
+    DWORD_PTR dwTag, dwIndex, dwOffset;
+    if ( m_pBackingStore && CVirtualAddress::DecodeTraceAddress (qwAddress, dwTag, dwIndex, dwOffset) )
+        bReturn = m_rgCacheSets[dwIndex].GetCacheData (dwTag, dwOffset, dwData);
+
+    if ( bReturn )
+        m_qwCacheHits++;
+    else
+        m_qwCacheMisses++;
+
+    return bReturn;
+}
+
+bool CCacheManager::LoadCachePage (QWORD qwAddress) noexcept
+{
+    const void* pAddress;
+    if ( CVirtualAddress::FromTraceAddress (qwAddress, pAddress) )
+        return LoadCachePage (pAddress);
+
+    bool bReturn = false;
+    DWORD_PTR dwTag, dwIndex, dwOffset;
+    if ( m_pBackingStore && CVirtualAddress::DecodeTraceAddress (qwAddress, dwTag, dwIndex, dwOffset) )
+    {
+        bReturn = FillFromBackingStore (qwAddress, dwTag, dwIndex, nullptr);
+        // the fill may have evicted the last block
+        m_pLastBlock = nullptr;
+    }
+    return bReturn;
+}
+
+bool CCacheManager::UpdateCacheData (QWORD qwAddress, const void* pData, size_t cbLen) noexcept
+{
+    const void* pAddress;
+    if ( CVirtualAddress::FromTraceAddress (qwAddress, pAddress) )
+        return UpdateCacheData (pAddress, pData, cbLen);
 
+    bool bReturn = false;
+    DWORD_PTR dwTag, dwIndex, dwOffset;
+    if ( pData && m_pBackingStore && CVirtualAddress::DecodeTraceAddress (qwAddress, dwTag, dwIndex, dwOffset) )
+    {
+        m_pBackingStore->Write (qwAddress, pData, cbLen);
+        bReturn = m_rgCacheSets[dwIndex].UpdateCacheData (dwTag, dwOffset, pData, cbLen);
+    }
+    return bReturn;
+}
+
+bool CCacheManager::FillFromBackingStore (QWORD qwAddress, DWORD_PTR dwTag, DWORD_PTR dwIndex,
+                                          DWORD_PTR* pdwEvictedTag) noexcept
+{
+    // LoadCacheBlock aligns the address it is given, so the
+    // buffer must be block aligned to be copied as a whole
+    alignas(req::g_CACHE_BLOCK_SIZE) BYTE rgBlock[req::g_CACHE_BLOCK_SIZE];
+    const QWORD qwBlock = qwAddress & ~static_cast<QWORD>(req::g_CACHE_BLOCK_SIZE - 1);
+
+    return m_pBackingStore->Read (qwBlock, rgBlock, sizeof(rgBlock)) &&
+           m_rgCacheSets[dwIndex].LoadCacheBlock (dwTag, rgBlock, pdwEvictedTag);
+}
+
+static void InitCheckpointHeader (CACHE_CHECKPOINT_HEADER& hdr) noexcept
+{
+    memset (&hdr, 0, sizeof(hdr));
+
+    hdr.dwMagic        = g_CHECKPOINT_MAGIC;
+    hdr.dwVersion      = g_CHECKPOINT_VERSION;
+    hdr.cbHeader       = sizeof(CACHE_CHECKPOINT_HEADER);
+    hdr.cbSetState     = sizeof(CACHE_SET_STATE);
+    hdr.dwNumSets      = g_CACHE_SETS;
+    hdr.dwBlocksPerSet = req::g_4WAY_BLOCKS_PER_SET;
+    hdr.dwBlockSize    = req::g_CACHE_BLOCK_SIZE;
+}
+
+bool CCacheManager::SaveCheckpoint (const TCHAR* szFileName) const noexcept
+{
+    bool bReturn = false;
+
+    if ( szFileName )
+    {
+        std::ofstream ofs (szFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if ( ofs.is_open() )
+        {
+            CACHE_CHECKPOINT_HEADER hdr;
+            InitCheckpointHeader (hdr);
+            hdr.qwCacheHits   = m_qwCacheHits;
+            hdr.qwCacheMisses = m_qwCacheMisses;
+
+            ofs.write (reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+
+            // zeroed once so the padding and reserved fields are written as zero
+            CACHE_SET_STATE state;
+            memset (&state, 0, sizeof(state));
+            for (const auto& it : m_rgCacheSets)
+            {
+                it.SaveState (state);
+                ofs.write (reinterpret_cast<const char*>(&state), sizeof(state));
+            }
+
+            ofs.close();
+            bReturn = !ofs.fail();
+        }
+    }
+    return bReturn;
+}
+
+bool CCacheManager::RestoreCheckpoint (const TCHAR* szFileName) noexcept
+{
+    bool bReturn = false;
+
+    if ( szFileName == nullptr )
+        return bReturn;
+
+    std::ifstream ifs (szFileName, std::ios::in | std::ios::binary);
+    if ( !ifs.is_open() )
+        return bReturn;
+
+    CACHE_CHECKPOINT_HEADER hdr;
+    CACHE_SET_STATE         rgState[g_CACHE_SETS];
+
+    ifs.read (reinterpret_cast<char*>(&hdr), sizeof(hdr));
+    ifs.read (reinterpret_cast<char*>(rgState), sizeof(rgState));
+
+    // both records must be complete and nothing may follow them
+    if ( !ifs || (ifs.peek() != std::ifstream::traits_type::eof()) )
+        return bReturn;
+
+    // the geometry must match exactly, otherwise the tags and
+    // indices recorded in the checkpoint mean something else
+    CACHE_CHECKPOINT_HEADER hdrExpected;
+    InitCheckpointHeader (hdrExpected);
+
+    bool bValid = (hdr.dwMagic        == hdrExpected.dwMagic)
+               && (hdr.dwVersion      == hdrExpected.dwVersion)
+               && (hdr.cbHeader       == hdrExpected.cbHeader)
+               && (hdr.cbSetState     == hdrExpected.cbSetState)
+               && (hdr.dwNumSets      == hdrExpected.dwNumSets)
+               && (hdr.dwBlocksPerSet == hdrExpected.dwBlocksPerSet)
+               && (hdr.dwBlockSize    == hdrExpected.dwBlockSize);
+
+    // also validate every set record prior to restoring anything,
+    // so a corrupt checkpoint leaves the cache untouched
+    for (DWORD i = 0; bValid && (i < g_CACHE_SETS); i++)
+        bValid = CCacheSet::IsValidState (rgState[i]);
+
+    if ( bValid )
+    {
+        bReturn = true;
+        for (DWORD i = 0; i < g_CACHE_SETS; i++)
+            bReturn = m_rgCacheSets[i].RestoreState (rgState[i]) && bReturn;
+        m_pLastBlock = nullptr;
+
+        m_qwCacheHits   = hdr.qwCacheHits;
+        m_qwCacheMisses = hdr.qwCacheMisses;
+    }
+
+    return bReturn;
+}
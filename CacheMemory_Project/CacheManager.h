@@ -17,6 +17,14 @@
     #include "CacheSet.h"
 #endif
 
+#if !defined(_CACHE_OBSERVER_H__)
+    #include "CacheObserver.h"
+#endif
+
+#if !defined(_BACKING_STORE_H__)
+    #include "BackingStore.h"
+#endif
+
 /**
     Number of cache sets needed
  */
@@ -26,6 +34,19 @@ class CCacheManager
 {
     CCacheSet m_rgCacheSets[g_CACHE_SETS];
 
+    QWORD     m_qwCacheHits;    ///< count of GetCacheData calls that hit
+    QWORD     m_qwCacheMisses;  ///< count of GetCacheData calls that missed
+
+    const CCacheBlock* m_pLastBlock;  ///< block of the last hit or fill, nullptr if none
+    DWORD_PTR m_dwLastBlock;    ///< block aligned address of m_pLastBlock
+    DWORD_PTR m_dwLastIndex;    ///< set of m_pLastBlock
+
+    ICacheObserver* m_pObserver; ///< optional, notified of every access and fill
+    IBackingStore*  m_pBackingStore; ///< optional, memory behind the cache
+
+    bool FillFromBackingStore (QWORD qwAddress, DWORD_PTR dwTag, DWORD_PTR dwIndex,
+                               DWORD_PTR* pdwEvictedTag) noexcept;
+
 public:
 
 /**
@@ -34,6 +55,13 @@ public:
  *  @note (is_nothrow_default_constructible == true)
  */
     CCacheManager ( ) noexcept
+        : m_qwCacheHits   (0),
+          m_qwCacheMisses (0),
+          m_pLastBlock    (nullptr),
+          m_dwLastBlock   (0),
+          m_dwLastIndex   (0),
+          m_pObserver     (nullptr),
+          m_pBackingStore (nullptr)
     { };
 
 /**
@@ -45,7 +73,12 @@ public:
     void Init();
 
 /**
-    Attempts to retrieve data from cache memory based on address
+    Attempts to retrieve data from cache memory based on address.
+
+    An access to the block of the last hit or fill is certain to hit, since
+    only a fill can evict it, so it is served from that block without
+    decoding the address or searching the set.  The observer is notified of
+    it like of any other access.
     
     @param [in]  pAddress     memory address to check for cache hit
     @param [out] dwData       output variable to return stored data value
@@ -55,9 +88,24 @@ public:
 */
     bool GetCacheData  (const void* pAddress, DWORD& dwData) noexcept;
 
+ /**
+    GetCacheData for a 64 bit trace address.  An address that does not fit
+    a pointer of this build (x86) is decoded as a QWORD instead, which takes
+    an attached backing store; such an access bypasses the last block and
+    is not reported to the observer, which both work on pointers.
+
+    @param [in]  qwAddress    trace address to check for cache hit
+    @param [out] dwData       output variable to return stored data value
+
+    @retval true     on cache hit, dwData is set
+    @retval false    on cache miss, dwData is not set
+ */
+    bool GetCacheData  (QWORD qwAddress, DWORD& dwData) noexcept;
+
  /**
     Loads a contiguous block of memory, upto CACHE_BLOCK_SIZE, based on the
-    address pointer passed.
+    address pointer passed.  The block is read from the backing store if one
+    is attached, or else from the process memory at that address.
 
     @param [in] pAddress       address of memory the actual page load is based on
 
@@ -66,6 +114,110 @@ public:
  */
     bool LoadCachePage (const void* pAddress) noexcept;
 
+ /**
+    LoadCachePage for a 64 bit trace address, see GetCacheData (QWORD)
+
+    @param [in] qwAddress      trace address the actual page load is based on
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool LoadCachePage (QWORD qwAddress) noexcept;
+
+ /**
+    Writes data through to cache memory (write-through, no-allocate).  Only
+    a cache block that is already resident is updated.  The data is written
+    to the backing store if one is attached; otherwise the caller remains
+    responsible for updating memory itself.
+
+    @param [in] pAddress       memory address being written
+    @param [in] pData          pointer to the data being written
+    @param [in] cbLen          count of bytes (cb) of data length, must not
+                               cross a cache block boundary
+
+    @retval true      if a resident cache block was updated
+    @retval false     if the block is not resident or on error
+ */
+    bool UpdateCacheData (const void* pAddress, const void* pData, size_t cbLen) noexcept;
+
+ /**
+    UpdateCacheData for a 64 bit trace address, see GetCacheData (QWORD)
+
+    @param [in] qwAddress      trace address being written
+    @param [in] pData          pointer to the data being written
+    @param [in] cbLen          count of bytes (cb) of data length, must not
+                               cross a cache block boundary
+
+    @retval true      if a resident cache block was updated
+    @retval false     if the block is not resident or on error
+ */
+    bool UpdateCacheData (QWORD qwAddress, const void* pData, size_t cbLen) noexcept;
+
+ /**
+    Attaches the memory blocks are loaded from and data is written through
+    to, or detaches the current one when passed nullptr, after which blocks
+    are copied from the process memory at their address again.  Addresses
+    are then only decoded, never dereferenced, so a trace recorded by
+    another process can be replayed with its data (see CSparseMemory),
+    through the QWORD overloads if it is wider than this build.
+
+    @param [in] pBackingStore  backing store to attach (not owned)
+ */
+    void set_BackingStore (IBackingStore* pBackingStore) noexcept
+    { m_pBackingStore = pBackingStore; };
+
+ /**
+    Returns the number of cache hits recorded by GetCacheData
+ */
+    constexpr QWORD get_CacheHits   (void) const noexcept
+    { return m_qwCacheHits; };
+
+ /**
+    Returns the number of cache misses recorded by GetCacheData
+ */
+    constexpr QWORD get_CacheMisses (void) const noexcept
+    { return m_qwCacheMisses; };
+
+ /**
+    Clears the hit / miss statistics without disturbing the cache contents,
+    typically called at the start of a measurement window
+ */
+    void ResetStatistics (void) noexcept
+    { m_qwCacheHits = m_qwCacheMisses = 0; };
+
+ /**
+    Attaches an observer that is notified of every access and block load,
+    or detaches the current one when passed nullptr
+
+    @param [in] pObserver      observer to attach (not owned)
+ */
+    void set_Observer (ICacheObserver* pObserver) noexcept
+    { m_pObserver = pObserver; };
+
+ /**
+    Writes the complete cache state (tags, valid bits, data blocks, FIFO
+    replacement order and statistics) to a binary checkpoint file
+
+    @param [in] szFileName      name of the checkpoint file to create
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool SaveCheckpoint    (const TCHAR* szFileName) const noexcept;
+
+ /**
+    Restores the complete cache state from a checkpoint file previously
+    written by SaveCheckpoint.  The whole file is read and validated before
+    any set is restored, so the cache is left untouched if the checkpoint is
+    malformed, truncated, or was taken with a different cache geometry.
+
+    @param [in] szFileName      name of the checkpoint file to restore
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool RestoreCheckpoint (const TCHAR* szFileName) noexcept;
+
 };
 
 
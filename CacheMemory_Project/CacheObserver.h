@@ -0,0 +1,92 @@
+/**
+ *  @file       CacheObserver.h
+ *  @brief      ICacheObserver interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CACHE_OBSERVER_H__)
+#define _CACHE_OBSERVER_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+/**
+ *  Receives a notification for every access and every block load performed
+ *  by a CCacheManager, see CCacheManager::set_Observer
+ */
+class ICacheObserver
+{
+public:
+    virtual ~ICacheObserver ( )
+    { };
+
+ /**
+    Called once for every lookup (CCacheManager::GetCacheData)
+
+    @param [in] pAddress        memory address being accessed
+    @param [in] dwIndex         cache set the address maps to
+    @param [in] bHit            true on a cache hit, false on a miss
+ */
+    virtual void OnCacheAccess (const void* pAddress, DWORD_PTR dwIndex, bool bHit) = 0;
+
+/**
+    Called once for every block load (CCacheManager::LoadCachePage)
+
+    @param [in] pAddress        memory address the block load is based on
+    @param [in] dwIndex         cache set the block was loaded into
+    @param [in] dwEvictedTag    Tag of the replaced block, NO_EVICTION if the
+                                block was empty
+ */
+    virtual void OnCacheFill   (const void* pAddress, DWORD_PTR dwIndex, 
+                                DWORD_PTR dwEvictedTag) = 0;
+};
+
+/**
+ *  Forwards every notification to a list of observers, so that several
+ *  observers can be attached to the same CCacheManager
+ */
+class CCacheObserverGroup : public ICacheObserver
+{
+    std::vector<ICacheObserver*> m_vecObservers;
+
+public:
+    CCacheObserverGroup ( )
+        : m_vecObservers ( )
+    { };
+
+ /**
+    Adds an observer to the group
+
+    @param [in] pObserver      observer to add (not owned)
+ */
+    void Add (ICacheObserver* pObserver)
+    {
+        if ( pObserver )
+            m_vecObservers.push_back (pObserver);
+    };
+
+    bool empty (void) const noexcept
+    { return m_vecObservers.empty(); };
+
+    virtual void OnCacheAccess (const void* pAddress, DWORD_PTR dwIndex, bool bHit) override
+    {
+        for (auto it : m_vecObservers)
+            it->OnCacheAccess (pAddress, dwIndex, bHit);
+    };
+
+    virtual void OnCacheFill   (const void* pAddress, DWORD_PTR dwIndex,
+                                DWORD_PTR dwEvictedTag) override
+    {
+        for (auto it : m_vecObservers)
+            it->OnCacheFill (pAddress, dwIndex, dwEvictedTag);
+    };
+};
+
+#endif
@@ -0,0 +1,238 @@
+/**
+ *  @file       CacheSampler.cpp
+ *  @brief      CCacheSampler class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <cmath>
+
+#include "CacheSampler.h"
+
+CCacheSampler::CCacheSampler ( ) noexcept
+    : m_rgSets       ( ),
+      m_nSets        (0),
+      m_dwOffsetBits (0),
+      m_dwIndexBits  (0),
+      m_nSetRatio    (1),
+      m_nSetPhase    (0),
+      m_qwPeriod     (0),
+      m_qwUnit       (0),
+      m_qwAccesses   (0),
+      m_qwSimulated  (0),
+      m_vecSets      ( ),
+      m_unit         { 0, 0 },
+      m_vecUnits     ( )
+{
+};
+
+bool CCacheSampler::Init (size_t nSets, size_t nWays, size_t cbBlock /* = req::g_CACHE_BLOCK_SIZE */,
+                          REPLACEMENT_POLICY ePolicy /* = REPLACE_FIFO */,
+                          size_t nSetRatio /* = 1 */, size_t nSetPhase /* = 0 */)
+{
+    if ( (nSets == 0) || ((nSets & (nSets - 1)) != 0) ||
+         (cbBlock == 0) || ((cbBlock & (cbBlock - 1)) != 0) ||
+         (nSetRatio == 0) || (nSetRatio > nSets) || (nSetPhase >= nSetRatio) )
+        return false;
+
+    // sampled set n is kept at (n - nSetPhase) / nSetRatio
+    const size_t nSampled = (nSets - nSetPhase + nSetRatio - 1) / nSetRatio;
+
+    m_rgSets.reset (new CAssociativeSet[nSampled]);
+    for (size_t i = 0; i < nSampled; i++)
+    {
+        if ( !m_rgSets[i].Init (nWays, ePolicy) )
+        {
+            m_rgSets.reset ( );
+            m_nSets = 0;
+            return false;
+        }
+    }
+
+    m_nSets     = nSets;
+    m_nSetRatio = nSetRatio;
+    m_nSetPhase = nSetPhase;
+
+    m_dwOffsetBits = 0;
+    while ( (static_cast<size_t>(1) << m_dwOffsetBits) < cbBlock )
+        m_dwOffsetBits++;
+    m_dwIndexBits = 0;
+    while ( (static_cast<size_t>(1) << m_dwIndexBits) < nSets )
+        m_dwIndexBits++;
+
+    m_vecSets.assign (nSampled, SAMPLE_COUNTS { 0, 0 });
+    Reset ( );
+    return true;
+}
+
+bool CCacheSampler::SetTimeSampling (QWORD qwPeriod, QWORD qwUnit) noexcept
+{
+    bool bReturn = false;
+    if ( (qwPeriod == 0) || ((qwUnit > 0) && (qwUnit <= qwPeriod)) )
+    {
+        m_qwPeriod = qwPeriod;
+        m_qwUnit   = qwUnit;
+        bReturn    = true;
+    }
+    return bReturn;
+}
+
+bool CCacheSampler::Access (QWORD qwAddress) noexcept
+{
+    if ( (qwAddress == 0) || (m_nSets == 0) )
+        return false;
+
+    // position within the current time sampling period, measured over every
+    // access presented so the periods are independent of set sampling
+    bool bMeasure   = true;
+    bool bUnitEnd   = false;
+    if ( m_qwPeriod )
+    {
+        QWORD qwPos = m_qwAccesses % m_qwPeriod;
+        bMeasure    = qwPos >= (m_qwPeriod - m_qwUnit);
+        bUnitEnd    = qwPos == (m_qwPeriod - 1);
+    }
+    m_qwAccesses++;
+
+    bool bReturn = false;
+
+    const QWORD  qwBlock = qwAddress >> m_dwOffsetBits;
+    const size_t nIndex  = static_cast<size_t>(qwBlock & (m_nSets - 1));
+
+    if ( IsSampledSet (nIndex) )
+    {
+        m_qwSimulated++;
+
+        const size_t    nSampled = (nIndex - m_nSetPhase) / m_nSetRatio;
+        const QWORD     qwTag    = qwBlock >> m_dwIndexBits;
+
+        CAssociativeSet& cacheSet = m_rgSets[nSampled];
+        bReturn = cacheSet.AccessCacheTag (qwTag);
+        if ( !bReturn )
+            cacheSet.LoadCacheTag (qwTag);
+
+        if ( bMeasure )
+        {
+            SAMPLE_COUNTS& counts = m_vecSets[nSampled];
+            counts.qwAccesses++;
+            m_unit.qwAccesses++;
+            if ( !bReturn )
+            {
+                counts.qwMisses++;
+                m_unit.qwMisses++;
+            }
+        }
+    }
+
+    if ( bUnitEnd )
+    {
+        if ( m_unit.qwAccesses )
+            m_vecUnits.push_back (m_unit);
+
+        m_unit = SAMPLE_COUNTS { 0, 0 };
+    }
+
+    return bReturn;
+}
+
+bool CCacheSampler::RatioEstimate (const std::vector<SAMPLE_COUNTS>& vecSamples, double dFpc,
+                                   double& dRate, double& dVariance) noexcept
+{
+    double dAccesses = 0.0;
+    double dMisses   = 0.0;
+    for (const auto& it : vecSamples)
+    {
+        dAccesses += static_cast<double>(it.qwAccesses);
+        dMisses   += static_cast<double>(it.qwMisses);
+    }
+
+    if ( dAccesses <= 0.0 )
+        return false;
+
+    dRate     = dMisses / dAccesses;
+    dVariance = 0.0;
+
+    const size_t n = vecSamples.size();
+    if ( (n >= 2) && (dFpc > 0.0) )
+    {
+        double dSumSq = 0.0;
+        for (const auto& it : vecSamples)
+        {
+            double d = it.qwMisses - dRate * it.qwAccesses;
+            dSumSq += d * d;
+        }
+        double dMeanAccesses = dAccesses / n;
+
+        dVariance = dFpc * (dSumSq / (n - 1)) / (n * dMeanAccesses * dMeanAccesses);
+    }
+    return true;
+}
+
+bool CCacheSampler::GetEstimate (SAMPLING_ESTIMATE& estimate, double dZ /* = 1.96 */) const
+{
+    bool   bReturn   = false;
+    double dRate     = 0.0;
+    double dVariance = 0.0;
+
+    if ( m_qwPeriod )
+    {
+        // time sampling: each measurement unit is one sample, weighted by the
+        // accesses it measured; the interval follows from the variance between
+        // units
+        if ( m_vecUnits.size() >= 2 )
+        {
+            bReturn = RatioEstimate (m_vecUnits, 1.0, dRate, dVariance);
+            estimate.nSamples = m_vecUnits.size();
+        }
+
+        // combined with set sampling this is a two-stage sample: the units
+        // only vary over time within the sets drawn, so the variance between
+        // the sampled set clusters is added as the first stage component
+        const size_t nSampled = m_vecSets.size();
+        if ( bReturn && (m_nSetRatio > 1) && (nSampled >= 2) )
+        {
+            double dSetRate     = 0.0;
+            double dSetVariance = 0.0;
+            double dFpc = 1.0 - static_cast<double>(nSampled) / m_nSets;
+            if ( RatioEstimate (m_vecSets, dFpc, dSetRate, dSetVariance) )
+                dVariance += dSetVariance;
+        }
+    }
+    else
+    {
+        // set sampling: the sampled sets are clusters of a simple random
+        // sample drawn without replacement from the sets of the cache
+        const size_t nSampled = m_vecSets.size();
+        if ( (nSampled >= 2) || (nSampled == m_nSets) )
+        {
+            double dFpc = 1.0 - static_cast<double>(nSampled) / m_nSets;
+            bReturn = RatioEstimate (m_vecSets, dFpc, dRate, dVariance);
+            estimate.nSamples = nSampled;
+        }
+    }
+
+    if ( bReturn )
+    {
+        estimate.dMissRate      = dRate;
+        estimate.dMissRateError = dZ * std::sqrt (dVariance);
+        estimate.dMisses        = estimate.dMissRate      * m_qwAccesses;
+        estimate.dMissesError   = estimate.dMissRateError * m_qwAccesses;
+    }
+
+    return bReturn;
+}
+
+void CCacheSampler::Reset (void)
+{
+    m_qwAccesses  = 0;
+    m_qwSimulated = 0;
+    m_unit        = SAMPLE_COUNTS { 0, 0 };
+
+    for (auto& it : m_vecSets)
+        it = SAMPLE_COUNTS { 0, 0 };
+
+    m_vecUnits.clear ( );
+}
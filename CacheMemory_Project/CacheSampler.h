@@ -0,0 +1,198 @@
+/**
+ *  @file       CacheSampler.h
+ *  @brief      CCacheSampler class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CACHE_SAMPLER_H__)
+#define _CACHE_SAMPLER_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _MEMORY_
+    #include <memory>
+#endif
+
+#if !defined(_ASSOCIATIVE_CACHE_H__)
+    #include "AssociativeCache.h"
+#endif
+
+/*
+    Statistical sampling of cache simulation.
+
+    Set sampling:
+        Only the sets whose index satisfies (index % SetRatio) == SetPhase are
+        simulated, and only they are allocated; accesses mapping to any other
+        set are discarded right after the address is decoded.  Since sets never
+        interact, each sampled set behaves exactly as it would in the full
+        simulation and the per-set miss counts form a simple random cluster
+        sample of the whole cache.  The 4 set cache of the assignment leaves
+        little to sample, so the sampler simulates a cache of any geometry.
+
+    Time sampling (SMARTS style):
+        The access stream is divided into periods of 'Period' accesses.  The
+        last 'Unit' accesses of every period form a detailed measurement unit
+        whose hits and misses are recorded.  Every other access is used for
+        functional warming only, i.e. the cache state is updated but nothing
+        is measured, so each measurement unit starts with a warm cache.
+
+    Both forms may be combined.  The whole-cache miss rate is estimated from
+    the samples, the sampled sets or the measurement units, as the ratio of
+    their misses to their accesses, so a sample is weighted by the accesses
+    it saw.  It is reported together with a confidence interval computed
+    from the linearized variance of that ratio (normal approximation).
+    When both are combined the estimate is a two-stage sample, sets drawn
+    first and measurement units within them, and the interval adds the
+    variance between the sampled sets to the variance between the units.
+*/
+
+/**
+ *  Extrapolated whole-cache results and their confidence intervals
+ */
+struct SAMPLING_ESTIMATE
+{
+    double  dMissRate;          ///< estimated miss rate (misses / accesses)
+    double  dMissRateError;     ///< +/- half width of the miss rate confidence interval
+    double  dMisses;            ///< estimated whole-cache miss count
+    double  dMissesError;       ///< +/- half width of the miss count confidence interval
+    size_t  nSamples;           ///< number of samples the estimate is based on
+};
+
+/**
+ *  Accesses and misses measured by one sample, a sampled set or a time
+ *  sampling measurement unit
+ */
+struct SAMPLE_COUNTS
+{
+    QWORD   qwAccesses;
+    QWORD   qwMisses;
+};
+
+/**
+ *  Simulates a cache of any geometry in set and/or time sampling mode and
+ *  extrapolates the sampled results to the whole cache
+ */
+class CCacheSampler
+{
+    std::unique_ptr<CAssociativeSet[]>  m_rgSets;   ///< the sampled sets only
+    size_t          m_nSets;            ///< sets of the whole cache
+    DWORD           m_dwOffsetBits;
+    DWORD           m_dwIndexBits;
+
+    size_t          m_nSetRatio;        ///< simulate 1 out of every m_nSetRatio sets
+    size_t          m_nSetPhase;        ///< index (modulo m_nSetRatio) of the sampled sets
+    QWORD           m_qwPeriod;         ///< time sampling period (in accesses), 0 disables
+    QWORD           m_qwUnit;           ///< detailed measurement unit (in accesses)
+
+    QWORD           m_qwAccesses;       ///< total accesses presented to the sampler
+    QWORD           m_qwSimulated;      ///< accesses actually simulated (sampled sets)
+
+    std::vector<SAMPLE_COUNTS> m_vecSets;   ///< measured counts of each sampled set
+    SAMPLE_COUNTS              m_unit;      ///< measured counts of the current unit
+    std::vector<SAMPLE_COUNTS> m_vecUnits;  ///< measured counts of each completed unit
+
+public:
+/**
+ *  Default Constructor, Init must be called before use
+ */
+    CCacheSampler ( ) noexcept;
+
+/**
+    Allocates the sampled sets of an empty cache and configures set sampling
+
+    @param [in] nSets           sets of the whole cache, a power of 2
+    @param [in] nWays           ways per set
+    @param [in] cbBlock         block size in bytes, a power of 2
+    @param [in] ePolicy         REPLACE_FIFO or REPLACE_LRU
+    @param [in] nSetRatio       simulate 1 out of every nSetRatio sets (1 disables),
+                                at most nSets
+    @param [in] nSetPhase       which of the nSetRatio sets to simulate
+
+    @retval true      on success
+    @retval false     on an invalid geometry, policy or sampling ratio
+ */
+    bool Init (size_t nSets, size_t nWays, size_t cbBlock = req::g_CACHE_BLOCK_SIZE,
+               REPLACEMENT_POLICY ePolicy = REPLACE_FIFO,
+               size_t nSetRatio = 1, size_t nSetPhase = 0);
+
+/**
+    Configures SMARTS style time sampling
+
+    @param [in] qwPeriod        sampling period in accesses (0 disables)
+    @param [in] qwUnit          detailed measurement unit in accesses
+
+    @retval true      on success
+    @retval false     on invalid parameters
+ */
+    bool SetTimeSampling (QWORD qwPeriod, QWORD qwUnit) noexcept;
+
+/**
+    Presents a single memory access to the sampler.  If the access maps to a
+    sampled set it is simulated (loading the cache block on a miss) and, if
+    it falls within a measurement unit, recorded.  Address 0 is skipped.
+
+    @param [in] qwAddress       memory address being accessed
+
+    @retval true      if the access was simulated and hit
+    @retval false     if the access missed or was not simulated
+ */
+    bool Access (QWORD qwAddress) noexcept;
+
+/**
+    Extrapolates the sampled results to the whole cache
+
+    @param [out] estimate       extrapolated results
+    @param [in]  dZ             standard normal quantile of the desired
+                                confidence level (1.96 for 95%)
+
+    @retval true      on success
+    @retval false     if not enough samples have been collected
+ */
+    bool GetEstimate (SAMPLING_ESTIMATE& estimate, double dZ = 1.96) const;
+
+/**
+    Returns the total number of accesses presented to the sampler
+ */
+    constexpr QWORD get_Accesses  (void) const noexcept
+    { return m_qwAccesses; };
+
+/**
+    Returns the number of accesses that were actually simulated
+ */
+    constexpr QWORD get_Simulated (void) const noexcept
+    { return m_qwSimulated; };
+
+/**
+    Discards all collected samples, leaving the cache state as is
+ */
+    void Reset (void);
+
+private:
+
+    bool IsSampledSet (size_t nIndex) const noexcept
+    { return (nIndex % m_nSetRatio) == m_nSetPhase; };
+
+/**
+    Ratio estimate of the miss rate over a set of samples: the misses of
+    all samples over their accesses, and the linearized variance of that
+    ratio scaled by the finite population correction dFpc
+
+    @retval true      on success
+    @retval false     if the samples saw no access
+ */
+    static bool RatioEstimate (const std::vector<SAMPLE_COUNTS>& vecSamples, double dFpc,
+                               double& dRate, double& dVariance) noexcept;
+
+    CCacheSampler (const CCacheSampler& rhs) = delete;
+    CCacheSampler& operator = (const CCacheSampler& rhs) = delete;
+};
+
+#endif
@@ -7,45 +7,87 @@
  */
 
 #include "stdafx.h"
+#include <memory.h>
 #include <iostream>
+#include <algorithm>
+#include "VirtualAddress.h"
 #include "CacheSet.h"
 
 CCacheSet::CCacheSet() noexcept
-    : m_queAvailableBlocks()
+    : m_storage(),
+      m_pStorage(&m_storage),
+      m_pLastBlock(nullptr),
+      m_ePolicy(REPLACE_FIFO),
+      m_nNextUse(0)
 {
+    Init();
 };
 
 void CCacheSet::Init(void)
 {
-    for (int i = 0; i < _countof(m_rgCacheBlock); i++)
-        m_queAvailableBlocks.push(&m_rgCacheBlock[i]);
+    for (size_t i = 0; i < _countof(m_pStorage->rgFifoOrder); i++)
+        m_pStorage->rgFifoOrder[i] = static_cast<BYTE>(i);
 };
 
-bool CCacheSet::GetCacheData (DWORD_PTR dwTag, size_t cbOffset, DWORD& dwData) noexcept
+bool CCacheSet::Attach (CACHE_SET_STORAGE* pStorage) noexcept
 {
-    bool bReturn = false;
+    if ( pStorage == nullptr )
+        pStorage = &m_storage;
+
+    if ( !IsValidFifoOrder (pStorage->rgFifoOrder) )
+        return false;
+
+    m_pStorage   = pStorage;
+    m_pLastBlock = nullptr;
+
+    // the OPT heap points into the previous storage, rebuild it
+    set_Policy (m_ePolicy);
+    return true;
+}
+
+CCacheBlock* CCacheSet::RotateFifo (size_t nPosition) noexcept
+{
+    BYTE* pOrder = &m_pStorage->rgFifoOrder[nPosition];
+    CCacheBlock* pCacheBlock = &m_pStorage->rgCacheBlock[*pOrder];
+
+    std::rotate (pOrder, pOrder + 1, m_pStorage->rgFifoOrder + _countof(m_pStorage->rgFifoOrder));
+    return pCacheBlock;
+}
+
+CCacheBlock* CCacheSet::FindCacheBlock (DWORD_PTR dwTag) noexcept
+{
+    // only a hint: the block is checked like any other, so it need not be
+    // forgotten when it is evicted
+    if ( m_pLastBlock && m_pLastBlock->is_Valid ( ) && (m_pLastBlock->get_Tag ( ) == dwTag) )
+        return m_pLastBlock;
+
     // lets iterate through our cache blocks and see if any matches 'dwTag'
     // Actually, this should be done in multiple threads simultaneously
-    bool bFound = false;
-    int i;
-    for ( i = 0; i < _countof(m_rgCacheBlock); i++ )
+    for (size_t i = 0; i < _countof(m_pStorage->rgCacheBlock); i++)
     {
-        DWORD_PTR dwCacheTag = m_rgCacheBlock[i].get_Tag ( );
+        DWORD_PTR dwCacheTag = m_pStorage->rgCacheBlock[i].get_Tag ( );
 
 #ifdef _DEBUG
         std::cout << "    Checking Cache Block [" << i << "] " 
                   << "Cache Tag ["            << dwCacheTag << "]" << std::endl;
 #endif
-        if ( dwTag == dwCacheTag )
+        if ( m_pStorage->rgCacheBlock[i].is_Valid ( ) && (dwTag == dwCacheTag) )
         {
-            bFound = true;
-            break;
+            m_pLastBlock = &m_pStorage->rgCacheBlock[i];
+            return m_pLastBlock;
         }
     }
+    return nullptr;
+}
+
+bool CCacheSet::GetCacheData (DWORD_PTR dwTag, size_t cbOffset, DWORD& dwData) noexcept
+{
+    bool bReturn = false;
 
-    if ( bFound )
+    CCacheBlock* pCacheBlock = FindCacheBlock (dwTag);
+    if ( pCacheBlock )
     {
-        bReturn = m_rgCacheBlock[i].GetCacheData (cbOffset, dwData);
+        bReturn = pCacheBlock->GetCacheData (cbOffset, dwData);
 #ifdef _DEBUG
         std::cout << "    ** Cache Hit ** ";
         if (bReturn)
@@ -79,31 +121,214 @@ bool CCacheSet::GetCacheData (DWORD_PTR dwTag, size_t cbOffset, DWORD& dwData) n
     at regular intervals, as soon as every other block in the candidate eviction
     set had been evicted.
 */
-bool CCacheSet::LoadCacheBlock (DWORD_PTR dwTag, const void* pAddress) noexcept
+bool CCacheSet::LoadCacheBlock (DWORD_PTR dwTag, const void* pAddress, 
+                                DWORD_PTR* pdwEvictedTag /* = nullptr */) noexcept
+{
+    // lets find a stale CacheBlock to load, the oldest one becomes the newest
+    CCacheBlock* pCacheBlock = RotateFifo (0);
+
+    if ( pdwEvictedTag )
+        *pdwEvictedTag = pCacheBlock->is_Valid ( ) ? pCacheBlock->get_Tag ( ) : NO_EVICTION;
+    /*
+         In order to keep everything matching up correctly with our Tag association,
+         we need to load memory addresses that would have the same tag and index
+         fields when subsequently broken down.
+
+         to do this, i am going clear the Offset bits (5 bits) of the pAddress parameter
+         to generate an address that points to memory that is properly aligned to match
+         up with our tag + index field associations
+    */
+    DWORD_PTR dwAdjustedAddress = (reinterpret_cast<DWORD_PTR>(pAddress) & ~(0x001F));
+
+    bool bReturn = pCacheBlock->LoadCacheBlock(dwTag,
+        reinterpret_cast<const BYTE*>(dwAdjustedAddress));
+    m_pLastBlock = pCacheBlock;
+
+    return bReturn;
+}
+
+bool CCacheSet::UpdateCacheData (DWORD_PTR dwTag, size_t cbOffset, 
+                                 const void* pData, size_t cbLen) noexcept
 {
     bool bReturn = false;
-    // lets find a stale CacheBlock to load
-    if (!m_queAvailableBlocks.empty())
+    for (auto& it : m_pStorage->rgCacheBlock)
     {
-        CCacheBlock* pCacheBlock = m_queAvailableBlocks.front();
-        m_queAvailableBlocks.pop();
-        /*
-             In order to keep everything matching up correctly with our Tag association,
-             we need to load memory addresses that would have the same tag and index
-             fields when subsequently broken down.
-
-             to do this, i am going clear the Offset bits (5 bits) of the pAddress parameter
-             to generate an address that points to memory that is properly aligned to match
-             up with our tag + index field associations
-        */
-        DWORD_PTR dwAdjustedAddress = (reinterpret_cast<DWORD_PTR>(pAddress) & ~(0x001F));
-
-        bReturn = pCacheBlock->LoadCacheBlock(dwTag,
-            reinterpret_cast<const BYTE*>(dwAdjustedAddress));
-
-        m_queAvailableBlocks.push(pCacheBlock);
+        if ( it.is_Valid ( ) && (it.get_Tag ( ) == dwTag) )
+        {
+            bReturn = it.UpdateCacheData (cbOffset, pData, cbLen);
+            break;
+        }
     }
-
     return bReturn;
 }
 
+void CCacheSet::SaveState (CACHE_SET_STATE& state) const noexcept
+{
+    static_assert (sizeof(state.rgFifoOrder) == sizeof(m_pStorage->rgFifoOrder), "FIFO order size mismatch");
+    memcpy (state.rgFifoOrder, m_pStorage->rgFifoOrder, sizeof(state.rgFifoOrder));
+
+    for (size_t i = 0; i < _countof(m_pStorage->rgCacheBlock); i++)
+        m_pStorage->rgCacheBlock[i].SaveState(state.rgBlock[i]);
+}
+
+bool CCacheSet::IsValidFifoOrder (const BYTE (&rgFifoOrder)[req::g_4WAY_BLOCKS_PER_SET]) noexcept
+{
+    bool rgSeen[req::g_4WAY_BLOCKS_PER_SET] = { false };
+    for (auto iBlock : rgFifoOrder)
+    {
+        if ( (iBlock >= _countof(rgSeen)) || rgSeen[iBlock] )
+            return false;
+        rgSeen[iBlock] = true;
+    }
+    return true;
+}
+
+bool CCacheSet::IsValidState (const CACHE_SET_STATE& state) noexcept
+{
+    // a Tag saved by a 64 bit build may not fit a pointer of this one
+    for (const auto& it : state.rgBlock)
+    {
+        if ( !fits_pointer (it.qwTag) )
+            return false;
+    }
+    return IsValidFifoOrder (state.rgFifoOrder);
+}
+
+bool CCacheSet::RestoreState (const CACHE_SET_STATE& state) noexcept
+{
+    // validate the replacement order and the Tags before touching anything
+    if ( !IsValidState (state) )
+        return false;
+
+    memcpy (m_pStorage->rgFifoOrder, state.rgFifoOrder, sizeof(m_pStorage->rgFifoOrder));
+    m_pLastBlock = nullptr;
+
+    for (size_t i = 0; i < _countof(m_pStorage->rgCacheBlock); i++)
+        m_pStorage->rgCacheBlock[i].RestoreState(state.rgBlock[i]);
+
+    return true;
+}
+
+bool CCacheSet::set_Policy (REPLACEMENT_POLICY ePolicy) noexcept
+{
+    // only CAssociativeSet keeps a recency order
+    if ( (ePolicy != REPLACE_FIFO) && (ePolicy != REPLACE_OPT) )
+        return false;
+
+    m_ePolicy  = ePolicy;
+    m_nNextUse = 0;
+
+    // blocks already resident have no known next use
+    for (auto& it : m_pStorage->rgCacheBlock)
+    {
+        if ( it.is_Valid ( ) )
+            m_rgNextUse[m_nNextUse++] = CNextUse { NEVER_REUSED, &it };
+    }
+    std::make_heap (m_rgNextUse, m_rgNextUse + m_nNextUse);
+    return true;
+}
+
+bool CCacheSet::AccessCacheTag (DWORD_PTR dwTag, QWORD qwNextUse /* = NEVER_REUSED */) noexcept
+{
+    CCacheBlock* pCacheBlock = FindCacheBlock (dwTag);
+    if ( pCacheBlock == nullptr )
+        return false;
+
+    if ( m_ePolicy == REPLACE_OPT )
+    {
+        for (size_t i = 0; i < m_nNextUse; i++)
+        {
+            if ( m_rgNextUse[i].pCacheBlock == pCacheBlock )
+            {
+                m_rgNextUse[i].qwNextUse = qwNextUse;
+                break;
+            }
+        }
+        // a handful of entries, re-heaping is cheaper than sifting
+        std::make_heap (m_rgNextUse, m_rgNextUse + m_nNextUse);
+    }
+    return true;
+}
+
+/**
+    @note Belady's OPT (or MIN) policy evicts the block whose next reference
+    lies furthest in the future, which minimizes the number of misses for a
+    given reference stream.  It requires knowledge of the future and so
+    cannot be built in hardware, but when replaying a recorded trace it is
+    the lower bound every realizable policy is measured against.
+
+    The next use of each resident block is kept in a max-heap, so the victim
+    is always on top.  Every block of the set is allocated on a miss (no
+    bypass), matching the behavior of the FIFO policy it is compared with.
+*/
+bool CCacheSet::LoadCacheTag (DWORD_PTR dwTag, QWORD qwNextUse /* = NEVER_REUSED */,
+                              DWORD_PTR* pdwEvictedTag /* = nullptr */) noexcept
+{
+    CCacheBlock* pCacheBlock = nullptr;
+
+    if ( m_ePolicy == REPLACE_OPT )
+    {
+        // fill empty blocks first, then evict the furthest next use
+        for (auto& it : m_pStorage->rgCacheBlock)
+        {
+            if ( !it.is_Valid ( ) )
+            {
+                pCacheBlock = &it;
+                break;
+            }
+        }
+        if ( (pCacheBlock == nullptr) && (m_nNextUse > 0) )
+        {
+            std::pop_heap (m_rgNextUse, m_rgNextUse + m_nNextUse);
+            pCacheBlock = m_rgNextUse[--m_nNextUse].pCacheBlock;
+        }
+    }
+    else
+        pCacheBlock = RotateFifo (0);
+
+    if ( pCacheBlock == nullptr )
+        return false;
+
+    if ( pdwEvictedTag )
+        *pdwEvictedTag = pCacheBlock->is_Valid ( ) ? pCacheBlock->get_Tag ( ) : NO_EVICTION;
+
+    pCacheBlock->LoadCacheTag (dwTag);
+    m_pLastBlock = pCacheBlock;
+
+    if ( (m_ePolicy == REPLACE_OPT) && (m_nNextUse < _countof(m_rgNextUse)) )
+    {
+        m_rgNextUse[m_nNextUse++] = CNextUse { qwNextUse, pCacheBlock };
+        std::push_heap (m_rgNextUse, m_rgNextUse + m_nNextUse);
+    }
+
+    return true;
+}
+
+bool CCacheSet::LoadCacheTagInWays (DWORD_PTR dwTag, DWORD dwWayMask,
+                                    DWORD_PTR* pdwEvictedTag /* = nullptr */,
+                                    size_t* pnWay /* = nullptr */) noexcept
+{
+    // the oldest block among the allowed ways becomes the newest; every
+    // other block keeps its place in the replacement order
+    CCacheBlock* pCacheBlock = nullptr;
+    for (size_t i = 0; i < _countof(m_pStorage->rgFifoOrder); i++)
+    {
+        if ( dwWayMask & (1u << m_pStorage->rgFifoOrder[i]) )
+        {
+            pCacheBlock = RotateFifo (i);
+            break;
+        }
+    }
+
+    if ( pCacheBlock == nullptr )
+        return false;
+
+    if ( pdwEvictedTag )
+        *pdwEvictedTag = pCacheBlock->is_Valid ( ) ? pCacheBlock->get_Tag ( ) : NO_EVICTION;
+    if ( pnWay )
+        *pnWay = static_cast<size_t>(pCacheBlock - m_pStorage->rgCacheBlock);
+
+    pCacheBlock->LoadCacheTag (dwTag);
+    m_pLastBlock = pCacheBlock;
+    return true;
+}
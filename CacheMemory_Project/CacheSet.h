@@ -13,8 +13,8 @@
     #include "CommonDef.h"
 #endif
 
-#ifndef _QUEUE_
-    #include <queue>
+#ifndef _LIMITS_
+    #include <limits>
 #endif
 
 #if !defined(_CACHE_BLOCK_H__)
@@ -77,13 +77,55 @@
 //
 
 
+/// Returned as the evicted Tag when a load filled an empty cache block
+constexpr DWORD_PTR NO_EVICTION = std::numeric_limits<DWORD_PTR>::max();
+
+/// Next use of a block that is never referenced again
+constexpr QWORD NEVER_REUSED = std::numeric_limits<QWORD>::max();
+
+/**
+ *  Replacement policy of a cache set
+ */
+enum REPLACEMENT_POLICY
+{
+    REPLACE_FIFO,   ///< evict the oldest block (default)
+    REPLACE_OPT,    ///< Belady's OPT, evict the block reused furthest in the future
+    REPLACE_LRU     ///< evict the least recently used block (CAssociativeSet only)
+};
+
+/**
+ *  Blocks of a cache set and their FIFO replacement order.  A CCacheSet
+ *  normally uses storage of its own; CMappedCache attaches sets to storage
+ *  inside a file mapping instead.
+ */
+struct CACHE_SET_STORAGE
+{
+    CCacheBlock              rgCacheBlock[req::g_4WAY_BLOCKS_PER_SET];
+    BYTE                     rgFifoOrder[req::g_4WAY_BLOCKS_PER_SET]; ///< block indices, oldest first
+};
+
 /**
  *  Contains a set of cache blocks and manages the associated replacement policy
  */
 class CCacheSet
 {
-    CCacheBlock              m_rgCacheBlock[req::g_4WAY_BLOCKS_PER_SET];
-    std::queue<CCacheBlock*> m_queAvailableBlocks;
+    /// OPT priority entry, the heap keeps the furthest next use on top
+    struct CNextUse
+    {
+        QWORD        qwNextUse;
+        CCacheBlock* pCacheBlock;
+
+        bool operator < (const CNextUse& rhs) const noexcept
+        { return qwNextUse < rhs.qwNextUse; };
+    };
+
+    CACHE_SET_STORAGE        m_storage;             ///< used unless other storage is attached
+    CACHE_SET_STORAGE*       m_pStorage;            ///< blocks and FIFO order in use
+    CCacheBlock*             m_pLastBlock;          ///< block last hit or filled, checked first
+
+    REPLACEMENT_POLICY       m_ePolicy;
+    CNextUse                 m_rgNextUse[req::g_4WAY_BLOCKS_PER_SET]; ///< max-heap of resident blocks (OPT)
+    size_t                   m_nNextUse;                              ///< entries in m_rgNextUse
 
 public:
 /**
@@ -101,6 +143,18 @@ public:
  */
     void Init();
 
+ /**
+    Switches the set to other storage, such as a record of a file mapping,
+    whose blocks and FIFO order are used as they are
+
+    @param [in] pStorage    storage to use, nullptr for the set's own
+
+    @retval true      on success
+    @retval false     if the FIFO order of pStorage is not a permutation of
+                      the blocks, the set is left unchanged
+ */
+    bool Attach (CACHE_SET_STORAGE* pStorage) noexcept;
+
  /**
     Attempts to retrieve data from cache memory based on 
     tag and offset
@@ -118,16 +172,160 @@ public:
     Loads a contiguous block of memory of CACHE_BLOCK_SIZE, into cache block. It
     further establishes an association with the updated data via the dwTag.
 
-    @param [in] dwTag       value containing Tag to associate with this cache block
-    @param [in] pAddress    pointer to contiguous block of memory to load
+    @param [in] dwTag           value containing Tag to associate with this cache block
+    @param [in] pAddress        pointer to contiguous block of memory to load
+    @param [out] pdwEvictedTag  optional, receives the Tag of the block that was
+                                replaced, or NO_EVICTION if the block was empty
+
+    @retval true    if successful
+    @retval false   on error
+ */
+    bool LoadCacheBlock (DWORD_PTR dwTag, const void* pAddress, 
+                         DWORD_PTR* pdwEvictedTag = nullptr) noexcept;
+
+ /**
+    Writes data through to the cache block associated with dwTag, if that
+    block is currently resident.
+
+    @param [in] dwTag       Tag associated with the cache block
+    @param [in] cbOffset    count of byte (cb) offset into cache block
+    @param [in] pData       pointer to the data being written
+    @param [in] cbLen       count of bytes (cb) of data length
+
+    @retval true    if the block was resident and updated
+    @retval false   if the block is not resident or on error
+ */
+    bool UpdateCacheData (DWORD_PTR dwTag, size_t cbOffset, 
+                          const void* pData, size_t cbLen) noexcept;
+
+ /**
+    Copies the cache blocks and the FIFO replacement order into a checkpoint
+    record
+
+    @param [out] state      checkpoint record to fill
+ */
+    void SaveState    (CACHE_SET_STATE& state) const noexcept;
+
+ /**
+    Restores the cache blocks and the FIFO replacement order from a checkpoint
+    record
+
+    @param [in] state       checkpoint record previously filled by SaveState
+
+    @retval true    if successful
+    @retval false   if the record contains an invalid replacement order or a
+                    Tag wider than a pointer
+ */
+    bool RestoreState (const CACHE_SET_STATE& state) noexcept;
+
+ /**
+    Validates a checkpoint record prior to restoring it
+
+    @param [in] state       checkpoint record to validate
+
+    @retval true    every block appears in the replacement order exactly once
+                    and every Tag fits a pointer of this build
+    @retval false   otherwise
+ */
+    static bool IsValidState (const CACHE_SET_STATE& state) noexcept;
+
+ /**
+    Selects the replacement policy used by LoadCacheTag.  LoadCacheBlock and
+    the checkpoint functions always use the FIFO order.
+
+    @param [in] ePolicy     replacement policy, REPLACE_FIFO or REPLACE_OPT
+
+    @retval true      on success
+    @retval false     on REPLACE_LRU or an unknown policy, the policy is
+                      left unchanged
+ */
+    bool set_Policy (REPLACEMENT_POLICY ePolicy) noexcept;
+
+    constexpr REPLACEMENT_POLICY get_Policy (void) const noexcept
+    { return m_ePolicy; };
+
+ /**
+    Returns the block last hit or filled, nullptr if there is none yet
+ */
+    constexpr const CCacheBlock* get_LastBlock (void) const noexcept
+    { return m_pLastBlock; };
+
+ /**
+    Looks up a Tag without reading any data, used when replaying an address
+    trace.  Under REPLACE_OPT a hit also records when the block is used next.
+
+    @param [in] dwTag       Tag associated with the cache block
+    @param [in] qwNextUse   trace position of the next access to the block,
+                            NEVER_REUSED if there is none (REPLACE_OPT only)
+
+    @retval true     on cache hit
+    @retval false    on cache miss
+ */
+    bool AccessCacheTag (DWORD_PTR dwTag, QWORD qwNextUse = NEVER_REUSED) noexcept;
+
+ /**
+    Associates a cache block with dwTag without loading any data, evicting a
+    block as dictated by the replacement policy.  Under REPLACE_OPT the block
+    whose next use lies furthest in the future is evicted.
+
+    @param [in] dwTag           Tag to associate with the cache block
+    @param [in] qwNextUse       trace position of the next access to the block,
+                                NEVER_REUSED if there is none (REPLACE_OPT only)
+    @param [out] pdwEvictedTag  optional, receives the Tag of the block that was
+                                replaced, or NO_EVICTION if the block was empty
 
     @retval true    if successful
     @retval false   on error
  */
-    bool LoadCacheBlock (DWORD_PTR dwTag, const void* pAddress) noexcept;
+    bool LoadCacheTag (DWORD_PTR dwTag, QWORD qwNextUse = NEVER_REUSED,
+                       DWORD_PTR* pdwEvictedTag = nullptr) noexcept;
+
+ /**
+    Associates a cache block with dwTag without loading any data, evicting
+    the oldest (FIFO) block among the ways allowed by a way mask.  This is
+    how way partitioning (e.g. Intel CAT) confines a workload's fills to its
+    own ways, while lookups still hit in any way.
+
+    @param [in] dwTag           Tag to associate with the cache block
+    @param [in] dwWayMask       bit n set if way n may be replaced
+    @param [out] pdwEvictedTag  optional, receives the Tag of the block that was
+                                replaced, or NO_EVICTION if the block was empty
+    @param [out] pnWay          optional, receives the way that was filled
+
+    @retval true    if successful
+    @retval false   if the mask allows no way
+ */
+    bool LoadCacheTagInWays (DWORD_PTR dwTag, DWORD dwWayMask,
+                             DWORD_PTR* pdwEvictedTag = nullptr, size_t* pnWay = nullptr) noexcept;
 
 private:
 
+ /**
+    Moves a block to the newest end of the FIFO order, every other block
+    keeping its place
+
+    @param [in] nPosition   position of the block in the order, 0 being the oldest
+
+    @retval the block that was moved
+ */
+    CCacheBlock* RotateFifo (size_t nPosition) noexcept;
+
+ /**
+    Checks that a FIFO order lists every block of the set exactly once
+ */
+    static bool IsValidFifoOrder (const BYTE (&rgFifoOrder)[req::g_4WAY_BLOCKS_PER_SET]) noexcept;
+
+ /**
+    Looks up the resident block holding dwTag, trying the block last used
+    before searching the set: consecutive accesses to one cache block, such
+    as a sequential scan, then cost a single compare.
+
+    @param [in] dwTag       Tag associated with the cache block
+
+    @retval the block holding dwTag, nullptr on a miss
+ */
+    CCacheBlock* FindCacheBlock (DWORD_PTR dwTag) noexcept;
+
     CCacheSet(const CCacheSet& rhs) = delete;
     CCacheSet& operator=(const CCacheSet& rhs) = delete;
 };
@@ -0,0 +1,613 @@
+/**
+ *  @file       CacheStream.cpp
+ *  @brief      CCacheStreamServer and CCacheStreamClient class implementations
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#define NOMINMAX
+#include <windows.h>
+#include <memory.h>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "VirtualAddress.h"
+#include "CacheStream.h"
+
+/// size hint for the pipe buffers in each direction
+constexpr DWORD g_STREAM_PIPE_BUFFER = 1024 * 1024;
+/// how often disconnected producers are reaped while no new one connects (in ms)
+constexpr DWORD g_STREAM_REAP_INTERVAL = 1000;
+
+/**
+    Transfers exactly cb bytes over a pipe or standard input
+
+    @param [in] hPipe           pipe handle
+    @param [in] pv              data to write or buffer to read into
+    @param [in] cb              count of bytes to transfer
+    @param [in] bWrite          write rather than read
+    @param [in] bOverlapped     hPipe was opened for overlapped I/O; only then
+                                can one thread write to a pipe while another
+                                is blocked reading from it
+
+    @retval true      on success
+    @retval false     on end of file or error
+*/
+static bool TransferExact (void* hPipe, void* pv, size_t cb, bool bWrite, bool bOverlapped)
+{
+    BYTE*  pb     = static_cast<BYTE*>(pv);
+    HANDLE hEvent = bOverlapped ? CreateEvent (nullptr, TRUE, FALSE, nullptr) : nullptr;
+
+    while ( cb > 0 )
+    {
+        DWORD cbChunk = static_cast<DWORD>(std::min<size_t> (cb, g_STREAM_PIPE_BUFFER));
+        DWORD cbDone  = 0;
+        BOOL  bOk;
+
+        if ( bOverlapped )
+        {
+            OVERLAPPED ov;
+            memset (&ov, 0, sizeof(ov));
+            ov.hEvent = hEvent;
+
+            bOk = bWrite ? WriteFile (hPipe, pb, cbChunk, nullptr, &ov)
+                         : ReadFile  (hPipe, pb, cbChunk, nullptr, &ov);
+            if ( bOk || (GetLastError ( ) == ERROR_IO_PENDING) )
+                bOk = GetOverlappedResult (hPipe, &ov, &cbDone, TRUE);
+        }
+        else
+        {
+            bOk = bWrite ? WriteFile (hPipe, pb, cbChunk, &cbDone, nullptr)
+                         : ReadFile  (hPipe, pb, cbChunk, &cbDone, nullptr);
+        }
+
+        if ( !bOk || (cbDone == 0) )
+            break;
+
+        pb += cbDone;
+        cb -= cbDone;
+    }
+
+    if ( hEvent )
+        CloseHandle (hEvent);
+
+    return (cb == 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CCacheStreamServer
+
+CCacheStreamServer::CCacheStreamServer ( )
+    : m_strPipeName  ( ),
+      m_mtxSessions  ( ),
+      m_vecSessions  ( ),
+      m_dwProducers  (0),
+      m_bShutdown    (false)
+{
+    memset (&m_statsClosed, 0, sizeof(m_statsClosed));
+};
+
+CCacheStreamServer::~CCacheStreamServer ( )
+{
+    for (auto& it : m_vecSessions)
+    {
+        if ( it->thread.joinable() )
+            it->thread.join ( );
+    }
+};
+
+CCacheStreamServer::CSession* CCacheStreamServer::NewSession (void* hIn, void* hOut, bool bCredits)
+{
+    std::unique_ptr<CSession> pSession (new CSession ( ));
+
+    pSession->hIn      = hIn;
+    pSession->hOut     = hOut;
+    pSession->bCredits = bCredits;
+    for (auto& it : pSession->rgCacheSets)
+        it.Init ( );
+
+    pSession->nHead = 0;
+    pSession->nFull = 0;
+    pSession->bEnd  = false;
+    pSession->qwAccesses = 0;
+    pSession->qwHits     = 0;
+    pSession->qwBatches  = 0;
+    pSession->bConnected = true;
+    pSession->bDone      = false;
+
+    std::lock_guard<std::mutex> lock (m_mtxSessions);
+    pSession->dwProducer = m_dwProducers++;
+    m_vecSessions.push_back (std::move (pSession));
+    return m_vecSessions.back().get();
+}
+
+void CCacheStreamServer::ReapSessions (void)
+{
+    std::vector<std::unique_ptr<CSession>> vecDone;
+    {
+        std::lock_guard<std::mutex> lock (m_mtxSessions);
+        for (auto it = m_vecSessions.begin(); it != m_vecSessions.end(); )
+        {
+            if ( !(*it)->bDone )
+            {
+                ++it;
+                continue;
+            }
+
+            QWORD qwAccesses = (*it)->qwAccesses;
+            QWORD qwHits     = (*it)->qwHits;
+
+            m_statsClosed.qwAccesses += qwAccesses;
+            m_statsClosed.qwHits     += qwHits;
+            m_statsClosed.qwMisses   += qwAccesses - qwHits;
+            m_statsClosed.qwBatches  += (*it)->qwBatches;
+            m_statsClosed.dwProducers++;
+
+            vecDone.push_back (std::move (*it));
+            it = m_vecSessions.erase (it);
+        }
+    }
+
+    // a finished thread only has to return, so join without holding the lock
+    for (auto& it : vecDone)
+    {
+        if ( it->thread.joinable() )
+            it->thread.join ( );
+    }
+}
+
+bool CCacheStreamServer::Send (CSession& session, DWORD dwType, DWORD dwCount,
+                               const void* pPayload /* = nullptr */, size_t cbPayload /* = 0 */)
+{
+    STREAM_MESSAGE msg = { g_STREAM_MAGIC, dwType, dwCount, 0 };
+
+    std::lock_guard<std::mutex> lock (session.mtxWrite);
+    return TransferExact (session.hOut, &msg, sizeof(msg), true, true) &&
+           ((cbPayload == 0) ||
+            TransferExact (session.hOut, const_cast<void*>(pPayload), cbPayload, true, true));
+}
+
+void CCacheStreamServer::SimulateLoop (CSession& session)
+{
+    // a run of accesses to the block accessed just before hits without being
+    // decoded; address 0 maps to no set, so it never starts a run
+    const QWORD qwBlockMask = ~static_cast<QWORD>(req::g_CACHE_BLOCK_SIZE - 1);
+    QWORD       qwLastBlock = 0;
+
+    for (;;)
+    {
+        size_t nHead;
+        {
+            std::unique_lock<std::mutex> lock (session.mtxRing);
+            session.cvRing.wait (lock, [&session]() { return (session.nFull > 0) || session.bEnd; });
+            if ( session.nFull == 0 )
+                break;
+            nHead = session.nHead;
+        }
+
+        const QWORD* pAddress = session.rgBuffers[nHead].data();
+        const DWORD  dwCount  = session.rgCounts[nHead];
+
+        QWORD qwHits = 0;
+        for (DWORD i = 0; i < dwCount; i++)
+        {
+            const QWORD qwBlock = pAddress[i] & qwBlockMask;
+            if ( (qwBlock == qwLastBlock) && (qwBlock != 0) )
+            {
+                qwHits++;
+                continue;
+            }
+
+            // RunSession refused every batch holding an address wider than a pointer
+            const void* pDecode;
+            if ( !CVirtualAddress::FromTraceAddress (pAddress[i], pDecode) )
+                continue;
+
+            CVirtualAddress vAddress (pDecode);
+            DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+            if ( dwIndex >= _countof(session.rgCacheSets) )
+                continue;
+
+            DWORD_PTR dwTag = vAddress.DecodeTag ( );
+            if ( session.rgCacheSets[dwIndex].AccessCacheTag (dwTag) )
+                qwHits++;
+            else
+                session.rgCacheSets[dwIndex].LoadCacheTag (dwTag);
+            qwLastBlock = qwBlock;
+        }
+
+        session.qwAccesses += dwCount;
+        session.qwHits     += qwHits;
+        session.qwBatches++;
+
+        {
+            std::lock_guard<std::mutex> lock (session.mtxRing);
+            session.nHead = (nHead + 1) % g_STREAM_CREDITS;
+            session.nFull--;
+        }
+        session.cvRing.notify_all ( );
+
+        if ( session.bCredits )
+            Send (session, STREAM_CREDIT, 1);
+    }
+}
+
+bool CCacheStreamServer::RunSession (CSession& session)
+{
+    bool bReturn = true;
+
+    std::thread simulator (&CCacheStreamServer::SimulateLoop, this, std::ref (session));
+
+    if ( session.bCredits )
+        bReturn = Send (session, STREAM_CREDIT, g_STREAM_CREDITS);
+
+    size_t         nTail = 0;
+    STREAM_MESSAGE msg;
+    while ( bReturn && TransferExact (session.hIn, &msg, sizeof(msg), false, session.bCredits) )
+    {
+        if ( msg.dwMagic != g_STREAM_MAGIC )
+        {
+            bReturn = false;
+        }
+        else if ( msg.dwType == STREAM_BATCH )
+        {
+            if ( msg.dwCount > g_STREAM_MAX_BATCH )
+            {
+                bReturn = false;
+                break;
+            }
+
+            {   // a producer honoring its credits never waits here
+                std::unique_lock<std::mutex> lock (session.mtxRing);
+                session.cvRing.wait (lock, [&session]() { return session.nFull < g_STREAM_CREDITS; });
+            }
+
+            std::vector<QWORD>& vecBuffer = session.rgBuffers[nTail];
+            vecBuffer.resize (msg.dwCount);
+            if ( !TransferExact (session.hIn, vecBuffer.data(), msg.dwCount * sizeof(QWORD),
+                                 false, session.bCredits) ||
+                 !std::all_of (vecBuffer.begin(), vecBuffer.end(), fits_pointer) )
+            {
+                bReturn = false;
+                break;
+            }
+            session.rgCounts[nTail] = msg.dwCount;
+            nTail = (nTail + 1) % g_STREAM_CREDITS;
+
+            {
+                std::lock_guard<std::mutex> lock (session.mtxRing);
+                session.nFull++;
+            }
+            session.cvRing.notify_all ( );
+        }
+        else if ( msg.dwType == STREAM_STATS_REQUEST )
+        {
+            {   // the reply covers every batch sent before the request
+                std::unique_lock<std::mutex> lock (session.mtxRing);
+                session.cvRing.wait (lock, [&session]() { return session.nFull == 0; });
+            }
+
+            if ( session.bCredits )
+            {
+                STREAM_STATS rgStats[2];
+                memset (rgStats, 0, sizeof(rgStats));
+                rgStats[0].qwAccesses  = session.qwAccesses;
+                rgStats[0].qwHits      = session.qwHits;
+                rgStats[0].qwMisses    = rgStats[0].qwAccesses - rgStats[0].qwHits;
+                rgStats[0].qwBatches   = session.qwBatches;
+                rgStats[0].dwProducers = 1;
+                rgStats[1] = get_Stats ( );
+
+                bReturn = Send (session, STREAM_STATS_REPLY, _countof(rgStats), rgStats, sizeof(rgStats));
+            }
+        }
+        else if ( msg.dwType == STREAM_CLOSE )
+        {
+            break;
+        }
+        else if ( msg.dwType == STREAM_SHUTDOWN )
+        {
+            m_bShutdown = true;
+
+            // wake the listener blocked waiting for the next producer
+            for (int i = 0; i < 10; i++)
+            {
+                HANDLE hWake = CreateFile (m_strPipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                                           nullptr, OPEN_EXISTING, 0, nullptr);
+                if ( hWake != INVALID_HANDLE_VALUE )
+                {
+                    CloseHandle (hWake);
+                    break;
+                }
+                WaitNamedPipe (m_strPipeName.c_str(), 100);
+            }
+            break;
+        }
+        else
+        {
+            bReturn = false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock (session.mtxRing);
+        session.bEnd = true;
+    }
+    session.cvRing.notify_all ( );
+    simulator.join ( );
+
+    for (auto& it : session.rgBuffers)
+        std::vector<QWORD> ( ).swap (it);
+
+    session.bConnected = false;
+    return bReturn;
+}
+
+bool CCacheStreamServer::Serve (const TCHAR* szPipeName)
+{
+    m_strPipeName = szPipeName;
+    m_bShutdown   = false;
+
+    bool bReturn = true;
+    while ( !m_bShutdown )
+    {
+        HANDLE hPipe = CreateNamedPipe (szPipeName, PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                                        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+                                        PIPE_UNLIMITED_INSTANCES, g_STREAM_PIPE_BUFFER,
+                                        g_STREAM_PIPE_BUFFER, 0, nullptr);
+        if ( hPipe == INVALID_HANDLE_VALUE )
+        {
+            bReturn = false;
+            break;
+        }
+
+        OVERLAPPED ov;
+        memset (&ov, 0, sizeof(ov));
+        ov.hEvent = CreateEvent (nullptr, TRUE, FALSE, nullptr);
+
+        DWORD cbDone;
+        BOOL  bConnected = ConnectNamedPipe (hPipe, &ov);
+        if ( !bConnected )
+        {
+            if ( GetLastError ( ) == ERROR_IO_PENDING )
+            {
+                while ( WaitForSingleObject (ov.hEvent, g_STREAM_REAP_INTERVAL) == WAIT_TIMEOUT )
+                    ReapSessions ( );
+                bConnected = GetOverlappedResult (hPipe, &ov, &cbDone, TRUE);
+            }
+            else
+                bConnected = (GetLastError ( ) == ERROR_PIPE_CONNECTED);
+        }
+        CloseHandle (ov.hEvent);
+
+        if ( !bConnected || m_bShutdown )
+        {
+            CloseHandle (hPipe);
+            continue;
+        }
+
+        ReapSessions ( );
+
+        CSession* pSession = NewSession (hPipe, hPipe, true);
+        pSession->thread = std::thread ([this, pSession]()
+        {
+            RunSession (*pSession);
+            FlushFileBuffers    (pSession->hOut);
+            DisconnectNamedPipe (pSession->hIn);
+            CloseHandle         (pSession->hIn);
+            pSession->bDone = true;
+        });
+    }
+
+    // only this thread adds and removes sessions, and the sessions lock
+    // m_mtxSessions to answer statistics requests, so join without holding it
+    for (auto& it : m_vecSessions)
+    {
+        if ( it->thread.joinable() )
+            it->thread.join ( );
+    }
+    ReapSessions ( );
+    return bReturn;
+}
+
+bool CCacheStreamServer::ServeStdin (void)
+{
+    CSession* pSession = NewSession (GetStdHandle (STD_INPUT_HANDLE), nullptr, false);
+    bool      bReturn  = RunSession (*pSession);
+
+    pSession->bDone = true;
+    ReapSessions ( );
+    return bReturn;
+}
+
+STREAM_STATS CCacheStreamServer::get_Stats (void)
+{
+    std::lock_guard<std::mutex> lock (m_mtxSessions);
+
+    STREAM_STATS stats = m_statsClosed;
+    stats.dwProducers  = 0;
+    for (const auto& it : m_vecSessions)
+    {
+        QWORD qwAccesses = it->qwAccesses;
+        QWORD qwHits     = it->qwHits;
+
+        stats.qwAccesses += qwAccesses;
+        stats.qwHits     += qwHits;
+        stats.qwMisses   += qwAccesses - qwHits;
+        stats.qwBatches  += it->qwBatches;
+        if ( it->bConnected )
+            stats.dwProducers++;
+    }
+    return stats;
+}
+
+std::ostream& CCacheStreamServer::Report (std::ostream& os)
+{
+    STREAM_STATS stats = get_Stats ( );
+
+    os << std::dec << std::setfill (' ');
+    os << "Stream server" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    os << std::setw(8)  << "Producer" << std::setw(14) << "Accesses"
+       << std::setw(14) << "Misses"   << std::setw(10) << "Batches"
+       << std::setw(10) << "Hit%" << std::endl;
+
+    os << std::fixed << std::setprecision(2);
+    {
+        std::lock_guard<std::mutex> lock (m_mtxSessions);
+        for (const auto& it : m_vecSessions)
+        {
+            QWORD qwAccesses = it->qwAccesses;
+            QWORD qwHits     = it->qwHits;
+
+            os << std::setw(8)  << it->dwProducer << std::setw(14) << qwAccesses
+               << std::setw(14) << qwAccesses - qwHits
+               << std::setw(10) << it->qwBatches
+               << std::setw(10) << (qwAccesses ? 100.0 * qwHits / qwAccesses : 0.0) << std::endl;
+        }
+
+        if ( m_statsClosed.dwProducers > 0 )
+        {
+            os << std::setw(8)  << "Closed" << std::setw(14) << m_statsClosed.qwAccesses
+               << std::setw(14) << m_statsClosed.qwMisses << std::setw(10) << m_statsClosed.qwBatches
+               << std::setw(10) << (m_statsClosed.qwAccesses ? 100.0 * m_statsClosed.qwHits / m_statsClosed.qwAccesses : 0.0)
+               << "  (" << m_statsClosed.dwProducers << " producers)" << std::endl;
+        }
+    }
+    os << std::setw(8)  << "Total" << std::setw(14) << stats.qwAccesses
+       << std::setw(14) << stats.qwMisses << std::setw(10) << stats.qwBatches
+       << std::setw(10) << (stats.qwAccesses ? 100.0 * stats.qwHits / stats.qwAccesses : 0.0) << std::endl;
+    os.unsetf (std::ios::floatfield);
+
+    return os;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CCacheStreamClient
+
+CCacheStreamClient::CCacheStreamClient ( )
+    : m_hPipe       (INVALID_HANDLE_VALUE),
+      m_dwCredits   (0),
+      m_vecBatch    ( ),
+      m_bStatsReply (false)
+{
+    memset (m_rgStats, 0, sizeof(m_rgStats));
+};
+
+CCacheStreamClient::~CCacheStreamClient ( )
+{
+    if ( m_hPipe != INVALID_HANDLE_VALUE )
+        Close ( );
+};
+
+bool CCacheStreamClient::Connect (const TCHAR* szPipeName)
+{
+    for (;;)
+    {
+        m_hPipe = CreateFile (szPipeName, GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                              OPEN_EXISTING, 0, nullptr);
+        if ( m_hPipe != INVALID_HANDLE_VALUE )
+            break;
+
+        // every instance is busy until the server creates the next one
+        if ( (GetLastError ( ) != ERROR_PIPE_BUSY) || !WaitNamedPipe (szPipeName, NMPWAIT_WAIT_FOREVER) )
+            return false;
+    }
+
+    m_dwCredits = 0;
+    m_vecBatch.reserve (g_STREAM_MAX_BATCH);
+    return true;
+}
+
+bool CCacheStreamClient::Send (DWORD dwType, DWORD dwCount, const void* pPayload /* = nullptr */,
+                               size_t cbPayload /* = 0 */)
+{
+    STREAM_MESSAGE msg = { g_STREAM_MAGIC, dwType, dwCount, 0 };
+    return TransferExact (m_hPipe, &msg, sizeof(msg), true, false) &&
+           ((cbPayload == 0) ||
+            TransferExact (m_hPipe, const_cast<void*>(pPayload), cbPayload, true, false));
+}
+
+bool CCacheStreamClient::ReceiveOne (void)
+{
+    STREAM_MESSAGE msg;
+    if ( !TransferExact (m_hPipe, &msg, sizeof(msg), false, false) || (msg.dwMagic != g_STREAM_MAGIC) )
+        return false;
+
+    if ( msg.dwType == STREAM_CREDIT )
+    {
+        m_dwCredits += msg.dwCount;
+        return true;
+    }
+
+    if ( (msg.dwType == STREAM_STATS_REPLY) && (msg.dwCount == _countof(m_rgStats)) )
+    {
+        m_bStatsReply = TransferExact (m_hPipe, m_rgStats, sizeof(m_rgStats), false, false);
+        return m_bStatsReply;
+    }
+
+    return false;
+}
+
+bool CCacheStreamClient::Append (QWORD qwAddress)
+{
+    m_vecBatch.push_back (qwAddress);
+    return (m_vecBatch.size() < g_STREAM_MAX_BATCH) || Flush ( );
+}
+
+bool CCacheStreamClient::Flush (void)
+{
+    if ( m_hPipe == INVALID_HANDLE_VALUE )
+        return false;
+
+    if ( m_vecBatch.empty() )
+        return true;
+
+    while ( m_dwCredits == 0 )
+    {
+        if ( !ReceiveOne ( ) )
+            return false;
+    }
+
+    if ( !Send (STREAM_BATCH, static_cast<DWORD>(m_vecBatch.size()),
+                m_vecBatch.data(), m_vecBatch.size() * sizeof(QWORD)) )
+        return false;
+
+    m_dwCredits--;
+    m_vecBatch.clear ( );
+    return true;
+}
+
+bool CCacheStreamClient::QueryStats (STREAM_STATS& statsServer, STREAM_STATS* pStatsProducer /* = nullptr */)
+{
+    if ( !Flush ( ) || !Send (STREAM_STATS_REQUEST, 0) )
+        return false;
+
+    m_bStatsReply = false;
+    while ( !m_bStatsReply )
+    {
+        if ( !ReceiveOne ( ) )
+            return false;
+    }
+
+    statsServer = m_rgStats[1];
+    if ( pStatsProducer )
+        *pStatsProducer = m_rgStats[0];
+    return true;
+}
+
+bool CCacheStreamClient::Close (bool bShutdown /* = false */)
+{
+    if ( m_hPipe == INVALID_HANDLE_VALUE )
+        return false;
+
+    bool bReturn = Flush ( ) && Send (bShutdown ? STREAM_SHUTDOWN : STREAM_CLOSE, 0);
+
+    CloseHandle (m_hPipe);
+    m_hPipe = INVALID_HANDLE_VALUE;
+    return bReturn;
+}
@@ -0,0 +1,301 @@
+/**
+ *  @file       CacheStream.h
+ *  @brief      CCacheStreamServer and CCacheStreamClient class interfaces
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CACHE_STREAM_H__)
+#define _CACHE_STREAM_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _STRING_
+    #include <string>
+#endif
+
+#ifndef _MEMORY_
+    #include <memory>
+#endif
+
+#ifndef _MUTEX_
+    #include <mutex>
+#endif
+
+#ifndef _CONDITION_VARIABLE_
+    #include <condition_variable>
+#endif
+
+#ifndef _THREAD_
+    #include <thread>
+#endif
+
+#ifndef _ATOMIC_
+    #include <atomic>
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+#if !defined(_CACHE_SET_H__)
+    #include "CacheSet.h"
+#endif
+
+/**
+    Stream protocol
+
+    Producers (live tracers) connect to the server's named pipe and send
+    messages, each a STREAM_MESSAGE header optionally followed by a payload:
+
+    - STREAM_BATCH          dwCount QWORD access addresses follow; a batch
+                            holding an address wider than a pointer of the
+                            server ends the producer's session
+    - STREAM_STATS_REQUEST  answered by STREAM_STATS_REPLY
+    - STREAM_CLOSE          the producer is done
+    - STREAM_SHUTDOWN       the producer is done and the server is to stop
+
+    Backpressure is credit based: every credit allows the producer one
+    STREAM_BATCH.  The server grants g_STREAM_CREDITS on connection and one
+    more (STREAM_CREDIT) each time it has finished simulating a batch, so
+    it never buffers more than g_STREAM_CREDITS batches per producer.
+
+    A producer on standard input receives no credits and no replies; there
+    the pipe itself blocks the producer while the server is busy.
+*/
+
+/// 'ACST' - Associative Cache STream
+constexpr DWORD g_STREAM_MAGIC      = 0x54534341;
+/// most addresses a single batch may carry
+constexpr DWORD g_STREAM_MAX_BATCH  = 64 * 1024;
+/// batches buffered per producer, the credits granted on connection
+constexpr DWORD g_STREAM_CREDITS    = 4;
+
+enum STREAM_MESSAGE_TYPE
+{
+    STREAM_BATCH            = 1,    ///< producer -> server
+    STREAM_STATS_REQUEST    = 2,    ///< producer -> server
+    STREAM_CLOSE            = 3,    ///< producer -> server
+    STREAM_SHUTDOWN         = 4,    ///< producer -> server
+    STREAM_CREDIT           = 0x81, ///< server -> producer, dwCount batches granted
+    STREAM_STATS_REPLY      = 0x82  ///< server -> producer, two STREAM_STATS follow:
+                                    ///< this producer, then every producer
+};
+
+/**
+ *  Message header
+ */
+struct STREAM_MESSAGE
+{
+    DWORD   dwMagic;            ///< g_STREAM_MAGIC
+    DWORD   dwType;             ///< STREAM_MESSAGE_TYPE
+    DWORD   dwCount;            ///< addresses, credits or statistics following
+    DWORD   dwReserved;         ///< always zero
+};
+
+/**
+ *  Statistics reported by STREAM_STATS_REPLY
+ */
+struct STREAM_STATS
+{
+    QWORD   qwAccesses;
+    QWORD   qwHits;
+    QWORD   qwMisses;
+    QWORD   qwBatches;
+    DWORD   dwProducers;        ///< producers connected now
+    DWORD   dwReserved;
+};
+
+/**
+ *  Long-running server simulating the access batches of any number of
+ *  producers, each in a cache of its own.
+ *
+ *  Every producer gets two threads: one reads its batches into a ring of
+ *  g_STREAM_CREDITS buffers and answers statistics requests, the other
+ *  replays the buffered batches through the producer's cache sets and
+ *  returns a credit for every buffer it frees.  Once a producer has
+ *  disconnected, its threads are joined and its session freed, and only
+ *  its statistics are kept, summed with those of every other producer
+ *  gone.  Memory use is therefore bounded by the number of producers
+ *  connected, however fast they send and however many have come and gone.
+ */
+class CCacheStreamServer
+{
+    struct CSession
+    {
+        DWORD                   dwProducer;     ///< sequence number, for reports
+        void*                   hIn;
+        void*                   hOut;
+        bool                    bCredits;       ///< false for standard input
+
+        CCacheSet               rgCacheSets[req::g_4WAY_CACHE_SETS];
+
+        std::vector<QWORD>      rgBuffers[g_STREAM_CREDITS];
+        DWORD                   rgCounts[g_STREAM_CREDITS];
+        size_t                  nHead;          ///< next buffer to simulate
+        size_t                  nFull;          ///< buffers waiting to be simulated
+        bool                    bEnd;           ///< no more batches will arrive
+        std::mutex              mtxRing;
+        std::condition_variable cvRing;
+
+        std::mutex              mtxWrite;       ///< serializes replies and credits
+
+        std::atomic<QWORD>      qwAccesses;
+        std::atomic<QWORD>      qwHits;
+        std::atomic<QWORD>      qwBatches;
+        std::atomic<bool>       bConnected;
+        std::atomic<bool>       bDone;          ///< thread finished, ready to be joined
+
+        std::thread             thread;
+    };
+
+    std::basic_string<TCHAR>                m_strPipeName;
+    std::mutex                              m_mtxSessions;
+    std::vector<std::unique_ptr<CSession>>  m_vecSessions;  ///< producers not yet reaped
+    STREAM_STATS                            m_statsClosed;  ///< sum of the reaped producers
+    DWORD                                   m_dwProducers;  ///< producers served so far
+    std::atomic<bool>                       m_bShutdown;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CCacheStreamServer ( );
+
+    ~CCacheStreamServer ( );
+
+/**
+    Serves producers connecting to a named pipe until one of them sends
+    STREAM_SHUTDOWN
+
+    @param [in] szPipeName      pipe name, e.g. \\\\.\\pipe\\CacheStream
+
+    @retval true      on success
+    @retval false     if the pipe cannot be created
+ */
+    bool Serve (const TCHAR* szPipeName);
+
+/**
+    Serves a single producer writing to standard input until end of file
+
+    @retval true      on success
+    @retval false     on a malformed stream, or an address wider than a
+                      pointer
+ */
+    bool ServeStdin (void);
+
+/**
+    Returns the statistics summed over every producer served so far,
+    reaped or not
+ */
+    STREAM_STATS get_Stats (void);
+
+/**
+    Writes the statistics of every producer not yet reaped, then those of
+    the reaped producers and of every producer together
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os);
+
+private:
+
+    CSession* NewSession (void* hIn, void* hOut, bool bCredits);
+    void ReapSessions (void);
+    bool RunSession   (CSession& session);
+    void SimulateLoop (CSession& session);
+    bool Send (CSession& session, DWORD dwType, DWORD dwCount,
+               const void* pPayload = nullptr, size_t cbPayload = 0);
+
+    CCacheStreamServer (const CCacheStreamServer& rhs) = delete;
+    CCacheStreamServer& operator = (const CCacheStreamServer& rhs) = delete;
+};
+
+/**
+ *  Producer side of the stream protocol, for tracers feeding a
+ *  CCacheStreamServer.  Addresses are batched and a batch is only sent
+ *  once the server has granted a credit for it.
+ */
+class CCacheStreamClient
+{
+    void*               m_hPipe;
+    DWORD               m_dwCredits;
+    std::vector<QWORD>  m_vecBatch;
+    STREAM_STATS        m_rgStats[2];       ///< last STREAM_STATS_REPLY
+    bool                m_bStatsReply;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CCacheStreamClient ( );
+
+    ~CCacheStreamClient ( );
+
+/**
+    Connects to a server
+
+    @param [in] szPipeName      pipe name passed to CCacheStreamServer::Serve
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool Connect (const TCHAR* szPipeName);
+
+/**
+    Appends an access, sending the batch once it is full
+
+    @param [in] qwAddress       memory address accessed
+
+    @retval true      on success
+    @retval false     if the connection failed
+ */
+    bool Append (QWORD qwAddress);
+
+/**
+    Sends the partial batch, waiting for a credit first if need be
+
+    @retval true      on success
+    @retval false     if the connection failed
+ */
+    bool Flush (void);
+
+/**
+    Requests the server statistics, covering every batch sent before the
+    request
+
+    @param [out] statsServer    statistics of every producer
+    @param [out] pStatsProducer statistics of this producer, if not nullptr
+
+    @retval true      on success
+    @retval false     if the connection failed
+ */
+    bool QueryStats (STREAM_STATS& statsServer, STREAM_STATS* pStatsProducer = nullptr);
+
+/**
+    Flushes, then ends the connection
+
+    @param [in] bShutdown       also stop the server
+
+    @retval true      on success
+    @retval false     if the connection failed
+ */
+    bool Close (bool bShutdown = false);
+
+private:
+
+    bool Send (DWORD dwType, DWORD dwCount, const void* pPayload = nullptr, size_t cbPayload = 0);
+    bool ReceiveOne (void);
+
+    CCacheStreamClient (const CCacheStreamClient& rhs) = delete;
+    CCacheStreamClient& operator = (const CCacheStreamClient& rhs) = delete;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ *  @file       CacheTiming.cpp
+ *  @brief      CCacheTimingModel class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "CacheTiming.h"
+
+CCacheTimingModel::CCacheTimingModel ( )
+    : m_config            (g_DEFAULT_TIMING),
+      m_vecMshrs          ( ),
+      m_vecOccupancy      ( ),
+      m_vecCompletion     ( ),
+      m_qwCycle           (0),
+      m_qwNextIssue       (0),
+      m_qwLastCompletion  (0),
+      m_qwAccesses        (0),
+      m_qwHits            (0),
+      m_qwPrimaryMisses   (0),
+      m_qwSecondaryMisses (0),
+      m_qwTotalLatency    (0),
+      m_qwStallCycles     (0)
+{
+};
+
+bool CCacheTimingModel::Init (const CACHE_TIMING_CONFIG& config /* = g_DEFAULT_TIMING */)
+{
+    if ( config.dwMshrEntries == 0 )
+        return false;
+
+    m_config = config;
+
+    m_vecMshrs.clear ( );
+    m_vecMshrs.reserve (config.dwMshrEntries);
+    m_vecOccupancy.assign (config.dwMshrEntries + 1, 0);
+    m_vecCompletion.assign (g_TIMING_DEPENDENCY_WINDOW, 0);
+
+    m_qwCycle           = 0;
+    m_qwNextIssue       = 0;
+    m_qwLastCompletion  = 0;
+    m_qwAccesses        = 0;
+    m_qwHits            = 0;
+    m_qwPrimaryMisses   = 0;
+    m_qwSecondaryMisses = 0;
+    m_qwTotalLatency    = 0;
+    m_qwStallCycles     = 0;
+
+    return true;
+}
+
+/**
+    @note Retires every MSHR whose fill completes by qwCycle, charging the
+    time in between to the occupancy histogram one interval at a time
+*/
+void CCacheTimingModel::AdvanceTo (QWORD qwCycle)
+{
+    if ( qwCycle < m_qwCycle )
+        return;
+
+    for ( ;; )
+    {
+        auto it = std::min_element (m_vecMshrs.begin(), m_vecMshrs.end(),
+                                    [](const CMshr& a, const CMshr& b) { return a.qwReady < b.qwReady; });
+        if ( (it == m_vecMshrs.end()) || (it->qwReady > qwCycle) )
+            break;
+
+        m_vecOccupancy[m_vecMshrs.size()] += it->qwReady - m_qwCycle;
+        m_qwCycle = it->qwReady;
+        m_vecMshrs.erase (it);
+    }
+
+    m_vecOccupancy[m_vecMshrs.size()] += qwCycle - m_qwCycle;
+    m_qwCycle = qwCycle;
+}
+
+QWORD CCacheTimingModel::Issue (QWORD qwAddress, bool bHit, QWORD qwTimestamp /* = 0 */,
+                                DWORD dwDependency /* = 0 */)
+{
+    if ( m_vecOccupancy.empty() )
+        Init ( );
+
+    // earliest cycle the access is ready to issue
+    QWORD qwReady = std::max (m_qwNextIssue, qwTimestamp);
+    if ( (dwDependency > 0) && (dwDependency <= m_qwAccesses) &&
+         (dwDependency <= m_vecCompletion.size()) )
+    {
+        QWORD qwProducer = m_qwAccesses - dwDependency;
+        qwReady = std::max (qwReady, m_vecCompletion[qwProducer % m_vecCompletion.size()]);
+    }
+
+    QWORD qwIssue = qwReady;
+    AdvanceTo (qwIssue);
+
+    const QWORD qwBlock = qwAddress & ~static_cast<QWORD>(req::g_CACHE_BLOCK_SIZE - 1);
+    QWORD qwComplete;
+
+    auto it = std::find_if (m_vecMshrs.begin(), m_vecMshrs.end(),
+                            [qwBlock](const CMshr& mshr) { return mshr.qwBlock == qwBlock; });
+    if ( it != m_vecMshrs.end() )
+    {   // secondary miss, wait for the fill already in flight
+        m_qwSecondaryMisses++;
+        qwComplete = std::max (it->qwReady, qwIssue + m_config.dwHitLatency);
+    }
+    else if ( bHit )
+    {   // hit, possibly under outstanding misses
+        m_qwHits++;
+        qwComplete = qwIssue + m_config.dwHitLatency;
+    }
+    else
+    {   // primary miss, stall issue while every MSHR is busy
+        if ( m_vecMshrs.size() >= m_config.dwMshrEntries )
+        {
+            QWORD qwFree = std::min_element (m_vecMshrs.begin(), m_vecMshrs.end(),
+                                             [](const CMshr& a, const CMshr& b)
+                                             { return a.qwReady < b.qwReady; })->qwReady;
+            m_qwStallCycles += qwFree - qwIssue;
+            qwIssue = qwFree;
+            AdvanceTo (qwIssue);
+        }
+
+        m_qwPrimaryMisses++;
+        qwComplete = qwIssue + m_config.dwHitLatency + m_config.dwMissLatency;
+        m_vecMshrs.push_back (CMshr { qwBlock, qwComplete });
+    }
+
+    m_vecCompletion[m_qwAccesses % m_vecCompletion.size()] = qwComplete;
+    m_qwAccesses++;
+    m_qwTotalLatency  += qwComplete - qwReady;
+    m_qwNextIssue      = qwIssue + m_config.dwIssueInterval;
+    m_qwLastCompletion = std::max (m_qwLastCompletion, qwComplete);
+
+    return qwComplete;
+}
+
+void CCacheTimingModel::Drain (void)
+{
+    AdvanceTo (std::max (m_qwLastCompletion, m_qwCycle));
+    m_qwNextIssue = std::max (m_qwNextIssue, m_qwCycle);
+}
+
+double CCacheTimingModel::get_Amat (void) const noexcept
+{
+    return m_qwAccesses ? static_cast<double>(m_qwTotalLatency) / m_qwAccesses : 0.0;
+}
+
+double CCacheTimingModel::get_Mlp (void) const noexcept
+{
+    QWORD qwBusyCycles = 0;
+    QWORD qwWeighted   = 0;
+    for (size_t i = 1; i < m_vecOccupancy.size(); i++)
+    {
+        qwBusyCycles += m_vecOccupancy[i];
+        qwWeighted   += m_vecOccupancy[i] * i;
+    }
+    return qwBusyCycles ? static_cast<double>(qwWeighted) / qwBusyCycles : 0.0;
+}
+
+std::ostream& CCacheTimingModel::Report (std::ostream& os) const
+{
+    QWORD qwTotalCycles = 0;
+    for (auto it : m_vecOccupancy)
+        qwTotalCycles += it;
+
+    os << std::dec << std::setfill (' ');
+    os << "Timing model" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    os << "Hit latency:      " << m_config.dwHitLatency  << std::endl;
+    os << "Miss latency:     " << m_config.dwMissLatency << std::endl;
+    os << "MSHR entries:     " << m_config.dwMshrEntries << std::endl;
+    os << "Accesses:         " << m_qwAccesses        << std::endl;
+    os << "Hits:             " << m_qwHits            << std::endl;
+    os << "Primary misses:   " << m_qwPrimaryMisses   << std::endl;
+    os << "Secondary misses: " << m_qwSecondaryMisses << std::endl;
+    os << "Cycles:           " << m_qwLastCompletion  << std::endl;
+    os << "MSHR full stalls: " << m_qwStallCycles     << std::endl;
+    os << "AMAT:             " << std::fixed << std::setprecision(2) << get_Amat() << std::endl;
+    os << "MLP:              " << get_Mlp() << std::endl;
+
+    os << std::endl;
+    os << "MSHR occupancy (busy MSHRs: cycles)" << std::endl;
+    for (size_t i = 0; i < m_vecOccupancy.size(); i++)
+    {
+        double dPercent = qwTotalCycles ? 100.0 * m_vecOccupancy[i] / qwTotalCycles : 0.0;
+        os << std::setw(6) << i << ": " << std::setw(12) << m_vecOccupancy[i]
+           << std::setw(9) << dPercent << "%" << std::endl;
+    }
+    os.unsetf (std::ios::floatfield);
+
+    return os;
+}
+
+void CCacheTimingModel::OnCacheAccess (const void* pAddress, DWORD_PTR /* dwIndex */, bool bHit)
+{
+    Issue (reinterpret_cast<DWORD_PTR>(pAddress), bHit);
+}
+
+void CCacheTimingModel::OnCacheFill (const void* /* pAddress */, DWORD_PTR /* dwIndex */,
+                                     DWORD_PTR /* dwEvictedTag */)
+{
+}
@@ -0,0 +1,173 @@
+/**
+ *  @file       CacheTiming.h
+ *  @brief      CCacheTimingModel class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CACHE_TIMING_H__)
+#define _CACHE_TIMING_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+#if !defined(_CACHE_OBSERVER_H__)
+    #include "CacheObserver.h"
+#endif
+
+/// accesses remembered for resolving dependency hints
+constexpr size_t g_TIMING_DEPENDENCY_WINDOW = 1024;
+
+/**
+ *  Timing model configuration, all latencies in cycles
+ */
+struct CACHE_TIMING_CONFIG
+{
+    DWORD   dwHitLatency;       ///< cache hit latency
+    DWORD   dwMissLatency;      ///< additional latency of a miss (next level / memory)
+    DWORD   dwMshrEntries;      ///< number of Miss Status Holding Registers
+    DWORD   dwIssueInterval;    ///< minimum cycles between two issued accesses
+};
+
+/// defaults: 4 cycle hit, 100 cycle memory, 8 MSHRs, one access per cycle
+constexpr CACHE_TIMING_CONFIG g_DEFAULT_TIMING = { 4, 100, 8, 1 };
+
+/**
+ *  Timing layer of a non-blocking cache.
+ *
+ *  The functional cache (CCacheManager, or a trace replay) decides whether
+ *  an access hits; the timing model decides when it completes.  Misses
+ *  allocate one of a finite number of Miss Status Holding Registers (MSHRs)
+ *  for the duration of the miss latency:
+ *
+ *  - hit-under-miss    hits complete after the hit latency, even while
+ *                      misses are outstanding
+ *  - miss-under-miss   further misses allocate further MSHRs; only when
+ *                      every MSHR is busy does issue stall until one frees
+ *  - secondary misses  any access to a block that already has an MSHR
+ *                      (including a functional hit on a block whose fill has
+ *                      not yet arrived) merges into it and completes with it
+ *
+ *  Accesses issue in order, no sooner than dwIssueInterval cycles apart, no
+ *  sooner than their timestamp and, with a dependency hint, not before the
+ *  access they depend on has completed.
+ *
+ *  The results are the average memory access time (AMAT), a histogram of
+ *  cycles spent with n MSHRs busy, and the memory-level parallelism (MLP):
+ *  the average number of outstanding misses while at least one is
+ *  outstanding.  An MLP close to 1 means the kernel is latency-bound; MSHRs
+ *  that are frequently all busy mean it is bandwidth-bound.
+ */
+class CCacheTimingModel : public ICacheObserver
+{
+    struct CMshr
+    {
+        QWORD   qwBlock;            ///< block address
+        QWORD   qwReady;            ///< cycle the fill completes
+    };
+
+    CACHE_TIMING_CONFIG     m_config;
+
+    std::vector<CMshr>      m_vecMshrs;         ///< busy MSHRs
+    std::vector<QWORD>      m_vecOccupancy;     ///< cycles spent with n MSHRs busy
+    std::vector<QWORD>      m_vecCompletion;    ///< completion cycle of recent accesses (ring)
+
+    QWORD   m_qwCycle;              ///< cycle up to which occupancy is accounted
+    QWORD   m_qwNextIssue;          ///< earliest cycle of the next issue
+    QWORD   m_qwLastCompletion;     ///< latest completion cycle so far
+
+    QWORD   m_qwAccesses;
+    QWORD   m_qwHits;
+    QWORD   m_qwPrimaryMisses;
+    QWORD   m_qwSecondaryMisses;    ///< accesses merged into an outstanding MSHR
+    QWORD   m_qwTotalLatency;       ///< sum of (completion - ready to issue)
+    QWORD   m_qwStallCycles;        ///< issue cycles lost to a full MSHR file
+
+public:
+/**
+ *  Default Constructor
+ */
+    CCacheTimingModel ( );
+
+/**
+    Sets the configuration and clears all statistics
+
+    @param [in] config          latencies and MSHR count
+
+    @retval true      on success
+    @retval false     if the configuration has no MSHRs
+ */
+    bool Init (const CACHE_TIMING_CONFIG& config = g_DEFAULT_TIMING);
+
+/**
+    Accounts for a single access
+
+    @param [in] qwAddress       memory address accessed
+    @param [in] bHit            result of the functional cache lookup
+    @param [in] qwTimestamp     earliest issue cycle, 0 if unknown
+    @param [in] dwDependency    number of accesses back to the access this
+                                one depends on, 0 if independent
+
+    @retval cycle the access completes
+ */
+    QWORD Issue (QWORD qwAddress, bool bHit, QWORD qwTimestamp = 0, DWORD dwDependency = 0);
+
+/**
+    Waits for every outstanding miss, completing the occupancy histogram
+ */
+    void Drain (void);
+
+/**
+    Returns the average memory access time (in cycles)
+ */
+    double get_Amat (void) const noexcept;
+
+/**
+    Returns the memory-level parallelism, the average number of busy MSHRs
+    over the cycles in which at least one is busy
+ */
+    double get_Mlp  (void) const noexcept;
+
+/**
+    Returns the number of cycles until the last access completed
+ */
+    constexpr QWORD get_Cycles (void) const noexcept
+    { return m_qwLastCompletion; };
+
+/**
+    Returns the cycles spent with n MSHRs busy, indexed by n
+ */
+    const std::vector<QWORD>& get_Occupancy (void) const noexcept
+    { return m_vecOccupancy; };
+
+/**
+    Writes AMAT, MLP, the access breakdown and the MSHR occupancy histogram
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os) const;
+
+    virtual void OnCacheAccess (const void* pAddress, DWORD_PTR dwIndex, bool bHit) override;
+
+    virtual void OnCacheFill   (const void* pAddress, DWORD_PTR dwIndex,
+                                DWORD_PTR dwEvictedTag) override;
+
+private:
+
+    void AdvanceTo (QWORD qwCycle);
+
+    CCacheTimingModel (const CCacheTimingModel& rhs) = delete;
+    CCacheTimingModel& operator = (const CCacheTimingModel& rhs) = delete;
+};
+
+#endif
@@ -0,0 +1,204 @@
+/**
+ *  @file       CacheTrace.cpp
+ *  @brief      CCacheTraceWriter and CCacheTraceReader class implementations
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <memory.h>
+
+#include "CacheTrace.h"
+#include "AccessCoalescer.h"
+
+/// records buffered by the writer before they are written out
+constexpr size_t g_TRACE_BUFFER_RECORDS = 4096;
+
+static void InitTraceHeader (TRACE_HEADER& hdr, QWORD qwRecords) noexcept
+{
+    memset (&hdr, 0, sizeof(hdr));
+
+    hdr.dwMagic   = g_TRACE_MAGIC;
+    hdr.dwVersion = g_TRACE_VERSION;
+    hdr.cbHeader  = sizeof(TRACE_HEADER);
+    hdr.cbRecord  = sizeof(TRACE_RECORD);
+    hdr.qwRecords = qwRecords;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CCacheTraceWriter
+
+CCacheTraceWriter::CCacheTraceWriter ( )
+    : m_ofs        ( ),
+      m_qwRecords  (0),
+      m_vecBuffer  ( ),
+      m_pCoalescer ( )
+{
+};
+
+CCacheTraceWriter::~CCacheTraceWriter ( )
+{
+    Close ( );
+};
+
+bool CCacheTraceWriter::Open (const TCHAR* szFileName, bool bCoalesce /* = false */)
+{
+    Close ( );
+
+    if ( szFileName == nullptr )
+        return false;
+
+    m_ofs.open (szFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    if ( !m_ofs.is_open() )
+        return false;
+
+    m_qwRecords = 0;
+    m_vecBuffer.clear ( );
+    m_vecBuffer.reserve (g_TRACE_BUFFER_RECORDS + g_COALESCE_WINDOW);
+
+    if ( bCoalesce )
+        m_pCoalescer.reset (new CAccessCoalescer);
+
+    // the record count is filled in by Close
+    TRACE_HEADER hdr;
+    InitTraceHeader (hdr, 0);
+    m_ofs.write (reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+
+    return !m_ofs.fail();
+}
+
+bool CCacheTraceWriter::Close (void)
+{
+    if ( !m_ofs.is_open() )
+        return false;
+
+    if ( m_pCoalescer )
+    {
+        size_t nBuffered = m_vecBuffer.size();
+        m_pCoalescer->Flush (m_vecBuffer);
+        m_qwRecords += m_vecBuffer.size() - nBuffered;
+        m_pCoalescer.reset ( );
+    }
+
+    bool bReturn = FlushBuffer ( );
+
+    TRACE_HEADER hdr;
+    InitTraceHeader (hdr, m_qwRecords);
+    m_ofs.seekp (0);
+    m_ofs.write (reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+
+    bReturn = bReturn && !m_ofs.fail();
+    m_ofs.close ( );
+
+    return bReturn;
+}
+
+void CCacheTraceWriter::Append (QWORD qwAddress, QWORD qwTimestamp /* = 0 */,
+                                DWORD dwDependency /* = 0 */, DWORD dwRepeat /* = 0 */)
+{
+    if ( !m_ofs.is_open() )
+        return;
+
+    const TRACE_RECORD record { qwAddress, qwTimestamp, dwDependency, dwRepeat };
+    if ( m_pCoalescer )
+    {   // the coalescer releases records in its own time
+        size_t nBuffered = m_vecBuffer.size();
+        m_pCoalescer->Append (record, m_vecBuffer);
+        m_qwRecords += m_vecBuffer.size() - nBuffered;
+    }
+    else
+    {
+        m_vecBuffer.push_back (record);
+        m_qwRecords++;
+    }
+
+    if ( m_vecBuffer.size() >= g_TRACE_BUFFER_RECORDS )
+        FlushBuffer ( );
+}
+
+bool CCacheTraceWriter::FlushBuffer (void)
+{
+    if ( !m_vecBuffer.empty() )
+    {
+        m_ofs.write (reinterpret_cast<const char*>(m_vecBuffer.data()),
+                     m_vecBuffer.size() * sizeof(TRACE_RECORD));
+        m_vecBuffer.clear ( );
+    }
+    return !m_ofs.fail();
+}
+
+void CCacheTraceWriter::OnCacheAccess (const void* pAddress, DWORD_PTR /* dwIndex */, bool /* bHit */)
+{
+    Append (reinterpret_cast<DWORD_PTR>(pAddress));
+}
+
+void CCacheTraceWriter::OnCacheFill (const void* /* pAddress */, DWORD_PTR /* dwIndex */,
+                                     DWORD_PTR /* dwEvictedTag */)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CCacheTraceReader
+
+CCacheTraceReader::CCacheTraceReader ( )
+    : m_ifs   ( ),
+      m_hdr   ( ),
+      m_vecV1 ( )
+{
+};
+
+bool CCacheTraceReader::Open (const TCHAR* szFileName)
+{
+    if ( szFileName == nullptr )
+        return false;
+
+    m_ifs.open (szFileName, std::ios::in | std::ios::binary);
+    if ( !m_ifs.is_open() )
+        return false;
+
+    m_ifs.read (reinterpret_cast<char*>(&m_hdr), sizeof(m_hdr));
+
+    if ( m_ifs.fail() || (m_hdr.dwMagic != g_TRACE_MAGIC) ||
+         (m_hdr.cbHeader != sizeof(TRACE_HEADER)) )
+        return false;
+
+    switch ( m_hdr.dwVersion )
+    {
+    case g_TRACE_VERSION_MIN:
+        return m_hdr.cbRecord == sizeof(TRACE_RECORD_V1);
+    case g_TRACE_VERSION_UNCOUNTED:
+    case g_TRACE_VERSION:
+        return m_hdr.cbRecord == sizeof(TRACE_RECORD);
+    default:
+        return false;
+    }
+}
+
+bool CCacheTraceReader::Read (QWORD qwFirst, size_t nCount, std::vector<TRACE_RECORD>& vecRecords)
+{
+    if ( (qwFirst > m_hdr.qwRecords) || (nCount > m_hdr.qwRecords - qwFirst) )
+        return false;
+
+    vecRecords.resize (nCount);
+    if ( nCount == 0 )
+        return true;
+
+    m_ifs.clear ( );
+    m_ifs.seekg (static_cast<std::streamoff>(m_hdr.cbHeader + qwFirst * m_hdr.cbRecord));
+
+    if ( m_hdr.dwVersion != g_TRACE_VERSION_MIN )
+    {   // version 2 wrote zero where version 3 counts repeats
+        m_ifs.read (reinterpret_cast<char*>(vecRecords.data()), nCount * sizeof(TRACE_RECORD));
+        return !m_ifs.fail();
+    }
+
+    // version 1, widen address only records
+    m_vecV1.resize (nCount);
+    m_ifs.read (reinterpret_cast<char*>(m_vecV1.data()), nCount * sizeof(TRACE_RECORD_V1));
+    for (size_t i = 0; i < nCount; i++)
+        vecRecords[i] = TRACE_RECORD { m_vecV1[i].qwAddress, 0, 0, 0 };
+
+    return !m_ifs.fail();
+}
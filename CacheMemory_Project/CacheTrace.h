@@ -0,0 +1,210 @@
+/**
+ *  @file       CacheTrace.h
+ *  @brief      CCacheTraceWriter and CCacheTraceReader class interfaces
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CACHE_TRACE_H__)
+#define _CACHE_TRACE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _MEMORY_
+    #include <memory>
+#endif
+
+#if !defined(_CACHE_OBSERVER_H__)
+    #include "CacheObserver.h"
+#endif
+
+/*
+    Binary address trace.
+
+    | TRACE_HEADER | TRACE_RECORD | TRACE_RECORD | ...
+
+    Records are fixed size, so record n lives at
+    cbHeader + n * cbRecord and a trace can be read in chunks from either
+    end, which is what the backward next-use pass of Belady's OPT needs.
+
+    Version 2 records carry an optional issue timestamp and dependency hint
+    for the timing model; version 1 traces (address only) are still read,
+    with both fields zero.
+
+    Version 3 records count the accesses CAccessCoalescer folded into them,
+    further accesses to the same block that are certain to hit; version 2
+    records have the same layout and no repeats.
+*/
+
+/// 'ACTR' - Associative Cache TRace
+constexpr DWORD g_TRACE_MAGIC   = 0x52544341;
+/// bumped whenever the layout of the trace changes
+constexpr DWORD g_TRACE_VERSION = 3;
+/// oldest trace version the reader still accepts
+constexpr DWORD g_TRACE_VERSION_MIN = 1;
+/// last trace version with uncounted records of the current layout
+constexpr DWORD g_TRACE_VERSION_UNCOUNTED = 2;
+
+/**
+ *  Trace file header
+ */
+struct TRACE_HEADER
+{
+    DWORD   dwMagic;            ///< g_TRACE_MAGIC
+    DWORD   dwVersion;          ///< g_TRACE_VERSION
+    DWORD   cbHeader;           ///< sizeof(TRACE_HEADER)
+    DWORD   cbRecord;           ///< sizeof(TRACE_RECORD)
+    QWORD   qwRecords;          ///< number of records following the header
+};
+
+/**
+ *  A single traced access
+ */
+struct TRACE_RECORD
+{
+    QWORD   qwAddress;          ///< memory address accessed
+    QWORD   qwTimestamp;        ///< earliest issue cycle, 0 if unknown
+    DWORD   dwDependency;       ///< number of records back to the access whose
+                                ///< data this one depends on, 0 if independent
+    DWORD   dwRepeat;           ///< further accesses to the same block folded
+                                ///< into this record, all of them hits
+};
+
+/**
+ *  Version 1 trace record
+ */
+struct TRACE_RECORD_V1
+{
+    QWORD   qwAddress;          ///< memory address accessed
+};
+
+class CAccessCoalescer;
+
+/**
+ *  Cache observer writing every access address to a trace file
+ */
+class CCacheTraceWriter : public ICacheObserver
+{
+    std::ofstream                       m_ofs;
+    QWORD                               m_qwRecords;
+    std::vector<TRACE_RECORD>           m_vecBuffer;    ///< records not yet written
+    std::unique_ptr<CAccessCoalescer>   m_pCoalescer;   ///< set while coalescing
+
+public:
+/**
+ *  Default Constructor
+ */
+    CCacheTraceWriter ( );
+
+    virtual ~CCacheTraceWriter ( );
+
+/**
+    Creates the trace file
+
+    @param [in] szFileName      name of the trace file
+    @param [in] bCoalesce       fold accesses certain to hit into counted
+                                records (see CAccessCoalescer)
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool Open   (const TCHAR* szFileName, bool bCoalesce = false);
+
+/**
+    Writes any buffered records, completes the header and closes the trace
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool Close  (void);
+
+/**
+    Appends a single access to the trace
+
+    @param [in] qwAddress       memory address accessed
+    @param [in] qwTimestamp     earliest issue cycle, 0 if unknown
+    @param [in] dwDependency    number of records back to the access this
+                                one depends on, 0 if independent
+    @param [in] dwRepeat        further hits to the same block this record
+                                stands for
+ */
+    void Append (QWORD qwAddress, QWORD qwTimestamp = 0, DWORD dwDependency = 0,
+                 DWORD dwRepeat = 0);
+
+/**
+    Returns the number of records written, fewer than the accesses appended
+    when coalescing
+ */
+    constexpr QWORD get_Records (void) const noexcept
+    { return m_qwRecords; };
+
+    virtual void OnCacheAccess (const void* pAddress, DWORD_PTR dwIndex, bool bHit) override;
+
+    virtual void OnCacheFill   (const void* pAddress, DWORD_PTR dwIndex,
+                                DWORD_PTR dwEvictedTag) override;
+
+private:
+
+    bool FlushBuffer (void);
+
+    CCacheTraceWriter (const CCacheTraceWriter& rhs) = delete;
+    CCacheTraceWriter& operator = (const CCacheTraceWriter& rhs) = delete;
+};
+
+/**
+ *  Random access reader of a trace written by CCacheTraceWriter
+ */
+class CCacheTraceReader
+{
+    std::ifstream   m_ifs;
+    TRACE_HEADER    m_hdr;
+    std::vector<TRACE_RECORD_V1> m_vecV1;  ///< conversion buffer for version 1 traces
+
+public:
+/**
+ *  Default Constructor
+ */
+    CCacheTraceReader ( );
+
+/**
+    Opens a trace and validates its header
+
+    @param [in] szFileName      name of the trace file
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool Open (const TCHAR* szFileName);
+
+/**
+    Returns the number of records in the trace
+ */
+    constexpr QWORD get_Records (void) const noexcept
+    { return m_hdr.qwRecords; };
+
+/**
+    Reads a contiguous run of records
+
+    @param [in]  qwFirst        index of the first record to read
+    @param [in]  nCount         number of records to read
+    @param [out] vecRecords     records read, resized to nCount
+
+    @retval true      on success
+    @retval false     if the run lies outside the trace or on error
+ */
+    bool Read (QWORD qwFirst, size_t nCount, std::vector<TRACE_RECORD>& vecRecords);
+
+private:
+
+    CCacheTraceReader (const CCacheTraceReader& rhs) = delete;
+    CCacheTraceReader& operator = (const CCacheTraceReader& rhs) = delete;
+};
+
+#endif
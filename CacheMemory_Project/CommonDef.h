@@ -16,6 +16,7 @@
 
 typedef unsigned __int8  BYTE;
 typedef unsigned __int32 DWORD;
+typedef unsigned __int64 QWORD;
 
 #ifndef _FSTREAM_
     #include <fstream>
@@ -63,4 +64,10 @@ namespace req
     constexpr int g_MAX_ARRAY_SIZE        = 512;
 }
 
+/**
+ *  Cache line size of the host processor (in bytes), used to lay out and pad
+ *  data structures shared between threads
+ */
+constexpr size_t g_HOST_CACHE_LINE_SIZE = 64;
+
 #endif
\ No newline at end of file
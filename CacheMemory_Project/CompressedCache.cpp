@@ -0,0 +1,335 @@
+/**
+ *  @file       CompressedCache.cpp
+ *  @brief      CCompressedCache class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <memory.h>
+#include <emmintrin.h>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "VirtualAddress.h"
+#include "CompressedCache.h"
+
+/// no block is kept by MakeRoom, room is made for a new block
+constexpr size_t g_NEW_BLOCK = static_cast<size_t>(-1);
+
+struct BDI_ENCODING
+{
+    COMPRESSION_ENCODING    eEncoding;
+    DWORD                   cbBase;
+    DWORD                   cbDelta;
+};
+
+/// base-delta encodings, smallest first
+static const BDI_ENCODING g_rgBaseDelta[] =
+{
+    { ENCODING_BASE8_DELTA1, 8, 1 },
+    { ENCODING_BASE4_DELTA1, 4, 1 },
+    { ENCODING_BASE8_DELTA2, 8, 2 },
+    { ENCODING_BASE2_DELTA1, 2, 1 },
+    { ENCODING_BASE4_DELTA2, 4, 2 },
+    { ENCODING_BASE8_DELTA4, 8, 4 },
+};
+
+static const char* g_rgEncodingNames[ENCODING_COUNT] =
+{
+    "Zero", "Repeated", "Base8-Delta1", "Base4-Delta1", "Base8-Delta2",
+    "Base2-Delta1", "Base4-Delta2", "Base8-Delta4", "Uncompressed"
+};
+
+/**
+    Fills a vector with a pattern of cbBase bytes
+*/
+static __m128i Broadcast (const BYTE* pPattern, DWORD cbBase) noexcept
+{
+    alignas(16) BYTE rgVector[16];
+    for (DWORD i = 0; i < sizeof(rgVector); i += cbBase)
+        memcpy (&rgVector[i], pPattern, cbBase);
+    return _mm_load_si128 (reinterpret_cast<const __m128i*>(rgVector));
+}
+
+static __m128i AddLanes (__m128i a, __m128i b, DWORD cbBase) noexcept
+{
+    switch (cbBase)
+    {
+    case 2:  return _mm_add_epi16 (a, b);
+    case 4:  return _mm_add_epi32 (a, b);
+    default: return _mm_add_epi64 (a, b);
+    }
+}
+
+static __m128i SubLanes (__m128i a, __m128i b, DWORD cbBase) noexcept
+{
+    switch (cbBase)
+    {
+    case 2:  return _mm_sub_epi16 (a, b);
+    case 4:  return _mm_sub_epi32 (a, b);
+    default: return _mm_sub_epi64 (a, b);
+    }
+}
+
+/**
+    @note A delta fits in cbDelta signed bytes when adding the bias
+    2^(8 * cbDelta - 1) leaves every byte above the low cbDelta bytes zero.
+
+    @retval bit n set if byte n of the block belongs to an element whose
+            delta from the base fits
+*/
+static DWORD DeltaFitMask (const __m128i rgData[2], __m128i base, __m128i bias,
+                           __m128i high, DWORD cbBase) noexcept
+{
+    const __m128i zero = _mm_setzero_si128 ( );
+
+    DWORD dwMask = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        __m128i delta = AddLanes (SubLanes (rgData[i], base, cbBase), bias, cbBase);
+        __m128i fits  = _mm_cmpeq_epi8 (_mm_and_si128 (delta, high), zero);
+        dwMask |= static_cast<DWORD>(_mm_movemask_epi8 (fits)) << (16 * i);
+    }
+    return dwMask;
+}
+
+/**
+    Tests a base-delta encoding.  Every element is a delta either from an
+    implicit zero base or from the first element that is not.
+*/
+static bool FitsBaseDelta (const BYTE* pBlock, const __m128i rgData[2],
+                           const BDI_ENCODING& encoding) noexcept
+{
+    const DWORD cbBase  = encoding.cbBase;
+    const DWORD dwLane  = (1u << cbBase) - 1;
+
+    BYTE rgBias[8] = { 0 };
+    BYTE rgHigh[8];
+    rgBias[encoding.cbDelta - 1] = 0x80;
+    for (DWORD i = 0; i < cbBase; i++)
+        rgHigh[i] = (i < encoding.cbDelta) ? 0x00 : 0xFF;
+
+    const __m128i bias = Broadcast (rgBias, cbBase);
+    const __m128i high = Broadcast (rgHigh, cbBase);
+
+    DWORD dwZeroFits = DeltaFitMask (rgData, _mm_setzero_si128 ( ), bias, high, cbBase);
+
+    DWORD cbFirst = 0;
+    while ( (cbFirst < req::g_CACHE_BLOCK_SIZE) && (((dwZeroFits >> cbFirst) & dwLane) == dwLane) )
+        cbFirst += cbBase;
+
+    if ( cbFirst == req::g_CACHE_BLOCK_SIZE )
+        return true;
+
+    DWORD dwBaseFits = DeltaFitMask (rgData, Broadcast (pBlock + cbFirst, cbBase), bias, high, cbBase);
+
+    for (DWORD cb = 0; cb < req::g_CACHE_BLOCK_SIZE; cb += cbBase)
+    {
+        if ( (((dwZeroFits >> cb) & dwLane) != dwLane) && (((dwBaseFits >> cb) & dwLane) != dwLane) )
+            return false;
+    }
+    return true;
+}
+
+CCompressedCache::CCompressedCache ( )
+{
+    Init ( );
+};
+
+void CCompressedCache::Init (void)
+{
+    for (auto& it : m_rgSets)
+    {
+        it.clear ( );
+        it.reserve (g_COMPRESSED_TAGS_PER_SET);
+    }
+    memset (m_rgSetBytes,   0, sizeof(m_rgSetBytes));
+    memset (m_rgEncodings,  0, sizeof(m_rgEncodings));
+
+    m_qwHits            = 0;
+    m_qwMisses          = 0;
+    m_qwBaselineMisses  = 0;
+    m_qwResidentSum     = 0;
+    m_qwCompressedBytes = 0;
+    m_qwGrowthEvictions = 0;
+}
+
+DWORD CCompressedCache::Compress (const BYTE* pBlock, COMPRESSION_ENCODING& eEncoding) noexcept
+{
+    static_assert (req::g_CACHE_BLOCK_SIZE == 2 * sizeof(__m128i), "Compress expects 32 byte blocks");
+
+    const __m128i rgData[2] =
+    {
+        _mm_loadu_si128 (reinterpret_cast<const __m128i*>(pBlock)),
+        _mm_loadu_si128 (reinterpret_cast<const __m128i*>(pBlock + sizeof(__m128i)))
+    };
+
+    const __m128i zero = _mm_setzero_si128 ( );
+    if ( _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_or_si128 (rgData[0], rgData[1]), zero)) == 0xFFFF )
+    {
+        eEncoding = ENCODING_ZERO;
+        return 1;
+    }
+
+    const __m128i repeated = _mm_unpacklo_epi64 (rgData[0], rgData[0]);
+    if ( _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (rgData[0], repeated),
+                                           _mm_cmpeq_epi8 (rgData[1], repeated))) == 0xFFFF )
+    {
+        eEncoding = ENCODING_REPEATED;
+        return 8;
+    }
+
+    for (const auto& it : g_rgBaseDelta)
+    {
+        if ( FitsBaseDelta (pBlock, rgData, it) )
+        {
+            eEncoding = it.eEncoding;
+            return it.cbBase + (req::g_CACHE_BLOCK_SIZE / it.cbBase) * it.cbDelta;
+        }
+    }
+
+    eEncoding = ENCODING_UNCOMPRESSED;
+    return req::g_CACHE_BLOCK_SIZE;
+}
+
+/**
+    Evicts blocks, oldest first, until cbNeeded more bytes fit in the set
+    and, for a new block, a tag is free
+
+    @param [in] dwIndex         cache set
+    @param [in] cbNeeded        bytes to make room for
+    @param [in] nKeep           position of a block never to evict, or
+                                g_NEW_BLOCK when making room for a new block
+
+    @retval position of the kept block after the evictions
+*/
+size_t CCompressedCache::MakeRoom (DWORD_PTR dwIndex, DWORD cbNeeded, size_t nKeep)
+{
+    std::vector<COMPRESSED_BLOCK>& vecSet = m_rgSets[dwIndex];
+
+    size_t nVictim = 0;
+    while ( (m_rgSetBytes[dwIndex] + cbNeeded > g_COMPRESSED_SET_BYTES) ||
+            ((nKeep == g_NEW_BLOCK) && (vecSet.size() >= g_COMPRESSED_TAGS_PER_SET)) )
+    {
+        if ( nVictim == nKeep )
+            nVictim++;
+
+        m_rgSetBytes[dwIndex] -= vecSet[nVictim].cbSize;
+        vecSet.erase (vecSet.begin() + nVictim);
+
+        if ( nKeep != g_NEW_BLOCK )
+        {
+            m_qwGrowthEvictions++;
+            if ( nVictim < nKeep )
+                nKeep--;
+        }
+    }
+    return nKeep;
+}
+
+bool CCompressedCache::Access (DWORD_PTR dwAddress, const BYTE* pBlock)
+{
+    CVirtualAddress vAddress (reinterpret_cast<const void*>(dwAddress));
+    DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+    if ( dwIndex >= _countof(m_rgSets) )
+        return false;
+
+    DWORD_PTR dwTag = vAddress.DecodeTag ( );
+    std::vector<COMPRESSED_BLOCK>& vecSet = m_rgSets[dwIndex];
+
+    COMPRESSION_ENCODING eEncoding;
+    DWORD cbCompressed = Compress (pBlock, eEncoding);
+    DWORD cbSize = (cbCompressed + g_COMPRESSION_SEGMENT - 1) & ~(g_COMPRESSION_SEGMENT - 1);
+
+    auto it = std::find_if (vecSet.begin(), vecSet.end(),
+                            [dwTag](const COMPRESSED_BLOCK& block) { return block.dwTag == dwTag; });
+
+    bool bHit = (it != vecSet.end());
+    if ( bHit )
+    {
+        m_qwHits++;
+
+        m_rgSetBytes[dwIndex] -= it->cbSize;
+        COMPRESSED_BLOCK& block = vecSet[MakeRoom (dwIndex, cbSize, it - vecSet.begin())];
+
+        block.cbSize    = cbSize;
+        block.eEncoding = eEncoding;
+    }
+    else
+    {
+        m_qwMisses++;
+        m_qwCompressedBytes += cbCompressed;
+        m_rgEncodings[eEncoding]++;
+
+        MakeRoom (dwIndex, cbSize, g_NEW_BLOCK);
+        vecSet.push_back (COMPRESSED_BLOCK { dwTag, cbSize, eEncoding });
+    }
+    m_rgSetBytes[dwIndex] += cbSize;
+
+    for (const auto& set : m_rgSets)
+        m_qwResidentSum += set.size();
+
+    return bHit;
+}
+
+double CCompressedCache::get_EffectiveCapacity (void) const noexcept
+{
+    QWORD qwAccesses = m_qwHits + m_qwMisses;
+    return qwAccesses ? static_cast<double>(m_qwResidentSum) / (qwAccesses * req::g_CACHE_NUM_BLOCKS) : 0.0;
+}
+
+double CCompressedCache::get_CompressionRatio (void) const noexcept
+{
+    return m_qwCompressedBytes ? static_cast<double>(m_qwMisses * req::g_CACHE_BLOCK_SIZE) / m_qwCompressedBytes
+                               : 0.0;
+}
+
+std::ostream& CCompressedCache::Report (std::ostream& os) const
+{
+    os << std::dec << std::setfill (' ');
+    os << "Compressed cache (BDI)" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    os << "Set budget:          " << g_COMPRESSED_SET_BYTES << " bytes, "
+                                  << g_COMPRESSED_TAGS_PER_SET << " tags" << std::endl;
+    os << "Hits:                " << m_qwHits            << std::endl;
+    os << "Misses:              " << m_qwMisses          << std::endl;
+    os << "Uncompressed misses: " << m_qwBaselineMisses  << std::endl;
+    os << "Growth evictions:    " << m_qwGrowthEvictions << std::endl;
+
+    os << std::fixed << std::setprecision(2);
+    double dReduction = m_qwBaselineMisses
+                      ? 100.0 * (static_cast<double>(m_qwBaselineMisses) - m_qwMisses) / m_qwBaselineMisses
+                      : 0.0;
+    os << "Miss reduction:      " << dReduction << "%" << std::endl;
+    os << "Effective capacity:  " << get_EffectiveCapacity() << "x" << std::endl;
+    os << "Compression ratio:   " << get_CompressionRatio()  << ":1" << std::endl;
+
+    os << "Fills by encoding:" << std::endl;
+    for (int i = 0; i < ENCODING_COUNT; i++)
+    {
+        if ( m_rgEncodings[i] )
+            os << "  " << std::left << std::setw(14) << g_rgEncodingNames[i] << std::right
+               << std::setw(10) << m_rgEncodings[i] << std::endl;
+    }
+    os.unsetf (std::ios::floatfield);
+
+    return os;
+}
+
+void CCompressedCache::OnCacheAccess (const void* pAddress, DWORD_PTR /* dwIndex */, bool bHit)
+{
+    if ( !bHit )
+        m_qwBaselineMisses++;
+
+    DWORD_PTR dwAddress = reinterpret_cast<DWORD_PTR>(pAddress);
+    Access (dwAddress, reinterpret_cast<const BYTE*>(dwAddress & ~static_cast<DWORD_PTR>(req::g_CACHE_BLOCK_SIZE - 1)));
+}
+
+void CCompressedCache::OnCacheFill (const void* /* pAddress */, DWORD_PTR /* dwIndex */,
+                                    DWORD_PTR /* dwEvictedTag */)
+{
+}
@@ -0,0 +1,163 @@
+/**
+ *  @file       CompressedCache.h
+ *  @brief      CCompressedCache class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_COMPRESSED_CACHE_H__)
+#define _COMPRESSED_CACHE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+#if !defined(_CACHE_OBSERVER_H__)
+    #include "CacheObserver.h"
+#endif
+
+/// data bytes per set, the same as the uncompressed 4-way cache
+constexpr DWORD  g_COMPRESSED_SET_BYTES     = req::g_4WAY_BLOCKS_PER_SET * req::g_CACHE_BLOCK_SIZE;
+/// tags per set, twice the associativity so that compressed blocks can fill the data space
+constexpr size_t g_COMPRESSED_TAGS_PER_SET  = 2 * req::g_4WAY_BLOCKS_PER_SET;
+/// allocation granularity of the data space, compressed sizes are rounded up to it
+constexpr DWORD  g_COMPRESSION_SEGMENT      = 4;
+
+/**
+ *  Encodings a cache block can be stored in, in order of preference.
+ *  BASEn_DELTAm stores one n byte base and an m byte signed delta per n byte
+ *  element; every element is a delta either from the base or from zero.
+ */
+enum COMPRESSION_ENCODING
+{
+    ENCODING_ZERO,          ///< every byte zero
+    ENCODING_REPEATED,      ///< one 8 byte value repeated
+    ENCODING_BASE8_DELTA1,
+    ENCODING_BASE4_DELTA1,
+    ENCODING_BASE8_DELTA2,
+    ENCODING_BASE2_DELTA1,
+    ENCODING_BASE4_DELTA2,
+    ENCODING_BASE8_DELTA4,
+    ENCODING_UNCOMPRESSED,
+    ENCODING_COUNT
+};
+
+/**
+ *  A block resident in a compressed cache set
+ */
+struct COMPRESSED_BLOCK
+{
+    DWORD_PTR               dwTag;
+    DWORD                   cbSize;         ///< allocated bytes, in whole segments
+    COMPRESSION_ENCODING    eEncoding;
+};
+
+/**
+ *  A cache with the geometry of the 4-way cache whose sets hold a variable
+ *  number of compressed blocks.  Every set has g_COMPRESSED_SET_BYTES of data
+ *  space, as much as four uncompressed blocks, and g_COMPRESSED_TAGS_PER_SET
+ *  tags.  A fill evicts blocks, oldest first, until both a tag and enough data
+ *  space are free.
+ *
+ *  Blocks are compressed on the fill path with Base-Delta-Immediate (BDI,
+ *  Pekhimenko et al., PACT 2012) plus zero and repeated-value detection;
+ *  every encoding is tried with SSE2 and the smallest one that fits is kept.
+ *  A hit recompresses the block, since a write may have changed its size,
+ *  evicting other blocks should it no longer fit.
+ *
+ *  Attached to a CCacheManager the model reads the block contents from
+ *  memory, and counts the misses of the uncompressed cache it observes, so
+ *  the report compares the two on the same access stream.
+ */
+class CCompressedCache : public ICacheObserver
+{
+    std::vector<COMPRESSED_BLOCK>   m_rgSets[req::g_4WAY_CACHE_SETS];   ///< oldest block first
+    DWORD                           m_rgSetBytes[req::g_4WAY_CACHE_SETS];
+
+    QWORD   m_qwHits;
+    QWORD   m_qwMisses;
+    QWORD   m_qwBaselineMisses;         ///< misses of the observed uncompressed cache
+    QWORD   m_qwResidentSum;            ///< resident blocks, summed over every access
+    QWORD   m_qwCompressedBytes;        ///< compressed size of every fill, unrounded
+    QWORD   m_qwGrowthEvictions;        ///< evictions caused by a block growing on a hit
+    QWORD   m_rgEncodings[ENCODING_COUNT];  ///< fills per encoding
+
+public:
+/**
+ *  Default Constructor
+ */
+    CCompressedCache ( );
+
+/**
+ *  Empties the cache and clears the statistics
+ */
+    void Init (void);
+
+/**
+    Compresses a cache block
+
+    @param [in]  pBlock         g_CACHE_BLOCK_SIZE bytes of block data
+    @param [out] eEncoding      smallest encoding that represents the block
+
+    @retval compressed size in bytes
+ */
+    static DWORD Compress (const BYTE* pBlock, COMPRESSION_ENCODING& eEncoding) noexcept;
+
+/**
+    Looks up a block, filling it on a miss
+
+    @param [in] dwAddress       address being accessed
+    @param [in] pBlock          current contents of the block containing dwAddress
+
+    @retval true      on a hit
+    @retval false     on a miss
+ */
+    bool  Access (DWORD_PTR dwAddress, const BYTE* pBlock);
+
+    QWORD get_Hits   (void) const noexcept
+    { return m_qwHits; };
+
+    QWORD get_Misses (void) const noexcept
+    { return m_qwMisses; };
+
+/**
+    Returns the average number of resident blocks relative to the
+    g_CACHE_NUM_BLOCKS an uncompressed cache holds
+ */
+    double get_EffectiveCapacity (void) const noexcept;
+
+/**
+    Returns the average uncompressed to compressed size ratio of the fills
+ */
+    double get_CompressionRatio  (void) const noexcept;
+
+/**
+    Writes misses compared to the uncompressed cache, effective capacity,
+    compression ratio and the encoding mix
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os) const;
+
+    virtual void OnCacheAccess (const void* pAddress, DWORD_PTR dwIndex, bool bHit) override;
+    virtual void OnCacheFill   (const void* pAddress, DWORD_PTR dwIndex,
+                                DWORD_PTR dwEvictedTag) override;
+
+private:
+
+    size_t MakeRoom (DWORD_PTR dwIndex, DWORD cbNeeded, size_t nKeep);
+
+    CCompressedCache (const CCompressedCache& rhs) = delete;
+    CCompressedCache& operator = (const CCompressedCache& rhs) = delete;
+};
+
+#endif
@@ -0,0 +1,425 @@
+/**
+ *  @file       ConcurrentCache.h
+ *  @brief      CConcurrentCache class template interface and implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CONCURRENT_CACHE_H__)
+#define _CONCURRENT_CACHE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _ATOMIC_
+    #include <atomic>
+#endif
+
+#ifndef _FUNCTIONAL_
+    #include <functional>
+#endif
+
+#ifndef _NEW_
+    #include <new>
+#endif
+
+#ifndef _THREAD_
+    #include <thread>
+#endif
+
+#ifndef _TYPE_TRAITS_
+    #include <type_traits>
+#endif
+
+#include <malloc.h>
+#include <immintrin.h>
+
+/*
+    CConcurrentCache is the software counterpart of the n-way set associative
+    data cache simulated by CCacheManager, intended to be used as a bounded,
+    in-process key / value cache shared by many threads.
+
+    - the hash of a key selects a set, exactly as the index bits of an address
+      select a CCacheSet
+    - the remaining hash bits form a 32 bit tag stored per way, so a lookup
+      compares tags first and only touches keys whose tag matches
+    - each set starts on a host cache line boundary and keeps its sequence
+      counter, eviction state and tags at the front, so a lookup normally
+      touches a single cache line of metadata
+
+    Concurrency:
+
+    Every set is protected by a sequence lock (seqlock).  Writers make the
+    sequence odd while modifying a set and even again when done; writers to
+    the same set serialize on it, writers to different sets never interact.
+    Readers never write shared state (other than an optional, relaxed eviction
+    hint) and never wait on a lock: they read the sequence, copy the value
+    out and retry only if the sequence changed in the meantime.  There is no
+    global lock anywhere.
+
+    Because readers may observe a value while it is being overwritten (and
+    then discard it), keys and values must be trivially copyable.
+
+    Eviction:
+
+    The eviction policy is a template parameter instantiated once per set.
+    A policy provides
+
+        void    OnHit    (size_t iWay) noexcept;   // reader side, lock free
+        void    OnInsert (size_t iWay) noexcept;   // writer side, set locked
+        size_t  Victim   (void) noexcept;          // writer side, set locked
+
+    CFifoEviction mirrors the FIFO replacement policy of CCacheSet and
+    CClockEviction approximates LRU with one reference bit per way, which
+    readers can set without taking the lock.
+*/
+
+/**
+ *  First-in, first-out eviction; hits do not affect the eviction order
+ */
+template <size_t nWays>
+class CFifoEviction
+{
+    BYTE    m_iNext;    ///< next way to evict, circular
+
+public:
+    CFifoEviction ( ) noexcept
+        : m_iNext (0)
+    { };
+
+    void   OnHit    (size_t /* iWay */) noexcept
+    { };
+
+    void   OnInsert (size_t /* iWay */) noexcept
+    { };
+
+    size_t Victim   (void) noexcept
+    {
+        size_t iWay = m_iNext;
+        m_iNext = static_cast<BYTE>((m_iNext + 1) % nWays);
+        return iWay;
+    };
+};
+
+/**
+ *  CLOCK (second chance) eviction, an approximation of LRU
+ */
+template <size_t nWays>
+class CClockEviction
+{
+    std::atomic<DWORD>  m_dwRefBits;    ///< one reference bit per way
+    BYTE                m_iHand;        ///< clock hand
+
+    static_assert (nWays <= 32, "CClockEviction supports at most 32 ways");
+
+public:
+    CClockEviction ( ) noexcept
+        : m_dwRefBits (0), m_iHand (0)
+    { };
+
+    void   OnHit    (size_t iWay) noexcept
+    {
+        // avoid dirtying the cache line when the bit is already set
+        DWORD dwBit = 1u << iWay;
+        if ( (m_dwRefBits.load (std::memory_order_relaxed) & dwBit) == 0 )
+            m_dwRefBits.fetch_or (dwBit, std::memory_order_relaxed);
+    };
+
+    void   OnInsert (size_t iWay) noexcept
+    { m_dwRefBits.fetch_or (1u << iWay, std::memory_order_relaxed); };
+
+    size_t Victim   (void) noexcept
+    {
+        for ( ; ; )
+        {
+            size_t iWay  = m_iHand;
+            DWORD  dwBit = 1u << iWay;
+            m_iHand = static_cast<BYTE>((m_iHand + 1) % nWays);
+
+            if ( (m_dwRefBits.fetch_and (~dwBit, std::memory_order_relaxed) & dwBit) == 0 )
+                return iWay;
+        }
+    };
+};
+
+/**
+ *  Concurrent n-way set associative key / value cache
+ *
+ *  @tparam TKey        key type, trivially copyable and equality comparable
+ *  @tparam TValue      value type, trivially copyable
+ *  @tparam nWays       associativity (ways per set)
+ *  @tparam TEviction   eviction policy template, see above
+ *  @tparam THash       hash function object for TKey
+ */
+template <typename TKey, typename TValue, size_t nWays = 8,
+          template <size_t> class TEviction = CFifoEviction,
+          typename THash = std::hash<TKey> >
+class CConcurrentCache
+{
+    static_assert (std::is_trivially_copyable<TKey>::value,   "TKey must be trivially copyable");
+    static_assert (std::is_trivially_copyable<TValue>::value, "TValue must be trivially copyable");
+    static_assert ((nWays > 0) && (nWays <= 32),              "nWays must be within 1..32");
+
+    /// tag value of an empty way; stored tags always have the low bit set
+    static constexpr DWORD EMPTY_TAG = 0;
+
+    struct alignas(g_HOST_CACHE_LINE_SIZE) CSet
+    {
+        std::atomic<DWORD>  dwSequence;         ///< odd while a writer owns the set
+        TEviction<nWays>    eviction;           ///< per set eviction state
+        std::atomic<DWORD>  rgTag[nWays];       ///< hash tag per way, EMPTY_TAG if unused
+        TKey                rgKey[nWays];
+        TValue              rgValue[nWays];
+
+        CSet ( ) noexcept
+            : dwSequence (0), eviction ( )
+        {
+            for (auto& it : rgTag)
+                it.store (EMPTY_TAG, std::memory_order_relaxed);
+        };
+    };
+
+    CSet*       m_rgSets;
+    size_t      m_nSets;
+    size_t      m_nSetMask;
+    THash       m_hash;
+
+public:
+/**
+ *  Default Constructor, Init must be called before use; until then every
+ *  lookup misses and every insert fails
+ *
+ *  @note (is_nothrow_default_constructible == true)
+ */
+    CConcurrentCache ( ) noexcept
+        : m_rgSets (nullptr), m_nSets (0), m_nSetMask (0), m_hash ( )
+    { };
+
+    ~CConcurrentCache ( )
+    { Release ( ); };
+
+/**
+ *  Allocates the cache sets
+ *
+ *  Two-stage construction: Construct and initialize the object in two separate stages.
+ *  The constructor creates the object and an initialization function initializes it.
+ *
+ *  @param [in] nCapacity   minimum number of entries, rounded up so that the
+ *                          number of sets is a power of two
+ *
+ *  @retval true    on success
+ *  @retval false   on allocation failure
+ */
+    bool Init (size_t nCapacity)
+    {
+        Release ( );
+
+        size_t nSets = 1;
+        while ( nSets * nWays < nCapacity )
+            nSets <<= 1;
+
+        void* pMem = _aligned_malloc (nSets * sizeof(CSet), alignof(CSet));
+        if ( pMem == nullptr )
+            return false;
+
+        m_rgSets = static_cast<CSet*>(pMem);
+        for (size_t i = 0; i < nSets; i++)
+            new (&m_rgSets[i]) CSet ( );
+
+        m_nSets    = nSets;
+        m_nSetMask = nSets - 1;
+        return true;
+    };
+
+/**
+    Looks up a key without blocking
+
+    @param [in]  key        key to look up
+    @param [out] value      value associated with key, set on a hit only
+
+    @retval true     on cache hit
+    @retval false    on cache miss
+ */
+    bool Find (const TKey& key, TValue& value) const noexcept
+    {
+        if ( m_rgSets == nullptr )
+            return false;
+
+        size_t dwHash = m_hash (key);
+        CSet&  set    = m_rgSets[dwHash & m_nSetMask];
+        DWORD  dwTag  = MakeTag (dwHash);
+
+        for ( ; ; )
+        {
+            DWORD dwSeqBegin = set.dwSequence.load (std::memory_order_acquire);
+            if ( dwSeqBegin & 1 )
+            {   // a writer currently owns the set, try again
+                _mm_pause ( );
+                continue;
+            }
+
+            size_t iFound = nWays;
+            for (size_t i = 0; i < nWays; i++)
+            {
+                if ( (set.rgTag[i].load (std::memory_order_relaxed) == dwTag) &&
+                     (set.rgKey[i] == key) )
+                {
+                    value  = set.rgValue[i];
+                    iFound = i;
+                    break;
+                }
+            }
+
+            std::atomic_thread_fence (std::memory_order_acquire);
+            if ( set.dwSequence.load (std::memory_order_relaxed) == dwSeqBegin )
+            {
+                if ( iFound < nWays )
+                {
+                    set.eviction.OnHit (iFound);
+                    return true;
+                }
+                return false;
+            }
+        }
+    };
+
+/**
+    Inserts a key / value pair, or updates the value if the key is already
+    cached.  Evicts an entry of the same set, chosen by the eviction policy,
+    if the set is full.
+
+    @param [in] key         key to insert
+    @param [in] value       value to associate with key
+
+    @retval true     on success
+    @retval false    if the cache has not been initialized
+ */
+    bool Insert (const TKey& key, const TValue& value) noexcept
+    {
+        if ( m_rgSets == nullptr )
+            return false;
+
+        size_t dwHash = m_hash (key);
+        CSet&  set    = m_rgSets[dwHash & m_nSetMask];
+        DWORD  dwTag  = MakeTag (dwHash);
+
+        LockSet (set);
+
+        size_t iWay   = nWays;
+        size_t iEmpty = nWays;
+        for (size_t i = 0; i < nWays; i++)
+        {
+            DWORD dwWayTag = set.rgTag[i].load (std::memory_order_relaxed);
+            if ( (dwWayTag == dwTag) && (set.rgKey[i] == key) )
+            {
+                iWay = i;
+                break;
+            }
+            if ( (dwWayTag == EMPTY_TAG) && (iEmpty == nWays) )
+                iEmpty = i;
+        }
+
+        if ( iWay == nWays )
+        {
+            iWay = (iEmpty < nWays) ? iEmpty : set.eviction.Victim ( );
+            set.rgKey[iWay] = key;
+            set.rgTag[iWay].store (dwTag, std::memory_order_relaxed);
+        }
+        set.rgValue[iWay] = value;
+        set.eviction.OnInsert (iWay);
+
+        UnlockSet (set);
+        return true;
+    };
+
+/**
+    Removes a key from the cache
+
+    @param [in] key         key to remove
+
+    @retval true     if the key was cached
+    @retval false    otherwise
+ */
+    bool Erase (const TKey& key) noexcept
+    {
+        if ( m_rgSets == nullptr )
+            return false;
+
+        size_t dwHash = m_hash (key);
+        CSet&  set    = m_rgSets[dwHash & m_nSetMask];
+        DWORD  dwTag  = MakeTag (dwHash);
+        bool   bReturn = false;
+
+        LockSet (set);
+        for (size_t i = 0; i < nWays; i++)
+        {
+            if ( (set.rgTag[i].load (std::memory_order_relaxed) == dwTag) &&
+                 (set.rgKey[i] == key) )
+            {
+                set.rgTag[i].store (EMPTY_TAG, std::memory_order_relaxed);
+                bReturn = true;
+                break;
+            }
+        }
+        UnlockSet (set);
+
+        return bReturn;
+    };
+
+/**
+    Returns the maximum number of entries the cache can hold
+ */
+    constexpr size_t get_Capacity (void) const noexcept
+    { return m_nSets * nWays; };
+
+private:
+
+    static DWORD MakeTag (size_t dwHash) noexcept
+    {   // fold the high hash bits, the low bits already selected the set
+        QWORD qwHash = static_cast<QWORD>(dwHash);
+        return static_cast<DWORD>((qwHash >> 32) ^ (qwHash >> 7)) | 1;
+    };
+
+    static void LockSet (CSet& set) noexcept
+    {
+        for (unsigned iSpin = 0; ; iSpin++)
+        {
+            DWORD dwSeq = set.dwSequence.load (std::memory_order_relaxed);
+            if ( ((dwSeq & 1) == 0) &&
+                 set.dwSequence.compare_exchange_weak (dwSeq, dwSeq + 1,
+                                                       std::memory_order_acquire) )
+                break;
+
+            if ( iSpin < 64 )
+                _mm_pause ( );
+            else
+                std::this_thread::yield ( );
+        }
+        // keep the stores to the set from moving above the odd sequence
+        std::atomic_thread_fence (std::memory_order_release);
+    };
+
+    static void UnlockSet (CSet& set) noexcept
+    {
+        set.dwSequence.fetch_add (1, std::memory_order_release);
+    };
+
+    void Release (void) noexcept
+    {
+        if ( m_rgSets )
+        {
+            for (size_t i = 0; i < m_nSets; i++)
+                m_rgSets[i].~CSet ( );
+            _aligned_free (m_rgSets);
+            m_rgSets = nullptr;
+        }
+        m_nSets = m_nSetMask = 0;
+    };
+
+    CConcurrentCache (const CConcurrentCache& rhs) = delete;
+    CConcurrentCache& operator = (const CConcurrentCache& rhs) = delete;
+};
+
+#endif
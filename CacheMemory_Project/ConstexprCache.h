@@ -0,0 +1,126 @@
+/**
+ *  @file       ConstexprCache.h
+ *  @brief      CConstexprCache class template interface and implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_CONSTEXPR_CACHE_H__)
+#define _CONSTEXPR_CACHE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#if !defined(_VIRTUAL_ADDRESS_H__)
+    #include "VirtualAddress.h"
+#endif
+
+/**
+ *  Set associative cache with FIFO replacement that can run entirely at
+ *  compile time, so the miss count of a kernel whose addresses are known
+ *  statically can be computed during compilation and checked with
+ *  static_assert:
+ *
+ *      constexpr size_t KernelMisses (void) noexcept
+ *      {
+ *          CConstexprCache<> cache;
+ *          for (DWORD_PTR i = 0; i < 64; i++)
+ *              cache.Access (i * sizeof(int));
+ *          return cache.get_Misses ( );
+ *      }
+ *      static_assert (KernelMisses ( ) == 8, "kernel cache behaviour regressed");
+ *
+ *  Unlike CCacheManager it holds no data, only Tags, in fixed arrays:
+ *  no std::queue, no heap and no pointers, which C++14 constant evaluation
+ *  does not allow.  Addresses are plain integers, so an array may well
+ *  start at address 0 as the assignment assumes.  Without invalidation the
+ *  blocks of a set are filled and replaced round robin, so a single fill
+ *  position per set reproduces the FIFO order CCacheSet keeps in its queue.
+ *
+ *  Compilers bound the work of a constant evaluation; long kernels may
+ *  need it raised (/constexpr:steps with MSVC).
+ */
+template <size_t nSets   = req::g_4WAY_CACHE_SETS,
+          size_t nWays   = req::g_4WAY_BLOCKS_PER_SET,
+          size_t cbBlock = req::g_CACHE_BLOCK_SIZE>
+class CConstexprCache
+{
+    static_assert ( (nSets > 0) && ((nSets & (nSets - 1)) == 0),
+                    "CConstexprCache set count must be a power of 2" );
+    static_assert ( (cbBlock > 0) && ((cbBlock & (cbBlock - 1)) == 0),
+                    "CConstexprCache block size must be a power of 2" );
+    static_assert ( nWays > 0, "CConstexprCache needs at least one way" );
+
+    DWORD_PTR   m_rgTag[nSets][nWays];
+    bool        m_rgValid[nSets][nWays];
+    size_t      m_rgNextFill[nSets];        ///< oldest block, the next to be replaced
+    size_t      m_nHits;
+    size_t      m_nMisses;
+
+public:
+/**
+ *  Default Constructor, an empty cache
+ */
+    constexpr CConstexprCache ( ) noexcept
+        : m_rgTag      { },
+          m_rgValid    { },
+          m_rgNextFill { },
+          m_nHits      (0),
+          m_nMisses    (0)
+    { };
+
+/**
+    Decodes the Tag of an address, as CVirtualAddress::DecodeTag does for
+    the cache geometry
+ */
+    static constexpr DWORD_PTR DecodeTag (DWORD_PTR dwAddress) noexcept
+    { return dwAddress >> (static_log2 (cbBlock) + static_log2 (nSets)); };
+
+/**
+    Decodes the (set) Index of an address, as CVirtualAddress::DecodeIndex
+    does for the cache geometry
+ */
+    static constexpr DWORD_PTR DecodeIndex (DWORD_PTR dwAddress) noexcept
+    { return (dwAddress >> static_log2 (cbBlock)) & bitmask<DWORD_PTR> (static_log2 (nSets)); };
+
+/**
+    Accesses an address, filling its block on a miss
+
+    @param [in] dwAddress       address being accessed
+
+    @retval true      on a hit
+    @retval false     on a miss
+ */
+    constexpr bool Access (DWORD_PTR dwAddress) noexcept
+    {
+        const DWORD_PTR dwIndex = DecodeIndex (dwAddress);
+        const DWORD_PTR dwTag   = DecodeTag (dwAddress);
+
+        for (size_t i = 0; i < nWays; i++)
+        {
+            if ( m_rgValid[dwIndex][i] && (m_rgTag[dwIndex][i] == dwTag) )
+            {
+                m_nHits++;
+                return true;
+            }
+        }
+
+        size_t& nFill = m_rgNextFill[dwIndex];
+        m_rgTag[dwIndex][nFill]   = dwTag;
+        m_rgValid[dwIndex][nFill] = true;
+        nFill = (nFill + 1) % nWays;
+
+        m_nMisses++;
+        return false;
+    };
+
+    constexpr size_t get_Hits   (void) const noexcept
+    { return m_nHits; };
+
+    constexpr size_t get_Misses (void) const noexcept
+    { return m_nMisses; };
+};
+
+#endif
@@ -0,0 +1,283 @@
+/**
+ *  @file       DramModel.cpp
+ *  @brief      CDramModel class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "VirtualAddress.h"
+#include "CacheSet.h"
+#include "DramModel.h"
+
+static bool IsPowerOf2 (DWORD dw) noexcept
+{
+    return (dw != 0) && ((dw & (dw - 1)) == 0);
+}
+
+CDramModel::CDramModel ( )
+    : m_config           (g_DEFAULT_DRAM),
+      m_vecChannels      ( ),
+      m_qwClock          (0),
+      m_qwFirstArrival   (0),
+      m_qwLastCompletion (0),
+      m_qwReads          (0),
+      m_qwWrites         (0),
+      m_qwRowHits        (0),
+      m_qwRowEmpty       (0),
+      m_qwRowConflicts   (0),
+      m_qwTotalLatency   (0),
+      m_qwQueueFull      (0)
+{
+};
+
+bool CDramModel::Init (const DRAM_CONFIG& config /* = g_DEFAULT_DRAM */)
+{
+    if ( !IsPowerOf2 (config.dwChannels) || !IsPowerOf2 (config.dwRanks) ||
+         !IsPowerOf2 (config.dwBanks)    || !IsPowerOf2 (config.cbRow)   ||
+         (config.cbRow < req::g_CACHE_BLOCK_SIZE) || (config.dwQueueDepth == 0) )
+        return false;
+
+    m_config = config;
+
+    m_vecChannels.assign (config.dwChannels, CChannel ( ));
+    for (auto& it : m_vecChannels)
+    {
+        it.vecQueue.reserve (config.dwQueueDepth);
+        it.vecBanks.assign (config.dwRanks * config.dwBanks, CBank { g_DRAM_NO_ROW, 0 });
+        it.qwCommand = 0;
+        it.qwBusFree = 0;
+        it.qwBusBusy = 0;
+    }
+
+    m_qwClock          = 0;
+    m_qwFirstArrival   = 0;
+    m_qwLastCompletion = 0;
+    m_qwReads          = 0;
+    m_qwWrites         = 0;
+    m_qwRowHits        = 0;
+    m_qwRowEmpty       = 0;
+    m_qwRowConflicts   = 0;
+    m_qwTotalLatency   = 0;
+    m_qwQueueFull      = 0;
+
+    return true;
+}
+
+DRAM_ADDRESS CDramModel::MapAddress (QWORD qwAddress) const noexcept
+{
+    const QWORD qwBlocksPerRow = m_config.cbRow / req::g_CACHE_BLOCK_SIZE;
+
+    QWORD qwBlock = qwAddress / req::g_CACHE_BLOCK_SIZE;
+
+    DRAM_ADDRESS addr;
+    addr.dwColumn  = static_cast<DWORD>(qwBlock % qwBlocksPerRow);
+    qwBlock       /= qwBlocksPerRow;
+    addr.dwChannel = static_cast<DWORD>(qwBlock % m_config.dwChannels);
+    qwBlock       /= m_config.dwChannels;
+    addr.dwBank    = static_cast<DWORD>(qwBlock % m_config.dwBanks);
+    qwBlock       /= m_config.dwBanks;
+    addr.dwRank    = static_cast<DWORD>(qwBlock % m_config.dwRanks);
+    addr.qwRow     = qwBlock / m_config.dwRanks;
+
+    return addr;
+}
+
+/**
+    @note FR-FCFS: find the earliest cycle at which any queued request can
+    issue, then among the requests ready by that cycle prefer the oldest one
+    that hits its bank's open row, and fall back to the oldest one.
+
+    @param [in] channel         channel to schedule
+    @param [in] qwUntil         only serve a request that can issue by this cycle
+    @param [in] bForce          ignore qwUntil
+
+    @retval true      if a request was served
+    @retval false     if the queue is empty or nothing can issue by qwUntil
+*/
+bool CDramModel::ScheduleNext (CChannel& channel, QWORD qwUntil, bool bForce)
+{
+    if ( channel.vecQueue.empty() )
+        return false;
+
+    auto IssueCycle = [&](const CRequest& r) -> QWORD
+    {
+        const CBank& bank = channel.vecBanks[r.addr.dwRank * m_config.dwBanks + r.addr.dwBank];
+        return std::max (std::max (channel.qwCommand, r.qwArrival), bank.qwReady);
+    };
+
+    QWORD qwIssue = ~0ULL;
+    for (const auto& it : channel.vecQueue)
+        qwIssue = std::min (qwIssue, IssueCycle (it));
+
+    if ( !bForce && (qwIssue > qwUntil) )
+        return false;
+
+    auto itPick = channel.vecQueue.end();
+    for (auto it = channel.vecQueue.begin(); it != channel.vecQueue.end(); ++it)
+    {
+        if ( IssueCycle (*it) > qwIssue )
+            continue;
+
+        if ( itPick == channel.vecQueue.end() )
+            itPick = it;
+
+        const CBank& bank = channel.vecBanks[it->addr.dwRank * m_config.dwBanks + it->addr.dwBank];
+        if ( (m_config.ePolicy == PAGE_OPEN) && (bank.qwOpenRow == it->addr.qwRow) )
+        {
+            itPick = it;
+            break;
+        }
+    }
+
+    CBank& bank = channel.vecBanks[itPick->addr.dwRank * m_config.dwBanks + itPick->addr.dwBank];
+
+    QWORD qwCommand;
+    if ( bank.qwOpenRow == itPick->addr.qwRow )
+    {
+        qwCommand = m_config.tCAS;
+        m_qwRowHits++;
+    }
+    else if ( bank.qwOpenRow == g_DRAM_NO_ROW )
+    {
+        qwCommand = m_config.tRCD + m_config.tCAS;
+        m_qwRowEmpty++;
+    }
+    else
+    {
+        qwCommand = m_config.tRP + m_config.tRCD + m_config.tCAS;
+        m_qwRowConflicts++;
+    }
+
+    QWORD qwData     = std::max (qwIssue + qwCommand, channel.qwBusFree);
+    QWORD qwComplete = qwData + m_config.tBurst;
+
+    channel.qwBusFree  = qwComplete;
+    channel.qwBusBusy += m_config.tBurst;
+    channel.qwCommand  = qwIssue + 1;
+
+    if ( m_config.ePolicy == PAGE_OPEN )
+    {   // the open row takes the next column command a burst (tCCD) after
+        // this one, so row hits pipeline behind it rather than wait out tCAS
+        bank.qwOpenRow = itPick->addr.qwRow;
+        bank.qwReady   = qwData - m_config.tCAS + m_config.tBurst;
+    }
+    else
+    {   // auto-precharge once the burst is done
+        bank.qwOpenRow = g_DRAM_NO_ROW;
+        bank.qwReady   = qwComplete + m_config.tRP;
+    }
+
+    m_qwTotalLatency  += qwComplete - itPick->qwArrival;
+    m_qwLastCompletion = std::max (m_qwLastCompletion, qwComplete);
+
+    channel.vecQueue.erase (itPick);
+    return true;
+}
+
+void CDramModel::Enqueue (QWORD qwAddress, QWORD qwArrival, bool bWrite /* = false */)
+{
+    if ( m_vecChannels.empty() )
+        Init ( );
+
+    if ( (m_qwReads + m_qwWrites) == 0 )
+        m_qwFirstArrival = qwArrival;
+
+    if ( bWrite )
+        m_qwWrites++;
+    else
+        m_qwReads++;
+
+    CRequest request = { qwArrival, MapAddress (qwAddress), bWrite };
+    CChannel& channel = m_vecChannels[request.addr.dwChannel];
+
+    // everything that could issue before this request arrived has issued
+    while ( ScheduleNext (channel, qwArrival, false) )
+        ;
+
+    if ( channel.vecQueue.size() >= m_config.dwQueueDepth )
+    {
+        m_qwQueueFull++;
+        while ( channel.vecQueue.size() >= m_config.dwQueueDepth )
+            ScheduleNext (channel, 0, true);
+    }
+
+    channel.vecQueue.push_back (request);
+}
+
+void CDramModel::Drain (void)
+{
+    for (auto& it : m_vecChannels)
+    {
+        while ( ScheduleNext (it, 0, true) )
+            ;
+    }
+}
+
+double CDramModel::get_RowHitRate (void) const noexcept
+{
+    QWORD qwServed = m_qwRowHits + m_qwRowEmpty + m_qwRowConflicts;
+    return qwServed ? static_cast<double>(m_qwRowHits) / qwServed : 0.0;
+}
+
+double CDramModel::get_BusUtilization (void) const noexcept
+{
+    QWORD qwBusy = 0;
+    for (const auto& it : m_vecChannels)
+        qwBusy += it.qwBusBusy;
+
+    QWORD qwElapsed = (m_qwLastCompletion > m_qwFirstArrival) ? m_qwLastCompletion - m_qwFirstArrival : 0;
+    return qwElapsed ? static_cast<double>(qwBusy) / (qwElapsed * m_vecChannels.size()) : 0.0;
+}
+
+double CDramModel::get_AverageLatency (void) const noexcept
+{
+    QWORD qwServed = m_qwRowHits + m_qwRowEmpty + m_qwRowConflicts;
+    return qwServed ? static_cast<double>(m_qwTotalLatency) / qwServed : 0.0;
+}
+
+std::ostream& CDramModel::Report (std::ostream& os) const
+{
+    os << std::dec << std::setfill (' ');
+    os << "DRAM model" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    os << "Organization:     " << m_config.dwChannels << " channel(s), "
+                               << m_config.dwRanks    << " rank(s), "
+                               << m_config.dwBanks    << " bank(s), "
+                               << m_config.cbRow      << " byte rows" << std::endl;
+    os << "Timing:           " << m_config.tCAS << "-" << m_config.tRCD << "-"
+                               << m_config.tRP  << ", burst " << m_config.tBurst << std::endl;
+    os << "Page policy:      " << ((m_config.ePolicy == PAGE_OPEN) ? "open" : "closed") << std::endl;
+    os << "Reads:            " << m_qwReads        << std::endl;
+    os << "Writes:           " << m_qwWrites       << std::endl;
+    os << "Row hits:         " << m_qwRowHits      << std::endl;
+    os << "Row empty:        " << m_qwRowEmpty     << std::endl;
+    os << "Row conflicts:    " << m_qwRowConflicts << std::endl;
+    os << "Queue full:       " << m_qwQueueFull    << std::endl;
+    os << std::fixed << std::setprecision(2);
+    os << "Row hit rate:     " << 100.0 * get_RowHitRate()     << "%" << std::endl;
+    os << "Bus utilization:  " << 100.0 * get_BusUtilization() << "%" << std::endl;
+    os << "Average latency:  " << get_AverageLatency()         << std::endl;
+    os.unsetf (std::ios::floatfield);
+
+    return os;
+}
+
+void CDramModel::OnCacheAccess (const void* /* pAddress */, DWORD_PTR /* dwIndex */, bool /* bHit */)
+{
+    m_qwClock++;
+}
+
+void CDramModel::OnCacheFill (const void* pAddress, DWORD_PTR dwIndex, DWORD_PTR dwEvictedTag)
+{
+    Enqueue (reinterpret_cast<DWORD_PTR>(pAddress), m_qwClock, false);
+
+    if ( m_config.bWriteBackEvictions && (dwEvictedTag != NO_EVICTION) )
+        Enqueue (CVirtualAddress::EncodeAddress (dwEvictedTag, dwIndex), m_qwClock, true);
+}
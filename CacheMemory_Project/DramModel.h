@@ -0,0 +1,215 @@
+/**
+ *  @file       DramModel.h
+ *  @brief      CDramModel class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_DRAM_MODEL_H__)
+#define _DRAM_MODEL_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+#if !defined(_CACHE_OBSERVER_H__)
+    #include "CacheObserver.h"
+#endif
+
+/**
+ *  Row buffer management policy
+ */
+enum DRAM_PAGE_POLICY
+{
+    PAGE_OPEN,      ///< leave the row open after an access, betting on a row hit
+    PAGE_CLOSED     ///< precharge after every access, betting on a row miss
+};
+
+/**
+ *  DRAM organization and timing, all latencies in cycles
+ */
+struct DRAM_CONFIG
+{
+    DWORD   dwChannels;         ///< independent channels (power of 2)
+    DWORD   dwRanks;            ///< ranks per channel (power of 2)
+    DWORD   dwBanks;            ///< banks per rank (power of 2)
+    DWORD   cbRow;              ///< row (page) size in bytes (power of 2)
+    DWORD   tCAS;               ///< column access, read command to data
+    DWORD   tRCD;               ///< row activate to column command
+    DWORD   tRP;                ///< row precharge
+    DWORD   tBurst;             ///< data bus cycles to transfer one cache block
+    DWORD   dwQueueDepth;       ///< request queue entries per channel
+    DRAM_PAGE_POLICY ePolicy;   ///< row buffer policy
+    bool    bWriteBackEvictions;///< treat every eviction as a dirty writeback
+};
+
+/// defaults: 1 channel, 1 rank, 8 banks of 2KB rows, 40-40-40 timing, 16 entry queue
+constexpr DRAM_CONFIG g_DEFAULT_DRAM = { 1, 1, 8, 2048, 40, 40, 40, 8, 16, PAGE_OPEN, false };
+
+/// open row of a precharged bank
+constexpr QWORD g_DRAM_NO_ROW = ~0ULL;
+
+/**
+ *  DRAM coordinates of a cache block
+ */
+struct DRAM_ADDRESS
+{
+    DWORD   dwChannel;
+    DWORD   dwRank;
+    DWORD   dwBank;
+    QWORD   qwRow;
+    DWORD   dwColumn;           ///< cache block within the row
+};
+
+/**
+ *  Memory behind the cache: a DRAM model with channels, ranks, banks and
+ *  row buffers, scheduled First-Ready First-Come-First-Served (FR-FCFS).
+ *
+ *  Cache blocks are mapped row:rank:bank:channel:column, from the most to
+ *  the least significant address bits, so consecutive blocks fill a row
+ *  and streaming accesses see row buffer hits, while neighboring rows are
+ *  spread over channels and banks.
+ *
+ *  Each request is a row buffer
+ *  - hit       the row is already open                     tCAS
+ *  - empty     the bank is precharged                      tRCD + tCAS
+ *  - conflict  another row is open and must be closed      tRP + tRCD + tCAS
+ *
+ *  followed by tBurst cycles on the channel's data bus.  Under PAGE_OPEN
+ *  the open row takes its next column command tBurst after the last one
+ *  (tCCD), so a run of row hits is limited by the bus rather than by tCAS.
+ *  Under PAGE_CLOSED every access precharges its bank afterwards, so there
+ *  are neither hits nor conflicts.  Among the queued requests whose bank is ready, FR-FCFS
+ *  serves the oldest row hit first, otherwise the oldest request.
+ *
+ *  As a cache observer every block load becomes a read request, and with
+ *  bWriteBackEvictions every eviction becomes a write request; accesses are
+ *  assumed to arrive one per cycle.  The cache is write-through without
+ *  dirty bits, so counting every eviction as a writeback is an upper bound
+ *  on writeback traffic.
+ */
+class CDramModel : public ICacheObserver
+{
+    struct CRequest
+    {
+        QWORD       qwArrival;
+        DRAM_ADDRESS addr;
+        bool        bWrite;
+    };
+
+    struct CBank
+    {
+        QWORD       qwOpenRow;      ///< g_DRAM_NO_ROW if precharged
+        QWORD       qwReady;        ///< cycle the bank accepts its next command
+    };
+
+    struct CChannel
+    {
+        std::vector<CRequest> vecQueue;     ///< pending requests, in arrival order
+        std::vector<CBank>    vecBanks;     ///< indexed by rank * banks + bank
+        QWORD       qwCommand;              ///< cycle of the next command slot
+        QWORD       qwBusFree;              ///< cycle the data bus becomes free
+        QWORD       qwBusBusy;              ///< cycles the data bus transferred data
+    };
+
+    DRAM_CONFIG             m_config;
+    std::vector<CChannel>   m_vecChannels;
+
+    QWORD   m_qwClock;              ///< arrival time of observed requests
+    QWORD   m_qwFirstArrival;
+    QWORD   m_qwLastCompletion;
+
+    QWORD   m_qwReads;
+    QWORD   m_qwWrites;
+    QWORD   m_qwRowHits;
+    QWORD   m_qwRowEmpty;
+    QWORD   m_qwRowConflicts;
+    QWORD   m_qwTotalLatency;       ///< sum of (completion - arrival)
+    QWORD   m_qwQueueFull;          ///< arrivals that found the queue full
+
+public:
+/**
+ *  Default Constructor
+ */
+    CDramModel ( );
+
+/**
+    Sets the organization and timing and clears all state and statistics
+
+    @param [in] config          DRAM configuration
+
+    @retval true      on success
+    @retval false     if a dimension is zero or not a power of 2
+ */
+    bool Init (const DRAM_CONFIG& config = g_DEFAULT_DRAM);
+
+/**
+    Maps a memory address to its DRAM coordinates
+
+    @param [in] qwAddress       memory address
+
+    @retval DRAM_ADDRESS        channel, rank, bank, row and column
+ */
+    DRAM_ADDRESS MapAddress (QWORD qwAddress) const noexcept;
+
+/**
+    Queues a request for the cache block containing qwAddress.  Arrival
+    times must not decrease from one call to the next.
+
+    @param [in] qwAddress       memory address
+    @param [in] qwArrival       cycle the request reaches the memory controller
+    @param [in] bWrite          true for a writeback, false for a block load
+ */
+    void Enqueue (QWORD qwAddress, QWORD qwArrival, bool bWrite = false);
+
+/**
+    Serves every queued request
+ */
+    void Drain (void);
+
+/**
+    Returns the fraction of requests that hit an open row
+ */
+    double get_RowHitRate (void) const noexcept;
+
+/**
+    Returns the fraction of elapsed cycles the data buses were transferring
+ */
+    double get_BusUtilization (void) const noexcept;
+
+/**
+    Returns the average request latency, queueing included (in cycles)
+ */
+    double get_AverageLatency (void) const noexcept;
+
+/**
+    Writes the request breakdown, row buffer locality, latency and bandwidth
+    utilization
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os) const;
+
+    virtual void OnCacheAccess (const void* pAddress, DWORD_PTR dwIndex, bool bHit) override;
+
+    virtual void OnCacheFill   (const void* pAddress, DWORD_PTR dwIndex,
+                                DWORD_PTR dwEvictedTag) override;
+
+private:
+
+    bool ScheduleNext (CChannel& channel, QWORD qwUntil, bool bForce);
+
+    CDramModel (const CDramModel& rhs) = delete;
+    CDramModel& operator = (const CDramModel& rhs) = delete;
+};
+
+#endif
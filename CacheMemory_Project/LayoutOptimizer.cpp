@@ -0,0 +1,316 @@
+/**
+ *  @file       LayoutOptimizer.cpp
+ *  @brief      CLayoutOptimizer class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <memory.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <iostream>
+#include <iomanip>
+
+#include "VirtualAddress.h"
+#include "CacheSet.h"
+#include "LayoutOptimizer.h"
+
+/// page aligned base address of the simulated data
+constexpr QWORD g_LAYOUT_BASE = 0x00100000;
+
+/// bytes after which padding wraps around to the same cache sets
+constexpr DWORD g_LAYOUT_WAY_SIZE = req::g_4WAY_CACHE_SETS * req::g_CACHE_BLOCK_SIZE;
+
+CLayoutOptimizer::CLayoutOptimizer ( )
+    : m_vecArrays   ( ),
+      m_vecAccesses ( ),
+      m_qwOuter     (1),
+      m_qwInner     (0)
+{
+};
+
+DWORD CLayoutOptimizer::AddArray (const char* szName, DWORD cbElement, QWORD qwElements)
+{
+    m_vecArrays.push_back (KERNEL_ARRAY { szName ? szName : "", cbElement, qwElements });
+    return static_cast<DWORD>(m_vecArrays.size() - 1);
+}
+
+bool CLayoutOptimizer::AddAccess (DWORD dwArray, __int64 iCoefOuter, __int64 iCoefInner, __int64 iOffset)
+{
+    if ( dwArray >= m_vecArrays.size() )
+        return false;
+
+    m_vecAccesses.push_back (KERNEL_ACCESS { dwArray, iCoefOuter, iCoefInner, iOffset });
+    return true;
+}
+
+void CLayoutOptimizer::EnumerateLayouts (std::vector<LAYOUT_RESULT>& vecResults) const
+{
+    DWORD cbStep = req::g_CACHE_BLOCK_SIZE;
+    bool  bEqualLength = true;
+    for (const auto& it : m_vecArrays)
+    {
+        cbStep = std::min (cbStep, std::max<DWORD> (it.cbElement, 1));
+        bEqualLength = bEqualLength && (it.qwElements == m_vecArrays.front().qwElements);
+    }
+
+    // tiling only changes the iteration order of a loop nest
+    std::vector<QWORD> vecTiles (1, 0);
+    if ( m_qwOuter > 1 )
+    {
+        for (QWORD qwTile = 4; qwTile < m_qwInner; qwTile <<= 1)
+            vecTiles.push_back (qwTile);
+    }
+
+    vecResults.clear ( );
+    for (auto qwTile : vecTiles)
+    {
+        for (DWORD cbOffset = 0; cbOffset < req::g_CACHE_BLOCK_SIZE; cbOffset += cbStep)
+        {
+            for (DWORD cbPadding = 0; cbPadding < g_LAYOUT_WAY_SIZE; cbPadding += cbStep)
+                vecResults.push_back (LAYOUT_RESULT { DATA_LAYOUT { cbOffset, cbPadding, false, qwTile },
+                                                      0, false, false });
+
+            if ( bEqualLength && (m_vecArrays.size() > 1) )
+                vecResults.push_back (LAYOUT_RESULT { DATA_LAYOUT { cbOffset, 0, true, qwTile },
+                                                      0, false, false });
+        }
+    }
+}
+
+QWORD CLayoutOptimizer::Simulate (const DATA_LAYOUT& layout, QWORD qwBound, bool bExtrapolate,
+                                  bool& bExtrapolated, bool& bPruned) const
+{
+    bExtrapolated = false;
+    bPruned       = false;
+
+    // address of element 0 and element stride of every array
+    std::vector<__int64> vecBase   (m_vecArrays.size());
+    std::vector<__int64> vecStride (m_vecArrays.size());
+
+    __int64 iAddress = static_cast<__int64>(g_LAYOUT_BASE + layout.cbBaseOffset);
+    if ( layout.bArrayOfStructs )
+    {
+        __int64 cbStruct = 0;
+        for (const auto& it : m_vecArrays)
+            cbStruct += it.cbElement;
+
+        for (size_t i = 0; i < m_vecArrays.size(); i++)
+        {
+            vecBase[i]   = iAddress;
+            vecStride[i] = cbStruct;
+            iAddress    += m_vecArrays[i].cbElement;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < m_vecArrays.size(); i++)
+        {
+            vecBase[i]   = iAddress;
+            vecStride[i] = m_vecArrays[i].cbElement;
+            iAddress    += static_cast<__int64>(m_vecArrays[i].cbElement * m_vecArrays[i].qwElements)
+                         + layout.cbPadding;
+        }
+    }
+
+    CCacheSet rgCacheSets[req::g_4WAY_CACHE_SETS];
+    for (auto& it : rgCacheSets)
+        it.Init ( );
+
+    const QWORD qwIterations = m_qwOuter * m_qwInner;
+    const QWORD qwTile       = ((layout.qwTile == 0) || (layout.qwTile > m_qwInner)) ? m_qwInner
+                                                                                     : layout.qwTile;
+    QWORD qwMisses    = 0;
+    QWORD qwIteration = 0;
+    QWORD qwWindowStart = 0;
+    QWORD rgWindow[4] = { 0 };      // misses of the last four windows, newest first
+    QWORD qwWindows   = 0;
+
+    for (QWORD qwFirst = 0; qwFirst < m_qwInner; qwFirst += qwTile)
+    {
+        QWORD qwLast = std::min (qwFirst + qwTile, m_qwInner);
+        for (QWORD qwOuter = 0; qwOuter < m_qwOuter; qwOuter++)
+        {
+            for (QWORD qwInner = qwFirst; qwInner < qwLast; qwInner++)
+            {
+                for (const auto& it : m_vecAccesses)
+                {
+                    __int64 iIndex = static_cast<__int64>(qwOuter) * it.iCoefOuter
+                                   + static_cast<__int64>(qwInner) * it.iCoefInner + it.iOffset;
+                    DWORD_PTR dwAddress = static_cast<DWORD_PTR>(vecBase[it.dwArray] + iIndex * vecStride[it.dwArray]);
+
+                    CVirtualAddress vAddress (reinterpret_cast<const void*>(dwAddress));
+                    CCacheSet& cacheSet = rgCacheSets[vAddress.DecodeIndex ( )];
+                    DWORD_PTR  dwTag    = vAddress.DecodeTag ( );
+
+                    if ( !cacheSet.AccessCacheTag (dwTag) )
+                    {
+                        qwMisses++;
+                        cacheSet.LoadCacheTag (dwTag);
+                    }
+                }
+
+                if ( qwMisses > qwBound )
+                {
+                    bPruned = true;
+                    return qwMisses;
+                }
+
+                if ( bExtrapolate && ((++qwIteration % g_LAYOUT_WINDOW) == 0) )
+                {
+                    memmove (&rgWindow[1], &rgWindow[0], sizeof(rgWindow) - sizeof(rgWindow[0]));
+                    rgWindow[0]   = qwMisses - qwWindowStart;
+                    qwWindowStart = qwMisses;
+
+                    // misses per window repeat with a period of one or two windows
+                    if ( (++qwWindows >= g_LAYOUT_WARMUP) &&
+                         (rgWindow[0] == rgWindow[2]) && (rgWindow[1] == rgWindow[3]) )
+                    {
+                        QWORD qwRemaining = qwIterations - qwIteration;
+                        QWORD qwTotal     = qwMisses + (rgWindow[0] + rgWindow[1]) * qwRemaining / (2 * g_LAYOUT_WINDOW);
+
+                        // a steady state heading past the bound is abandoned as well
+                        bExtrapolated = (qwRemaining > 0);
+                        bPruned       = bExtrapolated && (qwTotal > qwBound);
+                        return qwTotal;
+                    }
+                }
+            }
+        }
+    }
+
+    return qwMisses;
+}
+
+QWORD CLayoutOptimizer::Evaluate (const DATA_LAYOUT& layout) const
+{
+    bool bExtrapolated;
+    bool bPruned;
+    return Simulate (layout, ~0ULL, false, bExtrapolated, bPruned);
+}
+
+bool CLayoutOptimizer::Optimize (std::vector<LAYOUT_RESULT>& vecResults, DWORD dwThreads /* = 0 */) const
+{
+    vecResults.clear ( );
+    if ( m_vecArrays.empty() || m_vecAccesses.empty() || (m_qwOuter == 0) || (m_qwInner == 0) )
+        return false;
+
+    EnumerateLayouts (vecResults);
+
+    if ( dwThreads == 0 )
+        dwThreads = std::max (1u, std::thread::hardware_concurrency ( ));
+
+    // the first candidate, the layout as declared, is simulated exactly up
+    // front so that the workers have a bound to prune against from the start
+    LAYOUT_RESULT& seed = vecResults.front();
+    seed.qwMisses = Simulate (seed.layout, ~0ULL, false, seed.bExtrapolated, seed.bPruned);
+
+    std::atomic<size_t> nNext (1);
+    std::atomic<QWORD>  qwBest (seed.qwMisses);   // fewest misses of a complete candidate
+
+    auto Worker = [&]()
+    {
+        size_t i;
+        while ( (i = nNext++) < vecResults.size() )
+        {
+            LAYOUT_RESULT& result = vecResults[i];
+            result.qwMisses = Simulate (result.layout, qwBest.load ( ), true,
+                                        result.bExtrapolated, result.bPruned);
+
+            // an extrapolation is exact for a periodic kernel, so it lowers
+            // the bound as well; should it be too optimistic, the candidates
+            // pruned against it are checked again below
+            if ( !result.bPruned )
+            {
+                QWORD qwCurrent = qwBest.load ( );
+                while ( (result.qwMisses < qwCurrent) &&
+                        !qwBest.compare_exchange_weak (qwCurrent, result.qwMisses) )
+                    ;
+            }
+        }
+    };
+
+    std::vector<std::thread> vecThreads;
+    for (DWORD i = 1; i < dwThreads; i++)
+        vecThreads.emplace_back (Worker);
+    Worker ( );
+    for (auto& it : vecThreads)
+        it.join ( );
+
+    auto Ranking = [](const LAYOUT_RESULT& a, const LAYOUT_RESULT& b)
+    {
+        if ( a.bPruned != b.bPruned )
+            return b.bPruned;
+        return a.qwMisses < b.qwMisses;
+    };
+
+    // make the top of the ranking exact; an extrapolation that was too
+    // optimistic drops out of the top, and a candidate pruned against it
+    // whose lower bound is below the exact best is simulated after all, so
+    // repeat until nothing changes
+    bool bChanged = true;
+    while ( bChanged )
+    {
+        std::stable_sort (vecResults.begin(), vecResults.end(), Ranking);
+
+        bChanged = false;
+        for (size_t i = 0; (i < g_LAYOUT_VERIFY_TOP) && (i < vecResults.size()) && !vecResults[i].bPruned; i++)
+        {
+            if ( vecResults[i].bExtrapolated )
+            {
+                vecResults[i].qwMisses      = Evaluate (vecResults[i].layout);
+                vecResults[i].bExtrapolated = false;
+                bChanged = true;
+            }
+        }
+
+        if ( !bChanged && !vecResults.front().bPruned )
+        {
+            const QWORD qwExact = vecResults.front().qwMisses;
+            for (auto& it : vecResults)
+            {
+                if ( it.bPruned && (it.qwMisses < qwExact) )
+                {
+                    it.qwMisses = Evaluate (it.layout);
+                    it.bPruned  = false;
+                    bChanged    = true;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+std::ostream& CLayoutOptimizer::Report (std::ostream& os, const std::vector<LAYOUT_RESULT>& vecResults,
+                                        size_t nTop /* = g_LAYOUT_VERIFY_TOP */) const
+{
+    size_t nPruned = std::count_if (vecResults.begin(), vecResults.end(),
+                                    [](const LAYOUT_RESULT& r) { return r.bPruned; });
+
+    os << std::dec << std::setfill (' ');
+    os << "Layout search: " << vecResults.size() << " candidates, "
+       << nPruned << " pruned" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    os << std::setw(5) << "Rank" << std::setw(10) << "Misses" << "  "
+       << std::left << std::setw(6) << "Form" << std::right
+       << std::setw(8) << "Offset" << std::setw(9) << "Padding" << std::setw(7) << "Tile" << std::endl;
+
+    for (size_t i = 0; (i < nTop) && (i < vecResults.size()); i++)
+    {
+        const LAYOUT_RESULT& r = vecResults[i];
+        os << std::setw(5) << i + 1 << std::setw(10) << r.qwMisses
+           << (r.bPruned ? "+ " : (r.bExtrapolated ? "~ " : "  "))
+           << std::left << std::setw(6) << (r.layout.bArrayOfStructs ? "AoS" : "SoA") << std::right
+           << std::setw(8) << r.layout.cbBaseOffset
+           << std::setw(9) << r.layout.cbPadding
+           << std::setw(7) << r.layout.qwTile << std::endl;
+    }
+    os << "(~ extrapolated from the steady state, + pruned: lower bound, or extrapolation past the best)" << std::endl;
+
+    return os;
+}
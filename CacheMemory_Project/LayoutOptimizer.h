@@ -0,0 +1,195 @@
+/**
+ *  @file       LayoutOptimizer.h
+ *  @brief      CLayoutOptimizer class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_LAYOUT_OPTIMIZER_H__)
+#define _LAYOUT_OPTIMIZER_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _STRING_
+    #include <string>
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+/// iterations per steady-state detection window
+constexpr QWORD g_LAYOUT_WINDOW       = 64;
+/// windows simulated before steady state may be assumed
+constexpr QWORD g_LAYOUT_WARMUP       = 4;
+/// candidates re-simulated exactly once the search is done
+constexpr size_t g_LAYOUT_VERIFY_TOP  = 10;
+
+/**
+ *  An array referenced by the kernel
+ */
+struct KERNEL_ARRAY
+{
+    std::string szName;
+    DWORD       cbElement;          ///< size of one element in bytes
+    QWORD       qwElements;         ///< number of elements
+};
+
+/**
+ *  A single array reference of the loop body,
+ *  element index = outer * iCoefOuter + inner * iCoefInner + iOffset
+ */
+struct KERNEL_ACCESS
+{
+    DWORD       dwArray;            ///< index of the array referenced
+    __int64     iCoefOuter;
+    __int64     iCoefInner;
+    __int64     iOffset;
+};
+
+/**
+ *  A candidate memory layout
+ */
+struct DATA_LAYOUT
+{
+    DWORD       cbBaseOffset;       ///< offset of the first array from a cache block boundary
+    DWORD       cbPadding;          ///< gap between consecutive arrays (struct of arrays only)
+    bool        bArrayOfStructs;    ///< interleave the arrays into one array of structs
+    QWORD       qwTile;             ///< inner loop tile size, 0 if untiled
+};
+
+/**
+ *  Outcome of simulating one candidate layout
+ */
+struct LAYOUT_RESULT
+{
+    DATA_LAYOUT layout;
+    QWORD       qwMisses;           ///< simulated (or extrapolated) misses
+    bool        bExtrapolated;      ///< qwMisses extrapolated from the steady state
+    bool        bPruned;            ///< abandoned, qwMisses is a lower bound, or with
+                                    ///< bExtrapolated the extrapolation past the bound
+};
+
+/**
+ *  Searches the data layouts of a loop kernel for the one with the fewest
+ *  misses in the 4-way set associative cache.
+ *
+ *  The kernel is a loop nest of up to two levels whose body references
+ *  elements of a set of arrays through affine index expressions, e.g. the
+ *  Assignment #2 benchmark is a single loop over
+ *  A[i], B[i], B[i + 1] and C[i].  The search covers
+ *  - the offset of the data from a cache block boundary,
+ *  - the padding between consecutive arrays,
+ *  - struct of arrays versus array of structs,
+ *  - the tile size of the inner loop (loop nests only).
+ *
+ *  Padding is only searched up to one cache "way" (sets * block size), as
+ *  larger paddings map to the same sets.  Candidates are simulated in
+ *  parallel, one per worker thread at a time.  Two prunings keep the search
+ *  short:
+ *  - a candidate is abandoned once its misses exceed those of the best
+ *    complete candidate so far, exact or extrapolated, the count can only
+ *    grow; the first candidate is simulated exactly before the others so
+ *    that there is a bound from the start,
+ *  - once the misses per window of g_LAYOUT_WINDOW iterations repeat with a
+ *    period of one or two windows, the rest of the run is extrapolated, and
+ *    the candidate abandoned if the extrapolation exceeds that bound.
+ *
+ *  The best g_LAYOUT_VERIFY_TOP candidates are finally re-simulated without
+ *  extrapolation, so the top of the ranking is exact.
+ */
+class CLayoutOptimizer
+{
+    std::vector<KERNEL_ARRAY>   m_vecArrays;
+    std::vector<KERNEL_ACCESS>  m_vecAccesses;
+    QWORD                       m_qwOuter;
+    QWORD                       m_qwInner;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CLayoutOptimizer ( );
+
+/**
+    Declares an array referenced by the kernel, in memory order
+
+    @param [in] szName          name used in reports
+    @param [in] cbElement       size of one element in bytes
+    @param [in] qwElements      number of elements
+
+    @retval index of the array, used by AddAccess
+ */
+    DWORD AddArray  (const char* szName, DWORD cbElement, QWORD qwElements);
+
+/**
+    Appends an array reference to the loop body, in execution order
+
+    @param [in] dwArray         index of the array returned by AddArray
+    @param [in] iCoefOuter      coefficient of the outer loop index
+    @param [in] iCoefInner      coefficient of the inner loop index
+    @param [in] iOffset         constant element offset
+
+    @retval true      on success
+    @retval false     if dwArray is not a declared array
+ */
+    bool  AddAccess (DWORD dwArray, __int64 iCoefOuter, __int64 iCoefInner, __int64 iOffset);
+
+/**
+    Sets the trip counts of the loop nest
+
+    @param [in] qwOuter         outer loop trip count, 1 for a single loop
+    @param [in] qwInner         inner loop trip count
+ */
+    void  set_Iterations (QWORD qwOuter, QWORD qwInner) noexcept
+    { m_qwOuter = qwOuter; m_qwInner = qwInner; };
+
+/**
+    Simulates a single layout to completion, without pruning or extrapolation
+
+    @param [in] layout          layout to simulate
+
+    @retval number of cache misses
+ */
+    QWORD Evaluate (const DATA_LAYOUT& layout) const;
+
+/**
+    Searches the layout space
+
+    @param [out] vecResults     every candidate, ranked by misses (pruned last)
+    @param [in]  dwThreads      worker threads, 0 for one per hardware thread
+
+    @retval true      on success
+    @retval false     if the kernel is empty
+ */
+    bool  Optimize (std::vector<LAYOUT_RESULT>& vecResults, DWORD dwThreads = 0) const;
+
+/**
+    Writes the best layouts of a ranking
+
+    @param [in] os              output stream
+    @param [in] vecResults      ranking returned by Optimize
+    @param [in] nTop            number of layouts to write
+ */
+    std::ostream& Report (std::ostream& os, const std::vector<LAYOUT_RESULT>& vecResults,
+                          size_t nTop = g_LAYOUT_VERIFY_TOP) const;
+
+private:
+
+    void  EnumerateLayouts (std::vector<LAYOUT_RESULT>& vecResults) const;
+
+    QWORD Simulate (const DATA_LAYOUT& layout, QWORD qwBound, bool bExtrapolate,
+                    bool& bExtrapolated, bool& bPruned) const;
+
+    CLayoutOptimizer (const CLayoutOptimizer& rhs) = delete;
+    CLayoutOptimizer& operator = (const CLayoutOptimizer& rhs) = delete;
+};
+
+#endif
@@ -0,0 +1,273 @@
+/**
+ *  @file       MappedCache.cpp
+ *  @brief      CMappedCache class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#define NOMINMAX
+#include <windows.h>
+#include <memory.h>
+#include <new>
+
+#include "VirtualAddress.h"
+#include "MappedCache.h"
+
+static void InitImageHeader (MAPPED_CACHE_HEADER& hdr) noexcept
+{
+    memset (&hdr, 0, sizeof(hdr));
+
+    hdr.dwMagic        = g_MAPPED_CACHE_MAGIC;
+    hdr.dwVersion      = g_MAPPED_CACHE_VERSION;
+    hdr.cbHeader       = sizeof(MAPPED_CACHE_HEADER);
+    hdr.cbSetRecord    = sizeof(MAPPED_SET_RECORD);
+    hdr.dwNumSets      = g_MAPPED_CACHE_SETS;
+    hdr.dwBlocksPerSet = req::g_4WAY_BLOCKS_PER_SET;
+    hdr.dwBlockSize    = req::g_CACHE_BLOCK_SIZE;
+}
+
+CMappedCache::CMappedCache ( ) noexcept
+    : m_hFile           (INVALID_HANDLE_VALUE),
+      m_hMapping        (nullptr),
+      m_pView           (nullptr),
+      m_rgRecords       (nullptr),
+      m_rgCacheSets     ( ),
+      m_dwSetsRecovered (0),
+      m_dwSetsDiscarded (0)
+{
+};
+
+CMappedCache::~CMappedCache ( )
+{
+    Close ( );
+};
+
+/**
+    @note   32 bit FNV-1a over the state the set saves for a checkpoint; the
+            checksum only needs to catch torn or stray writes, not malicious
+            ones
+*/
+DWORD CMappedCache::ComputeChecksum (const CCacheSet& cacheSet) noexcept
+{
+    CACHE_SET_STATE state;
+    memset (&state, 0, sizeof(state));
+    cacheSet.SaveState (state);
+
+    const BYTE* pData    = reinterpret_cast<const BYTE*>(&state);
+    DWORD       dwHash   = 2166136261u;
+
+    for (size_t i = 0; i < sizeof(state); i++)
+    {
+        dwHash ^= pData[i];
+        dwHash *= 16777619u;
+    }
+    return dwHash;
+}
+
+void CMappedCache::ResetSet (DWORD dwIndex) noexcept
+{
+    MAPPED_SET_RECORD& rec = m_rgRecords[dwIndex];
+
+    // empty blocks in their initial FIFO order
+    new (&rec.storage) CACHE_SET_STORAGE;
+    for (BYTE i = 0; i < _countof(rec.storage.rgFifoOrder); i++)
+        rec.storage.rgFifoOrder[i] = i;
+
+    m_rgCacheSets[dwIndex].Attach (&rec.storage);
+
+    rec.dwChecksum = ComputeChecksum (m_rgCacheSets[dwIndex]);
+    rec.dwSequence = 0;
+}
+
+void CMappedCache::BeginUpdate (DWORD dwIndex) noexcept
+{
+    // odd sequence marks the set as torn until the checksum is current
+    MAPPED_SET_RECORD& rec = m_rgRecords[dwIndex];
+    rec.dwSequence = rec.dwSequence + 1;
+    MemoryBarrier ( );
+}
+
+void CMappedCache::EndUpdate (DWORD dwIndex) noexcept
+{
+    MAPPED_SET_RECORD& rec = m_rgRecords[dwIndex];
+    rec.dwChecksum = ComputeChecksum (m_rgCacheSets[dwIndex]);
+    MemoryBarrier ( );
+    rec.dwSequence = rec.dwSequence + 1;
+}
+
+bool CMappedCache::Open (const TCHAR* szFileName) noexcept
+{
+    Close ( );
+
+    if ( szFileName == nullptr )
+        return false;
+
+    const QWORD cbImage = sizeof(MAPPED_CACHE_HEADER)
+                        + sizeof(MAPPED_SET_RECORD) * g_MAPPED_CACHE_SETS;
+
+    m_hFile = CreateFile (szFileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                          nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if ( m_hFile == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER liSize;
+    if ( !GetFileSizeEx (m_hFile, &liSize) )
+    {
+        Close ( );
+        return false;
+    }
+
+    // a file of any other size is not an image of this cache; it is cut or
+    // extended to the image size, so no stale tail survives, and initialized
+    bool bFresh = static_cast<QWORD>(liSize.QuadPart) != cbImage;
+    if ( bFresh )
+    {
+        LARGE_INTEGER liImage;
+        liImage.QuadPart = static_cast<LONGLONG>(cbImage);
+        if ( !SetFilePointerEx (m_hFile, liImage, nullptr, FILE_BEGIN) || !SetEndOfFile (m_hFile) )
+        {
+            Close ( );
+            return false;
+        }
+    }
+
+    m_hMapping = CreateFileMapping (m_hFile, nullptr, PAGE_READWRITE,
+                                    static_cast<DWORD>(cbImage >> 32),
+                                    static_cast<DWORD>(cbImage & 0xFFFFFFFF), nullptr);
+    if ( m_hMapping != nullptr )
+        m_pView = static_cast<BYTE*>(MapViewOfFile (m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+
+    if ( m_pView == nullptr )
+    {
+        Close ( );
+        return false;
+    }
+
+    MAPPED_CACHE_HEADER* pHdr = reinterpret_cast<MAPPED_CACHE_HEADER*>(m_pView);
+    m_rgRecords = reinterpret_cast<MAPPED_SET_RECORD*>(m_pView + sizeof(MAPPED_CACHE_HEADER));
+
+    MAPPED_CACHE_HEADER hdrExpected;
+    InitImageHeader (hdrExpected);
+
+    m_dwSetsRecovered = 0;
+    m_dwSetsDiscarded = 0;
+
+    if ( bFresh || (memcmp (pHdr, &hdrExpected, sizeof(hdrExpected)) != 0) )
+    {   // new image, or an image written with a different layout
+        for (DWORD i = 0; i < g_MAPPED_CACHE_SETS; i++)
+            ResetSet (i);
+        memcpy (pHdr, &hdrExpected, sizeof(hdrExpected));
+    }
+    else
+    {   // existing image, keep every set that was left consistent
+        for (DWORD i = 0; i < g_MAPPED_CACHE_SETS; i++)
+        {
+            MAPPED_SET_RECORD& rec = m_rgRecords[i];
+            if ( ((rec.dwSequence & 1) == 0) &&
+                 m_rgCacheSets[i].Attach (&rec.storage) &&
+                 (rec.dwChecksum == ComputeChecksum (m_rgCacheSets[i])) )
+            {
+                m_dwSetsRecovered++;
+            }
+            else
+            {
+                ResetSet (i);
+                m_dwSetsDiscarded++;
+            }
+        }
+    }
+
+    return true;
+}
+
+void CMappedCache::Close (void) noexcept
+{
+    // the sets go back to their own storage before the view disappears
+    for (auto& it : m_rgCacheSets)
+        it.Attach (nullptr);
+
+    if ( m_pView )
+    {
+        FlushViewOfFile (m_pView, 0);
+        UnmapViewOfFile (m_pView);
+        m_pView = nullptr;
+    }
+    if ( m_hMapping )
+    {
+        CloseHandle (m_hMapping);
+        m_hMapping = nullptr;
+    }
+    if ( m_hFile != INVALID_HANDLE_VALUE )
+    {
+        CloseHandle (m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    m_rgRecords = nullptr;
+}
+
+bool CMappedCache::Flush (void) noexcept
+{
+    return (m_pView != nullptr) && (FlushViewOfFile (m_pView, 0) != FALSE);
+}
+
+bool CMappedCache::GetCacheData (const void* pAddress, DWORD& dwData) noexcept
+{
+    bool bReturn = false;
+
+    if ( pAddress && m_rgRecords )
+    {
+        CVirtualAddress vAddress (pAddress);
+        DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+
+        if ( dwIndex < g_MAPPED_CACHE_SETS )
+            bReturn = m_rgCacheSets[dwIndex].GetCacheData (vAddress.DecodeTag ( ), 
+                                                           vAddress.DecodeOffset ( ), dwData);
+    }
+    return bReturn;
+}
+
+bool CMappedCache::LoadCachePage (const void* pAddress) noexcept
+{
+    bool bReturn = false;
+
+    if ( pAddress && m_rgRecords )
+    {
+        CVirtualAddress vAddress (pAddress);
+        DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+
+        if ( dwIndex < g_MAPPED_CACHE_SETS )
+        {
+            BeginUpdate (static_cast<DWORD>(dwIndex));
+            bReturn = m_rgCacheSets[dwIndex].LoadCacheBlock (vAddress.DecodeTag ( ), pAddress);
+            EndUpdate (static_cast<DWORD>(dwIndex));
+        }
+    }
+    return bReturn;
+}
+
+bool CMappedCache::Access (QWORD qwAddress) noexcept
+{
+    const void* pAddress;
+    if ( (qwAddress == 0) || (m_rgRecords == nullptr) ||
+         !CVirtualAddress::FromTraceAddress (qwAddress, pAddress) )
+        return false;
+
+    CVirtualAddress vAddress (pAddress);
+    DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+    DWORD_PTR dwTag   = vAddress.DecodeTag ( );
+    if ( dwIndex >= g_MAPPED_CACHE_SETS )
+        return false;
+
+    // a hit leaves the FIFO order, and so the record, unchanged
+    CCacheSet& cacheSet = m_rgCacheSets[dwIndex];
+    if ( cacheSet.AccessCacheTag (dwTag) )
+        return true;
+
+    BeginUpdate (static_cast<DWORD>(dwIndex));
+    cacheSet.LoadCacheTag (dwTag);
+    EndUpdate (static_cast<DWORD>(dwIndex));
+    return false;
+}
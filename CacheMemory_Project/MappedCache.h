@@ -0,0 +1,189 @@
+/**
+ *  @file       MappedCache.h
+ *  @brief      CMappedCache class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_MAPPED_CACHE_H__)
+#define _MAPPED_CACHE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#if !defined(_CACHE_SET_H__)
+    #include "CacheSet.h"
+#endif
+
+/*
+    CMappedCache is a 4-way set associative cache whose storage lives entirely
+    in a file-backed memory mapping rather than in process memory.  Since the
+    operating system writes the mapped pages back to the file, a process that
+    re-opens the image after a restart resumes with a warm cache immediately,
+    without replaying any accesses.
+
+    Image layout:
+
+    | MAPPED_CACHE_HEADER | MAPPED_SET_RECORD[0] | ... | MAPPED_SET_RECORD[n-1] |
+
+    Each set record holds the CACHE_SET_STORAGE of a CCacheSet, its blocks
+    and FIFO order, together with a sequence number and a checksum.  The
+    sets are attached to their records, so lookups and fills run the same
+    CCacheSet code as the in-memory cache directly on the mapped blocks.
+
+    A writer makes the sequence odd before modifying a set, and even again
+    after updating the checksum, which covers the CACHE_SET_STATE the set
+    would save to a checkpoint (so the padding of the blocks is ignored).
+    On open, any set whose sequence is odd (the writer died mid-update) or
+    whose checksum does not match is reset to empty; every other set is used
+    as is.  A file of the wrong size is resized, and a file of the wrong
+    size or a header that does not match the current version or cache
+    geometry causes the whole image to be re-initialized.  The record size
+    in the header also tells apart images of 32 and 64 bit builds, whose
+    blocks are laid out differently.
+
+    @note   Tags are derived from addresses, so a re-opened image is only
+            meaningful when the cached addresses are stable across runs.
+*/
+
+/// 'ACMI' - Associative Cache Mapped Image
+constexpr DWORD g_MAPPED_CACHE_MAGIC   = 0x494D4341;
+/// bumped whenever the layout of the image changes
+constexpr DWORD g_MAPPED_CACHE_VERSION = 2;
+/// sets of the mapped cache, the geometry of the assignment
+constexpr DWORD g_MAPPED_CACHE_SETS    = req::g_4WAY_CACHE_SETS;
+
+/**
+ *  Mapped image header
+ */
+struct MAPPED_CACHE_HEADER
+{
+    DWORD   dwMagic;            ///< g_MAPPED_CACHE_MAGIC
+    DWORD   dwVersion;          ///< g_MAPPED_CACHE_VERSION
+    DWORD   cbHeader;           ///< sizeof(MAPPED_CACHE_HEADER)
+    DWORD   cbSetRecord;        ///< sizeof(MAPPED_SET_RECORD)
+    DWORD   dwNumSets;          ///< number of MAPPED_SET_RECORD records that follow
+    DWORD   dwBlocksPerSet;     ///< associativity
+    DWORD   dwBlockSize;        ///< block size in bytes
+    DWORD   dwReserved;         ///< padding, always zero
+};
+
+/**
+ *  Mapped cache set: storage of a CCacheSet guarded by a sequence and checksum
+ */
+struct MAPPED_SET_RECORD
+{
+    volatile DWORD      dwSequence; ///< odd while the set is being modified
+    DWORD               dwChecksum; ///< checksum of the saved state of the set
+    CACHE_SET_STORAGE   storage;    ///< tags, valid bits, data and FIFO order
+};
+
+/**
+ *  4-way set associative cache stored in a persistent memory mapped file
+ */
+class CMappedCache
+{
+    void*               m_hFile;            ///< image file handle
+    void*               m_hMapping;         ///< file mapping handle
+    BYTE*               m_pView;            ///< mapped view of the whole image
+    MAPPED_SET_RECORD*  m_rgRecords;        ///< set records within the view
+    CCacheSet           m_rgCacheSets[g_MAPPED_CACHE_SETS]; ///< attached to m_rgRecords
+    DWORD               m_dwSetsRecovered;  ///< sets reused as is on open
+    DWORD               m_dwSetsDiscarded;  ///< sets reset on open (torn or corrupt)
+
+public:
+/**
+ *  Default Constructor
+ *
+ *  @note (is_nothrow_default_constructible == true)
+ */
+    CMappedCache ( ) noexcept;
+
+    ~CMappedCache ( );
+
+/**
+    Opens (or creates) a cache image and maps it into memory.  Sets that were
+    left torn or corrupt by a previous writer are discarded, and a file of
+    the wrong size is resized and re-initialized.
+
+    @param [in] szFileName      name of the image file
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool Open  (const TCHAR* szFileName) noexcept;
+
+/**
+    Flushes the mapped image to disk and unmaps it
+ */
+    void Close (void) noexcept;
+
+/**
+    Flushes all modified pages of the image to disk
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool Flush (void) noexcept;
+
+/**
+    Attempts to retrieve data from the mapped cache based on address
+
+    @param [in]  pAddress     memory address to check for cache hit
+    @param [out] dwData       output variable to return stored data value
+
+    @retval true     on cache hit, dwData is set
+    @retval false    on cache miss, dwData is not set
+ */
+    bool GetCacheData  (const void* pAddress, DWORD& dwData) noexcept;
+
+ /**
+    Loads a contiguous block of memory of CACHE_BLOCK_SIZE, based on the
+    address pointer passed, evicting the oldest block of the set (FIFO).
+
+    @param [in] pAddress       address of memory the actual page load is based on
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool LoadCachePage (const void* pAddress) noexcept;
+
+/**
+    Accesses a trace address by Tag only, filling its block on a miss
+    without copying any data, as trace replay does
+
+    @param [in] qwAddress      memory address accessed
+
+    @retval true      on cache hit
+    @retval false     on cache miss, for address 0 or an address wider than
+                      a pointer, or when no image is open
+ */
+    bool Access (QWORD qwAddress) noexcept;
+
+/**
+    Returns the number of sets that were recovered intact by the last Open
+ */
+    constexpr DWORD get_SetsRecovered (void) const noexcept
+    { return m_dwSetsRecovered; };
+
+/**
+    Returns the number of sets that were discarded by the last Open
+ */
+    constexpr DWORD get_SetsDiscarded (void) const noexcept
+    { return m_dwSetsDiscarded; };
+
+private:
+
+    static DWORD ComputeChecksum (const CCacheSet& cacheSet) noexcept;
+
+    void ResetSet    (DWORD dwIndex) noexcept;
+    void BeginUpdate (DWORD dwIndex) noexcept;
+    void EndUpdate   (DWORD dwIndex) noexcept;
+
+    CMappedCache (const CMappedCache& rhs) = delete;
+    CMappedCache& operator = (const CMappedCache& rhs) = delete;
+};
+
+#endif
@@ -92,9 +92,36 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <thread>
 
 #include "VirtualAddress.h"
 #include "CacheManager.h"
+#include "CacheEventLog.h"
+#include "CacheHeatmap.h"
+#include "AddressRegistry.h"
+#include "CacheTrace.h"
+#include "BeladySimulator.h"
+#include "CacheTiming.h"
+#include "DramModel.h"
+#include "LayoutOptimizer.h"
+#include "SharedCache.h"
+#include "CompressedCache.h"
+#include "CacheStream.h"
+#include "TimeParallelSimulator.h"
+#include "PipelinedSimulator.h"
+#include "WorkloadGenerator.h"
+#include "ConstexprCache.h"
+#include "AssociativeCache.h"
+#include "CacheSampler.h"
+#include "SparseMemory.h"
+#include "NucaCache.h"
+#include "TrackedArray.h"
+#include "ConcurrentCache.h"
+#include "MappedCache.h"
 
 
 constexpr int g_DR_PASSOS_LOOP = 511;
@@ -107,21 +134,1364 @@ __declspec(align(32)) int g_rgC[req::g_MAX_ARRAY_SIZE] = { 0 };
 __declspec(align(32)) int g_rgD[req::g_MAX_ARRAY_SIZE] = { -1 };  // for debugging purposes
 #endif
 
+/**
+    Counts the cache misses of the benchmark kernel, in the same operand
+    order, with A[0], B[0] and C[0] at the given addresses
+
+    @param [in] dwAddressA      address of A[0]
+    @param [in] dwAddressB      address of B[0]
+    @param [in] dwAddressC      address of C[0]
+
+    @retval number of cache misses
+*/
+constexpr size_t BenchmarkKernelMisses (DWORD_PTR dwAddressA, DWORD_PTR dwAddressB,
+                                        DWORD_PTR dwAddressC) noexcept
+{
+    CConstexprCache<> cache;
+    for (DWORD_PTR i = 0; i < g_DR_PASSOS_LOOP; i++)
+    {
+        cache.Access (dwAddressB + (i + 1) * sizeof(int));
+        cache.Access (dwAddressC + i * sizeof(int));
+        cache.Access (dwAddressA + i * sizeof(int));
+        cache.Access (dwAddressB + i * sizeof(int));
+    }
+    return cache.get_Misses ( );
+}
+
+/**
+    Counts the cache misses of the benchmark kernel with A[0] at dwAddressA
+    and B and C following A in memory, as the assignment states it
+
+    @param [in] dwAddressA      address of A[0]
+
+    @retval number of cache misses
+*/
+constexpr size_t BenchmarkKernelMisses (DWORD_PTR dwAddressA) noexcept
+{
+    return BenchmarkKernelMisses (dwAddressA,
+                                  dwAddressA + req::g_MAX_ARRAY_SIZE * sizeof(int),
+                                  dwAddressA + 2 * req::g_MAX_ARRAY_SIZE * sizeof(int));
+}
+
+/// the assignment's answer, computed and checked during compilation
+constexpr size_t g_STATIC_KERNEL_MISSES = BenchmarkKernelMisses (0);
+static_assert (g_STATIC_KERNEL_MISSES == 192, "benchmark kernel cache misses regressed");
+
+// a single set has no index bits, so every address decodes to set 0
+static_assert (CConstexprCache<1, req::g_CACHE_NUM_BLOCKS>::DecodeIndex (0xFFE0) == 0,
+               "fully associative cache index decoding regressed");
+
+
+std::ostream& PrintIterationHeader(std::ostream& os, int iIteration)
+{
+    os  << std::dec << std::endl;
+    os  << "Cache Miss(es) in Iteration[" << iIteration + 1 << "]"  << std::endl;
+    os  << "-----------------------------------------------------"  << std::endl;
+
+    return os;
+}
+
+/**
+    Converts an event log into time x set heatmaps
+
+    usage: -heatmap \<event log\> \<output prefix\> [accesses per row]
+*/
+int RunHeatmap (int argc, _TCHAR* argv[])
+{
+    QWORD qwWindow = (argc >= 5) ? _tcstoui64 (argv[4], nullptr, 10) : 64;
+
+    CCacheHeatmap heatmap;
+    if ( !heatmap.Build (argv[2], qwWindow) || !heatmap.Write (argv[3]) )
+    {
+        std::cout << "Unable to generate heatmap" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Heatmap rows written: " << heatmap.get_Windows() << std::endl;
+    return 0;
+}
+
+/// longest trace checked against the brute-force OPT reference
+constexpr QWORD g_OPT_CHECK_RECORDS = 64 * 1024;
+
+/**
+    Counts the misses of Belady's OPT replacement on a trace the direct way,
+    as a reference for CBeladySimulator: on a miss into a full set the
+    resident block whose next access is furthest ahead, found by scanning
+    the rest of the trace, is evicted.  Repeats folded into a record hit
+    and are not counted
+
+    @param [in] vecRecords      the whole trace
+
+    @retval number of cache misses
+*/
+static QWORD BruteForceOptMisses (const std::vector<TRACE_RECORD>& vecRecords)
+{
+    constexpr QWORD qwBlockSize = req::g_CACHE_BLOCK_SIZE;
+    constexpr QWORD qwSets      = req::g_4WAY_CACHE_SETS;
+
+    std::vector<QWORD> rgResident[req::g_4WAY_CACHE_SETS];
+    QWORD qwMisses = 0;
+
+    for (size_t i = 0; i < vecRecords.size(); i++)
+    {
+        // address 0 does not decode, the simulator skips it
+        if ( vecRecords[i].qwAddress == 0 )
+            continue;
+
+        QWORD qwBlock = vecRecords[i].qwAddress / qwBlockSize;
+        std::vector<QWORD>& vecSet = rgResident[qwBlock % qwSets];
+
+        if ( std::find (vecSet.begin(), vecSet.end(), qwBlock) != vecSet.end() )
+            continue;
+
+        qwMisses++;
+        if ( vecSet.size() < req::g_4WAY_BLOCKS_PER_SET )
+        {
+            vecSet.push_back (qwBlock);
+            continue;
+        }
+
+        size_t nVictim   = 0;
+        size_t nFurthest = 0;
+        for (size_t w = 0; w < vecSet.size(); w++)
+        {
+            size_t j = i + 1;
+            while ( (j < vecRecords.size()) && (vecRecords[j].qwAddress / qwBlockSize != vecSet[w]) )
+                j++;
+
+            if ( j > nFurthest )
+            {
+                nFurthest = j;
+                nVictim   = w;
+            }
+        }
+        vecSet[nVictim] = qwBlock;
+    }
+
+    return qwMisses;
+}
+
+/**
+    Replays an address trace under FIFO and under Belady's OPT replacement.
+    Traces of up to g_OPT_CHECK_RECORDS records are also run through the
+    brute-force reference, which the OPT misses must match
+
+    usage: -opt \<trace\> \<next-use file\> [memory budget in MB]
+*/
+int RunOpt (int argc, _TCHAR* argv[])
+{
+    size_t cbBudget = g_OPT_MEMORY_BUDGET;
+    if ( argc >= 5 )
+        cbBudget = static_cast<size_t>(_tcstoui64 (argv[4], nullptr, 10)) * 1024 * 1024;
+
+    CBeladySimulator fifo;
+    CBeladySimulator opt;
+    if ( !fifo.Run (argv[2], nullptr, REPLACE_FIFO, cbBudget) ||
+         !CBeladySimulator::BuildNextUse (argv[2], argv[3], cbBudget) ||
+         !opt.Run  (argv[2], argv[3], REPLACE_OPT, cbBudget) )
+    {
+        std::cout << "Unable to replay trace" << std::endl;
+        return 1;
+    }
+
+    std::cout << "FIFO Cache Misses:" << fifo.get_CacheMisses() << std::endl;
+    std::cout << "FIFO Cache Hits:  " << fifo.get_CacheHits()   << std::endl;
+    std::cout << "OPT  Cache Misses:" << opt.get_CacheMisses()  << std::endl;
+    std::cout << "OPT  Cache Hits:  " << opt.get_CacheHits()    << std::endl;
+
+    CCacheTraceReader trace;
+    std::vector<TRACE_RECORD> vecRecords;
+    if ( trace.Open (argv[2]) && (trace.get_Records() <= g_OPT_CHECK_RECORDS) &&
+         trace.Read (0, static_cast<size_t>(trace.get_Records()), vecRecords) )
+    {
+        const QWORD qwReference = BruteForceOptMisses (vecRecords);
+        const bool  bMatch      = (qwReference == opt.get_CacheMisses());
+
+        std::cout << "OPT  Check Misses:" << qwReference
+                  << (bMatch ? " (match)" : " (MISMATCH)") << std::endl;
+        if ( !bMatch )
+            return 1;
+    }
+    return 0;
+}
+
+/**
+    Replays an address trace through the timing model
+
+    usage: -replay \<trace\> [hit latency] [miss latency] [MSHR entries]
+*/
+int RunReplay (int argc, _TCHAR* argv[])
+{
+    CACHE_TIMING_CONFIG config = g_DEFAULT_TIMING;
+    if ( argc >= 4 )
+        config.dwHitLatency  = static_cast<DWORD>(_tcstoui64 (argv[3], nullptr, 10));
+    if ( argc >= 5 )
+        config.dwMissLatency = static_cast<DWORD>(_tcstoui64 (argv[4], nullptr, 10));
+    if ( argc >= 6 )
+        config.dwMshrEntries = static_cast<DWORD>(_tcstoui64 (argv[5], nullptr, 10));
+
+    CCacheTimingModel timing;
+    CBeladySimulator  replay;
+    if ( !timing.Init (config) )
+    {
+        std::cout << "Invalid timing configuration" << std::endl;
+        return 1;
+    }
+
+    replay.set_TimingModel (&timing);
+    if ( !replay.Run (argv[2], nullptr, REPLACE_FIFO) )
+    {
+        std::cout << "Unable to replay trace (coalesced traces cannot be timed)" << std::endl;
+        return 1;
+    }
+    timing.Drain ( );
+
+    std::cout << "Cache Misses:" << replay.get_CacheMisses() << std::endl;
+    std::cout << "Cache Hits:  " << replay.get_CacheHits()   << std::endl;
+    std::cout << std::endl;
+    timing.Report (std::cout);
+    return 0;
+}
+
+/**
+    Searches the data layouts of the Assignment #2 benchmark kernel, or of
+    a kernel summing five int[64][256] arrays element by element.  The five
+    arrays are a multiple of a way apart, so as laid out they all fall on
+    the same set and every access misses under FIFO (81920); padding them
+    leaves the compulsory misses (10240).
+
+    usage: -layout [worker threads] [benchmark|conflict]
+*/
+int RunLayout (int argc, _TCHAR* argv[])
+{
+    DWORD dwThreads = (argc >= 3) ? static_cast<DWORD>(_tcstoui64 (argv[2], nullptr, 10)) : 0;
+
+    CLayoutOptimizer optimizer;
+    if ( (argc >= 4) && (_tcscmp (argv[3], _T("conflict")) == 0) )
+    {
+        constexpr QWORD qwRows    = 64;
+        constexpr QWORD qwColumns = 256;
+
+        // P[i][j] + Q[i][j] + R[i][j] + S[i][j] + T[i][j]
+        static const char* const rgszNames[] = { "P", "Q", "R", "S", "T" };
+        for (auto szName : rgszNames)
+        {
+            DWORD dwArray = optimizer.AddArray (szName, sizeof(int), qwRows * qwColumns);
+            optimizer.AddAccess (dwArray, qwColumns, 1, 0);
+        }
+        optimizer.set_Iterations (qwRows, qwColumns);
+    }
+    else
+    {
+        DWORD dwA = optimizer.AddArray ("A", sizeof(int), req::g_MAX_ARRAY_SIZE);
+        DWORD dwB = optimizer.AddArray ("B", sizeof(int), req::g_MAX_ARRAY_SIZE);
+        DWORD dwC = optimizer.AddArray ("C", sizeof(int), req::g_MAX_ARRAY_SIZE);
+
+        // same operand order as the benchmark: B[i + 1], C[i], A[i], B[i]
+        optimizer.AddAccess (dwB, 0, 1, 1);
+        optimizer.AddAccess (dwC, 0, 1, 0);
+        optimizer.AddAccess (dwA, 0, 1, 0);
+        optimizer.AddAccess (dwB, 0, 1, 0);
+        optimizer.set_Iterations (1, g_DR_PASSOS_LOOP);
+    }
+
+    std::vector<LAYOUT_RESULT> vecResults;
+    if ( !optimizer.Optimize (vecResults, dwThreads) )
+    {
+        std::cout << "Unable to search layouts" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Current layout misses: "
+              << optimizer.Evaluate (DATA_LAYOUT { 0, 0, false, 0 }) << std::endl << std::endl;
+    optimizer.Report (std::cout, vecResults);
+    return 0;
+}
+
+/**
+    Replays several traces through one shared cache
+
+    usage: -shared \<none|cat|ucp\> \<trace\> \<rate\> \<hex way mask\> [...]
+*/
+int RunShared (int argc, _TCHAR* argv[])
+{
+    CSharedCache cache;
+    if ( _tcscmp (argv[2], _T("cat")) == 0 )
+        cache.set_Policy (PARTITION_STATIC);
+    else if ( _tcscmp (argv[2], _T("ucp")) == 0 )
+        cache.set_Policy (PARTITION_UCP);
+    else
+        cache.set_Policy (PARTITION_NONE);
+
+    for (int i = 3; i + 2 < argc; i += 3)
+    {
+        DWORD dwRate    = static_cast<DWORD>(_tcstoui64 (argv[i + 1], nullptr, 10));
+        DWORD dwWayMask = static_cast<DWORD>(_tcstoui64 (argv[i + 2], nullptr, 16));
+        if ( cache.AddTenant (argv[i], dwRate, dwWayMask) < 0 )
+        {
+            std::cout << "Unable to add tenant " << (i - 3) / 3 << std::endl;
+            return 1;
+        }
+    }
+
+    if ( !cache.Run ( ) )
+    {
+        std::cout << "Unable to replay traces" << std::endl;
+        return 1;
+    }
+
+    cache.Report (std::cout);
+    return 0;
+}
+
+/**
+    Simulates the access batches of live producers until shut down
+
+    usage: -serve \<pipe name\> | -serve -   (a single producer on standard input)
+*/
+int RunServe (int argc, _TCHAR* argv[])
+{
+    CCacheStreamServer server;
+
+    bool bServed = (_tcscmp (argv[2], _T("-")) == 0) ? server.ServeStdin ( )
+                                                     : server.Serve (argv[2]);
+    server.Report (std::cout);
+    if ( !bServed )
+    {
+        std::cout << "Unable to serve producers" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+    Streams an address trace to a running server, then prints its statistics
+
+    usage: -stream \<pipe name\> \<trace\> [shutdown]
+*/
+int RunStream (int argc, _TCHAR* argv[])
+{
+    CCacheTraceReader  reader;
+    CCacheStreamClient client;
+    if ( !reader.Open (argv[3]) || !client.Connect (argv[2]) )
+    {
+        std::cout << "Unable to stream trace" << std::endl;
+        return 1;
+    }
+
+    // the server may share its cache between producers, so accesses folded
+    // into a record are no longer certain to hit and are sent one by one
+    std::vector<TRACE_RECORD> vecRecords;
+    QWORD                     qwStreamed = 0;
+    for (QWORD qwFirst = 0; qwFirst < reader.get_Records(); qwFirst += g_STREAM_MAX_BATCH)
+    {
+        size_t nCount = static_cast<size_t>(std::min<QWORD> (g_STREAM_MAX_BATCH, reader.get_Records() - qwFirst));
+        if ( !reader.Read (qwFirst, nCount, vecRecords) )
+        {
+            std::cout << "Unable to read trace" << std::endl;
+            return 1;
+        }
+
+        for (const auto& it : vecRecords)
+        {
+            for (QWORD r = 0; r <= it.dwRepeat; r++)
+            {
+                if ( !client.Append (it.qwAddress) )
+                {
+                    std::cout << "Connection lost" << std::endl;
+                    return 1;
+                }
+            }
+            qwStreamed += 1 + static_cast<QWORD>(it.dwRepeat);
+        }
+    }
+
+    STREAM_STATS statsServer;
+    if ( !client.QueryStats (statsServer) ||
+         !client.Close ((argc >= 5) && (_tcscmp (argv[4], _T("shutdown")) == 0)) )
+    {
+        std::cout << "Connection lost" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Accesses streamed: " << qwStreamed << std::endl;
+    std::cout << "Server accesses:   " << statsServer.qwAccesses  << std::endl;
+    std::cout << "Server misses:     " << statsServer.qwMisses    << std::endl;
+    std::cout << "Producers:         " << statsServer.dwProducers << std::endl;
+    return 0;
+}
+
+/**
+    Replays an address trace sequentially and time-parallel, and compares
+    the results and run times
+
+    usage: -tparallel \<trace\> [worker threads]
+*/
+int RunTimeParallel (int argc, _TCHAR* argv[])
+{
+    DWORD dwThreads = (argc >= 4) ? static_cast<DWORD>(_tcstoui64 (argv[3], nullptr, 10)) : 0;
+
+    CBeladySimulator       sequential;
+    CTimeParallelSimulator parallel;
+
+    auto tStart = std::chrono::steady_clock::now ( );
+    bool bSequential = sequential.Run (argv[2], nullptr, REPLACE_FIFO);
+    auto tSequential = std::chrono::steady_clock::now ( );
+    bool bParallel   = parallel.Run (argv[2], dwThreads);
+    auto tParallel   = std::chrono::steady_clock::now ( );
+
+    if ( !bSequential || !bParallel )
+    {
+        std::cout << "Unable to replay trace" << std::endl;
+        return 1;
+    }
+
+    std::chrono::duration<double> dSequential = tSequential - tStart;
+    std::chrono::duration<double> dParallel   = tParallel - tSequential;
+
+    parallel.Report (std::cout);
+    std::cout << "Sequential misses: " << sequential.get_CacheMisses ( )
+              << ((sequential.get_CacheMisses ( ) == parallel.get_CacheMisses ( )) ? " (match)" : " (MISMATCH)")
+              << std::endl;
+    std::cout << "Sequential time:   " << dSequential.count ( ) << " s" << std::endl;
+    std::cout << "Parallel time:     " << dParallel.count ( )   << " s" << std::endl;
+    return 0;
+}
+
+/**
+    Replays an address trace sequentially and through the stage pipeline,
+    and compares the results and run times
+
+    usage: -pipeline \<trace\>
+*/
+int RunPipeline (int argc, _TCHAR* argv[])
+{
+    CBeladySimulator    sequential;
+    CPipelinedSimulator pipelined;
+
+    auto tStart = std::chrono::steady_clock::now ( );
+    bool bSequential = sequential.Run (argv[2], nullptr, REPLACE_FIFO);
+    auto tSequential = std::chrono::steady_clock::now ( );
+    bool bPipelined  = pipelined.Run (argv[2]);
+    auto tPipelined  = std::chrono::steady_clock::now ( );
+
+    if ( !bSequential || !bPipelined )
+    {
+        std::cout << "Unable to replay trace" << std::endl;
+        return 1;
+    }
+
+    std::chrono::duration<double> dSequential = tSequential - tStart;
+    std::chrono::duration<double> dPipelined  = tPipelined - tSequential;
+
+    pipelined.Report (std::cout);
+    std::cout << std::endl;
+    std::cout << "Sequential misses: " << sequential.get_CacheMisses ( )
+              << ((sequential.get_CacheMisses ( ) == pipelined.get_CacheMisses ( )) ? " (match)" : " (MISMATCH)")
+              << std::endl;
+    std::cout << "Sequential time:   " << dSequential.count ( ) << " s" << std::endl;
+    std::cout << "Pipelined time:    " << dPipelined.count ( )  << " s" << std::endl;
+    return 0;
+}
+
+/**
+    Generates a synthetic workload, measures the generation rate on its own,
+    then replays the same addresses through the 4-way cache and optionally
+    writes them to a trace
+
+    usage: -generate \<workload\> \<accesses\> [seed] [trace]
+*/
+int RunGenerate (int argc, _TCHAR* argv[])
+{
+    constexpr size_t nBatch = 4 * 1024;
+
+    QWORD qwAccesses = _tcstoui64 (argv[3], nullptr, 10);
+    QWORD qwSeed     = (argc >= 5) ? _tcstoui64 (argv[4], nullptr, 10) : 0;
+
+    CWorkloadGenerator workload;
+    workload.Init (qwSeed);
+    if ( !workload.Parse (argv[2]) )
+    {
+        std::cout << "Invalid workload description" << std::endl;
+        return 1;
+    }
+
+    CCacheTraceWriter trace;
+    if ( (argc >= 6) && !trace.Open (argv[5]) )
+    {
+        std::cout << "Unable to create trace" << std::endl;
+        return 1;
+    }
+
+    std::vector<QWORD> vecBatch (nBatch);
+
+    // generation alone; the checksum keeps the work from being optimized away
+    QWORD qwChecksum = 0;
+    auto  tStart     = std::chrono::steady_clock::now ( );
+    for (QWORD qwDone = 0; qwDone < qwAccesses; qwDone += nBatch)
+    {
+        size_t nCount = static_cast<size_t>(std::min<QWORD> (nBatch, qwAccesses - qwDone));
+        workload.Generate (vecBatch.data ( ), nCount);
+        for (size_t i = 0; i < nCount; i++)
+            qwChecksum ^= vecBatch[i];
+    }
+    std::chrono::duration<double> dGenerate = std::chrono::steady_clock::now ( ) - tStart;
+
+    // the same addresses again, fed straight to the cache sets
+    workload.Init (qwSeed);
+    workload.Parse (argv[2]);
+
+    CCacheSet rgCacheSets[req::g_4WAY_CACHE_SETS];
+    for (auto& it : rgCacheSets)
+        it.Init ( );
+
+    QWORD qwHits   = 0;
+    QWORD qwMisses = 0;
+    tStart = std::chrono::steady_clock::now ( );
+    for (QWORD qwDone = 0; qwDone < qwAccesses; qwDone += nBatch)
+    {
+        size_t nCount = static_cast<size_t>(std::min<QWORD> (nBatch, qwAccesses - qwDone));
+        workload.Generate (vecBatch.data ( ), nCount);
+        for (size_t i = 0; i < nCount; i++)
+        {
+            const void* pAddress;
+            if ( !CVirtualAddress::FromTraceAddress (vecBatch[i], pAddress) )
+            {
+                std::cout << "Workload address 0x" << std::hex << vecBatch[i] << std::dec
+                          << " does not fit a pointer of this build" << std::endl;
+                return 1;
+            }
+
+            CVirtualAddress vAddress (pAddress);
+            DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+            DWORD_PTR dwTag   = vAddress.DecodeTag ( );
+            if ( dwIndex >= _countof(rgCacheSets) )
+                continue;
+
+            if ( argc >= 6 )
+                trace.Append (vecBatch[i]);
+
+            if ( rgCacheSets[dwIndex].AccessCacheTag (dwTag) )
+                qwHits++;
+            else
+            {
+                rgCacheSets[dwIndex].LoadCacheTag (dwTag);
+                qwMisses++;
+            }
+        }
+    }
+    std::chrono::duration<double> dSimulate = std::chrono::steady_clock::now ( ) - tStart;
+
+    if ( (argc >= 6) && !trace.Close ( ) )
+    {
+        std::cout << "Unable to write trace" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Footprint:         " << workload.get_Footprint ( ) << " bytes" << std::endl;
+    std::cout << "Checksum:          " << std::hex << qwChecksum << std::dec << std::endl;
+    std::cout << "Cache Misses:      " << qwMisses << std::endl;
+    std::cout << "Cache Hits:        " << qwHits   << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    if ( dGenerate.count ( ) > 0.0 )
+        std::cout << "Generated:         " << qwAccesses / dGenerate.count ( ) / 1.0e6 << " M addresses/s" << std::endl;
+    if ( dSimulate.count ( ) > 0.0 )
+        std::cout << "Simulated:         " << qwAccesses / dSimulate.count ( ) / 1.0e6 << " M accesses/s" << std::endl;
+    std::cout.unsetf (std::ios::floatfield);
+    return 0;
+}
+
+/**
+    Rewrites a trace with every access certain to hit folded into a counted
+    record, then replays both traces through the 4-way cache and compares
+    the results
+
+    usage: -coalesce \<trace\> \<coalesced trace\>
+*/
+int RunCoalesce (int argc, _TCHAR* argv[])
+{
+    constexpr size_t nBatch = 16 * 1024;
+
+    CCacheTraceReader reader;
+    CCacheTraceWriter writer;
+    if ( !reader.Open (argv[2]) || !writer.Open (argv[3], true) )
+    {
+        std::cout << "Unable to coalesce trace" << std::endl;
+        return 1;
+    }
+
+    std::vector<TRACE_RECORD> vecRecords;
+    QWORD                     qwAccesses = 0;
+    for (QWORD qwFirst = 0; qwFirst < reader.get_Records(); qwFirst += nBatch)
+    {
+        size_t nCount = static_cast<size_t>(std::min<QWORD> (nBatch, reader.get_Records() - qwFirst));
+        if ( !reader.Read (qwFirst, nCount, vecRecords) )
+        {
+            std::cout << "Unable to read trace" << std::endl;
+            return 1;
+        }
+
+        for (const auto& it : vecRecords)
+        {
+            writer.Append (it.qwAddress, it.qwTimestamp, it.dwDependency, it.dwRepeat);
+            qwAccesses += 1 + static_cast<QWORD>(it.dwRepeat);
+        }
+    }
+
+    if ( !writer.Close ( ) )
+    {
+        std::cout << "Unable to write coalesced trace" << std::endl;
+        return 1;
+    }
+
+    CBeladySimulator original;
+    CBeladySimulator coalesced;
+
+    auto tStart      = std::chrono::steady_clock::now ( );
+    bool bOriginal   = original.Run (argv[2], nullptr, REPLACE_FIFO);
+    auto tOriginal   = std::chrono::steady_clock::now ( );
+    bool bCoalesced  = coalesced.Run (argv[3], nullptr, REPLACE_FIFO);
+    auto tCoalesced  = std::chrono::steady_clock::now ( );
+
+    if ( !bOriginal || !bCoalesced )
+    {
+        std::cout << "Unable to replay trace" << std::endl;
+        return 1;
+    }
+
+    std::chrono::duration<double> dOriginal  = tOriginal - tStart;
+    std::chrono::duration<double> dCoalesced = tCoalesced - tOriginal;
+
+    bool bMatch = (original.get_CacheMisses ( ) == coalesced.get_CacheMisses ( )) &&
+                  (original.get_CacheHits ( )   == coalesced.get_CacheHits ( ));
+
+    std::cout << "Accesses:          " << qwAccesses << std::endl;
+    std::cout << "Records:           " << reader.get_Records() << " -> " << writer.get_Records() << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    if ( writer.get_Records() > 0 )
+        std::cout << "Shrink:            " << static_cast<double>(reader.get_Records()) / writer.get_Records()
+                  << "x" << std::endl;
+    std::cout.unsetf (std::ios::floatfield);
+    std::cout << "Cache Misses:      " << coalesced.get_CacheMisses ( )
+              << (bMatch ? " (match)" : " (MISMATCH)") << std::endl;
+    std::cout << "Cache Hits:        " << coalesced.get_CacheHits ( ) << std::endl;
+    std::cout << "Original time:     " << dOriginal.count ( )  << " s" << std::endl;
+    std::cout << "Coalesced time:    " << dCoalesced.count ( ) << " s" << std::endl;
+    return bMatch ? 0 : 1;
+}
+
+/**
+    Replays a trace through a cache of any associativity, with the hashed
+    Tag lookup and, for comparison, the linear one
+
+    usage: -assoc \<trace\> \<ways\> [sets] [fifo|lru]
+*/
+int RunAssoc (int argc, _TCHAR* argv[])
+{
+    // above this the linear search takes too long to be worth timing
+    constexpr size_t nLinearMaxWays = 4096;
+
+    size_t nWays = static_cast<size_t>(_tcstoui64 (argv[3], nullptr, 10));
+    size_t nSets = (argc >= 5) ? static_cast<size_t>(_tcstoui64 (argv[4], nullptr, 10)) : 1;
+    REPLACEMENT_POLICY ePolicy = ((argc >= 6) && (_tcscmp (argv[5], _T("lru")) == 0)) ? REPLACE_LRU
+                                                                                   : REPLACE_FIFO;
+
+    CCacheTraceReader reader;
+    if ( !reader.Open (argv[2]) )
+    {
+        std::cout << "Unable to open trace" << std::endl;
+        return 1;
+    }
+
+    // replays the whole trace, returning the run time or a negative value on error
+    auto Replay = [&](CAssociativeCache& cache, size_t nHashThreshold) -> double
+    {
+        constexpr size_t nBatch = 16 * 1024;
+
+        if ( !cache.Init (nSets, nWays, req::g_CACHE_BLOCK_SIZE, ePolicy, nHashThreshold) )
+            return -1.0;
+
+        std::vector<TRACE_RECORD> vecRecords;
+        auto tStart = std::chrono::steady_clock::now ( );
+        for (QWORD qwFirst = 0; qwFirst < reader.get_Records(); qwFirst += nBatch)
+        {
+            size_t nCount = static_cast<size_t>(std::min<QWORD> (nBatch, reader.get_Records() - qwFirst));
+            if ( !reader.Read (qwFirst, nCount, vecRecords) )
+                return -1.0;
+
+            for (const auto& it : vecRecords)
+            {
+                cache.Access (it.qwAddress);
+                cache.AddHits (it.dwRepeat);
+            }
+        }
+        std::chrono::duration<double> dReplay = std::chrono::steady_clock::now ( ) - tStart;
+        return dReplay.count ( );
+    };
+
+    CAssociativeCache hashed;
+    double dHashed = Replay (hashed, 0);
+    if ( dHashed < 0.0 )
+    {
+        std::cout << "Invalid geometry or unreadable trace" << std::endl;
+        return 1;
+    }
+
+    hashed.Report (std::cout);
+    std::cout << "Hashed time:       " << dHashed << " s" << std::endl;
+
+    if ( nWays > nLinearMaxWays )
+    {
+        std::cout << "Linear time:       skipped above " << nLinearMaxWays << " ways" << std::endl;
+        return 0;
+    }
+
+    CAssociativeCache linear;
+    double dLinear = Replay (linear, g_ASSOC_MAX_WAYS);
+    if ( dLinear < 0.0 )
+    {
+        std::cout << "Unable to replay trace" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Linear time:       " << dLinear << " s"
+              << (((linear.get_CacheMisses ( ) == hashed.get_CacheMisses ( )) &&
+                   (linear.get_CacheHits ( )   == hashed.get_CacheHits ( ))) ? " (match)" : " (MISMATCH)")
+              << std::endl;
+    return 0;
+}
+
+/**
+    Replays a trace through the cache stored in a memory mapped image file.
+    The image outlives the process, so a second run with the same image
+    starts with the cache the first run left behind.
+
+    usage: -mapped \<image\> \<trace\>
+*/
+int RunMapped (int argc, _TCHAR* argv[])
+{
+    constexpr size_t nBatch = 16 * 1024;
+
+    CMappedCache      cache;
+    CCacheTraceReader reader;
+    if ( !cache.Open (argv[2]) )
+    {
+        std::cout << "Unable to open image" << std::endl;
+        return 1;
+    }
+    if ( !reader.Open (argv[3]) )
+    {
+        std::cout << "Unable to open trace" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::dec << std::setfill(' ');
+    std::cout << "Sets recovered:    " << cache.get_SetsRecovered ( ) << std::endl;
+    std::cout << "Sets discarded:    " << cache.get_SetsDiscarded ( ) << std::endl;
+
+    QWORD qwHits   = 0;
+    QWORD qwMisses = 0;
+    std::vector<TRACE_RECORD> vecRecords;
+    for (QWORD qwFirst = 0; qwFirst < reader.get_Records(); qwFirst += nBatch)
+    {
+        size_t nCount = static_cast<size_t>(std::min<QWORD> (nBatch, reader.get_Records() - qwFirst));
+        if ( !reader.Read (qwFirst, nCount, vecRecords) )
+        {
+            std::cout << "Unable to read trace" << std::endl;
+            return 1;
+        }
+
+        for (const auto& it : vecRecords)
+        {
+            if ( !fits_pointer (it.qwAddress) )
+            {
+                std::cout << "Trace address 0x" << std::hex << it.qwAddress << std::dec
+                          << " does not fit a pointer of this build" << std::endl;
+                return 1;
+            }
+
+            if ( cache.Access (it.qwAddress) )
+                qwHits++;
+            else
+                qwMisses++;
+            qwHits += it.dwRepeat;
+        }
+    }
+
+    std::cout << "Cache Misses:      " << qwMisses << std::endl;
+    std::cout << "Cache Hits:        " << qwHits   << std::endl;
+
+    cache.Close ( );
+    return 0;
+}
+
+/**
+    Replays a trace through a FIFO cache twice, in full and under set and,
+    optionally, time sampling, and checks the sampled estimate of the misses
+    against the full run
+
+    usage: -sample \<trace\> \<sets\> \<ways\> \<set ratio\> [period unit]
+*/
+int RunSample (int argc, _TCHAR* argv[])
+{
+    constexpr size_t nBatch = 16 * 1024;
+
+    size_t nSets     = static_cast<size_t>(_tcstoui64 (argv[3], nullptr, 10));
+    size_t nWays     = static_cast<size_t>(_tcstoui64 (argv[4], nullptr, 10));
+    size_t nSetRatio = static_cast<size_t>(_tcstoui64 (argv[5], nullptr, 10));
+    QWORD  qwPeriod  = (argc >= 8) ? _tcstoui64 (argv[6], nullptr, 10) : 0;
+    QWORD  qwUnit    = (argc >= 8) ? _tcstoui64 (argv[7], nullptr, 10) : 0;
+
+    CCacheTraceReader reader;
+    if ( !reader.Open (argv[2]) )
+    {
+        std::cout << "Unable to open trace" << std::endl;
+        return 1;
+    }
+
+    CAssociativeCache full;
+    CCacheSampler     sampler;
+    if ( !full.Init (nSets, nWays) ||
+         !sampler.Init (nSets, nWays, req::g_CACHE_BLOCK_SIZE, REPLACE_FIFO, nSetRatio) ||
+         !sampler.SetTimeSampling (qwPeriod, qwUnit) )
+    {
+        std::cout << "Invalid geometry or sampling parameters" << std::endl;
+        return 1;
+    }
+
+    std::vector<TRACE_RECORD> vecRecords;
+    for (QWORD qwFirst = 0; qwFirst < reader.get_Records(); qwFirst += nBatch)
+    {
+        size_t nCount = static_cast<size_t>(std::min<QWORD> (nBatch, reader.get_Records() - qwFirst));
+        if ( !reader.Read (qwFirst, nCount, vecRecords) )
+        {
+            std::cout << "Unable to read trace" << std::endl;
+            return 1;
+        }
+
+        // the repeats folded into a record are accesses of their own to the
+        // time sampling periods, so both caches see every one of them
+        for (const auto& it : vecRecords)
+        {
+            for (QWORD r = 0; r <= it.dwRepeat; r++)
+            {
+                full.Access (it.qwAddress);
+                sampler.Access (it.qwAddress);
+            }
+        }
+    }
+
+    SAMPLING_ESTIMATE estimate;
+    if ( !sampler.GetEstimate (estimate) )
+    {
+        std::cout << "Not enough samples for an estimate" << std::endl;
+        return 1;
+    }
+
+    const double dFull   = static_cast<double>(full.get_CacheMisses ( ));
+    const bool   bInside = std::abs (estimate.dMisses - dFull) <= estimate.dMissesError;
+
+    std::cout << std::dec << std::setfill(' ');
+    std::cout << "Accesses:          " << sampler.get_Accesses ( ) << std::endl;
+    std::cout << "Simulated:         " << sampler.get_Simulated ( ) << std::endl;
+    std::cout << "Samples:           " << estimate.nSamples << std::endl;
+    std::cout << std::fixed << std::setprecision(6);
+    std::cout << "Miss rate:         " << estimate.dMissRate << " +/- " << estimate.dMissRateError
+              << " (95%)" << std::endl;
+    std::cout << std::setprecision(0);
+    std::cout << "Estimated misses:  " << estimate.dMisses << " +/- " << estimate.dMissesError << std::endl;
+    std::cout << "Full run misses:   " << dFull
+              << (bInside ? " (inside interval)" : " (OUTSIDE interval)") << std::endl;
+    std::cout.unsetf (std::ios::floatfield);
+    return 0;
+}
+
+/**
+    Measures the throughput of the concurrent key / value cache.  Every
+    thread looks up keys drawn uniformly from twice the capacity and inserts
+    the ones that miss; a value is always a function of its key, so a torn
+    read would show up as an error.
+
+    usage: -concurrent \<threads\> [operations per thread] [capacity]
+*/
+int RunConcurrent (int argc, _TCHAR* argv[])
+{
+    size_t nThreads   = static_cast<size_t>(_tcstoui64 (argv[2], nullptr, 10));
+    QWORD  qwOps      = (argc >= 4) ? _tcstoui64 (argv[3], nullptr, 10) : 4000000;
+    size_t nCapacity  = (argc >= 5) ? static_cast<size_t>(_tcstoui64 (argv[4], nullptr, 10)) : 64 * 1024;
+
+    if ( (nThreads == 0) || (nThreads > 256) || (nCapacity == 0) )
+    {
+        std::cout << "Invalid thread count or capacity" << std::endl;
+        return 1;
+    }
+
+    CConcurrentCache<QWORD, QWORD, 8, CClockEviction> cache;
+    if ( !cache.Init (nCapacity) )
+    {
+        std::cout << "Unable to allocate the cache" << std::endl;
+        return 1;
+    }
+
+    const QWORD qwKeys = 2 * static_cast<QWORD>(cache.get_Capacity ( ));
+
+    std::atomic<QWORD> qwHits   (0);
+    std::atomic<QWORD> qwErrors (0);
+    std::vector<std::thread> vecThreads;
+
+    auto tStart = std::chrono::steady_clock::now ( );
+    for (size_t t = 0; t < nThreads; t++)
+    {
+        vecThreads.emplace_back ([&, t]( )
+        {
+            QWORD qwState  = 0x9E3779B97F4A7C15ull * (t + 1);
+            QWORD qwLocalHits   = 0;
+            QWORD qwLocalErrors = 0;
+
+            for (QWORD i = 0; i < qwOps; i++)
+            {
+                // xorshift64, one stream per thread
+                qwState ^= qwState << 13;
+                qwState ^= qwState >> 7;
+                qwState ^= qwState << 17;
+
+                QWORD qwKey = qwState % qwKeys;
+                QWORD qwValue;
+                if ( cache.Find (qwKey, qwValue) )
+                {
+                    qwLocalHits++;
+                    if ( qwValue != ~qwKey )
+                        qwLocalErrors++;
+                }
+                else
+                    cache.Insert (qwKey, ~qwKey);
+            }
+
+            qwHits   += qwLocalHits;
+            qwErrors += qwLocalErrors;
+        });
+    }
+    for (auto& it : vecThreads)
+        it.join ( );
+
+    std::chrono::duration<double> dElapsed = std::chrono::steady_clock::now ( ) - tStart;
+
+    const QWORD qwTotal = qwOps * nThreads;
 
-std::ostream& PrintIterationHeader(std::ostream& os, int iIteration)
+    std::cout << std::dec << std::setfill(' ');
+    std::cout << "Threads:           " << nThreads << std::endl;
+    std::cout << "Capacity:          " << cache.get_Capacity ( ) << " entries, "
+              << qwKeys << " keys" << std::endl;
+    std::cout << "Operations:        " << qwTotal << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    if ( qwTotal > 0 )
+        std::cout << "Hit rate:          " << 100.0 * qwHits / qwTotal << "%" << std::endl;
+    if ( dElapsed.count ( ) > 0.0 )
+        std::cout << "Throughput:        " << qwTotal / dElapsed.count ( ) / 1.0e6 << " M ops/s" << std::endl;
+    std::cout.unsetf (std::ios::floatfield);
+    std::cout << "Time:              " << dElapsed.count ( ) << " s" << std::endl;
+    std::cout << "Errors:            " << qwErrors << std::endl;
+    return (qwErrors == 0) ? 0 : 1;
+}
+
+/**
+    Replays an address trace through the data-carrying cache, backed by a
+    sparse memory image instead of the simulator's own memory.  Every access
+    reads the word at its address through the cache, checks it against the
+    image and writes it back incremented, so the final image holds the
+    number of accesses to every word.
+
+    The cache decodes the trace addresses as QWORDs, so an x86 build replays
+    a 64 bit trace too; its cache keeps 32 bit Tags, so it refuses an address
+    above 512 GB rather than truncating it.
+
+    usage: -sparse \<trace\> [initial snapshot | -] [final snapshot | -] [image file \<hex base address\>]
+*/
+int RunSparse (int argc, _TCHAR* argv[])
 {
-    os  << std::dec << std::endl;
-    os  << "Cache Miss(es) in Iteration[" << iIteration + 1 << "]"  << std::endl;
-    os  << "-----------------------------------------------------"  << std::endl;
+    constexpr size_t nBatch = 16 * 1024;
 
-    return os;
+    CCacheTraceReader reader;
+    CSparseMemory     memory;
+    if ( !reader.Open (argv[2]) )
+    {
+        std::cout << "Unable to open trace" << std::endl;
+        return 1;
+    }
+    if ( (argc >= 4) && (_tcscmp (argv[3], _T("-")) != 0) && !memory.LoadSnapshot (argv[3]) )
+    {
+        std::cout << "Unable to load snapshot" << std::endl;
+        return 1;
+    }
+    if ( argc >= 6 )
+    {
+        _TCHAR* pEnd   = nullptr;
+        QWORD   qwBase = (argc >= 7) ? _tcstoui64 (argv[6], &pEnd, 16) : 0;
+        if ( (argc < 7) || (pEnd == argv[6]) || (*pEnd != 0) || !memory.LoadImage (argv[5], qwBase) )
+        {
+            std::cout << "Unable to load image" << std::endl;
+            return 1;
+        }
+    }
+
+    CCacheManager cacheManager;
+    cacheManager.Init ( );
+    cacheManager.set_BackingStore (&memory);
+
+    QWORD qwAccesses   = 0;
+    QWORD qwMisses     = 0;
+    QWORD qwMismatches = 0;
+    QWORD qwLowest     = std::numeric_limits<QWORD>::max();
+    QWORD qwHighest    = 0;
+
+    std::vector<TRACE_RECORD> vecRecords;
+    auto tStart = std::chrono::steady_clock::now ( );
+    for (QWORD qwFirst = 0; qwFirst < reader.get_Records(); qwFirst += nBatch)
+    {
+        size_t nCount = static_cast<size_t>(std::min<QWORD> (nBatch, reader.get_Records() - qwFirst));
+        if ( !reader.Read (qwFirst, nCount, vecRecords) )
+        {
+            std::cout << "Unable to read trace" << std::endl;
+            return 1;
+        }
+
+        for (const auto& it : vecRecords)
+        {
+            // whole words, so no read crosses the end of a cache block
+            const QWORD qwAddress = it.qwAddress & ~static_cast<QWORD>(sizeof(DWORD) - 1);
+            if ( qwAddress == 0 )
+                continue;
+
+            qwLowest  = std::min (qwLowest,  qwAddress);
+            qwHighest = std::max (qwHighest, qwAddress);
+
+            for (QWORD r = 0; r <= it.dwRepeat; r++)
+            {
+                DWORD dwData = 0;
+                if ( !cacheManager.GetCacheData (qwAddress, dwData) )
+                {
+                    qwMisses++;
+                    if ( !cacheManager.LoadCachePage (qwAddress) )
+                    {
+                        std::cout << "Unable to load trace address 0x" << std::hex << qwAddress
+                                  << std::dec << " into the cache" << std::endl;
+                        return 1;
+                    }
+                    cacheManager.GetCacheData (qwAddress, dwData);
+                }
+
+                DWORD dwMemory = 0;
+                memory.Read (qwAddress, &dwMemory, sizeof(dwMemory));
+                if ( dwData != dwMemory )
+                    qwMismatches++;
+
+                dwData++;
+                cacheManager.UpdateCacheData (qwAddress, &dwData, sizeof(dwData));
+                qwAccesses++;
+            }
+        }
+    }
+    std::chrono::duration<double> dReplay = std::chrono::steady_clock::now ( ) - tStart;
+
+    if ( (argc >= 5) && (_tcscmp (argv[4], _T("-")) != 0) && !memory.SaveSnapshot (argv[4]) )
+    {
+        std::cout << "Unable to save snapshot" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Accesses:          " << qwAccesses   << std::endl;
+    std::cout << "Cache Misses:      " << qwMisses     << std::endl;
+    std::cout << "Data mismatches:   " << qwMismatches << std::endl;
+    if ( qwHighest >= qwLowest )
+        std::cout << "Address range:     0x" << std::hex << qwLowest << " - 0x" << qwHighest << std::dec << std::endl;
+    std::cout << "Pages:             " << memory.get_Pages ( )  << std::endl;
+    std::cout << "Page tables:       " << memory.get_Tables ( ) << std::endl;
+    std::cout << "Memory allocated:  " << memory.get_Bytes ( ) / 1024 << " KB" << std::endl;
+    std::cout << "Replay time:       " << dReplay.count ( ) << " s" << std::endl;
+    return (qwMismatches == 0) ? 0 : 1;
+}
+
+/**
+    Parses the slice geometry of -nuca, \<sets\>x\<ways\>:\<fifo|lru\> optionally
+    followed by :\<tSlice\>:\<tHop\>:\<tMemory\>, into config
+
+    @param [in]     szGeometry  command line argument
+    @param [in,out] config      NUCA configuration updated
+
+    @retval true      on success
+    @retval false     if szGeometry is not a complete geometry
+ */
+static bool ParseNucaGeometry (const _TCHAR* szGeometry, NUCA_CONFIG& config)
+{
+    _TCHAR* pEnd = nullptr;
+    QWORD qwSets = _tcstoui64 (szGeometry, &pEnd, 10);
+    if ( (pEnd == szGeometry) || (*pEnd != _T('x')) )
+        return false;
+
+    const _TCHAR* p = pEnd + 1;
+    QWORD qwWays = _tcstoui64 (p, &pEnd, 10);
+    if ( (pEnd == p) || (*pEnd != _T(':')) )
+        return false;
+
+    p = pEnd + 1;
+    REPLACEMENT_POLICY ePolicy;
+    if ( _tcsncmp (p, _T("fifo"), 4) == 0 )
+        ePolicy = REPLACE_FIFO;
+    else if ( _tcsncmp (p, _T("lru"), 3) == 0 )
+        ePolicy = REPLACE_LRU;
+    else
+        return false;
+    p += (ePolicy == REPLACE_FIFO) ? 4 : 3;
+
+    QWORD rgLatency[3] = { config.tSlice, config.tHop, config.tMemory };
+    if ( *p == _T(':') )
+    {
+        for (QWORD& qwLatency : rgLatency)
+        {
+            if ( *p++ != _T(':') )
+                return false;
+            qwLatency = _tcstoui64 (p, &pEnd, 10);
+            if ( (pEnd == p) || (qwLatency > 0xFFFF) )
+                return false;
+            p = pEnd;
+        }
+    }
+    if ( (*p != _T('\0')) || (qwSets > 0xFFFFFFFF) || (qwWays > 0xFFFFFFFF) )
+        return false;
+
+    config.dwSetsPerSlice = static_cast<DWORD>(qwSets);
+    config.dwWays         = static_cast<DWORD>(qwWays);
+    config.ePolicy        = ePolicy;
+    config.tSlice         = static_cast<DWORD>(rgLatency[0]);
+    config.tHop           = static_cast<DWORD>(rgLatency[1]);
+    config.tMemory        = static_cast<DWORD>(rgLatency[2]);
+    return true;
+}
+
+/**
+    Replays one trace per core through a sliced NUCA last-level cache, the
+    cores taking turns a record at a time.  The slices are 64 sets x 8 ways
+    LRU with 12/2/200 cycle latencies unless a geometry is given.
+
+    usage: -nuca \<slices\> \<ring|mesh\> \<modulo|xor|hex mask,...\>
+                 [\<sets\>x\<ways\>:\<fifo|lru\>[:\<tSlice\>:\<tHop\>:\<tMemory\>]] \<trace\> [trace ...]
+*/
+int RunNuca (int argc, _TCHAR* argv[])
+{
+    constexpr size_t nBatch = 16 * 1024;
+
+    struct CCore
+    {
+        CCacheTraceReader           trace;
+        QWORD                       qwNext;         ///< next record to read
+        std::vector<TRACE_RECORD>   vecRecords;
+        size_t                      nBuffered;      ///< next buffered record
+    };
+
+    NUCA_CONFIG config   = g_DEFAULT_NUCA;
+    config.dwSlices      = static_cast<DWORD>(_tcstoui64 (argv[2], nullptr, 10));
+    if ( _tcscmp (argv[3], _T("ring")) == 0 )
+        config.eTopology = NUCA_RING;
+    else if ( _tcscmp (argv[3], _T("mesh")) == 0 )
+        config.eTopology = NUCA_MESH;
+    else
+    {
+        std::cout << "Topology must be ring or mesh" << std::endl;
+        return 1;
+    }
+    if ( _tcscmp (argv[4], _T("modulo")) == 0 )
+        config.eHash = SLICE_HASH_MODULO;
+    else if ( _tcscmp (argv[4], _T("xor")) == 0 )
+        config.eHash = SLICE_HASH_XOR;
+    else
+    {
+        config.eHash = SLICE_HASH_MASK;
+
+        // every mask must parse completely and select some address bit,
+        // a zero mask would pin its slice bit to 0
+        DWORD   dwMasks = 0;
+        bool    bValid  = true;
+        for (const _TCHAR* p = argv[4]; bValid; )
+        {
+            _TCHAR* pEnd = nullptr;
+            QWORD qwMask = _tcstoui64 (p, &pEnd, 16);
+            bValid = (pEnd != p) && (qwMask != 0) && (dwMasks < g_NUCA_MAX_MASKS) &&
+                     ((*pEnd == _T(',')) || (*pEnd == _T('\0')));
+            if ( bValid )
+                config.rgSliceMask[dwMasks++] = qwMask;
+            if ( *pEnd != _T(',') )
+                break;
+            p = pEnd + 1;
+        }
+        if ( !bValid || ((static_cast<DWORD>(1) << dwMasks) != config.dwSlices) )
+        {
+            std::cout << "Need one nonzero hex mask per slice index bit" << std::endl;
+            return 1;
+        }
+    }
+
+    int nFirstTrace = 5;
+    if ( ParseNucaGeometry (argv[5], config) )
+        nFirstTrace = 6;
+    if ( nFirstTrace >= argc )
+    {
+        std::cout << "Need at least one trace" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<CCore>> vecCores;
+    for (int i = nFirstTrace; i < argc; i++)
+    {
+        std::unique_ptr<CCore> pCore (new CCore ( ));
+        if ( !pCore->trace.Open (argv[i]) )
+        {
+            std::cout << "Unable to open trace " << i - nFirstTrace << std::endl;
+            return 1;
+        }
+        pCore->qwNext    = 0;
+        pCore->nBuffered = 0;
+        vecCores.push_back (std::move (pCore));
+    }
+
+    CNucaCache cache;
+    if ( !cache.Init (config, vecCores.size()) )
+    {
+        std::cout << "Invalid NUCA configuration" << std::endl;
+        return 1;
+    }
+
+    for (bool bActive = true; bActive; )
+    {
+        bActive = false;
+        for (size_t nCore = 0; nCore < vecCores.size(); nCore++)
+        {
+            CCore& core = *vecCores[nCore];
+            if ( core.nBuffered >= core.vecRecords.size() )
+            {
+                QWORD qwRemaining = core.trace.get_Records ( ) - core.qwNext;
+                if ( qwRemaining == 0 )
+                    continue;
+
+                size_t nCount = static_cast<size_t>(std::min<QWORD> (nBatch, qwRemaining));
+                if ( !core.trace.Read (core.qwNext, nCount, core.vecRecords) )
+                {
+                    std::cout << "Unable to read trace " << nCore << std::endl;
+                    return 1;
+                }
+                core.qwNext   += nCount;
+                core.nBuffered = 0;
+            }
+
+            // the repeats folded into a record travel to the slice as well
+            const TRACE_RECORD& record = core.vecRecords[core.nBuffered++];
+            for (QWORD r = 0; r <= record.dwRepeat; r++)
+                cache.Access (nCore, record.qwAddress);
+            bActive = true;
+        }
+    }
+
+    cache.Report (std::cout);
+    return 0;
 }
 
-int _tmain (int /*argc*/, _TCHAR* /*argv[]*/)
+int _tmain (int argc, _TCHAR* argv[])
 {
     std::ofstream oflog;
     std::stringstream ss;
 
+    if ( (argc >= 4) && (_tcscmp (argv[1], _T("-heatmap")) == 0) )
+        return RunHeatmap (argc, argv);
+
+    if ( (argc >= 4) && (_tcscmp (argv[1], _T("-opt")) == 0) )
+        return RunOpt (argc, argv);
+
+    if ( (argc >= 3) && (_tcscmp (argv[1], _T("-replay")) == 0) )
+        return RunReplay (argc, argv);
+
+    if ( (argc >= 2) && (_tcscmp (argv[1], _T("-layout")) == 0) )
+        return RunLayout (argc, argv);
+
+    if ( (argc >= 6) && (_tcscmp (argv[1], _T("-shared")) == 0) )
+        return RunShared (argc, argv);
+
+    if ( (argc >= 3) && (_tcscmp (argv[1], _T("-tparallel")) == 0) )
+        return RunTimeParallel (argc, argv);
+
+    if ( (argc >= 3) && (_tcscmp (argv[1], _T("-pipeline")) == 0) )
+        return RunPipeline (argc, argv);
+
+    if ( (argc >= 4) && (_tcscmp (argv[1], _T("-generate")) == 0) )
+        return RunGenerate (argc, argv);
+
+    if ( (argc >= 4) && (_tcscmp (argv[1], _T("-coalesce")) == 0) )
+        return RunCoalesce (argc, argv);
+
+    if ( (argc >= 4) && (_tcscmp (argv[1], _T("-assoc")) == 0) )
+        return RunAssoc (argc, argv);
+
+    if ( (argc >= 4) && (_tcscmp (argv[1], _T("-mapped")) == 0) )
+        return RunMapped (argc, argv);
+
+    if ( (argc >= 6) && (_tcscmp (argv[1], _T("-sample")) == 0) )
+        return RunSample (argc, argv);
+
+    if ( (argc >= 3) && (_tcscmp (argv[1], _T("-concurrent")) == 0) )
+        return RunConcurrent (argc, argv);
+
+    if ( (argc >= 3) && (_tcscmp (argv[1], _T("-sparse")) == 0) )
+        return RunSparse (argc, argv);
+
+    if ( (argc >= 6) && (_tcscmp (argv[1], _T("-nuca")) == 0) )
+        return RunNuca (argc, argv);
+
+    if ( (argc >= 3) && (_tcscmp (argv[1], _T("-serve")) == 0) )
+        return RunServe (argc, argv);
+
+    if ( (argc >= 4) && (_tcscmp (argv[1], _T("-stream")) == 0) )
+        return RunStream (argc, argv);
+
+    // '-events <event log>' records the per-access event stream of the run
+    // '-attribute' attributes hits, misses and evictions to A, B and C
+    // '-trace <trace>' records the address of every access of the run
+    // '-timing' runs the timing model alongside the cache
+    // '-dram <open|closed> [writeback]' models the DRAM behind the cache
+    // '-compress' runs a compressed cache alongside the cache
+    // '-checkpoint <file>' saves the final cache state and restores it into a second cache
+    const _TCHAR* szEventLog  = nullptr;
+    const _TCHAR* szTrace     = nullptr;
+    const _TCHAR* szCheckpoint = nullptr;
+    bool          bAttribute  = false;
+    bool          bTiming     = false;
+    bool          bDram       = false;
+    bool          bCompress   = false;
+    DRAM_CONFIG   dramConfig  = g_DEFAULT_DRAM;
+    for (int i = 1; i < argc; i++)
+    {
+        if ( (_tcscmp (argv[i], _T("-events")) == 0) && (i + 1 < argc) )
+            szEventLog = argv[++i];
+        else if ( (_tcscmp (argv[i], _T("-trace")) == 0) && (i + 1 < argc) )
+            szTrace = argv[++i];
+        else if ( (_tcscmp (argv[i], _T("-checkpoint")) == 0) && (i + 1 < argc) )
+            szCheckpoint = argv[++i];
+        else if ( _tcscmp (argv[i], _T("-attribute")) == 0 )
+            bAttribute = true;
+        else if ( _tcscmp (argv[i], _T("-timing")) == 0 )
+            bTiming = true;
+        else if ( _tcscmp (argv[i], _T("-compress")) == 0 )
+            bCompress = true;
+        else if ( (_tcscmp (argv[i], _T("-dram")) == 0) && (i + 1 < argc) )
+        {
+            bDram = true;
+            dramConfig.ePolicy = (_tcscmp (argv[++i], _T("closed")) == 0) ? PAGE_CLOSED : PAGE_OPEN;
+            if ( (i + 1 < argc) && (_tcscmp (argv[i + 1], _T("writeback")) == 0) )
+            {
+                dramConfig.bWriteBackEvictions = true;
+                i++;
+            }
+        }
+    }
+
     // Let's build our output filename based on the memory address
     // we get for our 1st global variable that we use in our cache
     // simulation.  The only uniqueness in the output is going to be
@@ -149,133 +1519,81 @@ int _tmain (int /*argc*/, _TCHAR* /*argv[]*/)
     CCacheManager cacheManager;
     cacheManager.Init();
 
-    // let's keep track of some cache statistics
-    int iCacheMisses = 0;
-    int iCacheHits   = 0;
-    int iCacheErrors = 0;
-
-    // also need some local variables to store data
-    int iA;
-    int iB;
-    int iB1;
-    int iC;
-//
-// The following is the benchmark code from Assignment #2
-//
-//    A[i] = A[i] + B[i] + B[i + 1] * C[i]
-//
-//
-#if defined(_WIN64)
-    oflog << "Executing an x64 build" << std::endl;
-#else
-    oflog << "Executing an x32 build" << std::endl;
-#endif
+    CCacheObserverGroup observers;
 
-    oflog << "Following based on the physical address of A[0] being 0x" 
-          << std::hex << std::setw(2*sizeof(DWORD_PTR)) << std::setfill('0') 
-          << reinterpret_cast<DWORD_PTR>(&g_rgA[0]) << std::endl;
-    oflog << "================================================================="
-          << std::endl;
+    CCacheEventLog eventLog;
+    if ( szEventLog )
+    {
+        if ( eventLog.Open (szEventLog) )
+            observers.Add (&eventLog);
+        else
+            std::cout << "Unable to create event log" << std::endl;
+    }
 
-    for ( int i = 0; i < g_DR_PASSOS_LOOP; i++ )
+    CCacheTraceWriter traceWriter;
+    if ( szTrace )
     {
-        DWORD dataFromCache;
-        bool bCacheMissThisIteration = false;
+        if ( traceWriter.Open (szTrace) )
+            observers.Add (&traceWriter);
+        else
+            std::cout << "Unable to create trace" << std::endl;
+    }
 
-///////////////////////////////////////////////////////////////////////////////
-// Attempting to access 1st operand 'B[i + 1]'
+    CAddressRegistry registry;
+    if ( bAttribute )
+    {
+        registry.Register ("A", g_rgA, sizeof(g_rgA));
+        registry.Register ("B", g_rgB, sizeof(g_rgB));
+        registry.Register ("C", g_rgC, sizeof(g_rgC));
+        observers.Add (&registry);
+    }
 
-        if ( cacheManager.GetCacheData ( &g_rgB[i + 1], dataFromCache) == false )
-        {
-            iCacheMisses++;
-            cacheManager.LoadCachePage ( &g_rgB[i + 1] );
-            iB1 = g_rgB[i + 1]; // cache-miss, load the data directly
+    CCacheTimingModel timing;
+    if ( bTiming )
+    {
+        timing.Init ( );
+        observers.Add (&timing);
+    }
 
-#ifdef _DEBUG
+    CDramModel dram;
+    if ( bDram )
+    {
+        dram.Init (dramConfig);
+        observers.Add (&dram);
+    }
 
-            CVirtualAddress va ( &g_rgB[i + 1] );
+    CCompressedCache compressed;
+    if ( bCompress )
+        observers.Add (&compressed);
 
-            if (bCacheMissThisIteration == false) 
-            { // then lets print the iteration header
-                bCacheMissThisIteration = true;
-                PrintIterationHeader(oflog, i);
-            }
+    if ( !observers.empty() )
+        cacheManager.set_Observer (&observers);
 
-            oflog << std::dec
-                  << "   Cache Miss["    << iCacheMisses << "] "
-                  << "for 'B[" << i << " + 1]'" << std::endl;
+    // the operands are read and A[i] written through tracked views of the
+    // arrays, the cache manager keeps the hit and miss statistics
+    CCacheManagerSink sink (cacheManager);
 
-            oflog << "   " << va << std::endl;
-#endif
+    TrackedArray<int, CCacheManagerSink> A (g_rgA, &sink);
+    TrackedArray<int, CCacheManagerSink> B (g_rgB, &sink);
+    TrackedArray<int, CCacheManagerSink> C (g_rgC, &sink);
 
-        }
-        else
-        {
-            iCacheHits++;
-            iB1 = dataFromCache; // cache-hit, use the data retrieved from cache
 #ifdef _DEBUG
-        // ok, let's verify if our cache actually stored and retrieved the correct
-        // data values
-            if (iB1 != g_rgB[i + 1] )
-            {
-                std::cout << "B[i+1] Data cache inconsistency detected" 
-                          << std::endl;
-                iCacheErrors++;
-            }
+    bool bCacheMissThisIteration = false;
 #endif
-        }
-
-///////////////////////////////////////////////////////////////////////////////
-// Attempting to access 2nd operand 'C[i]'
-
-        if ( cacheManager.GetCacheData ( &g_rgC[i], dataFromCache) == false )
-        {
-            iCacheMisses++;
-            cacheManager.LoadCachePage ( &g_rgC[i] );
-            iC = g_rgC[i]; // cache-miss, load the data directly
 
+    // reads one operand through the cache, in debug builds logging a miss
+    auto Fetch = [&](TrackedArray<int, CCacheManagerSink>::reference element,
+                     const char* szOperand, int i) -> int
+    {
 #ifdef _DEBUG
-            CVirtualAddress va (&g_rgC[i]);
-             
-            if ( bCacheMissThisIteration == false ) 
-            { // then lets print the iteration header
-                bCacheMissThisIteration = true;
-                PrintIterationHeader (oflog, i);
-            }
-
-            oflog << std::dec 
-                  << "   Cache Miss[" << iCacheMisses << "] "
-                  << "for 'C[" << i << "]'" << std::endl;
-
-            oflog << "   " << va << std::endl; 
+        QWORD qwMisses = cacheManager.get_CacheMisses ( );
 #endif
+        int iValue = element;
 
-        }
-        else
-        {
-            iCacheHits++;
-            iC = dataFromCache; // cache-hit, use the data retrieved from cache
 #ifdef _DEBUG
-            if ( iC != g_rgC[i] ) // now let's verify the retrieved cache data
-            {
-                std::cout << "C[i] Data cache inconsistency detected" 
-                          << std::endl;
-                iCacheErrors++;
-            }
-#endif
-        }
-
-///////////////////////////////////////////////////////////////////////////////
-// Attempting to access 3rd operand 'A[i]'
-
-        if ( cacheManager.GetCacheData (&g_rgA[i], dataFromCache) == false )
+        if ( cacheManager.get_CacheMisses ( ) != qwMisses )
         {
-            iCacheMisses++;
-            cacheManager.LoadCachePage (&g_rgA[i]);
-            iA = g_rgA[i]; // cache-miss, load the data directly
-
-#ifdef _DEBUG
-            CVirtualAddress va (&g_rgA[i]);
+            CVirtualAddress va (&element);
 
             if ( bCacheMissThisIteration == false ) 
             { // then lets print the iteration header
@@ -283,70 +1601,53 @@ int _tmain (int /*argc*/, _TCHAR* /*argv[]*/)
                 PrintIterationHeader (oflog, i);
             }
 
-            oflog << std::dec 
-                  << "   Cache Miss[" << iCacheMisses << "] "
-                  << "for 'A["          << i << "]'" << std::endl;
+            oflog << std::dec
+                  << "   Cache Miss[" << cacheManager.get_CacheMisses ( ) << "] "
+                  << "for '" << szOperand << "'" << std::endl;
 
             oflog << "   " << va << std::endl;
-#endif
         }
-        else
-        {
-            iCacheHits++;
-            iA = dataFromCache; // cache-hit, use the data retrieved from cache
-
-#ifdef _DEBUG
-            if ( iA != g_rgA[i] ) // now let's verify the retrieved cache data
-            {
-                std::cout << "A[i] Data cache inconsistency detected" 
-                          << std::endl;
-                iCacheErrors++;
-            }
+#else
+        (void) szOperand;
+        (void) i;
+#endif
+        return iValue;
+    };
+//
+// The following is the benchmark code from Assignment #2
+//
+//    A[i] = A[i] + B[i] + B[i + 1] * C[i]
+//
+//
+#if defined(_WIN64)
+    oflog << "Executing an x64 build" << std::endl;
+#else
+    oflog << "Executing an x32 build" << std::endl;
 #endif
-        }
-
-////////////////////////////////////////////////////////////////////////////////
-// Attempting to access 4th operand 'B[i]'
 
-        if ( cacheManager.GetCacheData ( &g_rgB[i], dataFromCache) == false )
-        {
-            iCacheMisses++;
-            cacheManager.LoadCachePage (&g_rgB[i]);
-            iB = g_rgB[i]; // cache-miss, load the data directly
+    oflog << "Following based on the physical address of A[0] being 0x" 
+          << std::hex << std::setw(2*sizeof(DWORD_PTR)) << std::setfill('0') 
+          << reinterpret_cast<DWORD_PTR>(&g_rgA[0]) << std::endl;
+    oflog << "================================================================="
+          << std::endl;
 
+    for ( int i = 0; i < g_DR_PASSOS_LOOP; i++ )
+    {
 #ifdef _DEBUG
-            CVirtualAddress va(&g_rgB[i]);
+        bCacheMissThisIteration = false;
+#endif
 
-            if ( bCacheMissThisIteration == false ) 
-            {  // then lets print the iteration header
-                bCacheMissThisIteration = true;
-                PrintIterationHeader(oflog, i);
-            }
+        // the operands are fetched in a fixed order, C++ leaves the order
+        // of the operands of a single expression unspecified
+        int iB1 = Fetch (B[i + 1], "B[i + 1]", i);
+        int iC  = Fetch (C[i],     "C[i]",     i);
+        int iA  = Fetch (A[i],     "A[i]",     i);
+        int iB  = Fetch (B[i],     "B[i]",     i);
 
-            oflog << std::dec 
-                  << "   Cache Miss[" << iCacheMisses << "] " 
-                  << "for 'B["          << i << "]'" << std::endl;
-            oflog << "   " << va << std::endl;
-#endif
-        }
-        else
-        {
-            iCacheHits++;
-            iB = dataFromCache; // cache-hit, use the data retrieved from cache
-#ifdef _DEBUG
-            if ( iB != g_rgB[i] ) // now let's verify the retrieved cache data
-            {
-                std::cout << "B[i] Data cache inconsistency detected" 
-                          << std::endl;
-                iCacheErrors++;
-            }
-#endif
-        }
-        
         // parenthesis used to denote explicit operation
         int iResult = iA + iB + (iB1 * iC);  
 
-        g_rgA[i] = iResult;
+        A[i] = iResult;
 
         std::cout << "Iteration[ i=" << i << " ]" << std::endl;
         std::cout << "A[i] + B[i] + B[i + 1] * C[i] Computation Result:" 
@@ -355,25 +1656,108 @@ int _tmain (int /*argc*/, _TCHAR* /*argv[]*/)
         std::cout << "-------------------------------------------------------------" 
                   << std::endl;
         std::cout << std::dec;
-        std::cout << "Cache Misses:" << iCacheMisses  << std::endl;
-        std::cout << "Cache Hits:  " << iCacheHits    << std::endl;
-        std::cout << "Cache Errors:" << iCacheErrors  << std::endl;
+        std::cout << "Cache Misses:" << cacheManager.get_CacheMisses ( ) << std::endl;
+        std::cout << "Cache Hits:  " << cacheManager.get_CacheHits ( )   << std::endl;
+        std::cout << "Cache Errors:" << sink.get_CacheErrors ( )         << std::endl;
     }
 
     oflog << std::dec;
     oflog << "----------------------------------------" << std::endl;
-    oflog << "Cache Misses:" << iCacheMisses << std::endl;
-    oflog << "Cache Hits:  " << iCacheHits   << std::endl;
-    oflog << "Cache Errors:" << iCacheErrors << std::endl;
+    oflog << "Cache Misses:" << cacheManager.get_CacheMisses ( ) << std::endl;
+    oflog << "Cache Hits:  " << cacheManager.get_CacheHits ( )   << std::endl;
+    oflog << "Cache Errors:" << sink.get_CacheErrors ( )         << std::endl;
+    oflog << "Cache Misses with A[0] at 0 (compile time):" << g_STATIC_KERNEL_MISSES << std::endl;
+
+    // the misses of the run must match the compile time model evaluated at
+    // the actual addresses of the arrays; an untracked build presents no
+    // access to the cache, so there is nothing to check
+    const size_t nModelMisses = BenchmarkKernelMisses (reinterpret_cast<DWORD_PTR>(&g_rgA[0]),
+                                                       reinterpret_cast<DWORD_PTR>(&g_rgB[0]),
+                                                       reinterpret_cast<DWORD_PTR>(&g_rgC[0]));
+    const bool   bModelMatch  = (CACHE_TRACKING == 0) ||
+                                (cacheManager.get_CacheMisses ( ) == nModelMisses);
+    const char*  szModelCheck = (CACHE_TRACKING == 0) ? " (untracked build)" :
+                                bModelMatch           ? " (match)" : " (MISMATCH)";
+
+    oflog << "Cache Misses at the actual addresses (model):" << nModelMisses
+          << szModelCheck << std::endl;
+    std::cout << "Cache Misses (model):" << nModelMisses
+              << szModelCheck << std::endl;
+
+    if ( bAttribute )
+    {
+        oflog << std::endl;
+        registry.Report (oflog);
+    }
+
+    if ( bTiming )
+    {
+        timing.Drain ( );
+        oflog << std::endl;
+        timing.Report (oflog);
+    }
+
+    if ( bDram )
+    {
+        dram.Drain ( );
+        oflog << std::endl;
+        dram.Report (oflog);
+    }
+
+    if ( bCompress )
+    {
+        oflog << std::endl;
+        compressed.Report (oflog);
+    }
+
+    cacheManager.set_Observer (nullptr);
+
+    if ( szCheckpoint )
+    {
+        // the restored cache must agree with the original on the statistics
+        // and on the hit or miss and the data of every element of A, B and C
+        CCacheManager restored;
+        restored.Init ( );
+
+        bool bMatch = false;
+        if ( cacheManager.SaveCheckpoint (szCheckpoint) && 
+             restored.RestoreCheckpoint (szCheckpoint) )
+        {
+            bMatch = (restored.get_CacheHits ( )   == cacheManager.get_CacheHits ( ))
+                  && (restored.get_CacheMisses ( ) == cacheManager.get_CacheMisses ( ));
+
+            const int* rgArrays[] = { g_rgA, g_rgB, g_rgC };
+            for (auto pArray : rgArrays)
+            {
+                for (int i = 0; bMatch && (i < req::g_MAX_ARRAY_SIZE); i++)
+                {
+                    DWORD dwOriginal = 0;
+                    DWORD dwRestored = 0;
+                    bool  bOriginal  = cacheManager.GetCacheData (&pArray[i], dwOriginal);
+                    bool  bRestored  = restored.GetCacheData (&pArray[i], dwRestored);
+
+                    bMatch = (bOriginal == bRestored) && (dwOriginal == dwRestored);
+                }
+            }
+        }
+        else
+            std::cout << "Unable to save or restore the checkpoint" << std::endl;
+
+        oflog << "Checkpoint round trip:" << (bMatch ? "(match)" : "(MISMATCH)") << std::endl;
+        std::cout << "Checkpoint round trip:" << (bMatch ? "(match)" : "(MISMATCH)") << std::endl;
+    }
 
     oflog.close();
 
+    eventLog.Close ( );
+    traceWriter.Close ( );
+
     std::cout << std::endl;
     std::cout << "[Enter 'q' to exit program]" << std::endl;
 
     char c;
     std::cin >> c;
 
-    return 0;
+    return bModelMatch ? 0 : 1;
 }
 
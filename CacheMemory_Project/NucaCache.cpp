@@ -0,0 +1,313 @@
+/**
+ *  @file       NucaCache.cpp
+ *  @brief      CNucaCache class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+
+#include "NucaCache.h"
+
+/// widest slice count for which Report writes the core by slice matrix
+constexpr size_t g_NUCA_MATRIX_SLICES = 16;
+
+/// returns the parity of the bits set in qwValue
+static DWORD Parity (QWORD qwValue) noexcept
+{
+    qwValue ^= qwValue >> 32;
+    qwValue ^= qwValue >> 16;
+    qwValue ^= qwValue >> 8;
+    qwValue ^= qwValue >> 4;
+    qwValue ^= qwValue >> 2;
+    qwValue ^= qwValue >> 1;
+    return static_cast<DWORD>(qwValue & 1);
+}
+
+/// returns log2 of qwValue, which must be a power of 2
+static DWORD Log2 (QWORD qwValue) noexcept
+{
+    DWORD dwBits = 0;
+    while ( (static_cast<QWORD>(1) << dwBits) < qwValue )
+        dwBits++;
+    return dwBits;
+}
+
+CNucaCache::CNucaCache ( ) noexcept
+    : m_config       (g_DEFAULT_NUCA),
+      m_vecSlices    ( ),
+      m_vecCores     ( ),
+      m_vecHops      ( ),
+      m_vecTraffic   ( ),
+      m_dwColumns    (0),
+      m_dwOffsetBits (0),
+      m_dwIndexBits  (0),
+      m_dwSliceBits  (0)
+{
+};
+
+bool CNucaCache::Init (const NUCA_CONFIG& config /* = g_DEFAULT_NUCA */, size_t nCores /* = 1 */)
+{
+    const bool bPowerOf2Slices = (config.dwSlices & (config.dwSlices - 1)) == 0;
+
+    m_vecSlices.clear ( );
+    m_vecCores.clear ( );
+    if ( (config.dwSlices == 0) || (config.dwSlices > g_NUCA_MAX_SLICES) ||
+         (nCores == 0) || (nCores > g_NUCA_MAX_CORES) ||
+         (config.dwSetsPerSlice == 0) || ((config.dwSetsPerSlice & (config.dwSetsPerSlice - 1)) != 0) ||
+         (config.cbBlock == 0) || ((config.cbBlock & (config.cbBlock - 1)) != 0) ||
+         ((config.eHash != SLICE_HASH_MODULO) && !bPowerOf2Slices) ||
+         ((config.eTopology == NUCA_MESH) && (config.dwMeshColumns > config.dwSlices)) )
+        return false;
+
+    m_config       = config;
+    m_dwOffsetBits = Log2 (config.cbBlock);
+    m_dwIndexBits  = Log2 (config.dwSetsPerSlice);
+    m_dwSliceBits  = bPowerOf2Slices ? Log2 (config.dwSlices) : 0;
+
+    if ( config.eHash == SLICE_HASH_XOR )
+    {
+        // slice bit n gathers every k-th block number bit starting at bit n
+        for (DWORD n = 0; n < g_NUCA_MAX_MASKS; n++)
+        {
+            m_config.rgSliceMask[n] = 0;
+            if ( n >= m_dwSliceBits )
+                continue;
+            for (DWORD dwBit = m_dwOffsetBits + n; dwBit < 64; dwBit += m_dwSliceBits)
+                m_config.rgSliceMask[n] |= static_cast<QWORD>(1) << dwBit;
+        }
+    }
+
+    m_vecSlices.resize (config.dwSlices);
+    for (auto& it : m_vecSlices)
+    {
+        it.rgSets.reset (new CAssociativeSet[config.dwSetsPerSlice]);
+        it.stats = NUCA_SLICE_STATS { 0, 0, 0 };
+        for (DWORD i = 0; i < config.dwSetsPerSlice; i++)
+        {
+            if ( !it.rgSets[i].Init (config.dwWays, config.ePolicy) )
+            {
+                m_vecSlices.clear ( );
+                return false;
+            }
+        }
+    }
+
+    m_vecCores.assign (nCores, NUCA_CORE_STATS { 0, 0, 0, 0, 0 });
+    for (size_t i = 0; i < nCores; i++)
+        m_vecCores[i].dwTile = static_cast<DWORD>(i * config.dwSlices / nCores);
+
+    m_vecTraffic.assign (nCores * config.dwSlices, 0);
+    ComputeHops ( );
+    return true;
+}
+
+void CNucaCache::ComputeHops (void)
+{
+    const DWORD dwSlices = m_config.dwSlices;
+
+    // the squarest mesh is as many rows as the largest divisor up to the
+    // square root, a line when the slice count is prime
+    m_dwColumns = m_config.dwMeshColumns;
+    if ( m_dwColumns == 0 )
+    {
+        DWORD dwRows = 1;
+        for (DWORD r = 1; r * r <= dwSlices; r++)
+        {
+            if ( dwSlices % r == 0 )
+                dwRows = r;
+        }
+        m_dwColumns = dwSlices / dwRows;
+    }
+
+    m_vecHops.assign (m_vecCores.size() * dwSlices, 0);
+    for (size_t nCore = 0; nCore < m_vecCores.size(); nCore++)
+    {
+        const DWORD dwTile = m_vecCores[nCore].dwTile;
+        for (DWORD dwSlice = 0; dwSlice < dwSlices; dwSlice++)
+        {
+            DWORD dwHops;
+            if ( m_config.eTopology == NUCA_RING )
+            {
+                DWORD dwDistance = (dwTile > dwSlice) ? dwTile - dwSlice : dwSlice - dwTile;
+                dwHops = std::min (dwDistance, dwSlices - dwDistance);
+            }
+            else
+            {
+                int iRow    = static_cast<int>(dwTile / m_dwColumns) - static_cast<int>(dwSlice / m_dwColumns);
+                int iColumn = static_cast<int>(dwTile % m_dwColumns) - static_cast<int>(dwSlice % m_dwColumns);
+                dwHops = static_cast<DWORD>(std::abs (iRow) + std::abs (iColumn));
+            }
+            m_vecHops[nCore * dwSlices + dwSlice] = dwHops;
+        }
+    }
+}
+
+DWORD CNucaCache::SelectSlice (QWORD qwAddress) const noexcept
+{
+    if ( m_config.eHash == SLICE_HASH_MODULO )
+        return static_cast<DWORD>((qwAddress >> m_dwOffsetBits) % m_config.dwSlices);
+
+    DWORD dwSlice = 0;
+    for (DWORD n = 0; n < m_dwSliceBits; n++)
+        dwSlice |= Parity (qwAddress & m_config.rgSliceMask[n]) << n;
+    return dwSlice;
+}
+
+DWORD CNucaCache::Access (size_t nCore, QWORD qwAddress) noexcept
+{
+    if ( (qwAddress == 0) || (nCore >= m_vecCores.size()) )
+        return 0;
+
+    const DWORD dwSlice = SelectSlice (qwAddress);
+    QWORD qwBlock = qwAddress >> m_dwOffsetBits;
+    if ( m_config.eHash == SLICE_HASH_MODULO )
+        qwBlock /= m_config.dwSlices;
+
+    const size_t    nIndex = static_cast<size_t>(qwBlock & (m_config.dwSetsPerSlice - 1));
+    const QWORD     qwTag  = qwBlock >> m_dwIndexBits;
+
+    CSlice&          slice = m_vecSlices[dwSlice];
+    CAssociativeSet& set   = slice.rgSets[nIndex];
+    NUCA_CORE_STATS& core  = m_vecCores[nCore];
+    const DWORD      dwHops = m_vecHops[nCore * m_vecSlices.size() + dwSlice];
+
+    DWORD dwLatency = m_config.tSlice + 2 * dwHops * m_config.tHop;
+    if ( !set.AccessCacheTag (qwTag) )
+    {
+        if ( set.LoadCacheTag (qwTag) )
+            slice.stats.qwEvictions++;
+        slice.stats.qwMisses++;
+        core.qwMisses++;
+        dwLatency += m_config.tMemory;
+    }
+
+    slice.stats.qwAccesses++;
+    core.qwAccesses++;
+    core.qwHops    += dwHops;
+    core.qwLatency += dwLatency;
+    m_vecTraffic[nCore * m_vecSlices.size() + dwSlice]++;
+    return dwLatency;
+}
+
+double CNucaCache::get_SliceImbalance (void) const noexcept
+{
+    QWORD qwTotal = 0;
+    QWORD qwMax   = 0;
+    for (const auto& it : m_vecSlices)
+    {
+        qwTotal += it.stats.qwAccesses;
+        qwMax    = std::max (qwMax, it.stats.qwAccesses);
+    }
+    return qwTotal ? static_cast<double>(qwMax) * m_vecSlices.size() / qwTotal : 0.0;
+}
+
+double CNucaCache::get_AverageHops (void) const noexcept
+{
+    QWORD qwAccesses = 0;
+    QWORD qwHops     = 0;
+    for (const auto& it : m_vecCores)
+    {
+        qwAccesses += it.qwAccesses;
+        qwHops     += it.qwHops;
+    }
+    return qwAccesses ? static_cast<double>(qwHops) / qwAccesses : 0.0;
+}
+
+std::ostream& CNucaCache::Report (std::ostream& os) const
+{
+    static const char* rgHash[] = { "modulo", "XOR fold", "parity masks" };
+
+    const size_t nSlices = m_vecSlices.size();
+
+    QWORD qwAccesses = 0;
+    QWORD qwMisses   = 0;
+    QWORD qwLatency  = 0;
+    for (const auto& it : m_vecCores)
+    {
+        qwAccesses += it.qwAccesses;
+        qwMisses   += it.qwMisses;
+        qwLatency  += it.qwLatency;
+    }
+
+    os << std::dec << std::setfill (' ');
+    os << "NUCA cache" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    if ( nSlices == 0 )
+        return os;
+
+    os << "Geometry:          " << nSlices << " slices x " << m_config.dwSetsPerSlice << " sets x "
+       << m_config.dwWays << " ways x " << m_config.cbBlock << " bytes, "
+       << ((m_config.ePolicy == REPLACE_LRU) ? "LRU" : "FIFO") << std::endl;
+    if ( m_config.eTopology == NUCA_RING )
+        os << "Topology:          ring of " << nSlices << " tiles" << std::endl;
+    else
+        os << "Topology:          mesh of " << m_dwColumns << " x "
+           << (nSlices + m_dwColumns - 1) / m_dwColumns << " tiles" << std::endl;
+    os << "Slice hash:        " << rgHash[m_config.eHash];
+    for (DWORD n = 0; n < m_dwSliceBits && m_config.eHash != SLICE_HASH_MODULO; n++)
+        os << ((n == 0) ? " 0x" : ", 0x") << std::hex << m_config.rgSliceMask[n] << std::dec;
+    os << std::endl;
+    os << "Latency:           slice " << m_config.tSlice << ", hop " << m_config.tHop
+       << ", memory " << m_config.tMemory << std::endl << std::endl;
+
+    os << std::fixed << std::setprecision(2);
+    os << std::setw(6) << "Slice" << std::setw(12) << "Accesses" << std::setw(9) << "Share%"
+       << std::setw(12) << "Misses"  << std::setw(9) << "Miss%" << std::endl;
+    for (size_t i = 0; i < nSlices; i++)
+    {
+        const NUCA_SLICE_STATS& stats = m_vecSlices[i].stats;
+        os << std::setw(6)  << i << std::setw(12) << stats.qwAccesses
+           << std::setw(9)  << (qwAccesses ? 100.0 * stats.qwAccesses / qwAccesses : 0.0)
+           << std::setw(12) << stats.qwMisses
+           << std::setw(9)  << (stats.qwAccesses ? 100.0 * stats.qwMisses / stats.qwAccesses : 0.0)
+           << std::endl;
+    }
+    os << std::endl;
+
+    os << std::setw(6) << "Core" << std::setw(6) << "Tile" << std::setw(12) << "Accesses"
+       << std::setw(9) << "Miss%" << std::setw(10) << "Avg hops" << std::setw(13) << "Avg latency" << std::endl;
+    for (size_t i = 0; i < m_vecCores.size(); i++)
+    {
+        const NUCA_CORE_STATS& stats = m_vecCores[i];
+        double dAccesses = stats.qwAccesses ? static_cast<double>(stats.qwAccesses) : 1.0;
+        os << std::setw(6)  << i << std::setw(6) << stats.dwTile << std::setw(12) << stats.qwAccesses
+           << std::setw(9)  << 100.0 * stats.qwMisses / dAccesses
+           << std::setw(10) << stats.qwHops / dAccesses
+           << std::setw(13) << stats.qwLatency / dAccesses << std::endl;
+    }
+    os << std::endl;
+
+    if ( nSlices <= g_NUCA_MATRIX_SLICES )
+    {
+        os << "Traffic (% of the core's accesses to each slice)" << std::endl;
+        os << std::setw(6) << "Core";
+        for (size_t j = 0; j < nSlices; j++)
+            os << std::setw(7) << j;
+        os << std::endl << std::setprecision(1);
+        for (size_t i = 0; i < m_vecCores.size(); i++)
+        {
+            double dAccesses = m_vecCores[i].qwAccesses ? static_cast<double>(m_vecCores[i].qwAccesses) : 1.0;
+            os << std::setw(6) << i;
+            for (size_t j = 0; j < nSlices; j++)
+                os << std::setw(7) << 100.0 * m_vecTraffic[i * nSlices + j] / dAccesses;
+            os << std::endl;
+        }
+        os << std::endl << std::setprecision(2);
+    }
+
+    os << "Accesses:          " << qwAccesses << std::endl;
+    os << "Miss Rate:         " << (qwAccesses ? 100.0 * qwMisses / qwAccesses : 0.0) << "%" << std::endl;
+    os << "Slice imbalance:   " << get_SliceImbalance ( ) << " (busiest slice / mean)" << std::endl;
+    os << "Average hops:      " << get_AverageHops ( ) << std::endl;
+    os << "Average latency:   " << (qwAccesses ? static_cast<double>(qwLatency) / qwAccesses : 0.0)
+       << " cycles" << std::endl;
+    os.unsetf (std::ios::floatfield);
+
+    return os;
+}
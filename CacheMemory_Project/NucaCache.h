@@ -0,0 +1,228 @@
+/**
+ *  @file       NucaCache.h
+ *  @brief      CNucaCache class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_NUCA_CACHE_H__)
+#define _NUCA_CACHE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _MEMORY_
+    #include <memory>
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+#if !defined(_ASSOCIATIVE_CACHE_H__)
+    #include "AssociativeCache.h"
+#endif
+
+/// most slices of a NUCA cache
+constexpr DWORD g_NUCA_MAX_SLICES = 64;
+/// most cores sharing a NUCA cache
+constexpr DWORD g_NUCA_MAX_CORES  = 64;
+/// slice index bits, enough for g_NUCA_MAX_SLICES
+constexpr DWORD g_NUCA_MAX_MASKS  = 6;
+
+/**
+ *  How the slice holding an address is chosen
+ */
+enum NUCA_SLICE_HASH
+{
+    SLICE_HASH_MODULO,  ///< block number modulo the slice count, any slice count
+    SLICE_HASH_XOR,     ///< the block number folded onto the slice bits with XOR
+    SLICE_HASH_MASK     ///< slice bit n is the parity of the address under mask n
+};
+
+/**
+ *  How the tiles of the slices are connected
+ */
+enum NUCA_TOPOLOGY
+{
+    NUCA_RING,          ///< bidirectional ring, tile n next to tiles n - 1 and n + 1
+    NUCA_MESH           ///< 2D mesh with XY routing, tiles numbered row by row
+};
+
+/**
+ *  NUCA organization and timing, all latencies in cycles
+ */
+struct NUCA_CONFIG
+{
+    DWORD   dwSlices;           ///< slices, one per tile
+    DWORD   dwSetsPerSlice;     ///< sets in every slice (power of 2)
+    DWORD   dwWays;             ///< ways per set
+    DWORD   cbBlock;            ///< block size in bytes (power of 2)
+    REPLACEMENT_POLICY ePolicy; ///< REPLACE_FIFO or REPLACE_LRU
+    NUCA_TOPOLOGY eTopology;
+    DWORD   dwMeshColumns;      ///< tiles per mesh row, 0 for the squarest mesh
+    NUCA_SLICE_HASH eHash;      ///< XOR and MASK need a power of 2 slices
+    DWORD   tSlice;             ///< tag and data access within a slice
+    DWORD   tHop;               ///< one hop of the interconnect, each way
+    DWORD   tMemory;            ///< added on a miss
+    QWORD   rgSliceMask[g_NUCA_MAX_MASKS]; ///< SLICE_HASH_MASK, one per slice index bit
+};
+
+/// defaults: 8 slices of 64 sets x 8 ways LRU on a ring, XOR hash, 12 cycle slices, 2 cycle hops
+constexpr NUCA_CONFIG g_DEFAULT_NUCA = { 8, 64, 8, req::g_CACHE_BLOCK_SIZE, REPLACE_LRU,
+                                         NUCA_RING, 0, SLICE_HASH_XOR, 12, 2, 200, { 0 } };
+
+/**
+ *  Per core statistics of a NUCA cache
+ */
+struct NUCA_CORE_STATS
+{
+    DWORD   dwTile;             ///< tile the core sits on
+    QWORD   qwAccesses;
+    QWORD   qwMisses;
+    QWORD   qwHops;             ///< hops to the slices accessed, one way
+    QWORD   qwLatency;          ///< cycles of every access, round trip included
+};
+
+/**
+ *  Per slice statistics of a NUCA cache
+ */
+struct NUCA_SLICE_STATS
+{
+    QWORD   qwAccesses;
+    QWORD   qwMisses;
+    QWORD   qwEvictions;
+};
+
+/**
+ *  Last-level cache split into slices, as on server processors: every
+ *  slice has its own array of sets and sits on a tile of a ring or mesh
+ *  interconnect next to a core, and a hash of the address decides which
+ *  slice holds a block.  The latency of an access depends on the distance
+ *  from the core to that slice,
+ *
+ *      tSlice + 2 * hops * tHop            (+ tMemory on a miss)
+ *
+ *  so a single cache whose latency is uniform cannot show it.
+ *
+ *  The slice is chosen by
+ *  - SLICE_HASH_MODULO   block number mod the slice count; consecutive
+ *                        blocks go round the slices, any slice count
+ *  - SLICE_HASH_XOR      slice bit n is the XOR of block number bits n,
+ *                        n + k, n + 2k, ... for 2^k slices, so that large
+ *                        power of 2 strides still spread over every slice
+ *  - SLICE_HASH_MASK     slice bit n is the parity of the address ANDed
+ *                        with rgSliceMask[n], the form of the reverse
+ *                        engineered complex addressing of Intel processors
+ *
+ *  Under SLICE_HASH_MODULO the set index is taken above the slice number,
+ *  otherwise from the low block bits as the hash spreads them anyway.  The
+ *  traces hold virtual addresses, which stand in for the physical ones.
+ *
+ *  Slice n sits on tile n.  Cores are spread evenly over the tiles, core c
+ *  of C on tile c * slices / C.  The hop count from every core to every
+ *  slice is computed once by Init: on the ring the shorter way round, on
+ *  the mesh the Manhattan distance.  Traffic is counted per core and per
+ *  slice, which shows the slice imbalance (the busiest slice against the
+ *  mean) and the average hop cost of an access pattern.
+ */
+class CNucaCache
+{
+    struct CSlice
+    {
+        std::unique_ptr<CAssociativeSet[]>  rgSets;
+        NUCA_SLICE_STATS                    stats;
+    };
+
+    NUCA_CONFIG                     m_config;
+    std::vector<CSlice>             m_vecSlices;
+    std::vector<NUCA_CORE_STATS>    m_vecCores;
+    std::vector<DWORD>              m_vecHops;      ///< core * slices + slice
+    std::vector<QWORD>              m_vecTraffic;   ///< accesses, core * slices + slice
+    DWORD                           m_dwColumns;    ///< tiles per mesh row
+    DWORD                           m_dwOffsetBits;
+    DWORD                           m_dwIndexBits;
+    DWORD                           m_dwSliceBits;  ///< log2 of the slices, hashes other than MODULO
+
+public:
+/**
+ *  Default Constructor, Init must be called before use
+ */
+    CNucaCache ( ) noexcept;
+
+/**
+    Allocates empty slices and computes the hops from every core to every
+    slice.  Under SLICE_HASH_XOR the slice masks are generated, under
+    SLICE_HASH_MASK they are taken from the configuration.
+
+    @param [in] config          NUCA configuration
+    @param [in] nCores          cores issuing accesses, 1 to g_NUCA_MAX_CORES
+
+    @retval true      on success
+    @retval false     on an invalid geometry, topology, hash or core count
+ */
+    bool Init (const NUCA_CONFIG& config = g_DEFAULT_NUCA, size_t nCores = 1);
+
+/**
+    Returns the slice holding an address
+ */
+    DWORD SelectSlice (QWORD qwAddress) const noexcept;
+
+/**
+    Accesses an address from a core, filling its block on a miss
+
+    @param [in] nCore           core issuing the access
+    @param [in] qwAddress       memory address accessed
+
+    @retval latency of the access in cycles, 0 for address 0 or an
+            invalid core
+ */
+    DWORD Access (size_t nCore, QWORD qwAddress) noexcept;
+
+/**
+    Returns the hops from a core to a slice, one way
+ */
+    DWORD get_Hops (size_t nCore, DWORD dwSlice) const
+    { return m_vecHops[nCore * m_vecSlices.size() + dwSlice]; };
+
+    const NUCA_CORE_STATS&  get_CoreStats  (size_t nCore) const
+    { return m_vecCores[nCore]; };
+
+    const NUCA_SLICE_STATS& get_SliceStats (DWORD dwSlice) const
+    { return m_vecSlices[dwSlice].stats; };
+
+/**
+    Returns the accesses of the busiest slice over the mean of all slices,
+    1.0 for a perfectly even spread
+ */
+    double get_SliceImbalance (void) const noexcept;
+
+/**
+    Returns the average hops of an access, one way
+ */
+    double get_AverageHops (void) const noexcept;
+
+/**
+    Writes the organization, the traffic, misses and share of every slice,
+    the hops and latency of every core and, for up to 16 slices, the core
+    by slice traffic matrix
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os) const;
+
+private:
+
+    void ComputeHops (void);
+
+    CNucaCache (const CNucaCache& rhs) = delete;
+    CNucaCache& operator = (const CNucaCache& rhs) = delete;
+};
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ *  @file       PipelinedSimulator.cpp
+ *  @brief      CPipelinedSimulator class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <memory.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+#include "VirtualAddress.h"
+#include "CacheSet.h"
+#include "CacheTrace.h"
+#include "SpscQueue.h"
+#include "PipelinedSimulator.h"
+
+/**
+ *  A batch of trace records and everything the stages derive from them
+ */
+struct PIPE_BATCH
+{
+    std::vector<TRACE_RECORD>   vecRecords;     ///< reserved once, never reallocated
+    DWORD_PTR                   rgIndex[g_PIPE_BATCH_RECORDS];
+    DWORD_PTR                   rgTag[g_PIPE_BATCH_RECORDS];
+    bool                        rgHit[g_PIPE_BATCH_RECORDS];
+    size_t                      nCount;
+    bool                        bLast;          ///< no batch follows this one
+    bool                        bFailed;        ///< the trace could not be read, an address
+                                                ///< is wider than a pointer, or the run was
+                                                ///< stopped; the batch carries no records
+};
+
+typedef CSpscQueue<PIPE_BATCH*, g_PIPE_BATCHES> PIPE_QUEUE;
+
+static const char* const g_szStageNames[PIPE_STAGE_COUNT] =
+{
+    "Read",
+    "Decode",
+    "Simulate",
+    "Statistics"
+};
+
+CPipelinedSimulator::CPipelinedSimulator ( ) noexcept
+{
+    Clear ( );
+};
+
+void CPipelinedSimulator::Clear (void) noexcept
+{
+    m_qwCacheHits   = 0;
+    m_qwCacheMisses = 0;
+    m_qwBatches     = 0;
+    memset (m_rgSetHits,   0, sizeof(m_rgSetHits));
+    memset (m_rgSetMisses, 0, sizeof(m_rgSetMisses));
+    memset (m_rgWaits,     0, sizeof(m_rgWaits));
+    for (auto& it : m_rgBusy)
+        it = 0.0;
+}
+
+bool CPipelinedSimulator::Run (const TCHAR* szTrace)
+{
+    Clear ( );
+
+    CCacheTraceReader trace;
+    if ( !trace.Open (szTrace) )
+        return false;
+
+    std::vector<PIPE_BATCH> vecBatches (g_PIPE_BATCHES);
+    PIPE_QUEUE              queFree;        // statistics -> read
+    PIPE_QUEUE              queRead;        // read       -> decode
+    PIPE_QUEUE              queDecoded;     // decode     -> simulate
+    PIPE_QUEUE              queSimulated;   // simulate   -> statistics
+
+    for (auto& it : vecBatches)
+    {
+        it.vecRecords.reserve (g_PIPE_BATCH_RECORDS);
+        queFree.Push (&it);
+    }
+
+    typedef std::chrono::steady_clock CLOCK;
+
+    // set by the first stage to fail; the reader ends the run with its next
+    // batch, so every stage still sees a last batch and returns
+    std::atomic<bool> bStop (false);
+
+    // the work and waits of a stage are counted in locals of its thread and
+    // published once it is done, so the stages share no cache line while
+    // running
+    auto Publish = [this](PIPE_STAGE eStage, double dBusy, QWORD qwWaits)
+    {
+        m_rgBusy[eStage]  = dBusy;
+        m_rgWaits[eStage] = qwWaits;
+    };
+
+    // the reader's input is the free list, so its waits are backpressure
+    auto ReadStage = [&]()
+    {
+        const QWORD qwRecords = trace.get_Records ( );
+        QWORD       qwFirst   = 0;
+        double      dBusy     = 0.0;
+        QWORD       qwWaits   = 0;
+        PIPE_BATCH* pBatch;
+
+        do
+        {
+            qwWaits += queFree.Pop (pBatch);
+            auto tStart = CLOCK::now ( );
+
+            pBatch->nCount  = static_cast<size_t>(std::min<QWORD> (g_PIPE_BATCH_RECORDS, qwRecords - qwFirst));
+            pBatch->bFailed = bStop.load ( ) ||
+                              ((pBatch->nCount > 0) && !trace.Read (qwFirst, pBatch->nCount, pBatch->vecRecords));
+            qwFirst        += pBatch->nCount;
+            pBatch->bLast   = pBatch->bFailed || (qwFirst >= qwRecords);
+
+            // a failed batch carries no records, it only stops the stages behind
+            if ( pBatch->bFailed )
+                pBatch->nCount = 0;
+
+            dBusy += std::chrono::duration<double> (CLOCK::now ( ) - tStart).count ( );
+            queRead.Push (pBatch);
+        } while ( !pBatch->bLast );
+
+        Publish (PIPE_STAGE_READ, dBusy, qwWaits);
+    };
+
+    auto DecodeStage = [&]()
+    {
+        double      dBusy   = 0.0;
+        QWORD       qwWaits = 0;
+        PIPE_BATCH* pBatch;
+        do
+        {
+            qwWaits += queRead.Pop (pBatch);
+            auto tStart = CLOCK::now ( );
+
+            for (size_t i = 0; i < pBatch->nCount; i++)
+            {
+                // an address wider than a pointer fails the batch and stops the run
+                const void* pAddress;
+                if ( !CVirtualAddress::FromTraceAddress (pBatch->vecRecords[i].qwAddress, pAddress) )
+                {
+                    pBatch->bFailed = true;
+                    pBatch->nCount  = 0;
+                    bStop = true;
+                    break;
+                }
+
+                CVirtualAddress vAddress (pAddress);
+                pBatch->rgIndex[i] = vAddress.DecodeIndex ( );
+                pBatch->rgTag[i]   = vAddress.DecodeTag ( );
+            }
+
+            dBusy += std::chrono::duration<double> (CLOCK::now ( ) - tStart).count ( );
+            queDecoded.Push (pBatch);
+        } while ( !pBatch->bLast );
+
+        Publish (PIPE_STAGE_DECODE, dBusy, qwWaits);
+    };
+
+    auto SimulateStage = [&]()
+    {
+        CCacheSet rgCacheSets[req::g_4WAY_CACHE_SETS];
+        for (auto& it : rgCacheSets)
+            it.Init ( );
+
+        double      dBusy   = 0.0;
+        QWORD       qwWaits = 0;
+        PIPE_BATCH* pBatch;
+        do
+        {
+            qwWaits += queDecoded.Pop (pBatch);
+            auto tStart = CLOCK::now ( );
+
+            for (size_t i = 0; i < pBatch->nCount; i++)
+            {
+                DWORD_PTR dwIndex = pBatch->rgIndex[i];
+                if ( dwIndex >= _countof(rgCacheSets) )
+                    continue;
+
+                bool bHit = rgCacheSets[dwIndex].AccessCacheTag (pBatch->rgTag[i]);
+                if ( !bHit )
+                    rgCacheSets[dwIndex].LoadCacheTag (pBatch->rgTag[i]);
+                pBatch->rgHit[i] = bHit;
+            }
+
+            dBusy += std::chrono::duration<double> (CLOCK::now ( ) - tStart).count ( );
+            queSimulated.Push (pBatch);
+        } while ( !pBatch->bLast );
+
+        Publish (PIPE_STAGE_SIMULATE, dBusy, qwWaits);
+    };
+
+    std::thread threadRead     (ReadStage);
+    std::thread threadDecode   (DecodeStage);
+    std::thread threadSimulate (SimulateStage);
+
+    // statistics stage on the calling thread
+    bool        bFailed = false;
+    double      dBusy   = 0.0;
+    QWORD       qwWaits = 0;
+    PIPE_BATCH* pBatch;
+    do
+    {
+        qwWaits += queSimulated.Pop (pBatch);
+        auto tStart = CLOCK::now ( );
+
+        for (size_t i = 0; i < pBatch->nCount; i++)
+        {
+            DWORD_PTR dwIndex = pBatch->rgIndex[i];
+            if ( dwIndex >= req::g_4WAY_CACHE_SETS )
+                continue;
+
+            if ( pBatch->rgHit[i] )
+                m_rgSetHits[dwIndex]++;
+            else
+                m_rgSetMisses[dwIndex]++;
+            m_rgSetHits[dwIndex] += pBatch->vecRecords[i].dwRepeat;
+        }
+        m_qwBatches++;
+        bFailed = bFailed || pBatch->bFailed;
+
+        dBusy += std::chrono::duration<double> (CLOCK::now ( ) - tStart).count ( );
+        queFree.Push (pBatch);
+    } while ( !pBatch->bLast );
+
+    Publish (PIPE_STAGE_STATS, dBusy, qwWaits);
+
+    threadRead.join ( );
+    threadDecode.join ( );
+    threadSimulate.join ( );
+
+    for (size_t i = 0; i < req::g_4WAY_CACHE_SETS; i++)
+    {
+        m_qwCacheHits   += m_rgSetHits[i];
+        m_qwCacheMisses += m_rgSetMisses[i];
+    }
+
+    return !bFailed;
+}
+
+std::ostream& CPipelinedSimulator::Report (std::ostream& os) const
+{
+    os << std::dec << std::setfill (' ');
+    os << "Pipelined replay" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    os << "Set          Hits       Misses" << std::endl;
+    for (size_t i = 0; i < req::g_4WAY_CACHE_SETS; i++)
+    {
+        os << std::setw(3)  << i << " "
+           << std::setw(12) << m_rgSetHits[i]   << " "
+           << std::setw(12) << m_rgSetMisses[i] << std::endl;
+    }
+    os << "Cache Misses:      " << m_qwCacheMisses << std::endl;
+    os << "Cache Hits:        " << m_qwCacheHits   << std::endl;
+    os << "Batches:           " << m_qwBatches     << std::endl;
+    os << std::endl;
+
+    os << "Stage        Busy (s)   Input waits" << std::endl;
+    os << std::fixed << std::setprecision(4);
+    for (size_t i = 0; i < PIPE_STAGE_COUNT; i++)
+    {
+        os << std::left  << std::setw(11) << g_szStageNames[i] << std::right
+           << std::setw(10) << m_rgBusy[i] << " "
+           << std::setw(13) << m_rgWaits[i] << std::endl;
+    }
+    os.unsetf (std::ios::floatfield);
+
+    return os;
+}
@@ -0,0 +1,102 @@
+/**
+ *  @file       PipelinedSimulator.h
+ *  @brief      CPipelinedSimulator class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_PIPELINED_SIMULATOR_H__)
+#define _PIPELINED_SIMULATOR_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+/// trace records carried by one batch
+constexpr size_t g_PIPE_BATCH_RECORDS = 16 * 1024;
+/// batches in flight, the capacity of every queue between two stages
+constexpr size_t g_PIPE_BATCHES       = 8;
+
+/**
+ *  Pipeline stages, in the order a batch passes through them
+ */
+enum PIPE_STAGE
+{
+    PIPE_STAGE_READ,            ///< reads trace records from the file
+    PIPE_STAGE_DECODE,          ///< decodes the set index and tag of every record
+    PIPE_STAGE_SIMULATE,        ///< replays the decoded accesses through the cache sets
+    PIPE_STAGE_STATS,           ///< aggregates the outcomes and recycles the batch
+    PIPE_STAGE_COUNT
+};
+
+/**
+ *  Replays an address trace through the 4-way set associative cache (FIFO)
+ *  in a pipeline of four threads, one per PIPE_STAGE, so that reading and
+ *  decoding the trace and aggregating the results overlap with the
+ *  simulation itself.
+ *
+ *  The stages are connected by bounded lock-free single producer / single
+ *  consumer queues (CSpscQueue) passing pointers to g_PIPE_BATCHES
+ *  preallocated batches.  The statistics stage hands every batch it has
+ *  finished with back to the reader, so no buffer is allocated once the
+ *  pipeline is running, and a slow stage stalls the ones before it instead
+ *  of letting memory grow.
+ *
+ *  The time each stage spends working and waiting for input shows which
+ *  one limits the throughput.
+ */
+class CPipelinedSimulator
+{
+    QWORD   m_qwCacheHits;
+    QWORD   m_qwCacheMisses;
+    QWORD   m_qwBatches;
+    QWORD   m_rgSetHits[req::g_4WAY_CACHE_SETS];
+    QWORD   m_rgSetMisses[req::g_4WAY_CACHE_SETS];
+    double  m_rgBusy[PIPE_STAGE_COUNT];     ///< seconds spent working, per stage
+    QWORD   m_rgWaits[PIPE_STAGE_COUNT];    ///< times a stage found its input empty
+
+public:
+/**
+ *  Default Constructor
+ */
+    CPipelinedSimulator ( ) noexcept;
+
+/**
+    Replays a trace
+
+    @param [in] szTrace         trace written by CCacheTraceWriter
+
+    @retval true      on success
+    @retval false     if the trace cannot be read or holds an address wider
+                      than a pointer
+ */
+    bool Run (const TCHAR* szTrace);
+
+    constexpr QWORD get_CacheHits   (void) const noexcept
+    { return m_qwCacheHits; };
+
+    constexpr QWORD get_CacheMisses (void) const noexcept
+    { return m_qwCacheMisses; };
+
+/**
+    Writes the outcome of the replay per set, and the work and input waits
+    of every stage
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os) const;
+
+private:
+
+    void Clear (void) noexcept;
+
+    CPipelinedSimulator (const CPipelinedSimulator& rhs) = delete;
+    CPipelinedSimulator& operator = (const CPipelinedSimulator& rhs) = delete;
+};
+
+#endif
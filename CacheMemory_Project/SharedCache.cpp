@@ -0,0 +1,365 @@
+/**
+ *  @file       SharedCache.cpp
+ *  @brief      CSharedCache class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <memory.h>
+#include <limits.h>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "VirtualAddress.h"
+#include "SharedCache.h"
+
+/// trace records buffered per tenant
+constexpr size_t g_TENANT_BUFFER_RECORDS = 4096;
+
+/// bit position of the tenant (address space) id within a Tag
+constexpr size_t g_TENANT_TAG_SHIFT = sizeof(DWORD_PTR) * CHAR_BIT - 4;
+
+constexpr size_t g_SHARED_WAYS = req::g_4WAY_BLOCKS_PER_SET;
+
+CSharedCache::CSharedCache ( )
+    : m_vecTenants ( ),
+      m_ePolicy    (PARTITION_NONE)
+{
+};
+
+int CSharedCache::AddTenant (const TCHAR* szTrace, DWORD dwRate /* = 1 */,
+                             DWORD dwWayMask /* = g_ALL_WAYS */)
+{
+    if ( (dwRate == 0) || (m_vecTenants.size() >= g_MAX_TENANTS) )
+        return -1;
+
+    std::unique_ptr<CTenant> pTenant (new CTenant ( ));
+    if ( !pTenant->trace.Open (szTrace) )
+        return -1;
+
+    pTenant->dwRate    = dwRate;
+    pTenant->dwWayMask = (dwWayMask & g_ALL_WAYS) ? (dwWayMask & g_ALL_WAYS) : g_ALL_WAYS;
+
+    m_vecTenants.push_back (std::move (pTenant));
+    return static_cast<int>(m_vecTenants.size() - 1);
+}
+
+bool CSharedCache::set_WayMask (int iTenant, DWORD dwWayMask) noexcept
+{
+    if ( (iTenant < 0) || (static_cast<size_t>(iTenant) >= m_vecTenants.size()) ||
+         ((dwWayMask & g_ALL_WAYS) == 0) )
+        return false;
+
+    m_vecTenants[iTenant]->dwWayMask = dwWayMask & g_ALL_WAYS;
+    return true;
+}
+
+bool CSharedCache::NextRecord (CTenant& tenant, TRACE_RECORD& record)
+{
+    // accesses folded into a record are only certain to hit while the set
+    // has no other user, so every one of them is replayed here
+    if ( tenant.dwRepeatLeft > 0 )
+    {
+        tenant.dwRepeatLeft--;
+        record = tenant.vecRecords[tenant.nBuffered - 1];
+        return true;
+    }
+
+    if ( tenant.nBuffered >= tenant.vecRecords.size() )
+    {
+        QWORD qwRemaining = tenant.trace.get_Records ( ) - tenant.qwNext;
+        if ( qwRemaining == 0 )
+            return false;
+
+        size_t nCount = static_cast<size_t>(std::min<QWORD> (g_TENANT_BUFFER_RECORDS, qwRemaining));
+        if ( !tenant.trace.Read (tenant.qwNext, nCount, tenant.vecRecords) )
+        {
+            FailTenant (tenant);
+            return false;
+        }
+        tenant.qwNext   += nCount;
+        tenant.nBuffered = 0;
+    }
+
+    record = tenant.vecRecords[tenant.nBuffered++];
+    tenant.dwRepeatLeft = record.dwRepeat;
+    return true;
+}
+
+void CSharedCache::FailTenant (CTenant& tenant) noexcept
+{
+    // treat the trace as ended, Simulate reports the failure
+    tenant.qwNext       = tenant.trace.get_Records ( );
+    tenant.vecRecords.clear ( );
+    tenant.nBuffered    = 0;
+    tenant.dwRepeatLeft = 0;
+    tenant.bFailed      = true;
+}
+
+void CSharedCache::AccessShadow (CTenant& tenant, DWORD_PTR dwIndex, DWORD_PTR dwTag) noexcept
+{
+    DWORD_PTR* rgStack = tenant.rgShadow[dwIndex];
+    size_t&    nDepth  = tenant.rgShadowDepth[dwIndex];
+
+    size_t nPosition = 0;
+    while ( (nPosition < nDepth) && (rgStack[nPosition] != dwTag) )
+        nPosition++;
+
+    if ( nPosition < nDepth )
+        tenant.rgStackHits[nPosition]++;   // a hit with nPosition + 1 or more ways
+    else if ( nDepth < g_SHARED_WAYS )
+        nPosition = nDepth++;
+    else
+        nPosition = g_SHARED_WAYS - 1;     // the LRU entry falls off the stack
+
+    // move to the MRU position
+    memmove (&rgStack[1], &rgStack[0], nPosition * sizeof(DWORD_PTR));
+    rgStack[0] = dwTag;
+}
+
+/**
+    @note Lookahead allocation: every tenant starts with one way, then the
+    remaining ways go, a few at a time, to the tenant whose shadow tags
+    promise the most extra hits per extra way.  Looking ahead over several
+    ways at once lets a tenant whose utility only rises after a couple of
+    ways (e.g. a loop slightly larger than one way) win them.
+*/
+void CSharedCache::Repartition (void)
+{
+    const size_t nTenants = m_vecTenants.size();
+
+    size_t rgAlloc[g_MAX_TENANTS];
+    for (size_t i = 0; i < nTenants; i++)
+        rgAlloc[i] = 1;
+
+    size_t nBalance     = g_SHARED_WAYS - nTenants;
+    size_t nRoundRobin  = 0;
+    while ( nBalance > 0 )
+    {
+        double dBestUtility = 0.0;
+        size_t nBestTenant  = 0;
+        size_t nBestWays    = 0;
+
+        for (size_t i = 0; i < nTenants; i++)
+        {
+            QWORD qwGain = 0;
+            for (size_t k = 1; (k <= nBalance) && (rgAlloc[i] + k <= g_SHARED_WAYS); k++)
+            {
+                qwGain += m_vecTenants[i]->rgStackHits[rgAlloc[i] + k - 1];
+                double dUtility = static_cast<double>(qwGain) / k;
+                if ( dUtility > dBestUtility )
+                {
+                    dBestUtility = dUtility;
+                    nBestTenant  = i;
+                    nBestWays    = k;
+                }
+            }
+        }
+
+        if ( nBestWays == 0 )
+        {   // no tenant gains anything, share the rest evenly
+            nBestTenant = nRoundRobin++ % nTenants;
+            nBestWays   = 1;
+        }
+
+        rgAlloc[nBestTenant] += nBestWays;
+        nBalance             -= nBestWays;
+    }
+
+    // contiguous masks, as CAT requires
+    size_t nFirstWay = 0;
+    for (size_t i = 0; i < nTenants; i++)
+    {
+        CTenant& tenant = *m_vecTenants[i];
+        tenant.dwWayMask = ((1u << rgAlloc[i]) - 1) << nFirstWay;
+        nFirstWay += rgAlloc[i];
+
+        // age the utility counters
+        for (auto& it : tenant.rgStackHits)
+            it >>= 1;
+    }
+}
+
+/**
+    @param [in] iAlone          tenant to replay alone through the whole
+                                cache, or -1 to replay all tenants together
+*/
+bool CSharedCache::Simulate (int iAlone)
+{
+    for (auto& it : m_vecTenants)
+    {
+        CTenant& tenant = *it;
+        tenant.qwNext       = 0;
+        tenant.nBuffered    = 0;
+        tenant.dwRepeatLeft = 0;
+        tenant.qwOccupancy  = 0;
+        tenant.bFailed      = false;
+        tenant.vecRecords.clear ( );
+        memset (tenant.rgShadowDepth, 0, sizeof(tenant.rgShadowDepth));
+        memset (tenant.rgStackHits,   0, sizeof(tenant.rgStackHits));
+
+        if ( iAlone < 0 )
+        {
+            QWORD qwAloneMisses = tenant.stats.qwAloneMisses;
+            memset (&tenant.stats, 0, sizeof(tenant.stats));
+            tenant.stats.qwAloneMisses = qwAloneMisses;
+        }
+        else if ( it == m_vecTenants[iAlone] )
+            tenant.stats.qwAloneMisses = 0;
+    }
+
+    CCacheSet rgCacheSets[req::g_4WAY_CACHE_SETS];
+    for (auto& it : rgCacheSets)
+        it.Init ( );
+
+    int rgOwner[req::g_4WAY_CACHE_SETS][g_SHARED_WAYS];
+    for (auto& it : rgOwner)
+        std::fill (std::begin(it), std::end(it), -1);
+
+    const PARTITION_POLICY ePolicy = (iAlone < 0) ? m_ePolicy : PARTITION_NONE;
+    if ( ePolicy == PARTITION_UCP )
+        Repartition ( );
+
+    QWORD qwAccesses = 0;
+    bool  bActive    = true;
+    while ( bActive )
+    {
+        bActive = false;
+        for (size_t t = 0; t < m_vecTenants.size(); t++)
+        {
+            if ( (iAlone >= 0) && (static_cast<size_t>(iAlone) != t) )
+                continue;
+
+            CTenant& tenant = *m_vecTenants[t];
+            DWORD    dwMask = (ePolicy == PARTITION_NONE) ? g_ALL_WAYS : tenant.dwWayMask;
+
+            TRACE_RECORD record;
+            for (DWORD r = 0; (r < tenant.dwRate) && NextRecord (tenant, record); r++)
+            {
+                bActive = true;
+
+                const void* pAddress;
+                if ( !CVirtualAddress::FromTraceAddress (record.qwAddress, pAddress) )
+                {
+                    FailTenant (tenant);
+                    break;
+                }
+
+                CVirtualAddress vAddress (pAddress);
+                DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+                if ( dwIndex >= _countof(rgCacheSets) )
+                    continue;
+
+                DWORD_PTR dwTag = vAddress.DecodeTag ( );
+                DWORD_PTR dwAsidTag = dwTag | (static_cast<DWORD_PTR>(t) << g_TENANT_TAG_SHIFT);
+
+                bool bHit = rgCacheSets[dwIndex].AccessCacheTag (dwAsidTag);
+                if ( !bHit )
+                {
+                    size_t nWay;
+                    if ( rgCacheSets[dwIndex].LoadCacheTagInWays (dwAsidTag, dwMask, nullptr, &nWay) )
+                    {
+                        int& iOwner = rgOwner[dwIndex][nWay];
+                        if ( iOwner >= 0 )
+                            m_vecTenants[iOwner]->qwOccupancy--;
+                        iOwner = static_cast<int>(t);
+                        tenant.qwOccupancy++;
+                    }
+                }
+
+                if ( iAlone >= 0 )
+                {
+                    if ( !bHit )
+                        tenant.stats.qwAloneMisses++;
+                    continue;
+                }
+
+                tenant.stats.qwAccesses++;
+                if ( bHit )
+                    tenant.stats.qwHits++;
+                else
+                    tenant.stats.qwMisses++;
+
+                for (auto& it : m_vecTenants)
+                    it->stats.qwOccupancySum += it->qwOccupancy;
+
+                if ( ePolicy == PARTITION_UCP )
+                {
+                    AccessShadow (tenant, dwIndex, dwTag);
+                    if ( (++qwAccesses % g_UCP_EPOCH) == 0 )
+                        Repartition ( );
+                }
+            }
+        }
+    }
+
+    bool bReturn = true;
+    for (auto& it : m_vecTenants)
+    {
+        if ( it->bFailed )
+            bReturn = false;
+        if ( iAlone < 0 )
+            it->stats.dwWayMask = (ePolicy == PARTITION_NONE) ? g_ALL_WAYS : it->dwWayMask;
+    }
+    return bReturn;
+}
+
+bool CSharedCache::Run (void)
+{
+    if ( m_vecTenants.empty() )
+        return false;
+
+    for (size_t i = 0; i < m_vecTenants.size(); i++)
+    {
+        if ( !Simulate (static_cast<int>(i)) )
+            return false;
+    }
+    return Simulate (-1);
+}
+
+std::ostream& CSharedCache::Report (std::ostream& os) const
+{
+    static const char* rgPolicy[] = { "none (shared)", "static way masks", "UCP" };
+
+    QWORD qwAccesses = 0;
+    QWORD qwHits     = 0;
+    for (const auto& it : m_vecTenants)
+    {
+        qwAccesses += it->stats.qwAccesses;
+        qwHits     += it->stats.qwHits;
+    }
+
+    os << std::dec << std::setfill (' ');
+    os << "Shared cache, partitioning: " << rgPolicy[m_ePolicy] << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    os << std::setw(6)  << "Tenant" << std::setw(10) << "Accesses"
+       << std::setw(9)  << "Misses"   << std::setw(9)  << "Miss%"
+       << std::setw(9)  << "Alone%"   << std::setw(10) << "Slowdown"
+       << std::setw(10) << "Occupancy" << std::setw(6) << "Ways" << std::endl;
+
+    os << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < m_vecTenants.size(); i++)
+    {
+        const TENANT_STATS& stats = m_vecTenants[i]->stats;
+        double dMissRate  = stats.qwAccesses ? 100.0 * stats.qwMisses      / stats.qwAccesses : 0.0;
+        double dAloneRate = stats.qwAccesses ? 100.0 * stats.qwAloneMisses / stats.qwAccesses : 0.0;
+        double dSlowdown  = stats.qwAloneMisses ? static_cast<double>(stats.qwMisses) / stats.qwAloneMisses : 0.0;
+        double dOccupancy = qwAccesses ? static_cast<double>(stats.qwOccupancySum) / qwAccesses : 0.0;
+
+        os << std::setw(6)  << i << std::setw(10) << stats.qwAccesses
+           << std::setw(9)  << stats.qwMisses << std::setw(9) << dMissRate
+           << std::setw(9)  << dAloneRate     << std::setw(10) << dSlowdown
+           << std::setw(10) << dOccupancy     << "  0x" << std::hex << stats.dwWayMask
+           << std::dec << std::endl;
+    }
+
+    os << "Combined hit rate: " << (qwAccesses ? 100.0 * qwHits / qwAccesses : 0.0) << "%" << std::endl;
+    os << "(Slowdown = misses shared / misses alone, Occupancy = average blocks owned)" << std::endl;
+    os.unsetf (std::ios::floatfield);
+
+    return os;
+}
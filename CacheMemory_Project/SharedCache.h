@@ -0,0 +1,183 @@
+/**
+ *  @file       SharedCache.h
+ *  @brief      CSharedCache class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_SHARED_CACHE_H__)
+#define _SHARED_CACHE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _MEMORY_
+    #include <memory>
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+#if !defined(_CACHE_SET_H__)
+    #include "CacheSet.h"
+#endif
+
+#if !defined(_CACHE_TRACE_H__)
+    #include "CacheTrace.h"
+#endif
+
+/// at most one tenant per way, so that every tenant can own a way
+constexpr size_t g_MAX_TENANTS   = req::g_4WAY_BLOCKS_PER_SET;
+/// way mask allowing every way
+constexpr DWORD  g_ALL_WAYS      = (1u << req::g_4WAY_BLOCKS_PER_SET) - 1;
+/// accesses between two utility-based repartitionings
+constexpr QWORD  g_UCP_EPOCH     = 4096;
+
+/**
+ *  How the ways of the shared cache are divided among tenants
+ */
+enum PARTITION_POLICY
+{
+    PARTITION_NONE,     ///< fully shared, every tenant may replace any way
+    PARTITION_STATIC,   ///< fixed way masks (CAT-style), see set_WayMask
+    PARTITION_UCP       ///< Utility-based Cache Partitioning from shadow tags
+};
+
+/**
+ *  Per tenant statistics of a shared cache run
+ */
+struct TENANT_STATS
+{
+    QWORD   qwAccesses;
+    QWORD   qwHits;
+    QWORD   qwMisses;
+    QWORD   qwAloneMisses;      ///< misses running alone in the whole cache
+    QWORD   qwOccupancySum;     ///< blocks owned, summed over every access
+    DWORD   dwWayMask;          ///< way mask at the end of the run
+};
+
+/**
+ *  A cache shared by several co-running workloads (tenants), each replaying
+ *  its own address trace.  The traces are interleaved round-robin, tenant
+ *  n issuing up to its rate of accesses per round, until every trace ends.
+ *
+ *  Tenants are kept apart by an address space id in the top bits of the
+ *  Tag, so identical addresses of two tenants never share a block.  Every
+ *  block is owned by the tenant that filled it, which gives the occupancy
+ *  of each tenant.
+ *
+ *  Partitioning only restricts where a tenant's fills go; a tenant still
+ *  hits on any block it owns.  Under PARTITION_UCP every tenant has shadow
+ *  tags, an LRU stack per set as deep as the cache is associative, that
+ *  count how many hits the tenant would get with 1..n ways of its own.
+ *  Every g_UCP_EPOCH accesses the ways are redistributed with the
+ *  lookahead algorithm of Qureshi & Patt (MICRO 2006), each tenant keeping
+ *  at least one way, and the counters are halved.
+ *
+ *  Every tenant is also replayed alone through the whole cache, so the
+ *  report shows the price each one pays for sharing (isolation) next to
+ *  the combined hit rate (throughput).
+ */
+class CSharedCache
+{
+    struct CTenant
+    {
+        CCacheTraceReader           trace;
+        QWORD                       qwNext;         ///< next record to issue
+        std::vector<TRACE_RECORD>   vecRecords;     ///< buffered records
+        size_t                      nBuffered;      ///< next buffered record
+        DWORD                       dwRepeatLeft;   ///< repeats of the last record still to issue
+        DWORD                       dwRate;         ///< accesses per round
+        DWORD                       dwWayMask;
+        TENANT_STATS                stats;
+        QWORD                       qwOccupancy;    ///< blocks currently owned
+        bool                        bFailed;        ///< the trace could not be read or
+                                                    ///< holds an address wider than a pointer
+
+        DWORD_PTR                   rgShadow[req::g_4WAY_CACHE_SETS][req::g_4WAY_BLOCKS_PER_SET];
+        size_t                      rgShadowDepth[req::g_4WAY_CACHE_SETS];
+        QWORD                       rgStackHits[req::g_4WAY_BLOCKS_PER_SET]; ///< hits per LRU position
+    };
+
+    std::vector<std::unique_ptr<CTenant>>   m_vecTenants;
+    PARTITION_POLICY                        m_ePolicy;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CSharedCache ( );
+
+/**
+    Adds a tenant replaying a trace
+
+    @param [in] szTrace         trace written by CCacheTraceWriter
+    @param [in] dwRate          accesses issued per round-robin turn (> 0)
+    @param [in] dwWayMask       ways the tenant may fill under PARTITION_STATIC
+
+    @retval tenant id (>= 0)    on success
+    @retval -1                  if the trace cannot be opened, the rate is zero
+                                or there are already g_MAX_TENANTS tenants
+ */
+    int  AddTenant (const TCHAR* szTrace, DWORD dwRate = 1, DWORD dwWayMask = g_ALL_WAYS);
+
+/**
+    Sets the way mask of a tenant, used under PARTITION_STATIC
+
+    @param [in] iTenant         tenant id returned by AddTenant
+    @param [in] dwWayMask       bit n set if the tenant may fill way n
+
+    @retval true      on success
+    @retval false     if the tenant does not exist or the mask is empty
+ */
+    bool set_WayMask (int iTenant, DWORD dwWayMask) noexcept;
+
+    void set_Policy (PARTITION_POLICY ePolicy) noexcept
+    { m_ePolicy = ePolicy; };
+
+/**
+    Replays every tenant alone, then all of them together
+
+    @retval true      on success
+    @retval false     if there are no tenants, or a trace cannot be read or
+                      holds an address wider than a pointer
+ */
+    bool Run (void);
+
+/**
+    Returns the statistics of a tenant after Run
+ */
+    const TENANT_STATS& get_Stats (int iTenant) const
+    { return m_vecTenants[iTenant]->stats; };
+
+    size_t get_Tenants (void) const noexcept
+    { return m_vecTenants.size(); };
+
+/**
+    Writes per tenant hits, misses, occupancy, way masks and the slowdown
+    in misses relative to running alone
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os) const;
+
+private:
+
+    bool Simulate (int iAlone);
+    bool NextRecord (CTenant& tenant, TRACE_RECORD& record);
+    void FailTenant (CTenant& tenant) noexcept;
+    void AccessShadow (CTenant& tenant, DWORD_PTR dwIndex, DWORD_PTR dwTag) noexcept;
+    void Repartition (void);
+
+    CSharedCache (const CSharedCache& rhs) = delete;
+    CSharedCache& operator = (const CSharedCache& rhs) = delete;
+};
+
+#endif
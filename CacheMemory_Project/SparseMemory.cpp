@@ -0,0 +1,257 @@
+/**
+ *  @file       SparseMemory.cpp
+ *  @brief      CSparseMemory class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <memory.h>
+#include <algorithm>
+#include <fstream>
+
+#include "SparseMemory.h"
+
+/// page tables allocated from the system at a time
+constexpr size_t g_SPARSE_POOL_TABLES = 16;
+/// bits of an address below the page number
+constexpr DWORD  g_SPARSE_PAGE_BITS   = 12;
+
+static_assert ( (static_cast<size_t>(1) << g_SPARSE_PAGE_BITS) == g_SPARSE_PAGE_SIZE,
+                "g_SPARSE_PAGE_BITS does not match g_SPARSE_PAGE_SIZE" );
+static_assert ( g_SPARSE_PAGE_BITS + g_SPARSE_LEVELS * g_SPARSE_LEVEL_BITS >= 64,
+                "the sparse page table does not cover a 64 bit address" );
+
+CSparseMemory::CSparseMemory ( )
+    : m_pRoot        (nullptr),
+      m_vecPagePool  ( ),
+      m_vecTablePool ( ),
+      m_nPagesFree   (0),
+      m_nTablesFree  (0),
+      m_qwPages      (0),
+      m_qwTables     (0),
+      m_qwLastPage   (0),
+      m_pLastPage    (nullptr)
+{
+    Init ( );
+};
+
+void CSparseMemory::Init (void)
+{
+    m_vecPagePool.clear ( );
+    m_vecTablePool.clear ( );
+    m_nPagesFree  = 0;
+    m_nTablesFree = 0;
+    m_qwPages     = 0;
+    m_qwTables    = 0;
+    m_pLastPage   = nullptr;
+
+    m_pRoot = AllocateTable ( );
+}
+
+QWORD CSparseMemory::get_Bytes (void) const noexcept
+{
+    return m_vecPagePool.size()  * g_SPARSE_POOL_PAGES  * g_SPARSE_PAGE_SIZE +
+           m_vecTablePool.size() * g_SPARSE_POOL_TABLES * sizeof(CTable);
+}
+
+BYTE* CSparseMemory::AllocatePage (void)
+{
+    if ( m_nPagesFree == 0 )
+    {   // value initialized, so fresh pages read as zero
+        m_vecPagePool.emplace_back (new BYTE[g_SPARSE_POOL_PAGES * g_SPARSE_PAGE_SIZE]());
+        m_nPagesFree = g_SPARSE_POOL_PAGES;
+    }
+    m_qwPages++;
+    return m_vecPagePool.back().get() + (g_SPARSE_POOL_PAGES - m_nPagesFree--) * g_SPARSE_PAGE_SIZE;
+}
+
+CSparseMemory::CTable* CSparseMemory::AllocateTable (void)
+{
+    if ( m_nTablesFree == 0 )
+    {
+        m_vecTablePool.emplace_back (new CTable[g_SPARSE_POOL_TABLES]());
+        m_nTablesFree = g_SPARSE_POOL_TABLES;
+    }
+    m_qwTables++;
+    return m_vecTablePool.back().get() + (g_SPARSE_POOL_TABLES - m_nTablesFree--);
+}
+
+/**
+    @param [in] qwPage          page number, the address shifted right by
+                                g_SPARSE_PAGE_BITS
+    @param [in] bCreate         allocate the page and its tables if missing
+
+    @retval the page, nullptr if it is missing and bCreate is false
+*/
+BYTE* CSparseMemory::FindPage (QWORD qwPage, bool bCreate)
+{
+    if ( m_pLastPage && (m_qwLastPage == qwPage) )
+        return m_pLastPage;
+
+    constexpr QWORD qwLevelMask = (static_cast<QWORD>(1) << g_SPARSE_LEVEL_BITS) - 1;
+
+    CTable* pTable = m_pRoot;
+    for (DWORD dwLevel = g_SPARSE_LEVELS; dwLevel-- > 1; )
+    {
+        void*& pEntry = pTable->rgEntry[(qwPage >> (dwLevel * g_SPARSE_LEVEL_BITS)) & qwLevelMask];
+        if ( pEntry == nullptr )
+        {
+            if ( !bCreate )
+                return nullptr;
+            pEntry = AllocateTable ( );
+        }
+        pTable = static_cast<CTable*>(pEntry);
+    }
+
+    void*& pEntry = pTable->rgEntry[qwPage & qwLevelMask];
+    if ( pEntry == nullptr )
+    {
+        if ( !bCreate )
+            return nullptr;
+        pEntry = AllocatePage ( );
+    }
+
+    m_qwLastPage = qwPage;
+    m_pLastPage  = static_cast<BYTE*>(pEntry);
+    return m_pLastPage;
+}
+
+bool CSparseMemory::Read (QWORD qwAddress, void* pBuffer, size_t cbLen)
+{
+    if ( pBuffer == nullptr )
+        return false;
+
+    BYTE* pOut = static_cast<BYTE*>(pBuffer);
+    while ( cbLen > 0 )
+    {
+        size_t cbOffset = static_cast<size_t>(qwAddress & (g_SPARSE_PAGE_SIZE - 1));
+        size_t cbChunk  = std::min (cbLen, g_SPARSE_PAGE_SIZE - cbOffset);
+
+        // memory never written reads as zero, without allocating anything
+        const BYTE* pPage = FindPage (qwAddress >> g_SPARSE_PAGE_BITS, false);
+        if ( pPage )
+            memcpy (pOut, pPage + cbOffset, cbChunk);
+        else
+            memset (pOut, 0, cbChunk);
+
+        pOut      += cbChunk;
+        qwAddress += cbChunk;
+        cbLen     -= cbChunk;
+    }
+    return true;
+}
+
+bool CSparseMemory::Write (QWORD qwAddress, const void* pData, size_t cbLen)
+{
+    if ( pData == nullptr )
+        return false;
+
+    const BYTE* pIn = static_cast<const BYTE*>(pData);
+    while ( cbLen > 0 )
+    {
+        size_t cbOffset = static_cast<size_t>(qwAddress & (g_SPARSE_PAGE_SIZE - 1));
+        size_t cbChunk  = std::min (cbLen, g_SPARSE_PAGE_SIZE - cbOffset);
+
+        memcpy (FindPage (qwAddress >> g_SPARSE_PAGE_BITS, true) + cbOffset, pIn, cbChunk);
+
+        pIn       += cbChunk;
+        qwAddress += cbChunk;
+        cbLen     -= cbChunk;
+    }
+    return true;
+}
+
+bool CSparseMemory::LoadImage (const TCHAR* szFileName, QWORD qwBase)
+{
+    if ( szFileName == nullptr )
+        return false;
+
+    std::ifstream ifs (szFileName, std::ios::in | std::ios::binary);
+    if ( !ifs.is_open() )
+        return false;
+
+    std::vector<char> vecBuffer (g_SPARSE_PAGE_SIZE);
+    while ( ifs.read (vecBuffer.data(), vecBuffer.size()) || (ifs.gcount() > 0) )
+    {
+        size_t cbRead = static_cast<size_t>(ifs.gcount());
+        Write (qwBase, vecBuffer.data(), cbRead);
+        qwBase += cbRead;
+    }
+    return ifs.eof();
+}
+
+bool CSparseMemory::LoadSnapshot (const TCHAR* szFileName)
+{
+    if ( szFileName == nullptr )
+        return false;
+
+    std::ifstream ifs (szFileName, std::ios::in | std::ios::binary);
+    if ( !ifs.is_open() )
+        return false;
+
+    SPARSE_SNAPSHOT_HEADER hdr;
+    ifs.read (reinterpret_cast<char*>(&hdr), sizeof(hdr));
+    if ( ifs.fail() || (hdr.dwMagic != g_SPARSE_MAGIC) || (hdr.dwVersion != g_SPARSE_VERSION) ||
+         (hdr.cbHeader != sizeof(SPARSE_SNAPSHOT_HEADER)) || (hdr.cbPage != g_SPARSE_PAGE_SIZE) )
+        return false;
+
+    for (QWORD i = 0; i < hdr.qwPages; i++)
+    {
+        QWORD qwAddress;
+        ifs.read (reinterpret_cast<char*>(&qwAddress), sizeof(qwAddress));
+        if ( ifs.fail() || (qwAddress & (g_SPARSE_PAGE_SIZE - 1)) )
+            return false;
+
+        BYTE* pPage = FindPage (qwAddress >> g_SPARSE_PAGE_BITS, true);
+        ifs.read (reinterpret_cast<char*>(pPage), g_SPARSE_PAGE_SIZE);
+        if ( ifs.fail() )
+            return false;
+    }
+    return true;
+}
+
+void CSparseMemory::SavePages (std::ostream& os, const CTable* pTable, DWORD dwLevel, QWORD qwPrefix)
+{
+    for (size_t i = 0; i < _countof(pTable->rgEntry); i++)
+    {
+        const void* pEntry = pTable->rgEntry[i];
+        if ( pEntry == nullptr )
+            continue;
+
+        QWORD qwPage = (qwPrefix << g_SPARSE_LEVEL_BITS) | i;
+        if ( dwLevel > 1 )
+            SavePages (os, static_cast<const CTable*>(pEntry), dwLevel - 1, qwPage);
+        else
+        {
+            QWORD qwAddress = qwPage << g_SPARSE_PAGE_BITS;
+            os.write (reinterpret_cast<const char*>(&qwAddress), sizeof(qwAddress));
+            os.write (static_cast<const char*>(pEntry), g_SPARSE_PAGE_SIZE);
+        }
+    }
+}
+
+bool CSparseMemory::SaveSnapshot (const TCHAR* szFileName) const
+{
+    if ( szFileName == nullptr )
+        return false;
+
+    std::ofstream ofs (szFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    if ( !ofs.is_open() )
+        return false;
+
+    SPARSE_SNAPSHOT_HEADER hdr;
+    memset (&hdr, 0, sizeof(hdr));
+    hdr.dwMagic   = g_SPARSE_MAGIC;
+    hdr.dwVersion = g_SPARSE_VERSION;
+    hdr.cbHeader  = sizeof(SPARSE_SNAPSHOT_HEADER);
+    hdr.cbPage    = g_SPARSE_PAGE_SIZE;
+    hdr.qwPages   = m_qwPages;
+    ofs.write (reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+
+    SavePages (ofs, m_pRoot, g_SPARSE_LEVELS, 0);
+
+    return !ofs.fail();
+}
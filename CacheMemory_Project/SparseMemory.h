@@ -0,0 +1,177 @@
+/**
+ *  @file       SparseMemory.h
+ *  @brief      CSparseMemory class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_SPARSE_MEMORY_H__)
+#define _SPARSE_MEMORY_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+#ifndef _MEMORY_
+    #include <memory>
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+#if !defined(_BACKING_STORE_H__)
+    #include "BackingStore.h"
+#endif
+
+/// bytes per page of a sparse memory image
+constexpr size_t g_SPARSE_PAGE_SIZE     = 4096;
+/// page table index bits per level
+constexpr DWORD  g_SPARSE_LEVEL_BITS    = 9;
+/// page table levels, enough for the 52 bit page number of a 64 bit address
+constexpr DWORD  g_SPARSE_LEVELS        = 6;
+/// pages allocated from the system at a time
+constexpr size_t g_SPARSE_POOL_PAGES    = 64;
+
+/*
+    Sparse memory snapshot, written by CSparseMemory::SaveSnapshot.
+
+    | SPARSE_SNAPSHOT_HEADER | QWORD address | page | QWORD address | page | ...
+
+    Only pages that were written are stored, each preceded by its address.
+*/
+
+/// 'ACSM' - Associative Cache Sparse Memory
+constexpr DWORD g_SPARSE_MAGIC   = 0x4D534341;
+/// bumped whenever the layout of the snapshot changes
+constexpr DWORD g_SPARSE_VERSION = 1;
+
+/**
+ *  Sparse memory snapshot header
+ */
+struct SPARSE_SNAPSHOT_HEADER
+{
+    DWORD   dwMagic;            ///< g_SPARSE_MAGIC
+    DWORD   dwVersion;          ///< g_SPARSE_VERSION
+    DWORD   cbHeader;           ///< sizeof(SPARSE_SNAPSHOT_HEADER)
+    DWORD   cbPage;             ///< g_SPARSE_PAGE_SIZE
+    QWORD   qwPages;            ///< number of pages following the header
+};
+
+/**
+ *  Memory image of a 64 bit address space, allocated a page at a time as
+ *  it is written, so a trace of another program can be replayed with data
+ *  at the addresses it recorded.
+ *
+ *  Pages are found through a radix tree page table of g_SPARSE_LEVELS
+ *  levels of 512 entries, like the one an x86-64 MMU walks; a table is
+ *  created only below entries in use.  Pages and tables are carved out of
+ *  pooled allocations, and the page last used is remembered, so runs of
+ *  accesses to one page skip the walk.  Memory never written reads as
+ *  zero and costs nothing, so the memory used follows the footprint
+ *  written, not the range of addresses.
+ *
+ *  Initial contents can be loaded from a flat image of a memory range (as
+ *  a debugger writes it, e.g. gdb's "dump memory") or from a snapshot
+ *  previously saved by SaveSnapshot.
+ */
+class CSparseMemory : public IBackingStore
+{
+    /// page table, entries point to lower tables or, at the last level, to pages
+    struct CTable
+    {
+        void*   rgEntry[static_cast<size_t>(1) << g_SPARSE_LEVEL_BITS];
+    };
+
+    CTable*                                 m_pRoot;
+    std::vector<std::unique_ptr<BYTE[]>>    m_vecPagePool;
+    std::vector<std::unique_ptr<CTable[]>>  m_vecTablePool;
+    size_t                                  m_nPagesFree;   ///< pages left in the last pool allocation
+    size_t                                  m_nTablesFree;  ///< tables left in the last pool allocation
+    QWORD                                   m_qwPages;
+    QWORD                                   m_qwTables;
+
+    QWORD                                   m_qwLastPage;   ///< page number of m_pLastPage
+    BYTE*                                   m_pLastPage;
+
+public:
+/**
+ *  Default Constructor, an empty image
+ */
+    CSparseMemory ( );
+
+/**
+    Releases every page, leaving an empty image
+ */
+    void Init (void);
+
+    virtual bool Read  (QWORD qwAddress, void* pBuffer, size_t cbLen) override;
+
+    virtual bool Write (QWORD qwAddress, const void* pData, size_t cbLen) override;
+
+/**
+    Copies a file into the image
+
+    @param [in] szFileName      flat image of a memory range
+    @param [in] qwBase          address of the first byte of the file
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool LoadImage    (const TCHAR* szFileName, QWORD qwBase);
+
+/**
+    Adds the pages of a snapshot to the image
+
+    @param [in] szFileName      snapshot written by SaveSnapshot
+
+    @retval true      on success
+    @retval false     on error or a malformed snapshot
+ */
+    bool LoadSnapshot (const TCHAR* szFileName);
+
+/**
+    Writes every page in the image to a snapshot
+
+    @param [in] szFileName      name of the snapshot to create
+
+    @retval true      on success
+    @retval false     on error
+ */
+    bool SaveSnapshot (const TCHAR* szFileName) const;
+
+/**
+    Returns the number of pages allocated
+ */
+    constexpr QWORD get_Pages  (void) const noexcept
+    { return m_qwPages; };
+
+/**
+    Returns the number of page tables allocated
+ */
+    constexpr QWORD get_Tables (void) const noexcept
+    { return m_qwTables; };
+
+/**
+    Returns the bytes allocated for pages and page tables
+ */
+    QWORD get_Bytes (void) const noexcept;
+
+private:
+
+    BYTE*   FindPage     (QWORD qwPage, bool bCreate);
+    BYTE*   AllocatePage (void);
+    CTable* AllocateTable (void);
+
+    static void SavePages (std::ostream& os, const CTable* pTable, DWORD dwLevel, QWORD qwPrefix);
+
+    CSparseMemory (const CSparseMemory& rhs) = delete;
+    CSparseMemory& operator = (const CSparseMemory& rhs) = delete;
+};
+
+#endif
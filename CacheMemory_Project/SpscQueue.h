@@ -0,0 +1,129 @@
+/**
+ *  @file       SpscQueue.h
+ *  @brief      CSpscQueue class template interface and implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_SPSC_QUEUE_H__)
+#define _SPSC_QUEUE_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _ATOMIC_
+    #include <atomic>
+#endif
+
+#ifndef _THREAD_
+    #include <thread>
+#endif
+
+/**
+ *  Bounded, lock-free queue between exactly one producer thread and one
+ *  consumer thread.
+ *
+ *  The slots form a ring of nCapacity entries indexed by two ever-growing
+ *  counters: the producer alone writes m_nTail, the consumer alone writes
+ *  m_nHead, and each only reads the other's counter.  The counters live on
+ *  host cache lines of their own so the two threads do not false share.
+ *
+ *  Intended for passing pointers to preallocated buffers between pipeline
+ *  stages; the queue itself never allocates.
+ */
+template <typename T, size_t nCapacity>
+class CSpscQueue
+{
+    static_assert ( (nCapacity > 0) && ((nCapacity & (nCapacity - 1)) == 0),
+                    "CSpscQueue capacity must be a power of 2" );
+
+    alignas(g_HOST_CACHE_LINE_SIZE) std::atomic<size_t> m_nHead;   ///< next slot to pop
+    alignas(g_HOST_CACHE_LINE_SIZE) std::atomic<size_t> m_nTail;   ///< next slot to push
+    alignas(g_HOST_CACHE_LINE_SIZE) T                   m_rgSlots[nCapacity];
+
+public:
+/**
+ *  Default Constructor
+ */
+    CSpscQueue ( ) noexcept
+        : m_nHead (0),
+          m_nTail (0)
+    { };
+
+/**
+    Appends an item, producer thread only
+
+    @param [in] item            item to append
+
+    @retval true      on success
+    @retval false     if the queue is full
+ */
+    bool TryPush (const T& item) noexcept
+    {
+        size_t nTail = m_nTail.load (std::memory_order_relaxed);
+        if ( nTail - m_nHead.load (std::memory_order_acquire) == nCapacity )
+            return false;
+
+        m_rgSlots[nTail & (nCapacity - 1)] = item;
+        m_nTail.store (nTail + 1, std::memory_order_release);
+        return true;
+    };
+
+/**
+    Removes the oldest item, consumer thread only
+
+    @param [out] item           item removed
+
+    @retval true      on success
+    @retval false     if the queue is empty
+ */
+    bool TryPop (T& item) noexcept
+    {
+        size_t nHead = m_nHead.load (std::memory_order_relaxed);
+        if ( nHead == m_nTail.load (std::memory_order_acquire) )
+            return false;
+
+        item = m_rgSlots[nHead & (nCapacity - 1)];
+        m_nHead.store (nHead + 1, std::memory_order_release);
+        return true;
+    };
+
+/**
+    Appends an item, yielding the processor while the queue is full
+
+    @param [in] item            item to append
+
+    @retval number of times the caller had to wait
+ */
+    size_t Push (const T& item) noexcept
+    {
+        size_t nWaits = 0;
+        for ( ; !TryPush (item); nWaits++)
+            std::this_thread::yield ( );
+        return nWaits;
+    };
+
+/**
+    Removes the oldest item, yielding the processor while the queue is empty
+
+    @param [out] item           item removed
+
+    @retval number of times the caller had to wait
+ */
+    size_t Pop (T& item) noexcept
+    {
+        size_t nWaits = 0;
+        for ( ; !TryPop (item); nWaits++)
+            std::this_thread::yield ( );
+        return nWaits;
+    };
+
+private:
+
+    CSpscQueue (const CSpscQueue& rhs) = delete;
+    CSpscQueue& operator = (const CSpscQueue& rhs) = delete;
+};
+
+#endif
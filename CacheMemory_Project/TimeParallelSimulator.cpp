@@ -0,0 +1,292 @@
+/**
+ *  @file       TimeParallelSimulator.cpp
+ *  @brief      CTimeParallelSimulator class implementation
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <memory.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+#include "VirtualAddress.h"
+#include "CacheCheckpoint.h"
+#include "CacheTrace.h"
+#include "TimeParallelSimulator.h"
+
+/**
+ *  A run of consecutive trace records and its speculative replay
+ */
+struct TP_CHUNK
+{
+    QWORD           qwFirst;
+    QWORD           qwCount;
+    QWORD           qwDecoded;      ///< records that map to a set
+    QWORD           qwMisses;       ///< misses replayed from an empty cache
+    QWORD           qwRepeats;      ///< hits folded into the records that map to a set
+    bool            bRead;          ///< the records were read successfully
+    CACHE_SET_STATE rgFinal[req::g_4WAY_CACHE_SETS];
+};
+
+/**
+    Replays one access
+
+    @retval true      on a hit
+    @retval false     on a miss, or if the address maps to no set
+*/
+static bool ReplayAccess (CCacheSet* rgCacheSets, QWORD qwAddress, DWORD_PTR& dwIndex) noexcept
+{
+    const void* pAddress = nullptr;
+    CVirtualAddress::FromTraceAddress (qwAddress, pAddress);
+
+    CVirtualAddress vAddress (pAddress);
+    dwIndex = vAddress.DecodeIndex ( );
+    if ( dwIndex >= req::g_4WAY_CACHE_SETS )
+        return false;
+
+    DWORD_PTR dwTag = vAddress.DecodeTag ( );
+    if ( rgCacheSets[dwIndex].AccessCacheTag (dwTag) )
+        return true;
+
+    rgCacheSets[dwIndex].LoadCacheTag (dwTag);
+    return false;
+}
+
+/**
+    Two sets behave identically from now on if they hold the same Tags in
+    the same FIFO order; which block holds a Tag does not matter.
+*/
+static bool SameContents (const CACHE_SET_STATE& a, const CACHE_SET_STATE& b) noexcept
+{
+    for (size_t i = 0; i < _countof(a.rgFifoOrder); i++)
+    {
+        const CACHE_BLOCK_STATE& blockA = a.rgBlock[a.rgFifoOrder[i]];
+        const CACHE_BLOCK_STATE& blockB = b.rgBlock[b.rgFifoOrder[i]];
+
+        bool bValidA = (blockA.dwFlags & g_BLOCK_FLAG_VALID) != 0;
+        bool bValidB = (blockB.dwFlags & g_BLOCK_FLAG_VALID) != 0;
+        if ( (bValidA != bValidB) || (bValidA && (blockA.qwTag != blockB.qwTag)) )
+            return false;
+    }
+    return true;
+}
+
+bool CTimeParallelSimulator::Run (const TCHAR* szTrace, DWORD dwThreads /* = 0 */,
+                                  size_t cbBudget /* = g_OPT_MEMORY_BUDGET */)
+{
+    m_qwCacheHits   = 0;
+    m_qwCacheMisses = 0;
+    m_qwFixups      = 0;
+    m_dwChunks      = 0;
+    m_dwUnconverged = 0;
+
+    CCacheTraceReader trace;
+    if ( !trace.Open (szTrace) )
+        return false;
+
+    const QWORD qwRecords = trace.get_Records ( );
+
+    if ( dwThreads == 0 )
+        dwThreads = std::max (1u, std::thread::hardware_concurrency ( ));
+
+    // records buffered by each worker at a time
+    const size_t nPiece = std::max<size_t> (1024, cbBudget / (dwThreads * sizeof(TRACE_RECORD)));
+
+    QWORD qwChunks = std::min<QWORD> (static_cast<QWORD>(dwThreads) * g_TP_CHUNKS_PER_THREAD,
+                                      qwRecords / g_TP_MIN_CHUNK);
+    qwChunks = std::max<QWORD> (qwChunks, 1);
+
+    std::vector<TP_CHUNK> vecChunks (static_cast<size_t>(qwChunks));
+    for (size_t i = 0; i < vecChunks.size(); i++)
+    {
+        vecChunks[i].qwFirst   = qwRecords * i / qwChunks;
+        vecChunks[i].qwCount   = qwRecords * (i + 1) / qwChunks - vecChunks[i].qwFirst;
+        vecChunks[i].qwDecoded = 0;
+        vecChunks[i].qwMisses  = 0;
+        vecChunks[i].qwRepeats = 0;
+        vecChunks[i].bRead     = false;
+    }
+
+    // parallel pass: every chunk from an empty cache
+    std::atomic<size_t> nNext (0);
+    auto Worker = [&]()
+    {
+        CCacheTraceReader         reader;
+        std::vector<TRACE_RECORD> vecRecords;
+        if ( !reader.Open (szTrace) )
+            return;
+
+        size_t i;
+        while ( (i = nNext++) < vecChunks.size() )
+        {
+            TP_CHUNK& chunk = vecChunks[i];
+
+            CCacheSet rgCacheSets[req::g_4WAY_CACHE_SETS];
+            for (auto& it : rgCacheSets)
+                it.Init ( );
+
+            QWORD qwEnd = chunk.qwFirst + chunk.qwCount;
+            for (QWORD qwFirst = chunk.qwFirst; qwFirst < qwEnd; qwFirst += nPiece)
+            {
+                size_t nCount = static_cast<size_t>(std::min<QWORD> (nPiece, qwEnd - qwFirst));
+                if ( !reader.Read (qwFirst, nCount, vecRecords) )
+                    return;
+
+                // an address wider than a pointer leaves the chunk unread,
+                // failing the run
+                DWORD_PTR dwIndex;
+                for (const auto& it : vecRecords)
+                {
+                    if ( !fits_pointer (it.qwAddress) )
+                        return;
+                    // records that map to no set (address 0) are skipped, as
+                    // by the sequential replay
+                    bool bHit = ReplayAccess (rgCacheSets, it.qwAddress, dwIndex);
+                    if ( dwIndex >= _countof(rgCacheSets) )
+                        continue;
+
+                    chunk.qwDecoded++;
+                    if ( !bHit )
+                        chunk.qwMisses++;
+                    chunk.qwRepeats += it.dwRepeat;
+                }
+            }
+
+            for (size_t s = 0; s < _countof(rgCacheSets); s++)
+                rgCacheSets[s].SaveState (chunk.rgFinal[s]);
+            chunk.bRead = true;
+        }
+    };
+
+    std::vector<std::thread> vecThreads;
+    for (DWORD i = 1; i < std::min<QWORD> (dwThreads, qwChunks); i++)
+        vecThreads.emplace_back (Worker);
+    Worker ( );
+    for (auto& it : vecThreads)
+        it.join ( );
+
+    for (const auto& it : vecChunks)
+    {
+        if ( !it.bRead )
+            return false;
+    }
+
+    // sequential fix-up pass: replay each chunk from the true initial state
+    // alongside the speculative replay until every set agrees
+    std::vector<TRACE_RECORD> vecRecords;
+    m_qwCacheMisses = vecChunks[0].qwMisses;
+    for (size_t i = 1; i < vecChunks.size(); i++)
+    {
+        TP_CHUNK&       chunk    = vecChunks[i];
+        const TP_CHUNK& previous = vecChunks[i - 1];
+
+        CCacheSet rgActual[req::g_4WAY_CACHE_SETS];
+        CCacheSet rgSpeculative[req::g_4WAY_CACHE_SETS];
+        bool      rgConverged[req::g_4WAY_CACHE_SETS];
+        size_t    nConverged = 0;
+
+        for (size_t s = 0; s < _countof(rgActual); s++)
+        {
+            rgActual[s].Init ( );
+            rgActual[s].RestoreState (previous.rgFinal[s]);
+            rgSpeculative[s].Init ( );
+
+            CACHE_SET_STATE stateSpeculative;
+            rgSpeculative[s].SaveState (stateSpeculative);
+            rgConverged[s] = SameContents (previous.rgFinal[s], stateSpeculative);
+            if ( rgConverged[s] )
+                nConverged++;
+        }
+
+        __int64 iMissDelta = 0;
+        QWORD   qwEnd      = chunk.qwFirst + chunk.qwCount;
+        for (QWORD qwFirst = chunk.qwFirst; (qwFirst < qwEnd) && (nConverged < _countof(rgActual)); qwFirst += nPiece)
+        {
+            size_t nCount = static_cast<size_t>(std::min<QWORD> (nPiece, qwEnd - qwFirst));
+            if ( !trace.Read (qwFirst, nCount, vecRecords) )
+                return false;
+
+            for (size_t r = 0; (r < nCount) && (nConverged < _countof(rgActual)); r++)
+            {
+                // the parallel pass refused addresses wider than a pointer
+                const void* pAddress;
+                if ( !CVirtualAddress::FromTraceAddress (vecRecords[r].qwAddress, pAddress) )
+                    continue;
+
+                CVirtualAddress vAddress (pAddress);
+                DWORD_PTR dwIndex = vAddress.DecodeIndex ( );
+                if ( (dwIndex >= _countof(rgActual)) || rgConverged[dwIndex] )
+                    continue;
+
+                m_qwFixups++;
+
+                DWORD_PTR dwSame;
+                bool bActualHit      = ReplayAccess (rgActual,      vecRecords[r].qwAddress, dwSame);
+                bool bSpeculativeHit = ReplayAccess (rgSpeculative, vecRecords[r].qwAddress, dwSame);
+                iMissDelta += static_cast<int>(bSpeculativeHit) - static_cast<int>(bActualHit);
+
+                // FIFO hits leave a set unchanged, only a fill can make the two agree
+                if ( bActualHit && bSpeculativeHit )
+                    continue;
+
+                CACHE_SET_STATE stateActual;
+                CACHE_SET_STATE stateSpeculative;
+                rgActual[dwIndex].SaveState (stateActual);
+                rgSpeculative[dwIndex].SaveState (stateSpeculative);
+                if ( SameContents (stateActual, stateSpeculative) )
+                {
+                    rgConverged[dwIndex] = true;
+                    nConverged++;
+                }
+            }
+        }
+
+        // a set that never converged ends in the state of the true replay
+        if ( nConverged < _countof(rgActual) )
+        {
+            m_dwUnconverged++;
+            for (size_t s = 0; s < _countof(rgActual); s++)
+            {
+                if ( !rgConverged[s] )
+                    rgActual[s].SaveState (chunk.rgFinal[s]);
+            }
+        }
+
+        chunk.qwMisses   = static_cast<QWORD>(static_cast<__int64>(chunk.qwMisses) + iMissDelta);
+        m_qwCacheMisses += chunk.qwMisses;
+    }
+
+    m_qwCacheHits = 0;
+    for (const auto& it : vecChunks)
+        m_qwCacheHits += it.qwDecoded + it.qwRepeats;
+    m_qwCacheHits -= m_qwCacheMisses;
+    m_dwChunks    = static_cast<DWORD>(vecChunks.size());
+    return true;
+}
+
+std::ostream& CTimeParallelSimulator::Report (std::ostream& os) const
+{
+    QWORD qwAccesses = m_qwCacheHits + m_qwCacheMisses;
+
+    os << std::dec << std::setfill (' ');
+    os << "Time-parallel replay" << std::endl;
+    os << "-----------------------------------------------------------------" << std::endl;
+    os << "Cache Misses:      " << m_qwCacheMisses << std::endl;
+    os << "Cache Hits:        " << m_qwCacheHits   << std::endl;
+    os << "Chunks:            " << m_dwChunks      << std::endl;
+    os << "Fix-up accesses:   " << m_qwFixups;
+    if ( qwAccesses )
+        os << " (" << std::fixed << std::setprecision(4) << 100.0 * m_qwFixups / qwAccesses << "%)";
+    os << std::endl;
+    os << "Unconverged chunks:" << m_dwUnconverged << std::endl;
+    os.unsetf (std::ios::floatfield);
+
+    return os;
+}
@@ -0,0 +1,110 @@
+/**
+ *  @file       TimeParallelSimulator.h
+ *  @brief      CTimeParallelSimulator class interface
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_TIME_PARALLEL_SIMULATOR_H__)
+#define _TIME_PARALLEL_SIMULATOR_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _OSTREAM_
+    #include <ostream>
+#endif
+
+#if !defined(_CACHE_SET_H__)
+    #include "CacheSet.h"
+#endif
+
+#if !defined(_BELADY_SIMULATOR_H__)
+    #include "BeladySimulator.h"
+#endif
+
+/// chunks per worker thread, more chunks balance the load better
+constexpr DWORD  g_TP_CHUNKS_PER_THREAD = 4;
+/// smallest chunk worth simulating on its own, in records
+constexpr QWORD  g_TP_MIN_CHUNK         = 64 * 1024;
+
+/**
+ *  Replays an address trace through the 4-way set associative cache (FIFO)
+ *  with temporal rather than set parallelism, so that a trace dominated by
+ *  a few hot sets still scales.
+ *
+ *  The trace is split into consecutive chunks, and every chunk is replayed
+ *  on a worker thread from an empty cache instead of the (still unknown)
+ *  final state of the chunk before it.  Only the first chunk starts from
+ *  the true state; in the others, the outcome of an access may depend on
+ *  the state the chunk should have started from.
+ *
+ *  A sequential fix-up pass then replays each chunk a second time from the
+ *  true state, which is the corrected final state of the previous chunk,
+ *  alongside a replay of the speculative run.  The fix-up for a set ends
+ *  as soon as both replays hold the same blocks in the same FIFO order.
+ *  From then on the set behaves exactly as it did in the speculative run.
+ *  This usually happens within a few misses per set, so the fix-up only
+ *  touches the start of each chunk.
+ *
+ *  Unlike LRU, FIFO is not certain to converge: a block that hits in one
+ *  replay and is filled in the other can keep the two out of step.  The
+ *  fix-up then replays the whole chunk, which costs time but keeps the
+ *  result exact; Report shows how often that happened.
+ */
+class CTimeParallelSimulator
+{
+    QWORD   m_qwCacheHits;
+    QWORD   m_qwCacheMisses;
+    QWORD   m_qwFixups;             ///< accesses replayed by the fix-up pass
+    DWORD   m_dwChunks;
+    DWORD   m_dwUnconverged;        ///< chunks with a set that never converged
+
+public:
+/**
+ *  Default Constructor
+ */
+    CTimeParallelSimulator ( ) noexcept
+        : m_qwCacheHits   (0),
+          m_qwCacheMisses (0),
+          m_qwFixups      (0),
+          m_dwChunks      (0),
+          m_dwUnconverged (0)
+    { };
+
+/**
+    Replays a trace
+
+    @param [in] szTrace         trace written by CCacheTraceWriter
+    @param [in] dwThreads       worker threads, 0 for one per hardware thread
+    @param [in] cbBudget        memory budget for the buffered records of
+                                all worker threads together
+
+    @retval true      on success
+    @retval false     if the trace cannot be read or holds an address wider
+                      than a pointer
+ */
+    bool Run (const TCHAR* szTrace, DWORD dwThreads = 0, size_t cbBudget = g_OPT_MEMORY_BUDGET);
+
+    constexpr QWORD get_CacheHits   (void) const noexcept
+    { return m_qwCacheHits; };
+
+    constexpr QWORD get_CacheMisses (void) const noexcept
+    { return m_qwCacheMisses; };
+
+/**
+    Writes the outcome of the replay and the amount of fix-up it needed
+
+    @param [in] os              output stream
+ */
+    std::ostream& Report (std::ostream& os) const;
+
+private:
+
+    CTimeParallelSimulator (const CTimeParallelSimulator& rhs) = delete;
+    CTimeParallelSimulator& operator = (const CTimeParallelSimulator& rhs) = delete;
+};
+
+#endif
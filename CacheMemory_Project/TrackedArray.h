@@ -0,0 +1,303 @@
+/**
+ *  @file       TrackedArray.h
+ *  @brief      TrackedArray / TrackedPtr memory access instrumentation templates
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_TRACKED_ARRAY_H__)
+#define _TRACKED_ARRAY_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _CSTDDEF_
+    #include <cstddef>
+#endif
+
+#ifndef _CSTRING_
+    #include <cstring>
+#endif
+
+#if !defined(_CACHE_MANAGER_H__)
+    #include "CacheManager.h"
+#endif
+
+/*
+    TrackedArray<T> and TrackedPtr<T> are thin, non-owning views over existing
+    memory whose element reads and writes are reported to a sink, typically a
+    CCacheManager, so that a native kernel can be instrumented by changing
+    only the declarations of the arrays it touches:
+
+        TrackedArray<int> A (g_rgA, &sink);
+        TrackedArray<int> B (g_rgB, &sink);
+
+        for (int i = 0; i < 511; i++)
+            A[i] = A[i] + B[i] + B[i + 1] * C[i];
+
+    Note that C++ leaves the evaluation order of the operands unspecified, so
+    the order in which the accesses reach the sink is up to the compiler.
+
+    A sink is any class providing:
+
+        void OnRead  (const void* pAddress, size_t cbLen);
+        void OnWrite (const void* pAddress, size_t cbLen);
+
+    Instrumentation is controlled at compile time by CACHE_TRACKING.  When it
+    is defined as 0 the views collapse to a bare pointer and operator[]
+    returns a plain T&, so the instrumented kernel compiles to exactly the
+    same code as the original.
+*/
+
+#if !defined(CACHE_TRACKING)
+    #define CACHE_TRACKING 1
+#endif
+
+/**
+ *  Sink that routes every tracked access through a CCacheManager, which
+ *  keeps the hit and miss statistics.  A read allocates on a miss and, on a
+ *  hit, checks the data returned by the cache against memory.  A write is
+ *  written through to a resident cache block (write-through, no-allocate),
+ *  so it is not counted as an access and later hits return the new value.
+ */
+class CCacheManagerSink
+{
+    CCacheManager&  m_cacheManager;
+    QWORD           m_qwCacheErrors;    ///< read hits whose data disagreed with memory
+
+public:
+/**
+ *  Initialization Constructor
+ *
+ *  @param [in] cacheManager    cache to route accesses through, must already
+ *                              be initialized
+ */
+    explicit CCacheManagerSink (CCacheManager& cacheManager) noexcept
+        : m_cacheManager  (cacheManager),
+          m_qwCacheErrors (0)
+    { };
+
+    void OnRead  (const void* pAddress, size_t cbLen) noexcept
+    {
+        ForEachBlock (pAddress, cbLen, [this](const BYTE* p, size_t cbBlock)
+        {
+            DWORD dwData;
+            if ( !m_cacheManager.GetCacheData (p, dwData) )
+                m_cacheManager.LoadCachePage (p);
+            else if ( memcmp (&dwData, p, (cbBlock < sizeof(dwData)) ? cbBlock : sizeof(dwData)) != 0 )
+                m_qwCacheErrors++;
+        });
+    };
+
+    void OnWrite (const void* pAddress, size_t cbLen) noexcept
+    {
+        ForEachBlock (pAddress, cbLen, [this](const BYTE* p, size_t cbBlock)
+        {
+            m_cacheManager.UpdateCacheData (p, p, cbBlock);
+        });
+    };
+
+    constexpr QWORD get_CacheErrors (void) const noexcept
+    { return m_qwCacheErrors; };
+
+private:
+    // an element may straddle cache blocks, each block touched is one access
+    template <typename TAccess>
+    static void ForEachBlock (const void* pAddress, size_t cbLen, TAccess access) noexcept
+    {
+        const BYTE* pFirst = static_cast<const BYTE*>(pAddress);
+        const BYTE* pLast  = pFirst + (cbLen ? cbLen - 1 : 0);
+        const BYTE* p      = pFirst;
+
+        while ( p <= pLast )
+        {
+            DWORD_PTR   dwBlockEnd = (reinterpret_cast<DWORD_PTR>(p) | (req::g_CACHE_BLOCK_SIZE - 1));
+            const BYTE* pBlockLast = reinterpret_cast<const BYTE*>(dwBlockEnd);
+            if ( pBlockLast > pLast )
+                pBlockLast = pLast;
+
+            access (p, static_cast<size_t>(pBlockLast - p) + 1);
+
+            p = pBlockLast + 1;
+        }
+    };
+};
+
+/**
+ *  Proxy returned by the tracked views for an individual element.  Reading
+ *  the value reports a read, assigning to it reports a write and compound
+ *  assignment reports both.
+ */
+template <typename T, typename TSink>
+class TrackedRef
+{
+    T*      m_p;
+    TSink*  m_pSink;
+
+public:
+    TrackedRef (T* p, TSink* pSink) noexcept
+        : m_p (p), m_pSink (pSink)
+    { };
+
+    TrackedRef (const TrackedRef& rhs) = default;
+
+    operator T () const
+    {
+        m_pSink->OnRead (m_p, sizeof(T));
+        return *m_p;
+    };
+
+    TrackedRef& operator = (const T& val)
+    {
+        *m_p = val;
+        m_pSink->OnWrite (m_p, sizeof(T));
+        return *this;
+    };
+
+    TrackedRef& operator = (const TrackedRef& rhs)
+    { return operator = (static_cast<T>(rhs)); };
+
+    TrackedRef& operator += (const T& val) { return operator = (static_cast<T>(*this) + val); };
+    TrackedRef& operator -= (const T& val) { return operator = (static_cast<T>(*this) - val); };
+    TrackedRef& operator *= (const T& val) { return operator = (static_cast<T>(*this) * val); };
+    TrackedRef& operator /= (const T& val) { return operator = (static_cast<T>(*this) / val); };
+
+    TrackedRef& operator ++ ( )    { return operator += (T(1)); };
+    TrackedRef& operator -- ( )    { return operator -= (T(1)); };
+    T           operator ++ (int)  { T tmp = *this; operator += (T(1)); return tmp; };
+    T           operator -- (int)  { T tmp = *this; operator -= (T(1)); return tmp; };
+
+ /**
+    Address of the underlying element, the access itself is not reported
+ */
+    T* operator & ( ) const noexcept
+    { return m_p; };
+};
+
+/**
+ *  Tracked pointer, behaves like T* for indexing, dereferencing and pointer
+ *  arithmetic
+ */
+template <typename T, typename TSink = CCacheManagerSink, bool bTracked = (CACHE_TRACKING != 0)>
+class TrackedPtr
+{
+    T*      m_p;
+    TSink*  m_pSink;
+
+public:
+    typedef TrackedRef<T, TSink> reference;
+
+    TrackedPtr (T* p, TSink* pSink) noexcept
+        : m_p (p), m_pSink (pSink)
+    { };
+
+    reference operator *  ( ) const noexcept                 { return reference (m_p, m_pSink); };
+    reference operator [] (std::ptrdiff_t i) const noexcept  { return reference (m_p + i, m_pSink); };
+
+    TrackedPtr& operator ++ ( ) noexcept                   { ++m_p; return *this; };
+    TrackedPtr& operator -- ( ) noexcept                   { --m_p; return *this; };
+    TrackedPtr  operator ++ (int) noexcept                 { TrackedPtr tmp (*this); ++m_p; return tmp; };
+    TrackedPtr  operator -- (int) noexcept                 { TrackedPtr tmp (*this); --m_p; return tmp; };
+    TrackedPtr& operator += (std::ptrdiff_t i) noexcept    { m_p += i; return *this; };
+    TrackedPtr& operator -= (std::ptrdiff_t i) noexcept    { m_p -= i; return *this; };
+    TrackedPtr  operator +  (std::ptrdiff_t i) const noexcept { return TrackedPtr (m_p + i, m_pSink); };
+    TrackedPtr  operator -  (std::ptrdiff_t i) const noexcept { return TrackedPtr (m_p - i, m_pSink); };
+
+    std::ptrdiff_t operator - (const TrackedPtr& rhs) const noexcept { return m_p - rhs.m_p; };
+
+    bool operator == (const TrackedPtr& rhs) const noexcept { return m_p == rhs.m_p; };
+    bool operator != (const TrackedPtr& rhs) const noexcept { return m_p != rhs.m_p; };
+    bool operator <  (const TrackedPtr& rhs) const noexcept { return m_p <  rhs.m_p; };
+
+    constexpr T* get (void) const noexcept
+    { return m_p; };
+};
+
+/**
+ *  Untracked pointer, compiles down to a bare T*
+ */
+template <typename T, typename TSink>
+class TrackedPtr<T, TSink, false>
+{
+    T*      m_p;
+
+public:
+    typedef T& reference;
+
+    TrackedPtr (T* p, TSink* /* pSink */) noexcept
+        : m_p (p)
+    { };
+
+    T& operator *  ( ) const noexcept                 { return *m_p; };
+    T& operator [] (std::ptrdiff_t i) const noexcept  { return m_p[i]; };
+
+    TrackedPtr& operator ++ ( ) noexcept                   { ++m_p; return *this; };
+    TrackedPtr& operator -- ( ) noexcept                   { --m_p; return *this; };
+    TrackedPtr  operator ++ (int) noexcept                 { TrackedPtr tmp (*this); ++m_p; return tmp; };
+    TrackedPtr  operator -- (int) noexcept                 { TrackedPtr tmp (*this); --m_p; return tmp; };
+    TrackedPtr& operator += (std::ptrdiff_t i) noexcept    { m_p += i; return *this; };
+    TrackedPtr& operator -= (std::ptrdiff_t i) noexcept    { m_p -= i; return *this; };
+    TrackedPtr  operator +  (std::ptrdiff_t i) const noexcept { return TrackedPtr (m_p + i, nullptr); };
+    TrackedPtr  operator -  (std::ptrdiff_t i) const noexcept { return TrackedPtr (m_p - i, nullptr); };
+
+    std::ptrdiff_t operator - (const TrackedPtr& rhs) const noexcept { return m_p - rhs.m_p; };
+
+    bool operator == (const TrackedPtr& rhs) const noexcept { return m_p == rhs.m_p; };
+    bool operator != (const TrackedPtr& rhs) const noexcept { return m_p != rhs.m_p; };
+    bool operator <  (const TrackedPtr& rhs) const noexcept { return m_p <  rhs.m_p; };
+
+    constexpr T* get (void) const noexcept
+    { return m_p; };
+};
+
+/**
+ *  Tracked, non-owning view of an existing array
+ */
+template <typename T, typename TSink = CCacheManagerSink, bool bTracked = (CACHE_TRACKING != 0)>
+class TrackedArray
+{
+    TrackedPtr<T, TSink, bTracked>  m_ptr;
+    size_t                          m_nCount;
+
+public:
+    typedef TrackedPtr<T, TSink, bTracked>              iterator;
+    typedef typename iterator::reference                reference;
+
+/**
+ *  Initialization Constructor
+ *
+ *  @param [in] pData       first element of the array being viewed
+ *  @param [in] nCount      number of elements in the array
+ *  @param [in] pSink       sink receiving the accesses (ignored when untracked)
+ */
+    TrackedArray (T* pData, size_t nCount, TSink* pSink) noexcept
+        : m_ptr (pData, pSink), m_nCount (nCount)
+    { };
+
+/**
+ *  Initialization Constructor for a built-in array
+ */
+    template <size_t N>
+    TrackedArray (T (&rgData)[N], TSink* pSink) noexcept
+        : m_ptr (rgData, pSink), m_nCount (N)
+    { };
+
+    reference operator [] (size_t i) const noexcept
+    { return m_ptr[static_cast<std::ptrdiff_t>(i)]; };
+
+    iterator begin (void) const noexcept
+    { return m_ptr; };
+
+    iterator end   (void) const noexcept
+    { return m_ptr + static_cast<std::ptrdiff_t>(m_nCount); };
+
+    constexpr size_t size (void) const noexcept
+    { return m_nCount; };
+
+    constexpr T* data (void) const noexcept
+    { return m_ptr.get(); };
+};
+
+#endif
@@ -13,18 +13,6 @@
 #include "VirtualAddress.h"
 
 
-template <typename _T>
-static constexpr _T bitmask(size_t nBitsSet)
-{
-    return static_cast<_T>(-(nBitsSet != 0))
-        & (static_cast<_T>(-1) >> ((sizeof(_T) * CHAR_BIT) - nBitsSet));
-};
-
-constexpr size_t static_log2(size_t n)
-{
-    return ((n < 2) ? 0 : 1 + static_log2(n >> 1));
-};
-
 /// calculated as log2(BlockSize), specifically log2(32) in this instance
 constexpr size_t   OFFSET_BITS = static_log2(req::g_CACHE_BLOCK_SIZE);
 /// calculated as log2(NumSets), specifically log2(4) in this instance
@@ -76,6 +64,39 @@ DWORD_PTR CVirtualAddress::DecodeIndex (void) const noexcept
         return DECODE_ERROR;
 }
 
+DWORD_PTR CVirtualAddress::EncodeAddress (DWORD_PTR dwTag, DWORD_PTR dwIndex) noexcept
+{
+    static DWORD_PTR indexMask = bitmask<DWORD_PTR>(INDEX_BITS);
+
+    return (dwTag << (INDEX_BITS + OFFSET_BITS)) | ((dwIndex & indexMask) << OFFSET_BITS);
+}
+
+bool CVirtualAddress::FromTraceAddress (QWORD qwAddress, const void*& pAddress) noexcept
+{
+    bool bReturn = false;
+    if ( fits_pointer (qwAddress) )
+    {
+        pAddress = reinterpret_cast<const void*>(static_cast<DWORD_PTR>(qwAddress));
+        bReturn  = true;
+    }
+    return bReturn;
+}
+
+bool CVirtualAddress::DecodeTraceAddress (QWORD qwAddress, DWORD_PTR& dwTag,
+                                          DWORD_PTR& dwIndex, DWORD_PTR& dwOffset) noexcept
+{
+    bool bReturn = false;
+    const QWORD qwTag = qwAddress >> (INDEX_BITS + OFFSET_BITS);
+    if ( fits_pointer (qwTag) )
+    {
+        dwTag    = static_cast<DWORD_PTR>(qwTag);
+        dwIndex  = static_cast<DWORD_PTR>((qwAddress >> OFFSET_BITS) & bitmask<QWORD>(INDEX_BITS));
+        dwOffset = static_cast<DWORD_PTR>(qwAddress & bitmask<QWORD>(OFFSET_BITS));
+        bReturn  = true;
+    }
+    return bReturn;
+}
+
 std::ostream& CVirtualAddress::operator << (std::ostream& os) const
 {
     os  << "Address[0x"  << std::hex << std::setw (2 * sizeof (DWORD_PTR)) 
@@ -17,10 +17,40 @@
     #include <ostream>
 #endif
 
+#ifndef _LIMITS_
+    #include <limits>
+#endif
+
+#ifndef _CLIMITS_
+    #include <climits>
+#endif
+
 
 /// Error Code returned on decoding failure
 constexpr DWORD_PTR DECODE_ERROR = std::numeric_limits<DWORD_PTR>::max();
 
+/// compile time generation of a mask of the nBitsSet low-order bits;
+/// 0 bits is a case of its own, as shifting by the full width is undefined
+template <typename _T>
+constexpr _T bitmask(size_t nBitsSet)
+{
+    return (nBitsSet == 0) ? static_cast<_T>(0)
+        : (static_cast<_T>(-1) >> ((sizeof(_T) * CHAR_BIT) - nBitsSet));
+};
+
+/// whether a 64 bit trace address or Tag fits a DWORD_PTR of this build; on
+/// a 32 bit build a wider one would alias a lower one once truncated
+constexpr bool fits_pointer(QWORD qwValue)
+{
+    return qwValue <= static_cast<QWORD>(std::numeric_limits<DWORD_PTR>::max());
+};
+
+/// compile time log2, rounded down
+constexpr size_t static_log2(size_t n)
+{
+    return ((n < 2) ? 0 : 1 + static_log2(n >> 1));
+};
+
 /**
   This class is used to translate physical memory addresses into "virtual" 
   addresses by decoding relevant bit patterns into corresponding information 
@@ -89,6 +119,45 @@ public:
 
     std::ostream& operator << (std::ostream& os) const;
 
+ /**
+    Rebuilds the address of the first byte of a cache block from its Tag and
+    (set) Index, the inverse of DecodeTag / DecodeIndex
+
+    @param [in] dwTag       Tag of the cache block
+    @param [in] dwIndex     (set) Index of the cache block
+
+    @retval DWORD_PTR containing the block address
+ */
+    static DWORD_PTR EncodeAddress (DWORD_PTR dwTag, DWORD_PTR dwIndex) noexcept;
+
+ /**
+    Converts a 64 bit trace address into an address of this build, the
+    entry point of every trace replay
+
+    @param [in]  qwAddress  trace address
+    @param [out] pAddress   receives the address as a pointer
+
+    @retval true    on success
+    @retval false   if qwAddress does not fit a pointer (see fits_pointer)
+ */
+    static bool FromTraceAddress (QWORD qwAddress, const void*& pAddress) noexcept;
+
+ /**
+    Decodes a 64 bit trace address without converting it into a pointer, for
+    an address that is never dereferenced (see CCacheManager::set_BackingStore)
+
+    @param [in]  qwAddress  trace address
+    @param [out] dwTag      receives the Tag
+    @param [out] dwIndex    receives the (set) Index
+    @param [out] dwOffset   receives the (block) Offset
+
+    @retval true    on success
+    @retval false   if the Tag does not fit a DWORD_PTR, an address above
+                    512 GB on a 32 bit build
+ */
+    static bool DecodeTraceAddress (QWORD qwAddress, DWORD_PTR& dwTag,
+                                    DWORD_PTR& dwIndex, DWORD_PTR& dwOffset) noexcept;
+
 private:
     // We really do not want this class to be instantiated in this manner
 
@@ -0,0 +1,529 @@
+/**
+ *  @file       WorkloadGenerator.cpp
+ *  @brief      CXoshiroRandom and CWorkloadGenerator class implementations
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#include "stdafx.h"
+
+#include <math.h>
+#include <emmintrin.h>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "WorkloadGenerator.h"
+
+/// largest footprint the block tables can index, in cache blocks
+constexpr QWORD g_WORKLOAD_MAX_BLOCKS = std::numeric_limits<DWORD>::max ( );
+
+///////////////////////////////////////////////////////////////////////////////
+// CXoshiroRandom
+
+void CXoshiroRandom::Seed (QWORD qwSeed) noexcept
+{
+    // SplitMix64, as recommended by the authors for seeding xoshiro
+    QWORD qwState = qwSeed;
+    auto SplitMix = [&qwState]() noexcept
+    {
+        QWORD z = (qwState += 0x9E3779B97F4A7C15);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return z ^ (z >> 31);
+    };
+
+    for (size_t j = 0; j < g_XOSHIRO_LANES; j++)
+    {
+        m_rgS0[j] = SplitMix ( );
+        m_rgS1[j] = SplitMix ( );
+        m_rgS2[j] = SplitMix ( );
+        m_rgS3[j] = SplitMix ( );
+    }
+    m_nNext = g_XOSHIRO_BUFFER;
+}
+
+/**
+    64 bit rotate left of both lanes of a vector
+*/
+static inline __m128i RotateLeft64 (__m128i x, int nBits) noexcept
+{
+    return _mm_or_si128 (_mm_slli_epi64 (x, nBits), _mm_srli_epi64 (x, 64 - nBits));
+}
+
+void CXoshiroRandom::Step (QWORD* pValues, size_t nSteps) noexcept
+{
+    // two lanes per SSE2 vector
+    constexpr size_t nVectors = g_XOSHIRO_LANES / 2;
+    static_assert (g_XOSHIRO_LANES % 2 == 0, "CXoshiroRandom lanes must fill whole SSE2 vectors");
+
+    __m128i s0[nVectors], s1[nVectors], s2[nVectors], s3[nVectors];
+    for (size_t v = 0; v < nVectors; v++)
+    {
+        s0[v] = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(m_rgS0 + 2 * v));
+        s1[v] = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(m_rgS1 + 2 * v));
+        s2[v] = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(m_rgS2 + 2 * v));
+        s3[v] = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(m_rgS3 + 2 * v));
+    }
+
+    for (size_t i = 0; i < nSteps; i++, pValues += g_XOSHIRO_LANES)
+    {
+        for (size_t v = 0; v < nVectors; v++)
+        {
+            _mm_storeu_si128 (reinterpret_cast<__m128i*>(pValues + 2 * v), _mm_add_epi64 (s0[v], s3[v]));
+
+            __m128i t = _mm_slli_epi64 (s1[v], 17);
+            s2[v] = _mm_xor_si128 (s2[v], s0[v]);
+            s3[v] = _mm_xor_si128 (s3[v], s1[v]);
+            s1[v] = _mm_xor_si128 (s1[v], s2[v]);
+            s0[v] = _mm_xor_si128 (s0[v], s3[v]);
+            s2[v] = _mm_xor_si128 (s2[v], t);
+            s3[v] = RotateLeft64 (s3[v], 45);
+        }
+    }
+
+    for (size_t v = 0; v < nVectors; v++)
+    {
+        _mm_storeu_si128 (reinterpret_cast<__m128i*>(m_rgS0 + 2 * v), s0[v]);
+        _mm_storeu_si128 (reinterpret_cast<__m128i*>(m_rgS1 + 2 * v), s1[v]);
+        _mm_storeu_si128 (reinterpret_cast<__m128i*>(m_rgS2 + 2 * v), s2[v]);
+        _mm_storeu_si128 (reinterpret_cast<__m128i*>(m_rgS3 + 2 * v), s3[v]);
+    }
+}
+
+void CXoshiroRandom::Refill (void) noexcept
+{
+    Step (m_rgBuffer, g_XOSHIRO_BUFFER / g_XOSHIRO_LANES);
+    m_nNext = 0;
+}
+
+void CXoshiroRandom::Fill (QWORD* pValues, size_t nCount) noexcept
+{
+    // whatever is still buffered comes first
+    for ( ; (nCount > 0) && (m_nNext < g_XOSHIRO_BUFFER); nCount--)
+        *pValues++ = m_rgBuffer[m_nNext++];
+
+    size_t nSteps = nCount / g_XOSHIRO_LANES;
+    Step (pValues, nSteps);
+    pValues += nSteps * g_XOSHIRO_LANES;
+    nCount  -= nSteps * g_XOSHIRO_LANES;
+
+    for ( ; nCount > 0; nCount--)
+        *pValues++ = Next ( );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CWorkloadGenerator
+
+CWorkloadGenerator::CWorkloadGenerator ( )
+    : m_vecStreams  ( ),
+      m_vecPhases   ( ),
+      m_qwSeed      (0),
+      m_qwNextBase  (g_WORKLOAD_BASE),
+      m_bStarted    (false),
+      m_rngMix      ( ),
+      m_nPhase      (0),
+      m_qwPhaseLeft (0),
+      m_nStream     (0),
+      m_nRunLeft    (0)
+{
+};
+
+void CWorkloadGenerator::Init (QWORD qwSeed /* = 0 */)
+{
+    m_vecStreams.clear ( );
+    m_vecPhases.clear ( );
+    m_qwSeed      = qwSeed;
+    m_qwNextBase  = g_WORKLOAD_BASE;
+    m_bStarted    = false;
+    m_rngMix.Seed (qwSeed);
+    m_nPhase      = 0;
+    m_qwPhaseLeft = 0;
+    m_nStream     = 0;
+    m_nRunLeft    = 0;
+}
+
+bool CWorkloadGenerator::AddPhase (QWORD qwAccesses)
+{
+    if ( m_bStarted || (!m_vecPhases.empty ( ) && (m_vecPhases.back ( ).qwAccesses == 0)) )
+        return false;
+
+    CPhase phase;
+    phase.qwAccesses    = qwAccesses;
+    phase.nFirstStream  = m_vecStreams.size ( );
+    phase.nStreams      = 0;
+    phase.dwTotalWeight = 0;
+    m_vecPhases.push_back (phase);
+    return true;
+}
+
+bool CWorkloadGenerator::AddStream (const WORKLOAD_STREAM_CONFIG& config)
+{
+    if ( m_bStarted )
+        return false;
+
+    QWORD qwBlocks = (config.qwFootprint + req::g_CACHE_BLOCK_SIZE - 1) / req::g_CACHE_BLOCK_SIZE;
+    if ( (qwBlocks == 0) || (qwBlocks > g_WORKLOAD_MAX_BLOCKS) || (config.dwWeight == 0) )
+        return false;
+
+    QWORD cbFootprint = qwBlocks * req::g_CACHE_BLOCK_SIZE;
+    if ( (config.ePattern == WORKLOAD_STRIDE) && ((config.qwStride == 0) || (config.qwStride > cbFootprint)) )
+        return false;
+    if ( (config.ePattern == WORKLOAD_ZIPF) && !(config.dSkew >= 0.0) )
+        return false;
+
+    if ( m_vecPhases.empty ( ) && !AddPhase (0) )
+        return false;
+
+    CPhase& phase = m_vecPhases.back ( );
+    if ( phase.dwTotalWeight > std::numeric_limits<DWORD>::max ( ) - config.dwWeight )
+        return false;
+
+    CStream stream;
+    stream.config     = config;
+    stream.qwBase     = m_qwNextBase;
+    stream.dwBlocks   = static_cast<DWORD>(qwBlocks);
+    stream.qwPosition = 0;
+    stream.rng.Seed (m_qwSeed + m_vecStreams.size ( ) + 1);
+
+    if ( config.ePattern == WORKLOAD_ZIPF )
+        BuildZipf (stream);
+    else if ( config.ePattern == WORKLOAD_CHASE )
+        BuildChase (stream);
+
+    m_vecStreams.push_back (std::move (stream));
+    m_qwNextBase        += cbFootprint;
+    phase.nStreams      ++;
+    phase.dwTotalWeight += config.dwWeight;
+    return true;
+}
+
+/**
+    Vose's construction of the alias table: columns whose probability is
+    below the average are topped up from one above the average
+*/
+void CWorkloadGenerator::BuildZipf (CStream& stream)
+{
+    const DWORD dwBlocks = stream.dwBlocks;
+
+    std::vector<double> vecProbability (dwBlocks);
+    double dSum = 0.0;
+    for (DWORD i = 0; i < dwBlocks; i++)
+    {
+        vecProbability[i] = pow (static_cast<double>(i) + 1.0, -stream.config.dSkew);
+        dSum += vecProbability[i];
+    }
+    for (auto& it : vecProbability)
+        it *= dwBlocks / dSum;
+
+    std::vector<DWORD> vecSmall;
+    std::vector<DWORD> vecLarge;
+    for (DWORD i = 0; i < dwBlocks; i++)
+    {
+        if ( vecProbability[i] < 1.0 )
+            vecSmall.push_back (i);
+        else
+            vecLarge.push_back (i);
+    }
+
+    stream.vecThreshold.assign (dwBlocks, std::numeric_limits<DWORD>::max ( ));
+    stream.vecAlias.resize (dwBlocks);
+    for (DWORD i = 0; i < dwBlocks; i++)
+        stream.vecAlias[i] = i;
+
+    while ( !vecSmall.empty ( ) && !vecLarge.empty ( ) )
+    {
+        DWORD dwSmall = vecSmall.back ( );
+        DWORD dwLarge = vecLarge.back ( );
+        vecSmall.pop_back ( );
+        vecLarge.pop_back ( );
+
+        stream.vecThreshold[dwSmall] = static_cast<DWORD>(vecProbability[dwSmall] * 4294967296.0);
+        stream.vecAlias[dwSmall]     = dwLarge;
+
+        vecProbability[dwLarge] -= 1.0 - vecProbability[dwSmall];
+        if ( vecProbability[dwLarge] < 1.0 )
+            vecSmall.push_back (dwLarge);
+        else
+            vecLarge.push_back (dwLarge);
+    }
+    // whatever is left is full up to rounding, and keeps its own column
+}
+
+/**
+    Sattolo's shuffle, which only produces permutations of a single cycle
+*/
+void CWorkloadGenerator::BuildChase (CStream& stream)
+{
+    stream.vecNext.resize (stream.dwBlocks);
+    for (DWORD i = 0; i < stream.dwBlocks; i++)
+        stream.vecNext[i] = i;
+
+    for (DWORD i = stream.dwBlocks - 1; i > 0; i--)
+        std::swap (stream.vecNext[i], stream.vecNext[stream.rng.NextBelow (i)]);
+}
+
+/**
+    Parses a size with an optional K, M or G suffix
+*/
+static bool ParseSize (const TCHAR*& pCursor, QWORD& qwSize)
+{
+    TCHAR* pEnd = nullptr;
+    qwSize = _tcstoui64 (pCursor, &pEnd, 10);
+    if ( pEnd == pCursor )
+        return false;
+
+    pCursor = pEnd;
+    switch ( *pCursor )
+    {
+    case _T('K'): case _T('k'):     qwSize <<= 10;  pCursor++;  break;
+    case _T('M'): case _T('m'):     qwSize <<= 20;  pCursor++;  break;
+    case _T('G'): case _T('g'):     qwSize <<= 30;  pCursor++;  break;
+    default:                                                    break;
+    }
+    return true;
+}
+
+bool CWorkloadGenerator::Parse (const TCHAR* szSpec)
+{
+    static const struct
+    {
+        const TCHAR*        szName;
+        WORKLOAD_PATTERN    ePattern;
+    } rgKinds[] =
+    {
+        { _T("stride"), WORKLOAD_STRIDE },
+        { _T("random"), WORKLOAD_RANDOM },
+        { _T("zipf"),   WORKLOAD_ZIPF   },
+        { _T("chase"),  WORKLOAD_CHASE  }
+    };
+
+    Init (m_qwSeed);
+    if ( szSpec == nullptr )
+        return false;
+
+    const TCHAR* pCursor = szSpec;
+    std::vector<WORKLOAD_STREAM_CONFIG> vecPhase;
+    for (;;)
+    {
+        WORKLOAD_STREAM_CONFIG config;
+        config.qwStride = req::g_CACHE_BLOCK_SIZE;
+        config.dSkew    = 0.99;
+        config.dwWeight = 1;
+
+        size_t i = 0;
+        for ( ; i < _countof(rgKinds); i++)
+        {
+            size_t cchName = _tcslen (rgKinds[i].szName);
+            if ( (_tcsncmp (pCursor, rgKinds[i].szName, cchName) == 0) && (pCursor[cchName] == _T(':')) )
+            {
+                config.ePattern = rgKinds[i].ePattern;
+                pCursor += cchName + 1;
+                break;
+            }
+        }
+        if ( (i == _countof(rgKinds)) || !ParseSize (pCursor, config.qwFootprint) )
+            return false;
+
+        if ( *pCursor == _T(':') )
+        {
+            pCursor++;
+            if ( config.ePattern == WORKLOAD_STRIDE )
+            {
+                if ( !ParseSize (pCursor, config.qwStride) )
+                    return false;
+            }
+            else if ( config.ePattern == WORKLOAD_ZIPF )
+            {
+                TCHAR* pEnd = nullptr;
+                config.dSkew = _tcstod (pCursor, &pEnd);
+                if ( pEnd == pCursor )
+                    return false;
+                pCursor = pEnd;
+            }
+            else
+                return false;
+        }
+
+        if ( *pCursor == _T('*') )
+        {
+            QWORD qwWeight;
+            if ( !ParseSize (++pCursor, qwWeight) || (qwWeight > std::numeric_limits<DWORD>::max ( )) )
+                return false;
+            config.dwWeight = static_cast<DWORD>(qwWeight);
+        }
+        vecPhase.push_back (config);
+
+        if ( *pCursor == _T('+') )
+        {
+            pCursor++;
+            continue;
+        }
+
+        // end of the phase
+        QWORD qwAccesses = 0;
+        if ( (*pCursor == _T('@')) && (!ParseSize (++pCursor, qwAccesses) || (qwAccesses == 0)) )
+            return false;
+
+        if ( !AddPhase (qwAccesses) )
+            return false;
+        for (const auto& it : vecPhase)
+        {
+            if ( !AddStream (it) )
+                return false;
+        }
+        vecPhase.clear ( );
+
+        if ( *pCursor == _T('\0') )
+            return true;
+        if ( *pCursor++ != _T('/') )
+            return false;
+    }
+}
+
+void CWorkloadGenerator::NextRun (void) noexcept
+{
+    if ( m_qwPhaseLeft == 0 )
+    {
+        // a phase that never ends lasts 2^64 - 1 accesses, which is as good
+        m_nPhase      = (m_nPhase + 1) % m_vecPhases.size ( );
+        m_qwPhaseLeft = m_vecPhases[m_nPhase].qwAccesses;
+        if ( m_qwPhaseLeft == 0 )
+            m_qwPhaseLeft = std::numeric_limits<QWORD>::max ( );
+    }
+
+    const CPhase& phase = m_vecPhases[m_nPhase];
+    if ( phase.nStreams == 1 )
+    {
+        m_nStream  = phase.nFirstStream;
+        m_nRunLeft = std::numeric_limits<size_t>::max ( );
+        return;
+    }
+
+    DWORD dwChoice = m_rngMix.NextBelow (phase.dwTotalWeight);
+    m_nStream = phase.nFirstStream;
+    while ( dwChoice >= m_vecStreams[m_nStream].config.dwWeight )
+        dwChoice -= m_vecStreams[m_nStream++].config.dwWeight;
+    m_nRunLeft = g_WORKLOAD_RUN;
+}
+
+bool CWorkloadGenerator::Generate (QWORD* pAddresses, size_t nCount) noexcept
+{
+    if ( !m_bStarted )
+    {
+        if ( m_vecPhases.empty ( ) )
+            return false;
+        for (const auto& it : m_vecPhases)
+        {
+            if ( it.nStreams == 0 )
+                return false;
+        }
+
+        m_bStarted    = true;
+        m_nPhase      = m_vecPhases.size ( ) - 1;
+        m_qwPhaseLeft = 0;
+        m_nRunLeft    = 0;
+    }
+
+    while ( nCount > 0 )
+    {
+        if ( m_nRunLeft == 0 )
+            NextRun ( );
+
+        size_t n = std::min (nCount, m_nRunLeft);
+        if ( n > m_qwPhaseLeft )
+            n = static_cast<size_t>(m_qwPhaseLeft);
+
+        CStream&    stream = m_vecStreams[m_nStream];
+        const QWORD qwBase = stream.qwBase;
+
+        switch ( stream.config.ePattern )
+        {
+        case WORKLOAD_STRIDE:
+            {
+                const QWORD cbFootprint = static_cast<QWORD>(stream.dwBlocks) * req::g_CACHE_BLOCK_SIZE;
+                const QWORD qwStride    = stream.config.qwStride;
+                QWORD       qwPosition  = stream.qwPosition;
+                for (size_t i = 0; i < n; )
+                {
+                    // straight runs up to the end of the footprint, which vectorize
+                    size_t nRun = static_cast<size_t>(std::min<QWORD> (n - i, (cbFootprint - qwPosition + qwStride - 1) / qwStride));
+                    QWORD  qwFirst = qwBase + qwPosition;
+                    for (size_t r = 0; r < nRun; r++)
+                        pAddresses[i + r] = qwFirst + r * qwStride;
+
+                    i          += nRun;
+                    qwPosition += nRun * qwStride;
+                    if ( qwPosition >= cbFootprint )
+                        qwPosition -= cbFootprint;
+                }
+                stream.qwPosition = qwPosition;
+            }
+            break;
+
+        case WORKLOAD_RANDOM:
+            {
+                // upper 32 bits scaled to the footprint, two 32 x 32 bit multiplies per address
+                const QWORD   qwBlocks   = stream.dwBlocks;
+                const __m128i blocks     = _mm_set1_epi64x (static_cast<__int64>(qwBlocks));
+                const __m128i blockSize  = _mm_set1_epi64x (req::g_CACHE_BLOCK_SIZE);
+                const __m128i base       = _mm_set1_epi64x (static_cast<__int64>(qwBase));
+                stream.rng.Fill (pAddresses, n);
+
+                size_t i = 0;
+                for ( ; i + 2 <= n; i += 2)
+                {
+                    __m128i* pPair  = reinterpret_cast<__m128i*>(pAddresses + i);
+                    __m128i  block  = _mm_srli_epi64 (_mm_mul_epu32 (_mm_srli_epi64 (_mm_loadu_si128 (pPair), 32), blocks), 32);
+                    _mm_storeu_si128 (pPair, _mm_add_epi64 (base, _mm_mul_epu32 (block, blockSize)));
+                }
+                for ( ; i < n; i++)
+                    pAddresses[i] = qwBase + (((pAddresses[i] >> 32) * qwBlocks) >> 32) * req::g_CACHE_BLOCK_SIZE;
+            }
+            break;
+
+        case WORKLOAD_ZIPF:
+            {
+                const QWORD  qwBlocks    = stream.dwBlocks;
+                const DWORD* rgThreshold = stream.vecThreshold.data ( );
+                const DWORD* rgAlias     = stream.vecAlias.data ( );
+                stream.rng.Fill (pAddresses, n);
+                for (size_t i = 0; i < n; i++)
+                {
+                    // the upper half scaled by the blocks picks the column, and
+                    // what is left below the column (the fraction) decides column
+                    // or alias, so the weak low bits are not used for either
+                    QWORD qwScaled = (pAddresses[i] >> 32) * qwBlocks;
+                    DWORD dwColumn = static_cast<DWORD>(qwScaled >> 32);
+                    // the choice is a coin toss, so select without a branch
+                    DWORD dwKeep   = 0u - static_cast<DWORD>(static_cast<DWORD>(qwScaled) < rgThreshold[dwColumn]);
+                    DWORD dwBlock  = (dwColumn & dwKeep) | (rgAlias[dwColumn] & ~dwKeep);
+                    pAddresses[i]  = qwBase + static_cast<QWORD>(dwBlock) * req::g_CACHE_BLOCK_SIZE;
+                }
+            }
+            break;
+
+        case WORKLOAD_CHASE:
+            {
+                const DWORD* rgNext  = stream.vecNext.data ( );
+                DWORD        dwBlock = static_cast<DWORD>(stream.qwPosition);
+                for (size_t i = 0; i < n; i++)
+                {
+                    dwBlock       = rgNext[dwBlock];
+                    pAddresses[i] = qwBase + static_cast<QWORD>(dwBlock) * req::g_CACHE_BLOCK_SIZE;
+                }
+                stream.qwPosition = dwBlock;
+            }
+            break;
+        }
+
+        pAddresses += n;
+        nCount     -= n;
+        m_nRunLeft -= n;
+        m_qwPhaseLeft -= n;
+        if ( m_qwPhaseLeft == 0 )
+            m_nRunLeft = 0;
+    }
+    return true;
+}
@@ -0,0 +1,259 @@
+/**
+ *  @file       WorkloadGenerator.h
+ *  @brief      CXoshiroRandom and CWorkloadGenerator class interfaces
+ *
+ *  @author     Mark L. Short
+ *
+ */
+
+#if !defined(_WORKLOAD_GENERATOR_H__)
+#define _WORKLOAD_GENERATOR_H__
+
+#if !defined(_COMMON_DEF_H__)
+    #include "CommonDef.h"
+#endif
+
+#ifndef _VECTOR_
+    #include <vector>
+#endif
+
+/// address of the first workload stream, nonzero since CVirtualAddress rejects null
+constexpr QWORD  g_WORKLOAD_BASE        = 0x100000;
+/// accesses a mix draws from one pattern before choosing again
+constexpr size_t g_WORKLOAD_RUN         = 16;
+/// random numbers generated at a time by CXoshiroRandom
+constexpr size_t g_XOSHIRO_BUFFER       = 64;
+/// independent generator lanes of CXoshiroRandom, stepped together
+constexpr size_t g_XOSHIRO_LANES        = 4;
+
+/**
+ *  xoshiro256+ pseudo-random number generator (Blackman and Vigna, 2018)
+ *  running g_XOSHIRO_LANES independent streams side by side.
+ *
+ *  The lanes are kept as a structure of arrays and stepped together with
+ *  SSE2, two lanes per vector; the step only shifts, xors and adds 64 bit
+ *  integers, all of which SSE2 provides.
+ *  Next then hands out the buffered values one at a time, while Fill steps
+ *  the lanes straight into the caller's buffer.
+ *
+ *  The low bits of xoshiro256+ are its weakest, so callers use the upper
+ *  32 bits for anything statistical.
+ */
+class CXoshiroRandom
+{
+    QWORD   m_rgS0[g_XOSHIRO_LANES];
+    QWORD   m_rgS1[g_XOSHIRO_LANES];
+    QWORD   m_rgS2[g_XOSHIRO_LANES];
+    QWORD   m_rgS3[g_XOSHIRO_LANES];
+    QWORD   m_rgBuffer[g_XOSHIRO_BUFFER];
+    size_t  m_nNext;
+
+public:
+/**
+ *  Default Constructor, seeded with 0
+ */
+    CXoshiroRandom ( ) noexcept
+    { Seed (0); };
+
+/**
+    Seeds every lane from a single value through SplitMix64
+
+    @param [in] qwSeed          any value, the same seed gives the same sequence
+ */
+    void Seed (QWORD qwSeed) noexcept;
+
+/**
+    Returns the next 64 bit pseudo-random value
+ */
+    QWORD Next (void) noexcept
+    {
+        if ( m_nNext == g_XOSHIRO_BUFFER )
+            Refill ( );
+        return m_rgBuffer[m_nNext++];
+    };
+
+/**
+    Fills a buffer with the next pseudo-random values, the same values
+    nCount calls of Next would return
+
+    @param [out] pValues        receives nCount values
+    @param [in]  nCount         number of values
+ */
+    void Fill (QWORD* pValues, size_t nCount) noexcept;
+
+/**
+    Returns a pseudo-random value in [0, dwRange)
+
+    @param [in] dwRange         number of possible values, at least 1
+ */
+    DWORD NextBelow (DWORD dwRange) noexcept
+    { return static_cast<DWORD>(((Next ( ) >> 32) * dwRange) >> 32); };
+
+private:
+
+    void Step   (QWORD* pValues, size_t nSteps) noexcept;
+    void Refill (void) noexcept;
+};
+
+/**
+ *  Access patterns of a workload stream
+ */
+enum WORKLOAD_PATTERN
+{
+    WORKLOAD_STRIDE,            ///< sequential, qwStride bytes apart, wrapping around
+    WORKLOAD_RANDOM,            ///< uniformly random blocks
+    WORKLOAD_ZIPF,              ///< random blocks, block n chosen in proportion to 1 / (n + 1)^dSkew
+    WORKLOAD_CHASE              ///< dependent pointer chase along a random cycle of every block
+};
+
+/**
+ *  One stream of a workload
+ */
+struct WORKLOAD_STREAM_CONFIG
+{
+    WORKLOAD_PATTERN    ePattern;
+    QWORD               qwFootprint;    ///< bytes touched, rounded up to whole cache blocks
+    QWORD               qwStride;       ///< WORKLOAD_STRIDE only
+    double              dSkew;          ///< WORKLOAD_ZIPF only
+    DWORD               dwWeight;       ///< share of the accesses within its phase
+};
+
+/**
+ *  Generates synthetic address streams on the fly, for stress tests and
+ *  benchmarks that need no trace file.
+ *
+ *  A workload is a sequence of phases, repeated for as long as addresses
+ *  are requested.  Each phase lasts a given number of accesses and mixes
+ *  one or more streams by weight, switching stream every g_WORKLOAD_RUN
+ *  accesses.  Every stream covers a footprint of its own, the streams
+ *  being laid out one after another from g_WORKLOAD_BASE, and keeps its
+ *  position from one phase to the next.
+ *
+ *  Zipf streams draw from an alias table (Walker, 1977) in constant time,
+ *  and pointer chases follow a single random cycle (Sattolo's algorithm),
+ *  so every block is visited once per lap.  Both tables take memory in
+ *  proportion to the footprint, 8 and 4 bytes per block.
+ *
+ *  Everything random derives from the seed passed to Init, so the same
+ *  workload and seed always produce the same addresses, in whatever batch
+ *  sizes they are requested.
+ *
+ *  A workload can also be described by a string:
+ *
+ *      spec    := phase { '/' phase }
+ *      phase   := stream { '+' stream } [ '@' accesses ]
+ *      stream  := kind ':' footprint [ ':' parameter ] [ '*' weight ]
+ *      kind    := stride | random | zipf | chase
+ *
+ *  where sizes may carry a K, M or G suffix, the parameter is the stride
+ *  in bytes (default one cache block) or the Zipf skew (default 0.99), and
+ *  a phase without a length runs forever.  For example
+ *  "stride:64K*3+random:1M@100000/zipf:4M:1.2" alternates between a mostly
+ *  sequential phase and a skewed one.
+ */
+class CWorkloadGenerator
+{
+    struct CStream
+    {
+        WORKLOAD_STREAM_CONFIG  config;
+        QWORD                   qwBase;         ///< first address of the footprint
+        DWORD                   dwBlocks;       ///< footprint in cache blocks
+        QWORD                   qwPosition;     ///< byte offset (stride) or block (chase)
+        std::vector<DWORD>      vecThreshold;   ///< Zipf alias table: keep the column below this
+        std::vector<DWORD>      vecAlias;       ///< Zipf alias table: otherwise take this block
+        std::vector<DWORD>      vecNext;        ///< pointer chase: block following each block
+        CXoshiroRandom          rng;
+    };
+
+    struct CPhase
+    {
+        QWORD                   qwAccesses;     ///< 0 for a phase that never ends
+        size_t                  nFirstStream;
+        size_t                  nStreams;
+        DWORD                   dwTotalWeight;
+    };
+
+    std::vector<CStream>    m_vecStreams;
+    std::vector<CPhase>     m_vecPhases;
+    QWORD                   m_qwSeed;
+    QWORD                   m_qwNextBase;
+    bool                    m_bStarted;
+
+    CXoshiroRandom          m_rngMix;           ///< chooses the stream of every run
+    size_t                  m_nPhase;
+    QWORD                   m_qwPhaseLeft;
+    size_t                  m_nStream;          ///< stream of the current run
+    size_t                  m_nRunLeft;
+
+public:
+/**
+ *  Default Constructor
+ */
+    CWorkloadGenerator ( );
+
+/**
+    Removes every phase and stream
+
+    @param [in] qwSeed          seed of every random choice the workload makes
+ */
+    void Init (QWORD qwSeed = 0);
+
+/**
+    Starts a new phase, to which the following AddStream calls add streams
+
+    @param [in] qwAccesses      length of the phase, 0 for a phase that
+                                never ends (the last phase only)
+
+    @retval true      on success
+    @retval false     if a phase that never ends was already added, or
+                      generation has started
+ */
+    bool AddPhase  (QWORD qwAccesses);
+
+/**
+    Adds a stream to the current phase, starting the first phase if need be
+
+    @param [in] config          stream description
+
+    @retval true      on success
+    @retval false     on an invalid description, or if generation has started
+ */
+    bool AddStream (const WORKLOAD_STREAM_CONFIG& config);
+
+/**
+    Builds the workload from a description string (see above)
+
+    @param [in] szSpec          workload description
+
+    @retval true      on success
+    @retval false     on a syntax error or an invalid stream
+ */
+    bool Parse (const TCHAR* szSpec);
+
+/**
+    Generates the next addresses of the workload
+
+    @param [out] pAddresses     receives nCount addresses
+    @param [in]  nCount         number of addresses to generate
+
+    @retval true      on success
+    @retval false     if the workload has no streams
+ */
+    bool Generate (QWORD* pAddresses, size_t nCount) noexcept;
+
+/**
+    Returns the bytes of address space the streams are laid out over, from
+    g_WORKLOAD_BASE to one past the highest address the workload can generate
+ */
+    QWORD get_Footprint (void) const noexcept
+    { return m_qwNextBase - g_WORKLOAD_BASE; };
+
+private:
+
+    static void BuildZipf  (CStream& stream);
+    static void BuildChase (CStream& stream);
+
+    void NextRun (void) noexcept;
+};
+
+#endif